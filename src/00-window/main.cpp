@@ -5,40 +5,38 @@
 /**
  * Renderer class
  */
-class WindowViewDelegate : public MyMTKViewDelegate {
+class WindowRenderer : public Renderer {
 public:
-  void drawInMTKView(MTK::View *view) override {
-    {
-      NS::AutoreleasePool *pool = NS::AutoreleasePool::alloc()->init();
-
-      // Stores rendering commands
-      MTL::CommandBuffer *cmd = m_commandQueue->commandBuffer();
-
-      // Defines render targets (framebuffers) among other things
-      // This is the view render pass, equivalent to a default framebuffer
-      MTL::RenderPassDescriptor *rpd = view->currentRenderPassDescriptor();
-
-      // Encondes rendering commands to a render pass descriptor
-      // We pass no commands so this only clears the buffer (with clear color)
-      MTL::RenderCommandEncoder *enc = cmd->renderCommandEncoder(rpd);
-      enc->endEncoding();
-
-      // A drawable is a RT that can be drawn to the screen, MTK creates one for us
-      // (the default drawable, which uses the default RT)
-      cmd->presentDrawable(view->currentDrawable());
-      cmd->commit(); // Commit the render commands to the GPU
-
-      pool->release();
-    }
+  explicit WindowRenderer(gfx::Device &device) : m_commandQueue(device.newCommandQueue()) {}
+
+  void draw(gfx::RenderTarget &target, float time) override {
+    // Stores rendering commands
+    auto cmd = m_commandQueue->commandBuffer();
+
+    // Encondes rendering commands to a render pass on the target (the view's
+    // default framebuffer). We pass no commands so this only clears the
+    // buffer (with clear color)
+    gfx::RenderCommandEncoder *enc = cmd->renderCommandEncoder(target);
+    enc->endEncoding();
+
+    // A drawable is a RT that can be drawn to the screen, MTK creates one for us
+    // (the default drawable, which uses the default RT)
+    cmd->present(target);
+    cmd->commit(); // Commit the render commands to the GPU
   }
+
+private:
+  std::unique_ptr<gfx::CommandQueue> m_commandQueue;
 };
 
 int main() {
   // Autorelease pool used for reference counting
   // https://developer.apple.com/documentation/foundation/nsautoreleasepool
   NS::AutoreleasePool *autoreleasePool = NS::AutoreleasePool::alloc()->init();
-  
-  MyAppDelegate del(new WindowViewDelegate());
+
+  MyAppDelegate del(new MyMTKViewDelegate([](gfx::Device &device, gfx::RenderTarget &) {
+    return std::make_unique<WindowRenderer>(device);
+  }));
 
   // NSApplication object managed the main event loop and delegates
   // https://developer.apple.com/documentation/appkit/nsapplication
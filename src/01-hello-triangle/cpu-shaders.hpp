@@ -0,0 +1,42 @@
+#ifndef LEARN_METAL_HELLO_TRIANGLE_CPU_SHADERS_HPP
+#define LEARN_METAL_HELLO_TRIANGLE_CPU_SHADERS_HPP
+
+#include <headless-backend.hpp>
+
+#include "renderer.hpp"
+#include "vertex.hpp"
+
+/**
+ * CPU versions of the functions in shaders.metal, for the headless backend
+ * Keep these in sync with the Metal code!
+ */
+namespace cpu_shaders {
+inline raster::Varyings vertexShader(uint32_t vertexID, const Vertex *vertices, const uint2 *viewportSizeP) {
+  float2 pixelSpacePos = vertices[vertexID].position;
+  float2 viewportSize = {float(viewportSizeP->x), float(viewportSizeP->y)};
+
+  float2 xy = pixelSpacePos / (viewportSize / 2.0f);
+
+  raster::Varyings out;
+  out.position = float4{xy.x, xy.y, 0.0f, 1.0f};
+  out.color = vertices[vertexID].color;
+
+  return out;
+}
+
+inline float4 fragmentShader(const raster::Varyings &in) {
+  return in.color;
+}
+
+inline void registerShaders(gfx::HeadlessDevice &device) {
+  device.registerVertexFunction(
+    HelloTriangleRenderer::libraryName, "vertexShader",
+    [](const gfx::ShaderBindings &b, uint32_t vertexId, uint32_t) {
+      return vertexShader(vertexId, b.buffer<Vertex>(0), b.buffer<uint2>(1));
+    }
+  );
+  device.registerFragmentFunction(HelloTriangleRenderer::libraryName, "fragmentShader", fragmentShader);
+}
+}
+
+#endif //LEARN_METAL_HELLO_TRIANGLE_CPU_SHADERS_HPP
@@ -0,0 +1,38 @@
+#include <iostream>
+#include <cstdlib>
+
+#include <headless-backend.hpp>
+
+#include "renderer.hpp"
+#include "cpu-shaders.hpp"
+
+/**
+ * Renders one frame of the 01-hello-triangle sample with the headless backend
+ * (software rasterizer) and writes it to a TGA file
+ *
+ * Usage: 01-hello-triangle-headless [output.tga] [width] [height]
+ */
+int main(int argc, char **argv) {
+  const char *outPath = argc > 1 ? argv[1] : "01-hello-triangle.tga";
+  const uint32_t width = argc > 2 ? std::atoi(argv[2]) : 512;
+  const uint32_t height = argc > 3 ? std::atoi(argv[3]) : 512;
+  if (width == 0 || height == 0) {
+    std::cerr << "Invalid render target size\n";
+    return 1;
+  }
+
+  gfx::HeadlessDevice device;
+  cpu_shaders::registerShaders(device);
+
+  gfx::HeadlessRenderTarget target(width, height);
+  HelloTriangleRenderer renderer(device, target);
+  renderer.draw(target, 0.0f);
+
+  if (!target.image()->writeTGA(outPath)) {
+    std::cerr << "Failed to write " << outPath << "\n";
+    return 1;
+  }
+
+  std::cout << "Wrote " << outPath << " (" << width << "x" << height << ")\n";
+  return 0;
+}
@@ -0,0 +1,59 @@
+#include "renderer.hpp"
+
+#include <iostream>
+#include <cassert>
+#include <cstring>
+
+HelloTriangleRenderer::HelloTriangleRenderer(gfx::Device &device, gfx::RenderTarget &target)
+  : m_device(device), m_commandQueue(device.newCommandQueue()), m_pipelines(device) {
+  m_viewportSize.x = target.width();
+  m_viewportSize.y = target.height();
+  buildBuffers();
+  buildShaders(target);
+}
+
+void HelloTriangleRenderer::buildBuffers() {
+  size_t bufferSize = 3 * sizeof(Vertex);
+  m_vertexBuffer = m_device.newBuffer(bufferSize, gfx::StorageMode::Managed);
+
+  memcpy(m_vertexBuffer->contents(), m_vertexData, bufferSize);
+  m_vertexBuffer->didModifyRange(0, m_vertexBuffer->length());
+}
+
+void HelloTriangleRenderer::buildShaders(const gfx::RenderTarget &target) {
+  gfx::RenderPipelineDescriptor desc;
+  desc.library = libraryName;
+  desc.vertexFunction = "vertexShader";
+  desc.fragmentFunction = "fragmentShader";
+  desc.colorPixelFormat = target.colorPixelFormat();
+  desc.depthPixelFormat = target.depthPixelFormat();
+
+  std::string error;
+  m_pso = m_pipelines.renderPipelineState(desc, &error);
+  if (!m_pso) {
+    std::cerr << error << "\n";
+    assert(false);
+  }
+}
+
+void HelloTriangleRenderer::draw(gfx::RenderTarget &target, float time) {
+  auto cmd = m_commandQueue->commandBuffer();
+  gfx::RenderCommandEncoder *enc = cmd->renderCommandEncoder(target);
+
+  enc->setViewport({0.0, 0.0, (double) m_viewportSize.x, (double) m_viewportSize.y, 0.0, 1.0});
+  enc->setRenderPipelineState(m_pso);
+  enc->setVertexBuffer(m_vertexBuffer.get(), 0, 0);
+  enc->setVertexBytes(&m_viewportSize, sizeof(m_viewportSize), 1);
+
+  enc->drawPrimitives(gfx::PrimitiveType::Triangle, 0, 3);
+
+  enc->endEncoding();
+
+  cmd->present(target);
+  cmd->commit();
+}
+
+void HelloTriangleRenderer::resize(uint32_t width, uint32_t height) {
+  m_viewportSize.x = width;
+  m_viewportSize.y = height;
+}
@@ -0,0 +1,41 @@
+#ifndef LEARN_METAL_HELLO_TRIANGLE_RENDERER_HPP
+#define LEARN_METAL_HELLO_TRIANGLE_RENDERER_HPP
+
+#include <renderer.hpp>
+#include <pipeline-cache.hpp>
+
+#include "vertex.hpp"
+
+/**
+ * Renderer class
+ */
+class HelloTriangleRenderer : public Renderer {
+public:
+  static constexpr const char *libraryName = "01-hello-triangle.metallib";
+
+  HelloTriangleRenderer(gfx::Device &device, gfx::RenderTarget &target);
+
+  void draw(gfx::RenderTarget &target, float time) override;
+
+  void resize(uint32_t width, uint32_t height) override;
+
+private:
+  gfx::Device &m_device;
+  std::unique_ptr<gfx::CommandQueue> m_commandQueue;
+  gfx::PipelineCache m_pipelines;
+  const gfx::RenderPipelineState *m_pso = nullptr; // Owned by m_pipelines
+  std::unique_ptr<gfx::Buffer> m_vertexBuffer;
+  uint2 m_viewportSize = {0, 0};
+
+  static constexpr const Vertex m_vertexData[] = {
+    {{100,  -100}, {1, 0, 0, 1}},
+    {{-100, -100}, {0, 1, 0, 1}},
+    {{0,    100},  {0, 0, 1, 1}},
+  };
+
+  void buildBuffers();
+
+  void buildShaders(const gfx::RenderTarget &target);
+};
+
+#endif //LEARN_METAL_HELLO_TRIANGLE_RENDERER_HPP
@@ -1,9 +1,15 @@
 #ifndef LEARN_METAL_VERTEX_HPP
 #define LEARN_METAL_VERTEX_HPP
 
+#ifdef __METAL_VERSION__
 #include <simd/simd.h>
 
 using namespace simd;
+#else
+#include <simd-types.hpp>
+
+using namespace psimd;
+#endif
 
 struct Vertex {
   float2 position;
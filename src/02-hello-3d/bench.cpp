@@ -0,0 +1,186 @@
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+
+#include <benchmark.hpp>
+#include <headless-backend.hpp>
+#include <parallel.hpp>
+
+#include "renderer.hpp"
+#include "cpu-shaders.hpp"
+
+/**
+ * Frame time benchmark: runs the 02-hello-3d draw loop on the headless backend
+ * and reports frame and per-stage CPU times as JSON.
+ *
+ * Options:
+ *   --frames N        measured frames (default 1000)
+ *   --warmup N        frames run before measuring (default 60)
+ *   --backend B       "null" records commands only, "raster" also renders
+ *   --width/--height  render target size (default 512x512)
+ *   --instances N     cubes drawn with one instanced draw (default 1)
+ *   --animated F      portion of the instances that move each frame (default 1)
+ *   --mesh PATH       mesh file to draw instead of the cube
+ *   --layout L        vertex layout: float (default), half or snorm16
+ *   --no-cull         draw everything instead of culling meshlets and instances
+ *   --occlusion       also cull instances hidden behind the nearest ones
+ *   --parallel-recording  record meshlet draws from several threads
+ *   --pipelined       update the next frame while submitting the current one
+ *   --frames-in-flight N  frames the CPU may run ahead of the GPU, 1 to 3 (default 3)
+ *   --gpu-time MS     simulated GPU time per frame, completion is immediate by default
+ *   --frame-timeout MS  longest wait for a frame in flight (default 1000)
+ *   --lod-error P     largest LOD error in pixels, 0 for full detail (default 1)
+ *   --pipeline-archive PATH  keep the pipelines created in this file, a second
+ *                     run finds them there (hashes only on this backend)
+ *   --output PATH     JSON output file, stdout by default
+ */
+int main(int argc, char **argv) {
+  bench::Args args(argc, argv);
+  const long long frames = args.intValue("frames", 1000);
+  const long long warmup = args.intValue("warmup", 60);
+  const std::string backend = args.value("backend", "null");
+  const auto width = static_cast<uint32_t>(args.intValue("width", 512));
+  const auto height = static_cast<uint32_t>(args.intValue("height", 512));
+
+  SceneOptions scene;
+  scene.instanceCount = static_cast<uint32_t>(std::max(1LL, args.intValue("instances", 1)));
+  scene.animatedFraction = args.floatValue("animated", 1.0f);
+  scene.meshPath = args.value("mesh", "");
+  scene.cullMeshlets = scene.frustumCulling = !args.flag("no-cull");
+  scene.occlusionCulling = args.flag("occlusion");
+  scene.parallelRecording = args.flag("parallel-recording");
+  scene.pipelined = args.flag("pipelined");
+  scene.framesInFlight = static_cast<uint32_t>(std::max(1LL, args.intValue("frames-in-flight", 3)));
+  scene.frameTimeoutMs = float(args.floatValue("frame-timeout", 1000.0));
+  const double gpuTimeMs = std::max(0.0, args.floatValue("gpu-time", 0.0));
+  scene.lodPixelError = args.floatValue("lod-error", 1.0f);
+  scene.pipelineArchive = args.value("pipeline-archive", "");
+
+  const std::string layout = args.value("layout", "float");
+  if (!mesh::parseLayout(layout, scene.vertexLayout)) {
+    std::cerr << "Unknown vertex layout " << layout << ", expected float, half or snorm16\n";
+    return 1;
+  }
+
+  if (backend != "null" && backend != "raster") {
+    std::cerr << "Unknown backend " << backend << ", expected null or raster\n";
+    return 1;
+  }
+  const bool rasterize = backend == "raster";
+
+  gfx::HeadlessDevice device(rasterize ? gfx::HeadlessDevice::Mode::Rasterize : gfx::HeadlessDevice::Mode::Null);
+  cpu_shaders::registerShaders(device);
+  device.setGpuTime(std::chrono::nanoseconds(static_cast<long long>(gpuTimeMs * 1e6)));
+
+  gfx::HeadlessRenderTarget target(width, height, rasterize);
+  Hello3DRenderer renderer(device, target, scene);
+
+  FrameProfiler profiler;
+  renderer.setProfiler(&profiler);
+  renderer.framePacer().setRecordSamples(true);
+
+  // Fixed time step, so runs are reproducible
+  constexpr float frameTime = 1.0f / 60.0f;
+  auto runFrames = [&](long long count, long long first) {
+    for (long long i = 0; i < count; i++) {
+      profiler.beginFrame();
+      renderer.draw(target, float(first + i) * frameTime);
+      profiler.endFrame();
+    }
+  };
+
+  runFrames(warmup, 0);
+  profiler.reset();
+  renderer.framePacer().resetStats();
+
+  auto start = bench::Clock::now();
+  runFrames(frames, warmup);
+  double totalMs = bench::elapsedMs(start);
+  renderer.flush(target);
+
+  /*
+   * Report
+   */
+  bench::JsonWriter json;
+  json.beginObject()
+    .field("benchmark", "02-hello-3d")
+    .field("backend", backend)
+    .field("width", width)
+    .field("height", height)
+    .field("instances", scene.instanceCount)
+    .field("animated_fraction", scene.animatedFraction)
+    .field("mesh", scene.meshPath.empty() ? "cube" : scene.meshPath)
+    .field("vertex_layout", layout)
+    .field("vertex_buffer_bytes", renderer.vertexBufferSize())
+    .field("threads", par::threadCount())
+    .field("pipelined", scene.pipelined)
+    .field("frames", frames)
+    .field("total_ms", totalMs)
+    .field("fps", totalMs > 0.0 ? double(frames) * 1000.0 / totalMs : 0.0)
+    .summary("frame_ms", bench::summarize(profiler.frameTimes()));
+
+  json.beginObject("stages_ms");
+  for (const FrameProfiler::Stage &stage: profiler.stages()) {
+    json.summary(stage.name, bench::summarize(stage.samples));
+  }
+  json.endObject();
+
+  const gfx::HeadlessStats &stats = device.stats();
+  json.beginObject("device")
+    .field("command_buffers", stats.commandBuffers)
+    .field("commands", stats.commands)
+    .field("draw_calls", stats.drawCalls)
+    .field("instances_uploaded_last_frame", renderer.instancesUploaded())
+    .field("instances_visible_last_frame", renderer.visibleInstances())
+    .field("instances_occluded_last_frame", renderer.occludedInstances())
+    .field("occluder_triangles", renderer.occluderTriangles())
+    .endObject();
+
+  json.beginObject("meshlets")
+    .field("count", renderer.meshletCount())
+    .field("visible_last_frame", renderer.visibleMeshlets())
+    .field("draw_ranges_last_frame", renderer.drawRanges())
+    .endObject();
+
+  json.beginObject("lod")
+    .field("levels", renderer.lodCount())
+    .field("level_last_frame", renderer.lodLevel())
+    .field("triangles_per_instance", renderer.trianglesPerInstance())
+    .endObject();
+
+  const gfx::FramePacer::Stats pacing = renderer.framePacer().stats();
+  json.beginObject("frame_pacing")
+    .field("frames_in_flight", renderer.framePacer().framesInFlight())
+    .field("gpu_time_ms", gpuTimeMs)
+    .field("timeouts", pacing.timeouts)
+    .summary("wait_ms", bench::summarize(pacing.waitMs))
+    .summary("frames_ahead", bench::summarize(pacing.ahead))
+    .summary("latency_ms", bench::summarize(pacing.latencyMs))
+    .endObject();
+
+  const gfx::PipelineCache::Stats pipelineStats = renderer.pipelineCache().stats();
+  json.beginObject("pipeline_cache")
+    .field("lookups", pipelineStats.lookups)
+    .field("memory_hits", pipelineStats.memoryHits)
+    .field("created", pipelineStats.created)
+    .field("archive_hits", pipelineStats.archiveHits)
+    .field("archive_misses", pipelineStats.archiveMisses)
+    .endObject();
+
+  const gfx::UploadRing::Stats &uploadStats = renderer.uploadRing().stats();
+  json.beginObject("upload_ring")
+    .field("capacity", uploadStats.capacity)
+    .field("peak_frame_bytes", uploadStats.peakFrameBytes)
+    .field("high_water_mark", uploadStats.highWaterMark)
+    .field("stalls", uploadStats.stalls)
+    .field("failures", uploadStats.failures)
+    .endObject();
+
+  json.endObject();
+
+  if (!bench::writeOutput(json.str(), args.value("output", "-"))) {
+    std::cerr << "Failed to write output\n";
+    return 1;
+  }
+  return 0;
+}
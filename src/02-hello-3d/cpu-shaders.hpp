@@ -0,0 +1,73 @@
+#ifndef LEARN_METAL_CPU_SHADERS_HPP
+#define LEARN_METAL_CPU_SHADERS_HPP
+
+#include <headless-backend.hpp>
+
+#include "renderer.hpp"
+#include "shader-defs.hpp"
+
+/**
+ * CPU versions of the functions in shaders.metal, for the headless backend
+ * Keep these in sync with the Metal code!
+ */
+namespace cpu_shaders {
+inline raster::Varyings vertexShader(const Vertex &in, const Transforms &t) {
+  raster::Varyings out;
+  out.position = t.mvp * make_float4(in.position, 1.0f);
+  out.color = in.color;
+
+  return out;
+}
+
+inline raster::Varyings instancedVertexShader(const Vertex &in, const Instance &instance) {
+  raster::Varyings out;
+  out.position = instance.mvp * make_float4(in.position, 1.0f);
+  out.color = in.color;
+
+  return out;
+}
+
+inline float4 fragmentShader(const raster::Varyings &in) {
+  return in.color;
+}
+
+/**
+ * [[stage_in]] equivalent for vertices stored as V, one of the vertex
+ * layouts. The conversions follow from V's layout description, so each
+ * layout gets its own fetch code and no format is looked up per vertex.
+ */
+template<typename V>
+inline Vertex stageIn(const gfx::ShaderBindings &b, uint32_t vertexId) {
+  const V &in = b.buffer<V>(0)[vertexId];
+  return {make_float3(gfx::fetchAttribute<V, 0>(in)), gfx::fetchAttribute<V, 1>(in)};
+}
+
+/**
+ * The vertex functions, for vertex buffers in layout V
+ */
+template<typename V>
+inline void registerVertexShaders(gfx::HeadlessDevice &device) {
+  device.registerVertexFunction<V>(
+    Hello3DRenderer::libraryName, "vertexShader", 0,
+    [](const gfx::ShaderBindings &b, uint32_t vertexId, uint32_t) {
+      return vertexShader(stageIn<V>(b, vertexId), *b.buffer<Transforms>(1));
+    }
+  );
+  device.registerVertexFunction<V>(
+    Hello3DRenderer::libraryName, "instancedVertexShader", 0,
+    [](const gfx::ShaderBindings &b, uint32_t vertexId, uint32_t instanceId) {
+      const uint32_t visibleId = b.buffer<uint32_t>(3)[instanceId];
+      return instancedVertexShader(stageIn<V>(b, vertexId), b.buffer<Instance>(2)[visibleId]);
+    }
+  );
+}
+
+inline void registerShaders(gfx::HeadlessDevice &device) {
+  registerVertexShaders<Vertex>(device);
+  registerVertexShaders<mesh::HalfVertex>(device);
+  registerVertexShaders<mesh::Snorm16Vertex>(device);
+  device.registerFragmentFunction(Hello3DRenderer::libraryName, "fragmentShader", fragmentShader);
+}
+}
+
+#endif //LEARN_METAL_CPU_SHADERS_HPP
@@ -0,0 +1,35 @@
+#ifndef LEARN_METAL_CUBE_HPP
+#define LEARN_METAL_CUBE_HPP
+
+#include <cstddef>
+
+#include "shader-defs.hpp"
+
+/**
+ * Cube mesh used by the sample, shared by the Metal and CPU renderers
+ */
+namespace cube {
+constexpr const Vertex vertices[] = {
+  {{1,  1,  -1}, {1, 1, 0, 1}},
+  {{1,  -1, -1}, {1, 0, 0, 1}},
+  {{1,  1,  1},  {1, 1, 1, 1}},
+  {{1,  -1, 1},  {1, 0, 1, 1}},
+  {{-1, 1,  -1}, {0, 1, 0, 1}},
+  {{-1, -1, -1}, {0, 0, 0, 1}},
+  {{-1, 1,  1},  {0, 1, 1, 1}},
+  {{-1, -1, 1},  {0, 0, 1, 1}},
+};
+constexpr size_t vertexCount = sizeof(vertices) / sizeof(Vertex);
+
+constexpr const unsigned indices[] = {
+  4, 2, 0, 2, 7, 3,
+  6, 5, 7, 1, 7, 5,
+  0, 3, 1, 4, 1, 5,
+  4, 6, 2, 2, 6, 7,
+  6, 4, 5, 1, 3, 7,
+  0, 2, 3, 4, 0, 1,
+};
+constexpr size_t indexCount = sizeof(indices) / sizeof(unsigned);
+}
+
+#endif //LEARN_METAL_CUBE_HPP
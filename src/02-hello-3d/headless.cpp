@@ -0,0 +1,82 @@
+#include <algorithm>
+#include <iostream>
+#include <cstdlib>
+#include <chrono>
+#include <string>
+
+#include <headless-backend.hpp>
+
+#include "renderer.hpp"
+#include "cpu-shaders.hpp"
+
+/**
+ * Renders one frame of the 02-hello-3d sample with the headless backend
+ * (software rasterizer) and writes it to a TGA file. No GPU or window system
+ * needed.
+ *
+ * Usage: 02-hello-3d-headless [output.tga] [width] [height] [time in seconds] [instances] [mesh] [layout] [raytrace]
+ *
+ * With raytrace, the frame is also ray traced on the CPU and the ray traced
+ * image is written instead, after counting the pixels where it differs from
+ * the rasterized one.
+ */
+int main(int argc, char **argv) {
+  const char *outPath = argc > 1 ? argv[1] : "02-hello-3d.tga";
+  const uint32_t width = argc > 2 ? std::atoi(argv[2]) : 512;
+  const uint32_t height = argc > 3 ? std::atoi(argv[3]) : 512;
+  const float time = argc > 4 ? std::strtof(argv[4], nullptr) : 1.0f;
+
+  SceneOptions scene;
+  scene.instanceCount = argc > 5 ? std::max(1, std::atoi(argv[5])) : 1;
+  if (argc > 6) scene.meshPath = argv[6];
+  if (argc > 7 && !mesh::parseLayout(argv[7], scene.vertexLayout)) {
+    std::cerr << "Unknown vertex layout " << argv[7] << ", expected float, half or snorm16\n";
+    return 1;
+  }
+  const bool raytrace = argc > 8 && std::string(argv[8]) == "raytrace";
+  if (width == 0 || height == 0) {
+    std::cerr << "Invalid render target size\n";
+    return 1;
+  }
+
+  gfx::HeadlessDevice device;
+  cpu_shaders::registerShaders(device);
+
+  gfx::HeadlessRenderTarget target(width, height);
+  Hello3DRenderer renderer(device, target, scene);
+
+  auto start = std::chrono::high_resolution_clock::now();
+  renderer.draw(target, time);
+  renderer.flush(target);
+  auto end = std::chrono::high_resolution_clock::now();
+
+  raster::RenderTarget *image = target.image();
+  raster::RenderTarget traced(width, height);
+  double traceMs = 0.0;
+  if (raytrace) {
+    auto traceStart = std::chrono::high_resolution_clock::now();
+    renderer.raytrace(traced, target.clearColor);
+    traceMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - traceStart).count();
+    image = &traced;
+  }
+
+  if (!image->writeTGA(outPath)) {
+    std::cerr << "Failed to write " << outPath << "\n";
+    return 1;
+  }
+
+  const raster::Stats &stats = device.rasterizer().stats();
+  std::cout << "Wrote " << outPath << " (" << width << "x" << height << ") in "
+            << std::chrono::duration<double, std::milli>(end - start).count() << " ms\n"
+            << "  triangles: " << stats.trianglesSubmitted << " submitted, "
+            << stats.trianglesCulled << " culled, " << stats.trianglesRasterized << " rasterized\n"
+            << "  fragments: " << stats.fragmentsShaded << "\n";
+
+  if (raytrace) {
+    size_t differing = 0;
+    for (size_t i = 0; i < size_t(width) * height; i++) differing += traced.color()[i] != target.image()->color()[i];
+    std::cout << "  ray traced in " << traceMs << " ms, " << differing << " of " << size_t(width) * height
+              << " pixels differ from the rasterized image\n";
+  }
+  return 0;
+}
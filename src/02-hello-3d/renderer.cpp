@@ -0,0 +1,619 @@
+#include "renderer.hpp"
+
+#include <algorithm>
+#include <iostream>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <numbers>
+
+#include "cube.hpp"
+#include "jobs.hpp"
+#include "matrices.hpp"
+#include "mesh.hpp"
+#include "mesh-simplifier.hpp"
+#include "parallel.hpp"
+#include "parallel-encoding.hpp"
+
+Hello3DRenderer::Hello3DRenderer(gfx::Device &device, gfx::RenderTarget &target, const SceneOptions &options)
+  : m_device(device),
+    m_commandQueue(device.newCommandQueue()),
+    m_pipelines(device),
+    m_uploadRing(device, (m_uploadBytesPerFrame + options.instanceCount * sizeof(uint32_t)) * m_maxFramesInFlight),
+    m_options(options),
+    m_pacer(
+      std::clamp<size_t>(options.framesInFlight, options.pipelined ? 2 : 1, m_maxFramesInFlight),
+      std::chrono::duration_cast<gfx::FramePacer::Clock::duration>(std::chrono::duration<float, std::milli>(options.frameTimeoutMs))
+    ) {
+  resize(target.width(), target.height());
+
+  buildBuffers();
+  if (m_options.instanceCount > 1) buildInstances();
+  buildShaders(target);
+}
+
+void Hello3DRenderer::buildBuffers() {
+  /*
+   * Vertex and index data come from either a memory mapped mesh file or the
+   * built-in cube. Mesh files store vertices in the GPU layout, so if it's the
+   * one we want they're copied as is.
+   */
+  static_assert(gfx::isSameLayout<Vertex, mesh::Vertex>());
+
+  const void *vertexData = cube::vertices, *indexData = cube::indices;
+  mesh::Layout sourceLayout = mesh::Layout::PositionColor;
+  size_t vertexCount = cube::vertexCount;
+  size_t indexBufferSize = cube::indexCount * sizeof(unsigned);
+  m_boundingRadius = std::numbers::sqrt3_v<float>;
+
+  std::unique_ptr<mesh::MeshFile> meshFile;
+  if (!m_options.meshPath.empty()) {
+    std::string error;
+    meshFile = mesh::MeshFile::open(m_options.meshPath, &error);
+    if (meshFile) {
+      vertexData = meshFile->vertexData();
+      sourceLayout = meshFile->layout();
+      vertexCount = meshFile->vertexCount();
+      indexData = meshFile->indices();
+      indexBufferSize = meshFile->indexDataSize();
+      m_lods.assign(meshFile->lods(), meshFile->lods() + meshFile->lodCount());
+      if (m_options.cullMeshlets && m_options.instanceCount == 1) {
+        m_meshlets.assign(meshFile->meshlets(), meshFile->meshlets() + meshFile->meshletCount());
+      }
+
+      // Sphere around the origin, which the model rotates about
+      const mesh::Header &header = meshFile->header();
+      float3 extent;
+      for (int i = 0; i < 3; i++) extent[i] = std::max(std::abs(header.boundsMin[i]), std::abs(header.boundsMax[i]));
+      m_boundingRadius = length(extent);
+    } else {
+      std::cerr << error << ", drawing the cube instead\n";
+    }
+  }
+
+  // Without a LOD chain the whole index buffer is the only level
+  if (m_lods.empty()) m_lods.push_back({0, uint32_t(indexBufferSize / sizeof(unsigned)), 0.0f});
+
+  if (m_options.instanceCount > 1 && m_options.occlusionCulling) {
+    buildOccluder(vertexData, sourceLayout, vertexCount, static_cast<const uint32_t *>(indexData));
+  }
+
+  /*
+   * Build the vertex buffer
+   */
+  const mesh::Layout layout = m_options.vertexLayout;
+  m_vertexBuffer = m_device.newBuffer(vertexCount * mesh::vertexStride(layout), gfx::StorageMode::Managed);
+
+  if (sourceLayout == layout) {
+    memcpy(m_vertexBuffer->contents(), vertexData, m_vertexBuffer->length());
+  } else {
+    std::vector<mesh::Vertex> vertices(vertexCount);
+    mesh::decodeVertices(sourceLayout, vertexData, vertexCount, vertices.data());
+    mesh::encodeVertices(layout, vertices.data(), vertexCount, m_vertexBuffer->contents());
+  }
+  m_vertexBuffer->didModifyRange(0, m_vertexBuffer->length());
+
+  /*
+   * Build the index buffer
+   */
+  m_indexBuffer = m_device.newBuffer(indexBufferSize, gfx::StorageMode::Shared);
+
+  memcpy(m_indexBuffer->contents(), indexData, indexBufferSize);
+  m_indexBuffer->didModifyRange(0, m_indexBuffer->length());
+}
+
+void Hello3DRenderer::buildInstances() {
+  const uint32_t count = m_options.instanceCount;
+  m_instances = std::make_unique<gfx::InstanceBuffer<Instance>>(m_device, count, m_maxFramesInFlight);
+
+  /*
+   * Lay out the cubes in a grid centered on the origin, and move the camera
+   * back far enough to fit the whole grid
+   */
+  constexpr float spacing = 3.0f;
+  const auto side = static_cast<uint32_t>(std::ceil(std::cbrt(double(count))));
+  const float halfExtent = float(side - 1) * spacing * 0.5f;
+  const float radius = (halfExtent + 1.0f) * std::numbers::sqrt3_v<float>;
+
+  m_cameraPos = {0.0f, 0.0f, radius * 1.8f + 2.0f};
+  m_far = m_cameraPos.z + radius * 2.0f;
+
+  m_models.resize(count);
+  m_scratch.resize(count);
+  m_animated.clear();
+  for (auto *v: {&m_tx, &m_ty, &m_tz, &m_axisX, &m_axisY, &m_axisZ}) v->clear();
+  for (uint32_t i = 0; i < count; i++) {
+    float3 position = {
+      float(i % side) * spacing - halfExtent,
+      float(i / side % side) * spacing - halfExtent,
+      float(i / (side * side)) * spacing - halfExtent,
+    };
+    m_models[i] = mat::translation(position);
+
+    /*
+     * Spread the animated instances evenly through the grid, each with its own
+     * axis and speed derived from its index
+     */
+    const float f = m_options.animatedFraction;
+    if (std::floor(float(i + 1) * f) > std::floor(float(i) * f)) {
+      uint32_t h = i * 2654435761u;
+      float3 axis = {float(h & 0xff) / 255.0f - 0.5f, float((h >> 8) & 0xff) / 255.0f + 0.1f, float((h >> 16) & 0xff) / 255.0f - 0.5f};
+      float speed = 0.25f + float((h >> 24) & 0xff) / 255.0f;
+      axis = normalize(axis);
+      m_animated.push_back({speed, i});
+      m_tx.push_back(position.x), m_ty.push_back(position.y), m_tz.push_back(position.z);
+      m_axisX.push_back(axis.x), m_axisY.push_back(axis.y), m_axisZ.push_back(axis.z);
+    }
+  }
+
+  /*
+   * Bounding spheres for frustum culling, in world space. Instances only spin
+   * about their centers, so these don't change.
+   */
+  m_boundsX.resize(count);
+  m_boundsY.resize(count);
+  m_boundsZ.resize(count);
+  m_boundsRadius.assign(count, m_boundingRadius);
+  for (uint32_t i = 0; i < count; i++) {
+    m_boundsX[i] = m_models[i].columns[3].x;
+    m_boundsY[i] = m_models[i].columns[3].y;
+    m_boundsZ[i] = m_models[i].columns[3].z;
+  }
+  std::vector<bvh::Aabb> boxes(count);
+  for (uint32_t i = 0; i < count; i++) {
+    const float3 center = {m_boundsX[i], m_boundsY[i], m_boundsZ[i]};
+    boxes[i] = {center - float3{m_boundingRadius}, center + float3{m_boundingRadius}};
+  }
+  m_instanceTree.build(boxes.data(), count);
+  m_visible.resize(count);
+  for (uint32_t i = 0; i < count; i++) m_visible[i] = i;
+  m_visibleCount = count;
+
+  for (auto *v: {&m_halfAngles, &m_sin, &m_cos, &m_qx, &m_qy, &m_qz}) v->resize(m_animated.size());
+  m_ones.assign(m_animated.size(), 1.0f);
+}
+
+void Hello3DRenderer::buildOccluder(const void *vertexData, mesh::Layout layout, size_t vertexCount,
+                                    const uint32_t *indices) {
+  /*
+   * The occluder is the coarsest level of detail, simplified further. The
+   * simplifier only drops vertices, so the occluder stays inside convex
+   * meshes, and the error limit keeps it close to the others.
+   */
+  std::vector<mesh::Vertex> vertices(vertexCount);
+  mesh::decodeVertices(layout, vertexData, vertexCount, vertices.data());
+
+  const mesh::Lod &lod = m_lods.back();
+  const std::vector<uint32_t> simplified = mesh::simplify(
+    indices + lod.firstIndex, lod.indexCount, vertices.data(), vertexCount,
+    m_maxOccluderTriangles * 3, m_boundingRadius * 0.02f
+  );
+
+  // Too detailed to rasterize every frame, go without occlusion culling
+  if (simplified.size() > m_maxOccluderTriangles * 3 * 4) return;
+
+  // Only keep the vertices the occluder uses
+  std::vector<uint32_t> remap(vertexCount, UINT32_MAX);
+  for (uint32_t i: simplified) {
+    if (remap[i] == UINT32_MAX) {
+      remap[i] = uint32_t(m_occluderPositions.size());
+      m_occluderPositions.push_back(vertices[i].position);
+    }
+    m_occluderIndices.push_back(remap[i]);
+  }
+}
+
+void Hello3DRenderer::buildShaders(const gfx::RenderTarget &target) {
+  /*
+   * Set up a render pipeline descriptor (parameter object)
+   * Set the shader library and functions, and attachment formats (match target)
+   */
+  gfx::RenderPipelineDescriptor desc;
+  desc.library = libraryName;
+  desc.vertexFunction = m_instances ? "instancedVertexShader" : "vertexShader";
+  desc.fragmentFunction = "fragmentShader";
+  desc.colorPixelFormat = target.colorPixelFormat();
+  desc.depthPixelFormat = target.depthPixelFormat();
+
+  /*
+   * Set up the vertex layout, this tells Metal where each attribute is located.
+   * It's derived from the vertex struct's layout description (vertex-layout.hpp).
+   */
+  desc.vertexDescriptor = mesh::vertexDescriptor(m_options.vertexLayout);
+
+  /*
+   * Get the pipeline state object from the cache. With an archive, it's only
+   * compiled the first time the program runs, then saved for the next runs.
+   */
+  std::string error;
+  if (!m_options.pipelineArchive.empty() && !m_pipelines.openArchive(m_options.pipelineArchive, &error)) {
+    std::cerr << error << ", compiling pipelines without it\n";
+  }
+
+  m_pso = m_pipelines.renderPipelineState(desc, &error);
+  if (!m_pso) {
+    std::cerr << error << "\n";
+    assert(false);
+  }
+  if (!m_pipelines.save(&error)) std::cerr << error << "\n";
+
+  /*
+   * Set up the depth/stencil state
+   */
+  gfx::DepthStencilDescriptor depthStencilDesc;
+  depthStencilDesc.depthWriteEnabled = true;
+  depthStencilDesc.depthCompareFunction = gfx::CompareFunction::Less;
+  m_dsso = m_pipelines.depthStencilState(depthStencilDesc);
+}
+
+void Hello3DRenderer::updateInstances(float time, const float4x4 &viewProjection) {
+  /*
+   * Rotation quaternions need the sine and cosine of half the angle, computed
+   * for a range of animated instances in one batch. sincos does its own range
+   * reduction, so the angle doesn't need to be wrapped. The models of the
+   * range are then composed in one batch too, the cosines being the
+   * quaternions' w, and scattered to their instances. Ranges are spread over
+   * the job system's threads.
+   */
+  jobs::parallelFor(m_animated.size(), m_instancesPerJob, [&](size_t begin, size_t end) {
+    for (size_t k = begin; k < end; k++) m_halfAngles[k] = time * m_animated[k].speed * 0.5f;
+    mat::sincos(m_halfAngles.data() + begin, m_sin.data() + begin, m_cos.data() + begin, end - begin);
+
+    for (size_t k = begin; k < end; k++) {
+      m_qx[k] = m_axisX[k] * m_sin[k], m_qy[k] = m_axisY[k] * m_sin[k], m_qz[k] = m_axisZ[k] * m_sin[k];
+    }
+    const mat::TRSArrays trs = {
+      m_tx.data() + begin, m_ty.data() + begin, m_tz.data() + begin,
+      m_qx.data() + begin, m_qy.data() + begin, m_qz.data() + begin, m_cos.data() + begin,
+      m_ones.data() + begin, m_ones.data() + begin, m_ones.data() + begin,
+    };
+    mat::composeTRS(trs, m_scratch.data() + begin, end - begin);
+    for (size_t k = begin; k < end; k++) m_models[m_animated[k].index] = m_scratch[k];
+  });
+
+  /*
+   * If the camera moved every instance needs a new MVP, otherwise only the
+   * animated ones. Either way, MVPs are computed in batches.
+   */
+  if (memcmp(&viewProjection, &m_viewProjection, sizeof(float4x4)) != 0) {
+    m_viewProjection = viewProjection;
+
+    jobs::parallelFor(m_models.size(), m_instancesPerJob, [&](size_t begin, size_t end) {
+      mat::multiply(viewProjection, m_models.data() + begin, m_scratch.data() + begin, end - begin);
+    });
+    for (size_t i = 0; i < m_models.size(); i++) m_instances->modify(i).mvp = m_scratch[i];
+  } else {
+    jobs::parallelFor(m_animated.size(), m_instancesPerJob, [&](size_t begin, size_t end) {
+      for (size_t k = begin; k < end; k++) m_scratch[k] = m_models[m_animated[k].index];
+      mat::multiply(viewProjection, m_scratch.data() + begin, m_scratch.data() + begin, end - begin);
+    });
+    for (size_t k = 0; k < m_animated.size(); k++) m_instances->modify(m_animated[k].index).mvp = m_scratch[k];
+  }
+}
+
+void Hello3DRenderer::updateConstants(FrameData &frame, float time) {
+  Transforms transforms;
+  transforms.model = mat::rotation(time * 0.5f, float3{0.5, 1.0, 0.0});
+  transforms.view = mat::translation(-m_cameraPos);
+  transforms.projection = mat::projection(m_fov, m_aspect, m_near, m_far);
+
+  /*
+   * In instanced mode only the changed instances are modified, the instance
+   * buffer takes care of uploading them
+   */
+  if (m_instances) {
+    transforms.model = mat::identity();
+    updateInstances(time, transforms.projection * transforms.view);
+    if (m_options.frustumCulling) cullInstances(transforms.projection * transforms.view);
+    if (!m_occluderIndices.empty()) occludeInstances(transforms.projection * transforms.view);
+  }
+
+  m_model = transforms.model;
+  transforms.mvp = transforms.projection * transforms.view * transforms.model;
+  selectLod(transforms);
+  if (!m_meshlets.empty() && m_lodLevel == 0) cullMeshlets(transforms);
+
+  frame.constants = m_uploadRing.push(transforms);
+  if (!frame.constants) {
+    std::cerr << "Failed to allocate constants\n";
+    assert(false);
+  }
+
+  /*
+   * The instanced vertex shader looks instances up through the visible list,
+   * so culling never touches the instance buffer
+   */
+  if (m_instances) {
+    frame.visibleIds = m_uploadRing.allocate(std::max<size_t>(m_visibleCount, 1) * sizeof(uint32_t), alignof(uint32_t));
+    if (!frame.visibleIds) {
+      std::cerr << "Failed to allocate the visible instance list\n";
+      assert(false);
+    }
+    memcpy(frame.visibleIds.data, m_visible.data(), m_visibleCount * sizeof(uint32_t));
+  }
+}
+
+void Hello3DRenderer::cullInstances(const float4x4 &viewProjection) {
+  FrameProfiler::Scope scope(m_profiler, "cull"); // Part of "update"
+
+  // Boxes around the bounding spheres, whole groups of instances inside or outside are decided at once
+  m_visibleCount = m_instanceTree.queryFrustum(cull::extractFrustum(viewProjection), m_visible.data());
+}
+
+void Hello3DRenderer::occludeInstances(const float4x4 &viewProjection) {
+  FrameProfiler::Scope scope(m_profiler, "occlusion"); // Part of "update"
+
+  /*
+   * The nearest visible instances are the occluders, they cover the most of
+   * the screen
+   */
+  m_occluders.clear();
+  for (size_t k = 0; k < m_visibleCount; k++) {
+    const uint32_t i = m_visible[k];
+    m_occluders.push_back({length_squared(float3{m_boundsX[i], m_boundsY[i], m_boundsZ[i]} - m_cameraPos), i});
+  }
+  const size_t count = std::min(m_occluders.size(), m_maxOccluders);
+  std::nth_element(m_occluders.begin(), m_occluders.begin() + count, m_occluders.end());
+
+  m_occlusion.clear();
+  for (size_t k = 0; k < count; k++) {
+    m_occlusion.addOccluder(
+      viewProjection * m_models[m_occluders[k].second],
+      m_occluderPositions.data(), m_occluderPositions.size(),
+      m_occluderIndices.data(), m_occluderIndices.size()
+    );
+  }
+  m_occlusion.render();
+
+  const cull::SphereArrays spheres{m_boundsX.data(), m_boundsY.data(), m_boundsZ.data(), m_boundsRadius.data()};
+  const size_t unoccluded = m_occlusion.cullSpheres(viewProjection, spheres, m_visible.data(), m_visibleCount);
+  m_occludedCount = m_visibleCount - unoccluded;
+  m_visibleCount = unoccluded;
+}
+
+void Hello3DRenderer::selectLod(const Transforms &transforms) {
+  /*
+   * The level is picked for the closest point of the closest object, in
+   * instanced mode all visible instances share it
+   */
+  float distance = length(m_cameraPos);
+  if (m_instances) {
+    distance = INFINITY;
+    for (size_t k = 0; k < m_visibleCount; k++) {
+      const uint32_t i = m_visible[k];
+      distance = std::min(distance, length(float3{m_boundsX[i], m_boundsY[i], m_boundsZ[i]} - m_cameraPos));
+    }
+  }
+  distance = std::max(distance - m_boundingRadius, m_near);
+
+  const float pixelsPerUnit = float(m_viewportSize.y) * 0.5f * transforms.projection.columns[1].y / distance;
+  m_lodLevel = mesh::selectLod(m_lods.data(), m_lods.size(), pixelsPerUnit, m_options.lodPixelError);
+}
+
+void Hello3DRenderer::cullMeshlets(const Transforms &transforms) {
+  FrameProfiler::Scope scope(m_profiler, "cull"); // Part of "update"
+
+  /*
+   * Meshlet bounds are in object space, so the camera is moved there instead.
+   * The model matrix is a rotation, its inverse is the transpose.
+   */
+  const float3 camera = make_float3(transpose(transforms.model) * make_float4(m_cameraPos, 1.0f));
+  const mesh::CullView view = mesh::makeCullView(transforms.mvp, camera);
+
+  m_drawRanges.clear();
+  m_visibleMeshlets = mesh::cullMeshlets(m_meshlets.data(), m_meshlets.size(), view, m_drawRanges);
+}
+
+void Hello3DRenderer::draw(gfx::RenderTarget &target, float time) {
+  {
+    FrameProfiler::Scope scope(m_profiler, "wait");
+    if (!m_pacer.beginFrame()) {
+      std::cerr << "Timed out waiting for the GPU, skipping a frame\n";
+      return;
+    }
+  }
+
+  /*
+   * The command buffer is created here rather than in the update stage:
+   * Metal returns it autoreleased, and job threads have no autorelease pool
+   * to release it.
+   */
+  FrameData &frame = m_frames[m_frameIdx % m_maxFramesInFlight];
+  frame.cmd = m_commandQueue->commandBuffer();
+  if (!m_options.pipelined) {
+    update(frame, time);
+    encode(frame, target);
+  } else {
+    /*
+     * This frame is updated by a job while the previous one is encoded and
+     * submitted here, so a frame costs about as much as the slower stage.
+     * The two only share state that doesn't change while drawing.
+     */
+    jobs::Counter updated;
+    jobs::run([&] { update(frame, time); }, &updated);
+    if (m_pending) encode(*m_pending, target);
+    jobs::wait(updated);
+    m_pending = &frame;
+  }
+
+  m_frameIdx++;
+}
+
+void Hello3DRenderer::flush(gfx::RenderTarget &target) {
+  if (!m_pending) return;
+  encode(*m_pending, target);
+  m_pending = nullptr;
+}
+
+void Hello3DRenderer::update(FrameData &frame, float time) {
+  /*
+   * May run as a job, on any thread. It relies on being the upload ring's only
+   * user while it runs: its frame begins and ends here, and neither the encode
+   * stage nor the previous update touches the ring meanwhile.
+   */
+  FrameProfiler::Scope scope(m_profiler, "update");
+  m_uploadRing.beginFrame();
+  updateConstants(frame, time);
+
+  frame.instanceData = m_instances ? m_instances->upload(m_frameIdx) : nullptr;
+  frame.visibleCount = m_visibleCount;
+  frame.lodLevel = m_lodLevel;
+  frame.drawMeshlets = !m_instances && !m_meshlets.empty() && m_lodLevel == 0;
+  if (frame.drawMeshlets) frame.drawRanges.assign(m_drawRanges.begin(), m_drawRanges.end());
+  frame.viewportSize = m_viewportSize;
+
+  // Only the update stage allocates from the upload ring, so the ring's frame ends here too
+  m_uploadRing.endFrame(*frame.cmd);
+}
+
+void Hello3DRenderer::encode(FrameData &frame, gfx::RenderTarget &target) {
+  gfx::CommandBuffer &cmd = *frame.cmd;
+  {
+    FrameProfiler::Scope scope(m_profiler, "encode");
+
+    // Every encoder starts from default state
+    auto setState = [&](gfx::RenderCommandEncoder *enc) {
+      enc->setDepthStencilState(m_dsso);
+      enc->setFrontFacingWinding(gfx::Winding::CounterClockwise);
+      enc->setCullMode(gfx::CullMode::Back);
+
+      enc->setViewport({0.0, 0.0, (double) frame.viewportSize.x, (double) frame.viewportSize.y, 0.0, 1.0});
+      enc->setRenderPipelineState(m_pso);
+      enc->setVertexBuffer(m_vertexBuffer.get(), 0, 0);
+      enc->setVertexBuffer(frame.constants.buffer, frame.constants.offset, 1);
+      if (m_instances) {
+        enc->setVertexBuffer(frame.instanceData, 0, 2);
+        enc->setVertexBuffer(frame.visibleIds.buffer, frame.visibleIds.offset, 3);
+      }
+    };
+
+    // One draw per run of visible meshlets
+    auto drawRanges = [&](gfx::RenderCommandEncoder *enc, size_t begin, size_t end) {
+      for (size_t i = begin; i < end; i++) {
+        enc->drawIndexedPrimitives(
+          gfx::PrimitiveType::Triangle,
+          frame.drawRanges[i].indexCount,
+          gfx::IndexType::UInt32,
+          m_indexBuffer.get(),
+          frame.drawRanges[i].firstIndex * sizeof(uint32_t)
+        );
+      }
+    };
+
+    if (frame.drawMeshlets && m_options.parallelRecording) {
+      const size_t chunks = gfx::encodingChunks(frame.drawRanges.size(), m_minDrawsPerChunk);
+      gfx::encodeParallel(
+        *cmd.parallelRenderCommandEncoder(target), frame.drawRanges.size(), chunks,
+        [&](gfx::RenderCommandEncoder &enc, size_t begin, size_t end) {
+          setState(&enc);
+          drawRanges(&enc, begin, end);
+        }
+      );
+    } else {
+      gfx::RenderCommandEncoder *enc = cmd.renderCommandEncoder(target);
+      setState(enc);
+
+      const mesh::Lod &lod = m_lods[frame.lodLevel];
+      if (frame.drawMeshlets) {
+        drawRanges(enc, 0, frame.drawRanges.size());
+      } else if (m_instances) {
+        if (frame.visibleCount > 0) {
+          enc->drawIndexedPrimitives(
+            gfx::PrimitiveType::Triangle,
+            lod.indexCount,
+            gfx::IndexType::UInt32,
+            m_indexBuffer.get(),
+            lod.firstIndex * sizeof(uint32_t),
+            frame.visibleCount
+          );
+        }
+      } else {
+        enc->drawIndexedPrimitives(
+          gfx::PrimitiveType::Triangle,
+          lod.indexCount,
+          gfx::IndexType::UInt32,
+          m_indexBuffer.get(),
+          lod.firstIndex * sizeof(uint32_t)
+        );
+      }
+
+      enc->endEncoding();
+    }
+  }
+
+  {
+    FrameProfiler::Scope scope(m_profiler, "submit");
+    cmd.present(target);
+    m_pacer.endFrame(cmd);
+    cmd.commit();
+  }
+  frame.cmd.reset();
+}
+
+void Hello3DRenderer::raytrace(raster::RenderTarget &image, float4 background, bool packets) {
+  const mesh::Lod &lod = m_lods[m_lodLevel];
+  const auto *indices = static_cast<const uint32_t *>(m_indexBuffer->contents()) + lod.firstIndex;
+
+  /*
+   * The mesh is decoded from the vertex buffer, so the ray tracer sees what
+   * the vertex shader does, and kept until the level of detail changes
+   */
+  if (m_rtScene.meshCount() == 0 || m_rtLodLevel != m_lodLevel) {
+    const mesh::Layout layout = m_options.vertexLayout;
+    const size_t vertexCount = m_vertexBuffer->length() / mesh::vertexStride(layout);
+    std::vector<mesh::Vertex> vertices(vertexCount);
+    mesh::decodeVertices(layout, m_vertexBuffer->contents(), vertexCount, vertices.data());
+
+    std::vector<float3> positions(vertexCount);
+    m_rtColors.resize(vertexCount);
+    for (size_t i = 0; i < vertexCount; i++) positions[i] = vertices[i].position, m_rtColors[i] = vertices[i].color;
+
+    m_rtScene = {};
+    m_rtScene.addMesh(positions.data(), indices, lod.indexCount / 3);
+    m_rtLodLevel = m_lodLevel;
+  }
+
+  if (m_instances) {
+    m_rtInstances.resize(m_models.size());
+    for (size_t i = 0; i < m_models.size(); i++) m_rtInstances[i] = {0, m_models[i]};
+  } else {
+    m_rtInstances.assign(1, {0, m_model});
+  }
+  m_rtScene.setInstances(m_rtInstances.data(), m_rtInstances.size());
+
+  const rt::Camera camera = rt::makeCamera(mat::translation(-m_cameraPos), mat::projection(m_fov, m_aspect, m_near, m_far));
+  const uint32_t width = image.width(), height = image.height();
+  m_rtHits.resize(size_t(width) * height);
+  rt::traceImage(m_rtScene, camera, width, height, m_rtHits.data(), packets);
+
+  /*
+   * Shade as the fragment shader does, with the vertex colors interpolated
+   */
+  const uint32_t backgroundColor = raster::RenderTarget::packColor(background);
+  par::parallelFor(height, [&](size_t y) {
+    for (size_t x = 0, i = y * width; x < width; x++, i++) {
+      const rt::Hit &hit = m_rtHits[i];
+      if (hit.instance == rt::noHit) {
+        image.color()[i] = backgroundColor;
+        image.depth()[i] = 1.0f;
+        continue;
+      }
+      const uint32_t *triangle = indices + 3 * hit.primitive;
+      const float4 color = m_rtColors[triangle[0]] * (1.0f - hit.u - hit.v) + m_rtColors[triangle[1]] * hit.u +
+                           m_rtColors[triangle[2]] * hit.v;
+      image.color()[i] = raster::RenderTarget::packColor(color);
+      image.depth()[i] = camera.depth(hit.t);
+    }
+  });
+}
+
+void Hello3DRenderer::resize(uint32_t width, uint32_t height) {
+  m_viewportSize.x = width;
+  m_viewportSize.y = height;
+
+  m_aspect = static_cast<float>(width) / static_cast<float>(height);
+
+  // Square pixels, with the long side at the occlusion buffer's default width
+  const float occlusionScale = 256.0f / float(std::max(width, height));
+  m_occlusion.resize(uint32_t(float(width) * occlusionScale), uint32_t(float(height) * occlusionScale));
+}
@@ -0,0 +1,279 @@
+#ifndef LEARN_METAL_HELLO_3D_RENDERER_HPP
+#define LEARN_METAL_HELLO_3D_RENDERER_HPP
+
+#include <array>
+#include <string>
+#include <vector>
+
+#include <renderer.hpp>
+#include <upload-ring.hpp>
+#include <frame-pacer.hpp>
+#include <pipeline-cache.hpp>
+#include <instance-buffer.hpp>
+#include <mesh.hpp>
+#include <culling.hpp>
+#include <bvh.hpp>
+#include <occlusion.hpp>
+#include <meshlets.hpp>
+#include <rasterizer.hpp>
+#include <raytracer.hpp>
+
+#include "shader-defs.hpp"
+
+struct SceneOptions {
+  /**
+   * With more than one instance, cubes are laid out in a grid and drawn with a
+   * single instanced draw call
+   */
+  uint32_t instanceCount = 1;
+
+  /**
+   * Portion of the instances that spin, the rest stay static and are only
+   * uploaded once
+   */
+  float animatedFraction = 1.0f;
+
+  /**
+   * Mesh file to draw instead of the cube (see mesh.hpp), empty for the cube
+   */
+  std::string meshPath;
+
+  /**
+   * Vertex buffer layout, the packed layouts are converted on the fly if the
+   * mesh is stored in a different one
+   */
+  mesh::Layout vertexLayout = mesh::Layout::PositionColor;
+
+  /**
+   * Cull the mesh's meshlets on the CPU and only draw the visible ones. Needs a
+   * mesh file with meshlets, and a single instance.
+   */
+  bool cullMeshlets = true;
+
+  /**
+   * Largest estimated surface error, in pixels, allowed when picking a level
+   * of detail from the mesh's LOD chain. 0 always draws the full mesh.
+   */
+  float lodPixelError = 1.0f;
+
+  /**
+   * Cull instances against the view frustum and only draw the visible ones,
+   * in instanced mode
+   */
+  bool frustumCulling = true;
+
+  /**
+   * Cull instances hidden behind the nearest ones, using a CPU depth buffer of
+   * simplified occluders, in instanced mode. Only pays off when near objects
+   * hide far ones, which the default camera on the grid doesn't see.
+   */
+  bool occlusionCulling = false;
+
+  /**
+   * Record the meshlet draws from several threads, each into its own
+   * sub-encoder of a parallel render pass. Only pays off with many draws.
+   */
+  bool parallelRecording = false;
+
+  /**
+   * Update (animation, culling, uploads) the next frame while the current
+   * one is encoded and submitted. Adds a frame of latency: each draw submits
+   * the frame updated by the previous one.
+   */
+  bool pipelined = false;
+
+  /**
+   * Frames the CPU may start before the GPU has finished the oldest one,
+   * from 1 (no overlap, least latency) to 3. At least 2 when pipelined, the
+   * frame waiting to be encoded holds one.
+   */
+  uint32_t framesInFlight = 3;
+
+  /**
+   * Longest wait for a frame in flight to complete before skipping a frame
+   */
+  float frameTimeoutMs = 1000.0f;
+
+  /**
+   * File keeping the compiled pipelines across runs (a binary archive on
+   * Metal), created if missing. Empty to compile them at every launch.
+   */
+  std::string pipelineArchive;
+};
+
+/**
+ * Renderer class
+ */
+class Hello3DRenderer : public Renderer {
+public:
+  static constexpr const char *libraryName = "02-hello-3d.metallib";
+
+  Hello3DRenderer(gfx::Device &device, gfx::RenderTarget &target, const SceneOptions &options = {});
+
+  void draw(gfx::RenderTarget &target, float time) override;
+
+  void flush(gfx::RenderTarget &target) override;
+
+  void resize(uint32_t width, uint32_t height) override;
+
+  const gfx::UploadRing &uploadRing() const { return m_uploadRing; }
+
+  gfx::FramePacer &framePacer() { return m_pacer; }
+
+  const gfx::PipelineCache &pipelineCache() const { return m_pipelines; }
+
+  size_t vertexBufferSize() const { return m_vertexBuffer->length(); }
+
+  /**
+   * Instances uploaded by the last frame, in instanced mode
+   */
+  size_t instancesUploaded() const { return m_instances ? m_instances->lastUploadCount() : 0; }
+
+  /**
+   * Instances drawn by the last frame, in instanced mode
+   */
+  size_t visibleInstances() const { return m_instances ? m_visibleCount : 0; }
+
+  /**
+   * Instances that passed frustum culling but were occluded, in the last frame
+   */
+  size_t occludedInstances() const { return m_occludedCount; }
+
+  size_t occluderTriangles() const { return m_occluderIndices.size() / 3; }
+
+  size_t meshletCount() const { return m_meshlets.size(); }
+
+  /**
+   * Meshlets and index ranges drawn by the last frame, with meshlet culling
+   */
+  size_t visibleMeshlets() const { return m_visibleMeshlets; }
+
+  size_t drawRanges() const { return m_drawRanges.size(); }
+
+  size_t lodCount() const { return m_lods.size(); }
+
+  /**
+   * Level of detail drawn by the last frame
+   */
+  size_t lodLevel() const { return m_lodLevel; }
+
+  size_t trianglesPerInstance() const { return m_lods[m_lodLevel].indexCount / 3; }
+
+  /**
+   * Renders the scene as of the last draw by ray tracing it on the CPU, as a
+   * ground truth for the rasterized image: the level of detail drawn, every
+   * instance (no culling), seen from m_cameraPos with m_fov. Writes color and
+   * depth to image, background where nothing is hit.
+   */
+  void raytrace(raster::RenderTarget &image, float4 background, bool packets = true);
+
+private:
+  gfx::Device &m_device;
+  std::unique_ptr<gfx::CommandQueue> m_commandQueue;
+  gfx::PipelineCache m_pipelines;
+  const gfx::RenderPipelineState *m_pso = nullptr; // Owned by m_pipelines
+  const gfx::DepthStencilState *m_dsso = nullptr;
+  std::unique_ptr<gfx::Buffer> m_vertexBuffer;
+  std::unique_ptr<gfx::Buffer> m_indexBuffer;
+  std::vector<mesh::Lod> m_lods;
+  size_t m_lodLevel = 0;
+  float m_boundingRadius = 0.0f;
+  std::vector<mesh::Meshlet> m_meshlets;
+  std::vector<mesh::DrawRange> m_drawRanges;
+  size_t m_visibleMeshlets = 0;
+  static constexpr size_t m_minDrawsPerChunk = 64;
+  uint2 m_viewportSize = {0, 0};
+
+  static constexpr size_t m_maxFramesInFlight = 3;
+  static constexpr size_t m_uploadBytesPerFrame = 16 * 1024;
+  gfx::UploadRing m_uploadRing;
+
+  /**
+   * What the update stage hands to the encode stage. One per frame in flight,
+   * indexed like the instance buffer's copies.
+   */
+  struct FrameData {
+    std::unique_ptr<gfx::CommandBuffer> cmd; // Created on the render thread, before the update
+    gfx::UploadRing::Allocation constants;
+    gfx::UploadRing::Allocation visibleIds;
+    gfx::Buffer *instanceData = nullptr;
+    size_t visibleCount = 0;
+    size_t lodLevel = 0;
+    bool drawMeshlets = false;
+    std::vector<mesh::DrawRange> drawRanges;
+    uint2 viewportSize = {0, 0};
+  };
+
+  std::array<FrameData, m_maxFramesInFlight> m_frames;
+  FrameData *m_pending = nullptr; // Updated, waiting to be encoded, in pipelined mode
+
+  struct AnimatedInstance {
+    float speed;
+    uint32_t index;
+  };
+
+  SceneOptions m_options;
+  std::unique_ptr<gfx::InstanceBuffer<Instance>> m_instances;
+  std::vector<AnimatedInstance> m_animated;
+  std::vector<float> m_halfAngles, m_sin, m_cos;
+  // Inputs of the batched composeTRS for the animated instances, one entry each
+  std::vector<float> m_tx, m_ty, m_tz, m_axisX, m_axisY, m_axisZ, m_qx, m_qy, m_qz, m_ones;
+  std::vector<float4x4> m_models;
+  std::vector<float4x4> m_scratch;
+  static constexpr size_t m_instancesPerJob = 4096;
+  std::vector<float> m_boundsX, m_boundsY, m_boundsZ, m_boundsRadius;
+  bvh::Tree m_instanceTree;
+  std::vector<uint32_t> m_visible;
+  size_t m_visibleCount = 0;
+
+  static constexpr size_t m_maxOccluders = 16;
+  static constexpr size_t m_maxOccluderTriangles = 256;
+  cull::OcclusionBuffer m_occlusion;
+  std::vector<float3> m_occluderPositions;
+  std::vector<uint32_t> m_occluderIndices;
+  std::vector<std::pair<float, uint32_t>> m_occluders;
+  size_t m_occludedCount = 0;
+  float4x4 m_viewProjection{0.0f};
+  float4x4 m_model{1.0f}; // Of the last frame, in single object mode
+
+  rt::Scene m_rtScene;
+  size_t m_rtLodLevel = 0;
+  std::vector<float4> m_rtColors;
+  std::vector<rt::Instance> m_rtInstances;
+  std::vector<rt::Hit> m_rtHits;
+
+  size_t m_frameIdx = 0;
+  gfx::FramePacer m_pacer;
+
+  float3 m_cameraPos = {0.0f, 0.0f, 5.0f};
+  float m_fov = 45.0f;
+  float m_aspect = 1.0;
+  float m_near = 0.1f;
+  float m_far = 100.0f;
+
+  void buildBuffers();
+
+  void buildInstances();
+
+  void buildOccluder(const void *vertexData, mesh::Layout layout, size_t vertexCount, const uint32_t *indices);
+
+  void buildShaders(const gfx::RenderTarget &target);
+
+  void updateInstances(float time, const float4x4 &viewProjection);
+
+  void update(FrameData &frame, float time);
+
+  void encode(FrameData &frame, gfx::RenderTarget &target);
+
+  void updateConstants(FrameData &frame, float time);
+
+  void cullInstances(const float4x4 &viewProjection);
+
+  void occludeInstances(const float4x4 &viewProjection);
+
+  void selectLod(const Transforms &transforms);
+
+  void cullMeshlets(const Transforms &transforms);
+};
+
+#endif //LEARN_METAL_HELLO_3D_RENDERER_HPP
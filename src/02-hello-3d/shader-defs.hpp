@@ -1,24 +1,73 @@
+#if defined(__clang__)
 #pragma clang diagnostic push
 #pragma clang diagnostic ignored "-Wunknown-attributes"
+#elif defined(__GNUC__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wattributes"
+#endif
 
 #ifndef LEARN_METAL_VERTEX_HPP
 #define LEARN_METAL_VERTEX_HPP
 
+#ifdef __METAL_VERSION__
 #include <simd/simd.h>
 
 using namespace simd;
+#else
+#include <simd-types.hpp>
+#include <vertex-layout.hpp>
+
+using namespace psimd;
+#endif
 
 struct Vertex {
   float3 position [[attribute(0)]];
   float4 color [[attribute(1)]];
 };
 
+/**
+ * mvp is computed on the CPU once per object, so the vertex shader only does
+ * a single matrix-vector multiply. There's no lighting, so no normal matrix.
+ */
 struct Transforms {
   float4x4 model;
   float4x4 view;
   float4x4 projection;
+  float4x4 mvp;
+};
+
+/**
+ * Per-instance data for instanced draws, indexed by instance ID
+ */
+struct Instance {
+  float4x4 mvp;
 };
 
+#ifndef __METAL_VERSION__
+/**
+ * Vertex descriptor and CPU [[stage_in]] of the unpacked layout are derived
+ * from this, attribute i is [[attribute(i)]] above
+ */
+template<>
+struct gfx::VertexLayout<Vertex> {
+  static constexpr AttributeInfo attributes[] = {
+    GFX_VERTEX_ATTRIBUTE(Vertex, position),
+    GFX_VERTEX_ATTRIBUTE(Vertex, color),
+  };
+};
+
+static_assert(gfx::isValidLayout<Vertex>(), "Vertex layout mismatch");
+#endif
+
+// Must match the Metal layout of these structs
+static_assert(sizeof(Vertex) == 32, "Vertex layout mismatch");
+static_assert(sizeof(Transforms) == 4 * 64, "Transforms layout mismatch");
+static_assert(sizeof(Instance) == 64, "Instance layout mismatch");
+
 #endif //LEARN_METAL_VERTEX_HPP
 
-#pragma clang diagnostic pop
\ No newline at end of file
+#if defined(__clang__)
+#pragma clang diagnostic pop
+#elif defined(__GNUC__)
+#pragma GCC diagnostic pop
+#endif
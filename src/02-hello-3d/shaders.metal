@@ -14,7 +14,20 @@ vertex RasterVertex vertexShader(
     constant Transforms &t [[buffer(1)]]
 ) {
     RasterVertex out;
-    out.position = t.projection * t.view * t.model * float4(in.position, 1.0);
+    out.position = t.mvp * float4(in.position, 1.0);
+    out.color = in.color;
+
+    return out;
+}
+
+vertex RasterVertex instancedVertexShader(
+    Vertex in [[stage_in]],
+    const device Instance *instances [[buffer(2)]],
+    const device uint *visibleIds [[buffer(3)]],
+    uint instanceId [[instance_id]]
+) {
+    RasterVertex out;
+    out.position = instances[visibleIds[instanceId]].mvp * float4(in.position, 1.0);
     out.color = in.color;
 
     return out;
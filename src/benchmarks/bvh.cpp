@@ -0,0 +1,197 @@
+#include <algorithm>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include <benchmark.hpp>
+#include <bvh.hpp>
+#include <culling.hpp>
+#include <matrices.hpp>
+
+using namespace psimd;
+
+/**
+ * BVH queries against linear scans over the same boxes, scattered through a
+ * large volume:
+ *   frustum  queryFrustum vs cullBoxes (SIMD), views turning around the y axis
+ *   aabb     queryAabb vs testing every box
+ *   ray      nearest box hit, raycast vs testing every box
+ *   refit    moving a portion of the objects, incremental vs full refit
+ * Results are checked against the scans, mismatches should be 0.
+ *
+ * Options:
+ *   --count N       objects (default 100000)
+ *   --queries N     queries per pass, for each kind (default 64)
+ *   --moved F       portion of the objects moved before refitting (default 0.1)
+ *   --iterations N  timed passes (default 20)
+ *   --output PATH   JSON output file, stdout by default
+ */
+namespace {
+bool overlaps(const bvh::Aabb &a, const bvh::Aabb &b) {
+  return a.min.x <= b.max.x && a.max.x >= b.min.x && a.min.y <= b.max.y && a.max.y >= b.min.y &&
+         a.min.z <= b.max.z && a.max.z >= b.min.z;
+}
+
+/**
+ * Entry distance of a ray into a box, infinity if it misses
+ */
+float rayBox(const bvh::Ray &ray, const bvh::Aabb &box) {
+  float tMin = ray.tMin, tMax = ray.tMax;
+  for (int k = 0; k < 3; k++) {
+    const float inv = 1.0f / ray.direction[k];
+    float t0 = (box.min[k] - ray.origin[k]) * inv, t1 = (box.max[k] - ray.origin[k]) * inv;
+    if (t0 > t1) std::swap(t0, t1);
+    tMin = std::max(tMin, t0), tMax = std::min(tMax, t1);
+  }
+  return tMin <= tMax ? tMin : INFINITY;
+}
+}
+
+int main(int argc, char **argv) {
+  bench::Args args(argc, argv);
+  const auto count = static_cast<size_t>(std::max(1LL, args.intValue("count", 100000)));
+  const auto queryCount = static_cast<size_t>(std::max(1LL, args.intValue("queries", 64)));
+  const float movedFraction = std::clamp(float(args.floatValue("moved", 0.1)), 0.0f, 1.0f);
+  const long long iterations = std::max(1LL, args.intValue("iterations", 20));
+
+  std::mt19937 rng(1234);
+  std::uniform_real_distribution<float> position(-500.0f, 500.0f), size(0.5f, 2.0f), unit(-1.0f, 1.0f);
+
+  std::vector<bvh::Aabb> boxes(count);
+  std::vector<float> x(count), y(count), z(count), extentX(count), extentY(count), extentZ(count);
+  for (size_t i = 0; i < count; i++) {
+    x[i] = position(rng), y[i] = position(rng), z[i] = position(rng);
+    extentX[i] = size(rng), extentY[i] = size(rng), extentZ[i] = size(rng);
+    boxes[i] = {{x[i] - extentX[i], y[i] - extentY[i], z[i] - extentZ[i]}, {x[i] + extentX[i], y[i] + extentY[i], z[i] + extentZ[i]}};
+  }
+  const cull::BoxArrays boxArrays{x.data(), y.data(), z.data(), extentX.data(), extentY.data(), extentZ.data()};
+
+  bvh::Tree tree;
+  auto buildMs = bench::timePasses(std::max(1LL, iterations / 4), [&] { tree.build(boxes.data(), count); });
+  const float builtCost = tree.sahCost();
+
+  /*
+   * Queries
+   */
+  const float4x4 projection = mat::projection(1.0f, 16.0f / 9.0f, 0.1f, 400.0f);
+  std::vector<cull::Frustum> frustums;
+  std::vector<bvh::Aabb> queryBoxes;
+  std::vector<bvh::Ray> rays;
+  for (size_t q = 0; q < queryCount; q++) {
+    const float angle = float(q) / float(queryCount) * 6.2831853f;
+    frustums.push_back(cull::extractFrustum(projection * mat::rotation(angle, float3{0.0f, 1.0f, 0.0f})));
+
+    const float3 center = {position(rng), position(rng), position(rng)};
+    queryBoxes.push_back({center - float3{20.0f}, center + float3{20.0f}});
+
+    bvh::Ray ray;
+    ray.origin = {position(rng), position(rng), position(rng)};
+    ray.direction = normalize(float3{unit(rng), unit(rng), unit(rng)});
+    rays.push_back(ray);
+  }
+
+  std::vector<uint32_t> results(count);
+  size_t frustumTree = 0, frustumScan = 0, aabbTree = 0, aabbScan = 0;
+  std::vector<float> hitsTree(queryCount), hitsScan(queryCount);
+
+  auto frustumTreeMs = bench::timePasses(iterations, [&] {
+    frustumTree = 0;
+    for (const cull::Frustum &f: frustums) frustumTree += tree.queryFrustum(f, results.data());
+  });
+  auto frustumScanMs = bench::timePasses(iterations, [&] {
+    frustumScan = 0;
+    for (const cull::Frustum &f: frustums) frustumScan += cull::cullBoxes(f, boxArrays, count, results.data());
+  });
+
+  auto aabbTreeMs = bench::timePasses(iterations, [&] {
+    aabbTree = 0;
+    for (const bvh::Aabb &box: queryBoxes) aabbTree += tree.queryAabb(box, results.data());
+  });
+  auto aabbScanMs = bench::timePasses(iterations, [&] {
+    aabbScan = 0;
+    for (const bvh::Aabb &box: queryBoxes) {
+      for (size_t i = 0; i < count; i++) aabbScan += overlaps(boxes[i], box);
+    }
+  });
+
+  auto rayTreeMs = bench::timePasses(iterations, [&] {
+    for (size_t q = 0; q < queryCount; q++) {
+      bvh::Ray ray = rays[q];
+      tree.raycast(ray, [&](uint32_t object, bvh::Ray &r) {
+        const float t = rayBox(r, boxes[object]);
+        if (t > r.tMax) return false;
+        r.tMax = t;
+        return true;
+      });
+      hitsTree[q] = ray.tMax;
+    }
+  });
+  auto rayScanMs = bench::timePasses(iterations, [&] {
+    for (size_t q = 0; q < queryCount; q++) {
+      float nearest = INFINITY;
+      for (size_t i = 0; i < count; i++) nearest = std::min(nearest, rayBox(rays[q], boxes[i]));
+      hitsScan[q] = nearest;
+    }
+  });
+  size_t rayMismatches = 0;
+  for (size_t q = 0; q < queryCount; q++) rayMismatches += hitsTree[q] != hitsScan[q];
+
+  /*
+   * Refit after moving some of the objects a short random step each pass.
+   * They drift away from where the tree was built, so the cost after the
+   * refits shows how much the tree degrades without a rebuild
+   */
+  std::vector<uint32_t> moved;
+  for (size_t i = 0; i < count; i++) {
+    if (std::floor(float(i + 1) * movedFraction) > std::floor(float(i) * movedFraction)) moved.push_back(uint32_t(i));
+  }
+  auto moveObjects = [&] {
+    for (uint32_t i: moved) {
+      const float3 step = float3{unit(rng), unit(rng), unit(rng)} * 3.0f;
+      boxes[i].min += step;
+      boxes[i].max += step;
+    }
+  };
+  auto refitMovedMs = bench::timePasses(iterations, [&] {
+    moveObjects();
+    tree.refit(boxes.data(), moved.data(), moved.size());
+  });
+  auto refitAllMs = bench::timePasses(iterations, [&] {
+    moveObjects();
+    tree.refit(boxes.data());
+  });
+
+  /*
+   * Report
+   */
+  bench::JsonWriter json;
+  json.beginObject()
+    .field("benchmark", "bvh")
+    .field("count", count)
+    .field("queries", queryCount)
+    .field("iterations", iterations)
+    .field("nodes", tree.nodes().size())
+    .summary("build_ms", bench::summarize(buildMs))
+    .field("sah_cost", builtCost)
+    .summary("frustum_tree_ms", bench::summarize(frustumTreeMs))
+    .summary("frustum_scan_ms", bench::summarize(frustumScanMs))
+    .field("frustum_visible_fraction", double(frustumTree) / double(count * queryCount))
+    .field("frustum_mismatch", (long long) frustumTree - (long long) frustumScan)
+    .summary("aabb_tree_ms", bench::summarize(aabbTreeMs))
+    .summary("aabb_scan_ms", bench::summarize(aabbScanMs))
+    .field("aabb_mismatch", (long long) aabbTree - (long long) aabbScan)
+    .summary("ray_tree_ms", bench::summarize(rayTreeMs))
+    .summary("ray_scan_ms", bench::summarize(rayScanMs))
+    .field("ray_mismatch", rayMismatches)
+    .field("moved", moved.size())
+    .summary("refit_moved_ms", bench::summarize(refitMovedMs))
+    .summary("refit_all_ms", bench::summarize(refitAllMs))
+    .field("sah_cost_after_refit", tree.sahCost())
+    .endObject();
+
+  if (!bench::writeOutput(json.str(), args.value("output", "-"))) {
+    std::cerr << "Failed to write output\n";
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,107 @@
+#include <algorithm>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include <benchmark.hpp>
+#include <culling.hpp>
+#include <matrices.hpp>
+
+using namespace psimd;
+
+/**
+ * Frustum culling throughput for random objects scattered around the camera:
+ *   scalar   isSphereVisible, one object at a time
+ *   spheres  cullSpheres over SoA arrays
+ *   boxes    cullBoxes over SoA arrays
+ *
+ * Each pass culls all objects against a set of views, the camera turning
+ * around the vertical axis.
+ *
+ * Options:
+ *   --count N       objects (default 100000)
+ *   --views N       views per pass (default 8)
+ *   --iterations N  timed passes (default 50)
+ *   --output PATH   JSON output file, stdout by default
+ */
+int main(int argc, char **argv) {
+  bench::Args args(argc, argv);
+  const auto count = static_cast<size_t>(std::max(1LL, args.intValue("count", 100000)));
+  const auto viewCount = static_cast<size_t>(std::max(1LL, args.intValue("views", 8)));
+  const long long iterations = std::max(1LL, args.intValue("iterations", 50));
+
+  std::vector<float> x(count), y(count), z(count), radius(count);
+  std::mt19937 rng(1234);
+  std::uniform_real_distribution<float> position(-100.0f, 100.0f), size(0.5f, 2.0f);
+  for (size_t i = 0; i < count; i++) {
+    x[i] = position(rng), y[i] = position(rng), z[i] = position(rng);
+    radius[i] = size(rng);
+  }
+  const cull::SphereArrays spheres{x.data(), y.data(), z.data(), radius.data()};
+  const cull::BoxArrays boxes{x.data(), y.data(), z.data(), radius.data(), radius.data(), radius.data()};
+
+  const float4x4 projection = mat::projection(45.0f, 16.0f / 9.0f, 0.1f, 150.0f);
+  std::vector<cull::Frustum> frustums;
+  for (size_t v = 0; v < viewCount; v++) {
+    const float angle = float(v) / float(viewCount) * 6.2831853f;
+    frustums.push_back(cull::extractFrustum(projection * mat::rotation(angle, float3{0.0f, 1.0f, 0.0f})));
+  }
+
+  std::vector<uint32_t> visible(count);
+  size_t scalarVisible = 0, sphereVisible = 0, boxVisible = 0;
+
+  auto scalarMs = bench::timePasses(iterations, [&] {
+    scalarVisible = 0;
+    for (const cull::Frustum &f: frustums) {
+      size_t n = 0;
+      for (size_t i = 0; i < count; i++) {
+        visible[n] = uint32_t(i);
+        n += cull::isSphereVisible(f, {x[i], y[i], z[i]}, radius[i]);
+      }
+      scalarVisible += n;
+    }
+  });
+
+  auto sphereMs = bench::timePasses(iterations, [&] {
+    sphereVisible = 0;
+    for (const cull::Frustum &f: frustums) sphereVisible += cull::cullSpheres(f, spheres, count, visible.data());
+  });
+
+  auto boxMs = bench::timePasses(iterations, [&] {
+    boxVisible = 0;
+    for (const cull::Frustum &f: frustums) boxVisible += cull::cullBoxes(f, boxes, count, visible.data());
+  });
+
+  /*
+   * Report
+   */
+  bench::Summary scalarSummary = bench::summarize(scalarMs);
+  bench::Summary sphereSummary = bench::summarize(sphereMs);
+  bench::Summary boxSummary = bench::summarize(boxMs);
+  const double tested = double(count * viewCount);
+  auto perMicrosecond = [&](const bench::Summary &s) { return tested / (s.p50 * 1e3); };
+
+  bench::JsonWriter json;
+  json.beginObject()
+    .field("benchmark", "culling")
+    .field("count", count)
+    .field("views", viewCount)
+    .field("iterations", iterations)
+    .summary("scalar_ms", scalarSummary)
+    .summary("spheres_ms", sphereSummary)
+    .summary("boxes_ms", boxSummary)
+    .field("scalar_objects_per_us", perMicrosecond(scalarSummary))
+    .field("spheres_objects_per_us", perMicrosecond(sphereSummary))
+    .field("boxes_objects_per_us", perMicrosecond(boxSummary))
+    .field("spheres_speedup_vs_scalar", scalarSummary.p50 / sphereSummary.p50)
+    .field("visible_fraction_spheres", double(sphereVisible) / tested)
+    .field("visible_fraction_boxes", double(boxVisible) / tested)
+    .field("scalar_batch_mismatch", (long long) scalarVisible - (long long) sphereVisible)
+    .endObject();
+
+  if (!bench::writeOutput(json.str(), args.value("output", "-"))) {
+    std::cerr << "Failed to write output\n";
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,149 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <benchmark.hpp>
+#include <jobs.hpp>
+#include <matrices.hpp>
+
+using namespace psimd;
+
+/**
+ * Job system scaling, with 1, 2, 4... up to every thread allowed to take jobs:
+ *   spawn        many empty jobs on one counter, the cost of a job
+ *   parallel_for sincos and MVPs for many transforms, split into ranges
+ *   graph        the same work as a frame's dependency chain: animation jobs,
+ *                then a continuation that fans out the MVP jobs
+ * The results are checked against a serial run, mismatches should be 0.
+ *
+ * Options:
+ *   --count N       transforms (default 200000)
+ *   --grain N       transforms per job (default 4096)
+ *   --jobs N        empty jobs for the spawn test (default 100000)
+ *   --iterations N  timed passes per thread count (default 20)
+ *   --output PATH   JSON output file, stdout by default
+ */
+namespace {
+struct Transforms {
+  std::vector<float> angles, sin, cos;
+  std::vector<float4x4> models, mvps;
+
+  explicit Transforms(size_t count) : angles(count), sin(count), cos(count), models(count), mvps(count) {
+    for (size_t i = 0; i < count; i++) angles[i] = float(i) * 0.001f;
+  }
+
+  void animate(size_t begin, size_t end) {
+    mat::sincos(angles.data() + begin, sin.data() + begin, cos.data() + begin, end - begin);
+    for (size_t i = begin; i < end; i++) {
+      const mat::quat q = {0.0f, sin[i], 0.0f, cos[i]};
+      models[i] = mat::composeTRS(float3{float(i % 100), float(i / 100 % 100), 0.0f}, q, float3{1.0f});
+    }
+  }
+
+  void transform(const float4x4 &viewProjection, size_t begin, size_t end) {
+    mat::multiply(viewProjection, models.data() + begin, mvps.data() + begin, end - begin);
+  }
+};
+
+size_t countMismatches(const Transforms &a, const Transforms &b) {
+  size_t mismatches = 0;
+  for (size_t i = 0; i < a.mvps.size(); i++) mismatches += memcmp(&a.mvps[i], &b.mvps[i], sizeof(float4x4)) != 0;
+  return mismatches;
+}
+}
+
+int main(int argc, char **argv) {
+  bench::Args args(argc, argv);
+  const auto count = static_cast<size_t>(std::max(1LL, args.intValue("count", 200000)));
+  const auto grain = static_cast<size_t>(std::max(1LL, args.intValue("grain", 4096)));
+  const auto jobCount = static_cast<size_t>(std::max(1LL, args.intValue("jobs", 100000)));
+  const long long iterations = std::max(1LL, args.intValue("iterations", 20));
+
+  const float4x4 viewProjection = mat::projection(1.0f, 16.0f / 9.0f, 0.1f, 400.0f) *
+                                  mat::translation(float3{-50.0f, -50.0f, -150.0f});
+
+  // Reference, serial
+  Transforms reference(count);
+  reference.animate(0, count);
+  reference.transform(viewProjection, 0, count);
+
+  bench::JsonWriter json;
+  json.beginObject()
+    .field("benchmark", "jobs")
+    .field("count", count)
+    .field("grain", grain)
+    .field("jobs", jobCount)
+    .field("threads", jobs::threadCount())
+    .field("iterations", iterations);
+
+  double parallelForBase = 0.0, graphBase = 0.0;
+  size_t mismatches = 0;
+  const jobs::Stats before = jobs::stats();
+
+  std::vector<size_t> threadCounts;
+  for (size_t t = 1; t < jobs::threadCount(); t *= 2) threadCounts.push_back(t);
+  threadCounts.push_back(jobs::threadCount());
+
+  for (size_t threads: threadCounts) {
+    jobs::setThreadLimit(threads);
+
+    auto spawnMs = bench::timePasses(iterations, [&] {
+      jobs::Counter counter;
+      for (size_t i = 0; i < jobCount; i++) jobs::run([] {}, &counter);
+      jobs::wait(counter);
+    });
+
+    Transforms transforms(count);
+    auto parallelForMs = bench::timePasses(iterations, [&] {
+      jobs::parallelFor(count, grain, [&](size_t begin, size_t end) { transforms.animate(begin, end); });
+      jobs::parallelFor(count, grain, [&](size_t begin, size_t end) { transforms.transform(viewProjection, begin, end); });
+    });
+    mismatches += countMismatches(reference, transforms);
+
+    Transforms graphTransforms(count);
+    auto graphMs = bench::timePasses(iterations, [&] {
+      jobs::Counter animated, transformed;
+      for (size_t begin = 0; begin < count; begin += grain) {
+        jobs::run([&, begin] { graphTransforms.animate(begin, std::min(begin + grain, count)); }, &animated);
+      }
+      jobs::runAfter(animated, [&] {
+        for (size_t begin = 0; begin < count; begin += grain) {
+          jobs::run([&, begin] { graphTransforms.transform(viewProjection, begin, std::min(begin + grain, count)); },
+                    &transformed);
+        }
+      }, &transformed);
+      jobs::wait(transformed);
+    });
+    mismatches += countMismatches(reference, graphTransforms);
+
+    const bench::Summary spawn = bench::summarize(spawnMs);
+    const bench::Summary parallelFor = bench::summarize(parallelForMs);
+    const bench::Summary graph = bench::summarize(graphMs);
+    if (threads == 1) parallelForBase = parallelFor.p50, graphBase = graph.p50;
+
+    json.beginObject("threads_" + std::to_string(threads))
+      .summary("spawn_ms", spawn)
+      .field("spawn_ns_per_job", spawn.p50 * 1e6 / double(jobCount))
+      .summary("parallel_for_ms", parallelFor)
+      .field("parallel_for_speedup", parallelForBase / parallelFor.p50)
+      .summary("graph_ms", graph)
+      .field("graph_speedup", graphBase / graph.p50)
+      .endObject();
+  }
+  jobs::setThreadLimit(jobs::threadCount());
+
+  const jobs::Stats after = jobs::stats();
+  json.field("jobs_executed", after.executed - before.executed)
+    .field("jobs_stolen", after.stolen - before.stolen)
+    .field("mismatches", mismatches)
+    .endObject();
+
+  if (!bench::writeOutput(json.str(), args.value("output", "-"))) {
+    std::cerr << "Failed to write output\n";
+    return 1;
+  }
+  return 0;
+}
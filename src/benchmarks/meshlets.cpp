@@ -0,0 +1,153 @@
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <numbers>
+#include <random>
+#include <vector>
+
+#include <benchmark.hpp>
+#include <matrices.hpp>
+#include <mesh.hpp>
+#include <mesh-optimizer.hpp>
+#include <meshlets.hpp>
+
+using namespace psimd;
+
+/**
+ * Meshlet build and cull times. The mesh is optimized first, as mesh-convert
+ * does, then meshlets are built and culled from a set of random views: the
+ * mesh rotated randomly in front of a camera at a random distance, close
+ * enough for some of it to be out of the frustum.
+ *
+ * Options:
+ *   --mesh PATH     mesh file (see mesh.hpp), a UV sphere by default
+ *   --rings N       sphere rings, with twice as many segments (default 256)
+ *   --views N       views culled per pass (default 64)
+ *   --iterations N  timed passes (default 50)
+ *   --output PATH   JSON output file, stdout by default
+ */
+namespace {
+mesh::MeshData makeSphere(uint32_t rings) {
+  const uint32_t segments = rings * 2;
+  mesh::MeshData data;
+  for (uint32_t r = 0; r <= rings; r++) {
+    const float theta = float(r) / float(rings) * std::numbers::pi_v<float>;
+    for (uint32_t s = 0; s <= segments; s++) {
+      const float phi = float(s) / float(segments) * 2.0f * std::numbers::pi_v<float>;
+      const float3 p = {std::sin(theta) * std::cos(phi), std::cos(theta), std::sin(theta) * std::sin(phi)};
+      data.vertices.push_back({p, make_float4(p * 0.5f + float3{0.5f}, 1.0f)});
+    }
+  }
+
+  // Counter-clockwise seen from outside
+  for (uint32_t r = 0; r < rings; r++) {
+    for (uint32_t s = 0; s < segments; s++) {
+      const uint32_t a = r * (segments + 1) + s, b = a + segments + 1;
+      data.indices.insert(data.indices.end(), {a, a + 1, b, a + 1, b + 1, b});
+    }
+  }
+  return data;
+}
+}
+
+int main(int argc, char **argv) {
+  bench::Args args(argc, argv);
+  const std::string meshPath = args.value("mesh", "");
+  const auto rings = static_cast<uint32_t>(std::max(2LL, args.intValue("rings", 256)));
+  const auto viewCount = static_cast<size_t>(std::max(1LL, args.intValue("views", 64)));
+  const long long iterations = std::max(1LL, args.intValue("iterations", 50));
+
+  mesh::MeshData data;
+  if (meshPath.empty()) {
+    data = makeSphere(rings);
+  } else {
+    std::string error;
+    auto file = mesh::MeshFile::open(meshPath, &error);
+    if (!file) {
+      std::cerr << error << "\n";
+      return 1;
+    }
+    data.vertices.resize(file->vertexCount());
+    mesh::decodeVertices(file->layout(), file->vertexData(), file->vertexCount(), data.vertices.data());
+    // Level 0 only, meshlets don't cover the other levels
+    const size_t indexCount = file->lodCount() > 0 ? file->lods()[0].indexCount : file->indexCount();
+    data.indices.assign(file->indices(), file->indices() + indexCount);
+  }
+  mesh::optimize(data);
+
+  auto buildMs = bench::timePasses(iterations, [&] { mesh::buildMeshlets(data); });
+  if (data.meshlets.empty()) {
+    std::cerr << "Mesh has no triangles\n";
+    return 1;
+  }
+
+  /*
+   * Views: camera on the z axis looking down -z, mesh rotated, so the camera
+   * position in object space is the inverse (transposed) rotation of it
+   */
+  const float4x4 projection = mat::projection(45.0f, 1.0f, 0.1f, 100.0f);
+  std::vector<mesh::CullView> views;
+  std::mt19937 rng(1234);
+  std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+  std::uniform_real_distribution<float> distance(1.5f, 5.0f);
+  for (size_t i = 0; i < viewCount; i++) {
+    const float3 axis = normalize(float3{unit(rng), unit(rng), unit(rng)} + float3{0.0f, 0.0f, 1e-3f});
+    const float4x4 model = mat::rotation(unit(rng) * std::numbers::pi_v<float>, axis);
+    const float3 camera = {0.0f, 0.0f, distance(rng)};
+
+    const float4x4 mvp = projection * mat::translation(-camera) * model;
+    views.push_back(mesh::makeCullView(mvp, make_float3(transpose(model) * make_float4(camera, 1.0f))));
+  }
+
+  std::vector<mesh::DrawRange> ranges;
+  size_t visible = 0, rangeCount = 0, visibleTriangles = 0;
+  auto cullMs = bench::timePasses(iterations, [&] {
+    visible = rangeCount = visibleTriangles = 0;
+    for (const mesh::CullView &view: views) {
+      ranges.clear();
+      visible += mesh::cullMeshlets(data.meshlets.data(), data.meshlets.size(), view, ranges);
+      rangeCount += ranges.size();
+      for (const mesh::DrawRange &r: ranges) visibleTriangles += r.indexCount / 3;
+    }
+  });
+
+  /*
+   * Report
+   */
+  bench::Summary buildSummary = bench::summarize(buildMs);
+  bench::Summary cullSummary = bench::summarize(cullMs);
+  const size_t triangles = data.indices.size() / 3, meshlets = data.meshlets.size();
+
+  size_t withCone = 0, meshletVertices = 0;
+  for (const mesh::Meshlet &m: data.meshlets) {
+    withCone += m.coneCutoff < 1.0f;
+    meshletVertices += m.vertexCount;
+  }
+
+  bench::JsonWriter json;
+  json.beginObject()
+    .field("benchmark", "meshlets")
+    .field("mesh", meshPath.empty() ? "sphere" : meshPath)
+    .field("vertices", data.vertices.size())
+    .field("triangles", triangles)
+    .field("meshlets", meshlets)
+    .field("triangles_per_meshlet", double(triangles) / double(meshlets))
+    .field("vertices_per_meshlet", double(meshletVertices) / double(meshlets))
+    .field("meshlets_with_cone", withCone)
+    .field("views", viewCount)
+    .field("iterations", iterations)
+    .summary("build_ms", buildSummary)
+    .summary("cull_ms", cullSummary)
+    .field("build_ns_per_triangle", buildSummary.p50 * 1e6 / double(triangles))
+    .field("cull_ns_per_meshlet", cullSummary.p50 * 1e6 / double(meshlets * viewCount))
+    .field("visible_meshlet_fraction", double(visible) / double(meshlets * viewCount))
+    .field("visible_triangle_fraction", double(visibleTriangles) / double(triangles * viewCount))
+    .field("draw_ranges_per_view", double(rangeCount) / double(viewCount))
+    .endObject();
+
+  if (!bench::writeOutput(json.str(), args.value("output", "-"))) {
+    std::cerr << "Failed to write output\n";
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,133 @@
+#include <algorithm>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include <benchmark.hpp>
+#include <matrices.hpp>
+#include <occlusion.hpp>
+#include <parallel.hpp>
+
+using namespace psimd;
+
+/**
+ * Occlusion culling cost and yield: a row of box occluders close to the
+ * camera hides part of a field of random spheres behind it.
+ *   render  rasterize the occluders and build the depth pyramid
+ *   test    test every sphere against the pyramid
+ *
+ * Options:
+ *   --count N       spheres (default 100000)
+ *   --occluders N   occluder boxes (default 32)
+ *   --width N       occlusion buffer width (default 256)
+ *   --height N      occlusion buffer height (default 128)
+ *   --iterations N  timed passes (default 50)
+ *   --output PATH   JSON output file, stdout by default
+ */
+namespace {
+/**
+ * Unit cube around the origin, outward facing triangles are counter-clockwise
+ */
+void makeBox(std::vector<float3> &positions, std::vector<uint32_t> &indices) {
+  for (uint32_t i = 0; i < 8; i++) positions.push_back({i & 1 ? 1.0f : -1.0f, i & 2 ? 1.0f : -1.0f, i & 4 ? 1.0f : -1.0f});
+
+  const uint32_t faces[6][4] = {{0, 2, 6, 4}, {1, 5, 7, 3}, {0, 4, 5, 1}, {2, 3, 7, 6}, {0, 1, 3, 2}, {4, 6, 7, 5}};
+  for (const auto &f: faces) {
+    for (int k = 1; k < 3; k++) {
+      uint32_t a = f[0], b = f[k], c = f[k + 1];
+      const float3 pa = positions[a], pb = positions[b], pc = positions[c];
+      if (dot(cross(pb - pa, pc - pa), pa + pb + pc) < 0.0f) std::swap(b, c);
+      indices.insert(indices.end(), {a, b, c});
+    }
+  }
+}
+}
+
+int main(int argc, char **argv) {
+  bench::Args args(argc, argv);
+  const auto count = static_cast<size_t>(std::max(1LL, args.intValue("count", 100000)));
+  const auto occluderCount = static_cast<size_t>(std::max(0LL, args.intValue("occluders", 32)));
+  const auto width = static_cast<uint32_t>(std::max(1LL, args.intValue("width", 256)));
+  const auto height = static_cast<uint32_t>(std::max(1LL, args.intValue("height", 128)));
+  const long long iterations = std::max(1LL, args.intValue("iterations", 50));
+
+  /*
+   * Camera at the origin looking down -z. The occluders are boxes in a row at
+   * z = -12, overlapping into a wall, the spheres are spread out behind.
+   */
+  const float4x4 viewProjection = mat::projection(1.0f, float(width) / float(height), 0.1f, 200.0f);
+
+  std::vector<float3> boxPositions;
+  std::vector<uint32_t> boxIndices;
+  makeBox(boxPositions, boxIndices);
+
+  const float3 boxExtent = {0.7f, 4.0f, 0.7f};
+  std::vector<float3> boxCenters;
+  std::vector<float4x4> occluders;
+  for (size_t i = 0; i < occluderCount; i++) {
+    boxCenters.push_back({(float(i) - float(occluderCount - 1) * 0.5f) * 1.2f, 0.0f, -12.0f});
+    occluders.push_back(viewProjection * mat::translation(boxCenters.back()) * mat::scaling(boxExtent));
+  }
+
+  std::vector<float> x(count), y(count), z(count), radius(count);
+  std::mt19937 rng(1234);
+  std::uniform_real_distribution<float> spreadX(-60.0f, 60.0f), spreadY(-15.0f, 15.0f), depth(-150.0f, -20.0f);
+  std::uniform_real_distribution<float> size(0.2f, 1.5f);
+  for (size_t i = 0; i < count; i++) {
+    x[i] = spreadX(rng), y[i] = spreadY(rng), z[i] = depth(rng);
+    radius[i] = size(rng);
+  }
+  const cull::SphereArrays spheres{x.data(), y.data(), z.data(), radius.data()};
+
+  cull::OcclusionBuffer buffer(width, height);
+  auto renderMs = bench::timePasses(iterations, [&] {
+    buffer.clear();
+    for (const float4x4 &mvp: occluders) {
+      buffer.addOccluder(mvp, boxPositions.data(), boxPositions.size(), boxIndices.data(), boxIndices.size());
+    }
+    buffer.render();
+  });
+
+  std::vector<uint32_t> visible(count);
+  size_t visibleCount = 0;
+  auto testMs = bench::timePasses(iterations, [&] {
+    for (size_t i = 0; i < count; i++) visible[i] = uint32_t(i);
+    visibleCount = buffer.cullSpheres(viewProjection, spheres, visible.data(), count);
+  });
+
+  /*
+   * The occluders' own bounds are in front of their depth, none of them may
+   * be culled
+   */
+  size_t occludersCulled = 0;
+  for (const float3 &center: boxCenters) occludersCulled += !buffer.isSphereVisible(viewProjection, center, length(boxExtent));
+
+  /*
+   * Report
+   */
+  bench::Summary renderSummary = bench::summarize(renderMs);
+  bench::Summary testSummary = bench::summarize(testMs);
+
+  bench::JsonWriter json;
+  json.beginObject()
+    .field("benchmark", "occlusion")
+    .field("count", count)
+    .field("occluders", occluderCount)
+    .field("occluder_triangles", buffer.triangleCount())
+    .field("width", buffer.width())
+    .field("height", buffer.height())
+    .field("threads", par::threadCount())
+    .field("iterations", iterations)
+    .summary("render_ms", renderSummary)
+    .summary("test_ms", testSummary)
+    .field("test_ns_per_object", testSummary.p50 * 1e6 / double(count))
+    .field("occluded_fraction", 1.0 - double(visibleCount) / double(count))
+    .field("occluders_culled", occludersCulled)
+    .endObject();
+
+  if (!bench::writeOutput(json.str(), args.value("output", "-"))) {
+    std::cerr << "Failed to write output\n";
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,158 @@
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <numbers>
+#include <vector>
+
+#include <benchmark.hpp>
+#include <matrices.hpp>
+#include <mesh.hpp>
+#include <parallel.hpp>
+#include <raytracer.hpp>
+
+using namespace psimd;
+
+/**
+ * CPU ray tracing throughput: a grid of instances of one mesh, seen from a
+ * camera in front of it, traced one ray per pixel.
+ *   build    the mesh's tree, then the top level tree over the instances
+ *   rays     one ray at a time
+ *   packets  2x2 pixel packets
+ * Both modes must find the same hits, mismatches should be 0 (or a few
+ * pixels on triangle edges).
+ *
+ * Options:
+ *   --mesh PATH     mesh file (see mesh.hpp), a UV sphere by default
+ *   --rings N       sphere rings, with twice as many segments (default 64)
+ *   --instances N   instances, in a square grid (default 100)
+ *   --width N       image width (default 512)
+ *   --height N      image height (default 512)
+ *   --iterations N  timed passes (default 10)
+ *   --output PATH   JSON output file, stdout by default
+ */
+namespace {
+void makeSphere(uint32_t rings, std::vector<float3> &positions, std::vector<uint32_t> &indices) {
+  const uint32_t segments = rings * 2;
+  for (uint32_t r = 0; r <= rings; r++) {
+    const float theta = float(r) / float(rings) * std::numbers::pi_v<float>;
+    for (uint32_t s = 0; s <= segments; s++) {
+      const float phi = float(s) / float(segments) * 2.0f * std::numbers::pi_v<float>;
+      positions.push_back({std::sin(theta) * std::cos(phi), std::cos(theta), std::sin(theta) * std::sin(phi)});
+    }
+  }
+
+  // Counter-clockwise seen from outside
+  for (uint32_t r = 0; r < rings; r++) {
+    for (uint32_t s = 0; s < segments; s++) {
+      const uint32_t a = r * (segments + 1) + s, b = a + segments + 1;
+      indices.insert(indices.end(), {a, a + 1, b, a + 1, b + 1, b});
+    }
+  }
+}
+}
+
+int main(int argc, char **argv) {
+  bench::Args args(argc, argv);
+  const std::string meshPath = args.value("mesh", "");
+  const auto rings = static_cast<uint32_t>(std::max(2LL, args.intValue("rings", 64)));
+  const auto instanceCount = static_cast<uint32_t>(std::max(1LL, args.intValue("instances", 100)));
+  const auto width = static_cast<uint32_t>(std::max(1LL, args.intValue("width", 512)));
+  const auto height = static_cast<uint32_t>(std::max(1LL, args.intValue("height", 512)));
+  const long long iterations = std::max(1LL, args.intValue("iterations", 10));
+
+  std::vector<float3> positions;
+  std::vector<uint32_t> indices;
+  if (meshPath.empty()) {
+    makeSphere(rings, positions, indices);
+  } else {
+    std::string error;
+    std::unique_ptr<mesh::MeshFile> file = mesh::MeshFile::open(meshPath, &error);
+    if (!file) {
+      std::cerr << error << "\n";
+      return 1;
+    }
+    std::vector<mesh::Vertex> vertices(file->vertexCount());
+    mesh::decodeVertices(file->layout(), file->vertexData(), vertices.size(), vertices.data());
+    for (const mesh::Vertex &v: vertices) positions.push_back(v.position);
+
+    // The full detail level only
+    const uint32_t *first = file->indices() + (file->lodCount() ? file->lods()[0].firstIndex : 0);
+    indices.assign(first, first + (file->lodCount() ? file->lods()[0].indexCount : file->indexCount()));
+  }
+
+  // Instances scaled to a unit radius, in a grid around the origin
+  float radius = 0.0f;
+  for (const float3 &p: positions) radius = std::max(radius, length(p));
+  const auto side = static_cast<uint32_t>(std::ceil(std::sqrt(double(instanceCount))));
+  const float spacing = 2.5f, halfExtent = float(side - 1) * spacing * 0.5f;
+  std::vector<rt::Instance> instances(instanceCount);
+  for (uint32_t i = 0; i < instanceCount; i++) {
+    const float3 position = {float(i % side) * spacing - halfExtent, float(i / side) * spacing - halfExtent, 0.0f};
+    instances[i] = {0, mat::translation(position) * mat::rotation(float(i), float3{0.0f, 1.0f, 0.0f}) *
+                       mat::scaling(1.0f / radius)};
+  }
+
+  rt::Scene scene;
+  auto start = bench::Clock::now();
+  scene.addMesh(positions.data(), indices.data(), indices.size() / 3);
+  const double meshBuildMs = bench::elapsedMs(start);
+
+  start = bench::Clock::now();
+  scene.setInstances(instances.data(), instances.size());
+  const double instanceBuildMs = bench::elapsedMs(start);
+
+  // Same instances again, only refits
+  auto refitMs = bench::timePasses(iterations, [&] { scene.setInstances(instances.data(), instances.size()); });
+
+  /*
+   * Camera far enough back to see the whole grid
+   */
+  const float fov = 1.0f, aspect = float(width) / float(height);
+  const float distance = (halfExtent + 1.0f) / std::tan(fov * 0.5f) + 1.0f;
+  const rt::Camera camera = rt::makeCamera(mat::translation(float3{0.0f, 0.0f, -distance}),
+                                           mat::projection(fov, aspect, 0.1f, distance * 2.0f));
+
+  const size_t pixelCount = size_t(width) * height;
+  std::vector<rt::Hit> rayHits(pixelCount), packetHits(pixelCount);
+  auto raysMs = bench::timePasses(iterations, [&] { rt::traceImage(scene, camera, width, height, rayHits.data(), false); });
+  auto packetsMs = bench::timePasses(iterations, [&] { rt::traceImage(scene, camera, width, height, packetHits.data(), true); });
+
+  size_t hitCount = 0, mismatches = 0;
+  for (size_t i = 0; i < pixelCount; i++) {
+    hitCount += rayHits[i].instance != rt::noHit;
+    mismatches += rayHits[i].instance != packetHits[i].instance || rayHits[i].primitive != packetHits[i].primitive;
+  }
+
+  /*
+   * Report
+   */
+  bench::Summary raysSummary = bench::summarize(raysMs);
+  bench::Summary packetsSummary = bench::summarize(packetsMs);
+
+  bench::JsonWriter json;
+  json.beginObject()
+    .field("benchmark", "raytrace")
+    .field("mesh", meshPath.empty() ? "sphere" : meshPath)
+    .field("triangles", indices.size() / 3)
+    .field("instances", instanceCount)
+    .field("width", width)
+    .field("height", height)
+    .field("threads", par::threadCount())
+    .field("iterations", iterations)
+    .field("mesh_build_ms", meshBuildMs)
+    .field("instance_build_ms", instanceBuildMs)
+    .summary("instance_refit_ms", bench::summarize(refitMs))
+    .summary("rays_ms", raysSummary)
+    .summary("packets_ms", packetsSummary)
+    .field("rays_mrays_per_s", double(pixelCount) / (raysSummary.p50 * 1e3))
+    .field("packets_mrays_per_s", double(pixelCount) / (packetsSummary.p50 * 1e3))
+    .field("hit_fraction", double(hitCount) / double(pixelCount))
+    .field("mismatches", mismatches)
+    .endObject();
+
+  if (!bench::writeOutput(json.str(), args.value("output", "-"))) {
+    std::cerr << "Failed to write output\n";
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,194 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#include <benchmark.hpp>
+#include <headless-backend.hpp>
+#include <matrices.hpp>
+#include <parallel.hpp>
+#include <parallel-encoding.hpp>
+
+using namespace psimd;
+
+/**
+ * Command recording cost with one draw per object, the way scenes without
+ * instancing are submitted: each draw computes its MVP, passes it with
+ * setVertexBytes and draws a cube. Recorded on one encoder, then split over
+ * 1, 2, 4... sub-encoders of a parallel pass, recorded by that many tasks.
+ * With the raster backend the images are compared too.
+ *
+ * Options:
+ *   --draws N       draws per frame (default 20000)
+ *   --backend B     "null" records commands only (default), "raster" also
+ *                   renders and checks the images match
+ *   --iterations N  timed frames per configuration (default 50)
+ *   --output PATH   JSON output file, stdout by default
+ */
+struct CubeVertex {
+  float3 position;
+};
+
+template<>
+struct gfx::VertexLayout<CubeVertex> {
+  static constexpr AttributeInfo attributes[] = {
+    GFX_VERTEX_ATTRIBUTE(CubeVertex, position),
+  };
+};
+
+namespace {
+constexpr const char *library = "recording";
+
+const CubeVertex cubeVertices[8] = {
+  {{-1.0f, -1.0f, -1.0f}}, {{1.0f, -1.0f, -1.0f}}, {{-1.0f, 1.0f, -1.0f}}, {{1.0f, 1.0f, -1.0f}},
+  {{-1.0f, -1.0f, 1.0f}}, {{1.0f, -1.0f, 1.0f}}, {{-1.0f, 1.0f, 1.0f}}, {{1.0f, 1.0f, 1.0f}},
+};
+
+// Counter-clockwise seen from outside
+const uint32_t cubeIndices[36] = {
+  0, 2, 1, 1, 2, 3, 4, 5, 6, 5, 7, 6, 0, 1, 4, 1, 5, 4,
+  2, 6, 3, 3, 6, 7, 0, 4, 2, 2, 4, 6, 1, 3, 5, 3, 7, 5,
+};
+
+void registerShaders(gfx::HeadlessDevice &device) {
+  device.registerVertexFunction<CubeVertex>(library, "vertex", 0, [](const gfx::ShaderBindings &b, uint32_t vertexId, uint32_t) {
+    const float4x4 &mvp = *b.buffer<float4x4>(1);
+    const float3 p = make_float3(gfx::fetchAttribute<CubeVertex, 0>(b.buffer<CubeVertex>(0)[vertexId]));
+    return raster::Varyings{mvp * make_float4(p, 1.0f), make_float4(p * 0.5f + float3{0.5f}, 1.0f)};
+  });
+  device.registerFragmentFunction(library, "fragment", [](const raster::Varyings &in) { return in.color; });
+}
+}
+
+int main(int argc, char **argv) {
+  bench::Args args(argc, argv);
+  const auto drawCount = static_cast<size_t>(std::max(1LL, args.intValue("draws", 20000)));
+  const std::string backend = args.value("backend", "null");
+  const long long iterations = std::max(1LL, args.intValue("iterations", 50));
+
+  if (backend != "null" && backend != "raster") {
+    std::cerr << "Unknown backend " << backend << ", expected null or raster\n";
+    return 1;
+  }
+  const bool rasterize = backend == "raster";
+
+  gfx::HeadlessDevice device(rasterize ? gfx::HeadlessDevice::Mode::Rasterize : gfx::HeadlessDevice::Mode::Null);
+  registerShaders(device);
+  gfx::HeadlessRenderTarget target(256, 256, rasterize);
+  std::unique_ptr<gfx::CommandQueue> queue = device.newCommandQueue();
+
+  gfx::RenderPipelineDescriptor desc;
+  desc.library = library;
+  desc.vertexFunction = "vertex";
+  desc.fragmentFunction = "fragment";
+  desc.colorPixelFormat = target.colorPixelFormat();
+  desc.depthPixelFormat = target.depthPixelFormat();
+  desc.vertexDescriptor = gfx::vertexDescriptor<CubeVertex>();
+  std::string error;
+  std::unique_ptr<gfx::RenderPipelineState> pso = device.newRenderPipelineState(desc, &error);
+  if (!pso) {
+    std::cerr << error << "\n";
+    return 1;
+  }
+
+  gfx::DepthStencilDescriptor depthDesc;
+  depthDesc.depthCompareFunction = gfx::CompareFunction::Less;
+  depthDesc.depthWriteEnabled = true;
+  std::unique_ptr<gfx::DepthStencilState> dsso = device.newDepthStencilState(depthDesc);
+
+  std::unique_ptr<gfx::Buffer> vertexBuffer = device.newBuffer(sizeof(cubeVertices), gfx::StorageMode::Shared);
+  std::memcpy(vertexBuffer->contents(), cubeVertices, sizeof(cubeVertices));
+  std::unique_ptr<gfx::Buffer> indexBuffer = device.newBuffer(sizeof(cubeIndices), gfx::StorageMode::Shared);
+  std::memcpy(indexBuffer->contents(), cubeIndices, sizeof(cubeIndices));
+
+  // Small cubes in a slab in front of the camera, overlapping so draw order matters
+  const auto side = static_cast<size_t>(std::ceil(std::sqrt(double(drawCount))));
+  std::vector<float4x4> models(drawCount);
+  for (size_t i = 0; i < drawCount; i++) {
+    const float x = (float(i % side) / float(side) - 0.5f) * 20.0f, y = (float(i / side) / float(side) - 0.5f) * 20.0f;
+    models[i] = mat::translation(float3{x, y, -20.0f - float(i % 7)}) * mat::rotation(float(i), float3{0.3f, 1.0f, 0.0f}) *
+                mat::scaling(0.2f);
+  }
+  const float4x4 viewProjection = mat::projection(1.0f, 1.0f, 0.1f, 100.0f);
+
+  auto record = [&](gfx::RenderCommandEncoder &enc, size_t begin, size_t end) {
+    enc.setRenderPipelineState(pso.get());
+    enc.setDepthStencilState(dsso.get());
+    enc.setFrontFacingWinding(gfx::Winding::CounterClockwise);
+    enc.setCullMode(gfx::CullMode::Back);
+    enc.setVertexBuffer(vertexBuffer.get(), 0, 0);
+    for (size_t i = begin; i < end; i++) {
+      const float4x4 mvp = viewProjection * models[i];
+      enc.setVertexBytes(&mvp, sizeof(mvp), 1);
+      enc.drawIndexedPrimitives(gfx::PrimitiveType::Triangle, 36, gfx::IndexType::UInt32, indexBuffer.get(), 0);
+    }
+  };
+
+  // Encode time only, commit (replay) isn't part of recording
+  double encodeMs = 0.0;
+  auto frame = [&](size_t chunks) {
+    std::unique_ptr<gfx::CommandBuffer> cmd = queue->commandBuffer();
+    auto start = bench::Clock::now();
+    if (chunks == 0) {
+      gfx::RenderCommandEncoder *enc = cmd->renderCommandEncoder(target);
+      record(*enc, 0, drawCount);
+      enc->endEncoding();
+    } else {
+      gfx::encodeParallel(*cmd->parallelRenderCommandEncoder(target), drawCount, chunks, record);
+    }
+    encodeMs = bench::elapsedMs(start);
+    cmd->commit();
+  };
+
+  auto measure = [&](size_t chunks) {
+    frame(chunks);
+    std::vector<double> samples;
+    for (long long i = 0; i < iterations; i++) {
+      frame(chunks);
+      samples.push_back(encodeMs);
+    }
+    return bench::summarize(samples);
+  };
+
+  /*
+   * Report
+   */
+  bench::JsonWriter json;
+  json.beginObject()
+    .field("benchmark", "recording")
+    .field("backend", backend)
+    .field("draws", drawCount)
+    .field("threads", par::threadCount())
+    .field("iterations", iterations);
+
+  const bench::Summary serial = measure(0);
+  json.summary("serial_ms", serial);
+
+  std::vector<uint32_t> serialImage;
+  if (rasterize) serialImage.assign(target.image()->color(), target.image()->color() + 256 * 256);
+
+  size_t mismatchedPixels = 0;
+  const size_t maxChunks = std::max<size_t>(par::threadCount(), 4);
+  for (size_t chunks = 1; chunks <= maxChunks; chunks *= 2) {
+    const bench::Summary summary = measure(chunks);
+    json.beginObject("chunks_" + std::to_string(chunks))
+      .summary("encode_ms", summary)
+      .field("speedup", summary.p50 > 0.0 ? serial.p50 / summary.p50 : 0.0)
+      .endObject();
+
+    if (rasterize) {
+      for (size_t i = 0; i < serialImage.size(); i++) mismatchedPixels += target.image()->color()[i] != serialImage[i];
+    }
+  }
+
+  json.field("commands_per_frame", device.stats().commands / device.stats().commandBuffers)
+    .field("mismatched_pixels", mismatchedPixels)
+    .endObject();
+
+  if (!bench::writeOutput(json.str(), args.value("output", "-"))) {
+    std::cerr << "Failed to write output\n";
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,125 @@
+#include <algorithm>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include <benchmark.hpp>
+#include <matrices.hpp>
+
+/**
+ * Compares ways of building object transforms from position, rotation and
+ * scale:
+ *   matrices  translation(t) * rotation(angle, axis) * scaling(s), one object at a time
+ *   scalar    mat::composeTRS from a mat::quat, one object at a time
+ *   batch     mat::composeTRS over structure-of-arrays input
+ *
+ * Options:
+ *   --count N       objects per pass (default 100000)
+ *   --iterations N  timed passes (default 50)
+ *   --output PATH   JSON output file, stdout by default
+ */
+namespace {
+struct Scene {
+  std::vector<float> tx, ty, tz, qx, qy, qz, qw, sx, sy, sz;
+  std::vector<float3> axes;
+  std::vector<float> angles;
+
+  explicit Scene(size_t count) {
+    for (auto *v: {&tx, &ty, &tz, &qx, &qy, &qz, &qw, &sx, &sy, &sz, &angles}) v->resize(count);
+    axes.resize(count);
+
+    std::mt19937 rng(1234);
+    std::uniform_real_distribution<float> pos(-100.0f, 100.0f), unit(-1.0f, 1.0f), scale(0.5f, 2.0f);
+    for (size_t i = 0; i < count; i++) {
+      tx[i] = pos(rng), ty[i] = pos(rng), tz[i] = pos(rng);
+      sx[i] = scale(rng), sy[i] = scale(rng), sz[i] = scale(rng);
+
+      axes[i] = normalize(float3{unit(rng), unit(rng), unit(rng) + 2.0f});
+      angles[i] = unit(rng) * 3.14159265f;
+
+      float s = std::sin(angles[i] * 0.5f);
+      qx[i] = axes[i].x * s, qy[i] = axes[i].y * s, qz[i] = axes[i].z * s;
+      qw[i] = std::cos(angles[i] * 0.5f);
+    }
+  }
+
+  mat::TRSArrays arrays() const {
+    return {
+      tx.data(), ty.data(), tz.data(),
+      qx.data(), qy.data(), qz.data(), qw.data(),
+      sx.data(), sy.data(), sz.data(),
+    };
+  }
+};
+
+float maxDifference(const std::vector<float4x4> &a, const std::vector<float4x4> &b) {
+  float diff = 0.0f;
+  for (size_t i = 0; i < a.size(); i++) {
+    for (int j = 0; j < 4; j++) {
+      for (int k = 0; k < 4; k++) diff = std::max(diff, std::abs(a[i][j][k] - b[i][j][k]));
+    }
+  }
+  return diff;
+}
+}
+
+int main(int argc, char **argv) {
+  bench::Args args(argc, argv);
+  const auto count = static_cast<size_t>(std::max(1LL, args.intValue("count", 100000)));
+  const long long iterations = std::max(1LL, args.intValue("iterations", 50));
+
+  Scene scene(count);
+  std::vector<float4x4> matrices(count), scalar(count), batch(count);
+
+  auto matricesMs = bench::timePasses(iterations, [&] {
+    for (size_t i = 0; i < count; i++) {
+      matrices[i] = mat::translation({scene.tx[i], scene.ty[i], scene.tz[i]})
+                    * mat::rotation(scene.angles[i], scene.axes[i])
+                    * mat::scaling(float3{scene.sx[i], scene.sy[i], scene.sz[i]});
+    }
+  });
+
+  auto scalarMs = bench::timePasses(iterations, [&] {
+    for (size_t i = 0; i < count; i++) {
+      scalar[i] = mat::composeTRS(
+        {scene.tx[i], scene.ty[i], scene.tz[i]},
+        {scene.qx[i], scene.qy[i], scene.qz[i], scene.qw[i]},
+        {scene.sx[i], scene.sy[i], scene.sz[i]}
+      );
+    }
+  });
+
+  const mat::TRSArrays arrays = scene.arrays();
+  auto batchMs = bench::timePasses(iterations, [&] { mat::composeTRS(arrays, batch.data(), count); });
+
+  /*
+   * Report
+   */
+  bench::Summary matricesSummary = bench::summarize(matricesMs);
+  bench::Summary scalarSummary = bench::summarize(scalarMs);
+  bench::Summary batchSummary = bench::summarize(batchMs);
+  auto nsPerObject = [&](const bench::Summary &s) { return s.p50 * 1e6 / double(count); };
+
+  bench::JsonWriter json;
+  json.beginObject()
+    .field("benchmark", "transforms")
+    .field("count", count)
+    .field("iterations", iterations)
+    .summary("matrices_ms", matricesSummary)
+    .summary("scalar_ms", scalarSummary)
+    .summary("batch_ms", batchSummary)
+    .field("matrices_ns_per_object", nsPerObject(matricesSummary))
+    .field("scalar_ns_per_object", nsPerObject(scalarSummary))
+    .field("batch_ns_per_object", nsPerObject(batchSummary))
+    .field("batch_speedup_vs_matrices", matricesSummary.p50 / batchSummary.p50)
+    .field("batch_speedup_vs_scalar", scalarSummary.p50 / batchSummary.p50)
+    .field("max_difference_scalar", double(maxDifference(matrices, scalar)))
+    .field("max_difference_batch", double(maxDifference(matrices, batch)))
+    .endObject();
+
+  if (!bench::writeOutput(json.str(), args.value("output", "-"))) {
+    std::cerr << "Failed to write output\n";
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,93 @@
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include <benchmark.hpp>
+#include <matrices.hpp>
+
+/**
+ * Compares ways of computing sine and cosine for many angles:
+ *   libm    std::sin and std::cos, one value at a time
+ *   scalar  mat::sincos, one value at a time
+ *   batch   mat::sincos over arrays
+ *
+ * Errors are measured against double precision libm.
+ *
+ * Options:
+ *   --count N       values per pass (default 100000)
+ *   --iterations N  timed passes (default 50)
+ *   --range X       angles are uniform in [-X, X] (default 100)
+ *   --output PATH   JSON output file, stdout by default
+ */
+namespace {
+double maxError(const std::vector<float> &x, const std::vector<float> &s, const std::vector<float> &c) {
+  double err = 0.0;
+  for (size_t i = 0; i < x.size(); i++) {
+    err = std::max(err, std::abs(double(s[i]) - std::sin(double(x[i]))));
+    err = std::max(err, std::abs(double(c[i]) - std::cos(double(x[i]))));
+  }
+  return err;
+}
+}
+
+int main(int argc, char **argv) {
+  bench::Args args(argc, argv);
+  const auto count = static_cast<size_t>(std::max(1LL, args.intValue("count", 100000)));
+  const long long iterations = std::max(1LL, args.intValue("iterations", 50));
+  const auto range = static_cast<float>(args.floatValue("range", 100.0));
+
+  std::vector<float> x(count);
+  std::mt19937 rng(1234);
+  std::uniform_real_distribution<float> dist(-range, range);
+  for (float &v: x) v = dist(rng);
+
+  std::vector<float> libmS(count), libmC(count), scalarS(count), scalarC(count), batchS(count), batchC(count);
+
+  auto libmMs = bench::timePasses(iterations, [&] {
+    for (size_t i = 0; i < count; i++) {
+      libmS[i] = std::sin(x[i]);
+      libmC[i] = std::cos(x[i]);
+    }
+  });
+
+  auto scalarMs = bench::timePasses(iterations, [&] {
+    for (size_t i = 0; i < count; i++) mat::sincos(x[i], scalarS[i], scalarC[i]);
+  });
+
+  auto batchMs = bench::timePasses(iterations, [&] { mat::sincos(x.data(), batchS.data(), batchC.data(), count); });
+
+  /*
+   * Report
+   */
+  bench::Summary libmSummary = bench::summarize(libmMs);
+  bench::Summary scalarSummary = bench::summarize(scalarMs);
+  bench::Summary batchSummary = bench::summarize(batchMs);
+  auto nsPerValue = [&](const bench::Summary &s) { return s.p50 * 1e6 / double(count); };
+
+  bench::JsonWriter json;
+  json.beginObject()
+    .field("benchmark", "trig")
+    .field("count", count)
+    .field("iterations", iterations)
+    .field("range", double(range))
+    .summary("libm_ms", libmSummary)
+    .summary("scalar_ms", scalarSummary)
+    .summary("batch_ms", batchSummary)
+    .field("libm_ns_per_value", nsPerValue(libmSummary))
+    .field("scalar_ns_per_value", nsPerValue(scalarSummary))
+    .field("batch_ns_per_value", nsPerValue(batchSummary))
+    .field("batch_speedup_vs_libm", libmSummary.p50 / batchSummary.p50)
+    .field("scalar_speedup_vs_libm", libmSummary.p50 / scalarSummary.p50)
+    .field("max_error_libm", maxError(x, libmS, libmC))
+    .field("max_error_scalar", maxError(x, scalarS, scalarC))
+    .field("max_error_batch", maxError(x, batchS, batchC))
+    .endObject();
+
+  if (!bench::writeOutput(json.str(), args.value("output", "-"))) {
+    std::cerr << "Failed to write output\n";
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,154 @@
+#include "benchmark.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <numeric>
+
+namespace bench {
+namespace {
+/**
+ * Linear interpolation between closest ranks, p in [0, 1]
+ */
+double percentile(const std::vector<double> &sorted, double p) {
+  if (sorted.empty()) return 0.0;
+
+  double rank = p * double(sorted.size() - 1);
+  auto lo = static_cast<size_t>(rank);
+  size_t hi = std::min(lo + 1, sorted.size() - 1);
+  return sorted[lo] + (sorted[hi] - sorted[lo]) * (rank - double(lo));
+}
+
+std::string escape(const std::string &s) {
+  std::string out;
+  for (char c: s) {
+    if (c == '"' || c == '\\') out += '\\';
+    out += c;
+  }
+  return out;
+}
+}
+
+Summary summarize(std::vector<double> samples) {
+  Summary s;
+  s.count = samples.size();
+  if (samples.empty()) return s;
+
+  std::sort(samples.begin(), samples.end());
+  s.mean = std::accumulate(samples.begin(), samples.end(), 0.0) / double(samples.size());
+  s.min = samples.front();
+  s.max = samples.back();
+  s.p50 = percentile(samples, 0.50);
+  s.p95 = percentile(samples, 0.95);
+  s.p99 = percentile(samples, 0.99);
+  return s;
+}
+
+/*
+ * Command line
+ */
+Args::Args(int argc, char **argv) : m_args(argv + 1, argv + argc) {
+}
+
+const std::string *Args::find(const std::string &name) const {
+  auto it = std::find(m_args.begin(), m_args.end(), "--" + name);
+  if (it == m_args.end() || it + 1 == m_args.end()) return nullptr;
+  return &*(it + 1);
+}
+
+std::string Args::value(const std::string &name, const std::string &fallback) const {
+  const std::string *v = find(name);
+  return v ? *v : fallback;
+}
+
+long long Args::intValue(const std::string &name, long long fallback) const {
+  const std::string *v = find(name);
+  return v ? std::atoll(v->c_str()) : fallback;
+}
+
+double Args::floatValue(const std::string &name, double fallback) const {
+  const std::string *v = find(name);
+  return v ? std::atof(v->c_str()) : fallback;
+}
+
+bool Args::flag(const std::string &name) const {
+  return std::find(m_args.begin(), m_args.end(), "--" + name) != m_args.end();
+}
+
+/*
+ * JSON
+ */
+void JsonWriter::key(const std::string &key) {
+  if (m_hasFields.empty()) return;
+
+  if (m_hasFields.back()) m_out << ",";
+  m_hasFields.back() = true;
+
+  m_out << "\n" << std::string(m_hasFields.size() * 2, ' ');
+  if (!key.empty()) m_out << "\"" << escape(key) << "\": ";
+}
+
+JsonWriter &JsonWriter::beginObject(const std::string &k) {
+  key(k);
+  m_out << "{";
+  m_hasFields.push_back(false);
+  return *this;
+}
+
+JsonWriter &JsonWriter::endObject() {
+  bool hadFields = m_hasFields.back();
+  m_hasFields.pop_back();
+  if (hadFields) m_out << "\n" << std::string(m_hasFields.size() * 2, ' ');
+  m_out << "}";
+  if (m_hasFields.empty()) m_out << "\n";
+  return *this;
+}
+
+JsonWriter &JsonWriter::field(const std::string &k, double value) {
+  key(k);
+  m_out << value;
+  return *this;
+}
+
+JsonWriter &JsonWriter::field(const std::string &k, long long value) {
+  key(k);
+  m_out << value;
+  return *this;
+}
+
+JsonWriter &JsonWriter::field(const std::string &k, const std::string &value) {
+  key(k);
+  m_out << "\"" << escape(value) << "\"";
+  return *this;
+}
+
+JsonWriter &JsonWriter::field(const std::string &k, bool value) {
+  key(k);
+  m_out << (value ? "true" : "false");
+  return *this;
+}
+
+JsonWriter &JsonWriter::summary(const std::string &k, const Summary &s) {
+  return beginObject(k)
+    .field("count", s.count)
+    .field("mean", s.mean)
+    .field("min", s.min)
+    .field("p50", s.p50)
+    .field("p95", s.p95)
+    .field("p99", s.p99)
+    .field("max", s.max)
+    .endObject();
+}
+
+bool writeOutput(const std::string &text, const std::string &path) {
+  if (path.empty() || path == "-") {
+    std::cout << text;
+    return true;
+  }
+
+  std::ofstream file(path);
+  file << text;
+  return file.good();
+}
+}
@@ -0,0 +1,105 @@
+#ifndef LEARN_METAL_BENCHMARK_HPP
+#define LEARN_METAL_BENCHMARK_HPP
+
+#include <chrono>
+#include <sstream>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+/**
+ * Small helpers shared by the benchmark executables: command line options,
+ * sample statistics and JSON output
+ */
+namespace bench {
+using Clock = std::chrono::high_resolution_clock;
+
+inline double elapsedMs(Clock::time_point start, Clock::time_point end = Clock::now()) {
+  return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+/**
+ * Runs fn once to warm up, then times it, returning milliseconds per pass
+ */
+template<typename F>
+std::vector<double> timePasses(long long iterations, F &&fn) {
+  fn();
+  std::vector<double> samples;
+  for (long long i = 0; i < iterations; i++) {
+    auto start = Clock::now();
+    fn();
+    samples.push_back(elapsedMs(start));
+  }
+  return samples;
+}
+
+struct Summary {
+  size_t count = 0;
+  double mean = 0, min = 0, max = 0;
+  double p50 = 0, p95 = 0, p99 = 0;
+};
+
+Summary summarize(std::vector<double> samples);
+
+/**
+ * Options in the form --name value, or --name for flags
+ */
+class Args {
+public:
+  Args(int argc, char **argv);
+
+  std::string value(const std::string &name, const std::string &fallback) const;
+
+  long long intValue(const std::string &name, long long fallback) const;
+
+  double floatValue(const std::string &name, double fallback) const;
+
+  bool flag(const std::string &name) const;
+
+private:
+  std::vector<std::string> m_args;
+
+  const std::string *find(const std::string &name) const;
+};
+
+/**
+ * Minimal streaming JSON writer, takes care of commas and quoting
+ */
+class JsonWriter {
+public:
+  JsonWriter &beginObject(const std::string &key = "");
+
+  JsonWriter &endObject();
+
+  JsonWriter &field(const std::string &key, double value);
+
+  JsonWriter &field(const std::string &key, long long value);
+
+  template<typename T>
+  requires std::is_integral_v<T> && (!std::is_same_v<T, bool>)
+  JsonWriter &field(const std::string &key, T value) { return field(key, static_cast<long long>(value)); }
+
+  JsonWriter &field(const std::string &key, const std::string &value);
+
+  JsonWriter &field(const std::string &key, const char *value) { return field(key, std::string(value)); }
+
+  JsonWriter &field(const std::string &key, bool value);
+
+  JsonWriter &summary(const std::string &key, const Summary &summary);
+
+  std::string str() const { return m_out.str(); }
+
+private:
+  std::ostringstream m_out;
+  std::vector<bool> m_hasFields;
+
+  void key(const std::string &key);
+};
+
+/**
+ * Writes to a file, or stdout if the path is empty or "-"
+ */
+bool writeOutput(const std::string &text, const std::string &path);
+}
+
+#endif //LEARN_METAL_BENCHMARK_HPP
@@ -0,0 +1,298 @@
+#include "bvh.hpp"
+
+#include <algorithm>
+#include <numeric>
+
+using namespace psimd;
+
+namespace bvh {
+namespace {
+constexpr size_t binCount = 16;
+constexpr uint32_t noParent = UINT32_MAX;
+
+const Aabb emptyBox = {float3{INFINITY}, float3{-INFINITY}};
+
+void setBounds(Node &node, const Aabb &box) {
+  for (int k = 0; k < 3; k++) node.min[k] = box.min[k], node.max[k] = box.max[k];
+}
+
+Aabb nodeBounds(const Node &node) {
+  return {{node.min[0], node.min[1], node.min[2]}, {node.max[0], node.max[1], node.max[2]}};
+}
+
+/*
+ * Plane tests take the box as center and half extent. A box is outside a
+ * plane if its nearest corner is behind it, and inside if its farthest corner
+ * is in front.
+ */
+constexpr uint32_t outside = UINT32_MAX;
+constexpr uint32_t allPlanes = (1u << 6) - 1;
+
+/**
+ * Returns the planes of mask the box still straddles, or outside
+ */
+uint32_t classify(const cull::Frustum &frustum, const float *min, const float *max, uint32_t mask) {
+  const float cx = (min[0] + max[0]) * 0.5f, cy = (min[1] + max[1]) * 0.5f, cz = (min[2] + max[2]) * 0.5f;
+  const float ex = (max[0] - min[0]) * 0.5f, ey = (max[1] - min[1]) * 0.5f, ez = (max[2] - min[2]) * 0.5f;
+
+  for (uint32_t planes = mask; planes; planes &= planes - 1) {
+    const int p = __builtin_ctz(planes);
+    const float4 &plane = frustum.planes[p];
+    const float d = plane.x * cx + plane.y * cy + plane.z * cz + plane.w;
+    const float r = std::abs(plane.x) * ex + std::abs(plane.y) * ey + std::abs(plane.z) * ez;
+    if (d + r < 0.0f) return outside;
+    if (d - r >= 0.0f) mask &= ~(1u << p);
+  }
+  return mask;
+}
+
+bool overlaps(const float *min, const float *max, const Aabb &box) {
+  return min[0] <= box.max.x && max[0] >= box.min.x &&
+         min[1] <= box.max.y && max[1] >= box.min.y &&
+         min[2] <= box.max.z && max[2] >= box.min.z;
+}
+
+bool contains(const Aabb &box, const float *min, const float *max) {
+  return min[0] >= box.min.x && max[0] <= box.max.x &&
+         min[1] >= box.min.y && max[1] <= box.max.y &&
+         min[2] >= box.min.z && max[2] <= box.max.z;
+}
+}
+
+Aabb merge(const Aabb &a, const Aabb &b) {
+  return {psimd::min(a.min, b.min), psimd::max(a.max, b.max)};
+}
+
+float surfaceArea(const Aabb &box) {
+  const float x = box.max.x - box.min.x, y = box.max.y - box.min.y, z = box.max.z - box.min.z;
+  return x < 0.0f ? 0.0f : 2.0f * (x * y + y * z + z * x);
+}
+
+void Tree::build(const Aabb *bounds, size_t count) {
+  m_nodes.clear();
+  m_parents.clear();
+  m_objects.resize(count);
+  std::iota(m_objects.begin(), m_objects.end(), 0u);
+  m_leafOf.resize(count);
+  m_slotOf.resize(count);
+  m_objectBounds.resize(count);
+  if (count == 0) return;
+
+  std::vector<float3> centroids(count);
+  for (size_t i = 0; i < count; i++) centroids[i] = (bounds[i].min + bounds[i].max) * 0.5f;
+
+  m_nodes.reserve(2 * count);
+  m_parents.reserve(m_nodes.capacity());
+  buildNode(bounds, centroids.data(), 0, uint32_t(count), noParent, 0);
+
+  for (size_t k = 0; k < count; k++) {
+    m_objectBounds[k] = bounds[m_objects[k]];
+    m_slotOf[m_objects[k]] = uint32_t(k);
+  }
+}
+
+uint32_t Tree::buildNode(const Aabb *bounds, const float3 *centroids, uint32_t begin, uint32_t end, uint32_t parent,
+                         size_t depth) {
+  const auto node = uint32_t(m_nodes.size());
+  m_nodes.emplace_back();
+  m_parents.push_back(parent);
+
+  Aabb box = emptyBox, centroidBox = emptyBox;
+  for (uint32_t i = begin; i < end; i++) {
+    box = merge(box, bounds[m_objects[i]]);
+    centroidBox = merge(centroidBox, {centroids[m_objects[i]], centroids[m_objects[i]]});
+  }
+  setBounds(m_nodes[node], box);
+
+  const uint32_t count = end - begin;
+  auto makeLeaf = [&] {
+    m_nodes[node].offset = begin;
+    m_nodes[node].count = count;
+    for (uint32_t i = begin; i < end; i++) m_leafOf[m_objects[i]] = node;
+    return node;
+  };
+  if (count == 1) return makeLeaf();
+
+  /*
+   * Binned SAH: objects go into bins by centroid along each axis, and every
+   * boundary between bins is a candidate split. The cost of a split is the
+   * expected number of object tests, children weighted by the probability a
+   * query that reaches this node enters them (their relative area).
+   */
+  int bestAxis = -1;
+  size_t bestSplit = 0;
+  float bestCost = INFINITY;
+
+  if (depth < maxDepth) {
+    for (int axis = 0; axis < 3; axis++) {
+      const float extent = centroidBox.max[axis] - centroidBox.min[axis];
+      if (!(extent > 0.0f)) continue;
+
+      Aabb binBoxes[binCount];
+      uint32_t binCounts[binCount] = {};
+      std::fill(std::begin(binBoxes), std::end(binBoxes), emptyBox);
+      const float scale = float(binCount) / extent;
+      for (uint32_t i = begin; i < end; i++) {
+        const uint32_t o = m_objects[i];
+        const auto b = std::min(binCount - 1, size_t((centroids[o][axis] - centroidBox.min[axis]) * scale));
+        binBoxes[b] = merge(binBoxes[b], bounds[o]);
+        binCounts[b]++;
+      }
+
+      // Sweep from the right for the costs of the right sides, then from the left
+      float rightCost[binCount];
+      Aabb accumulated = emptyBox;
+      uint32_t accumulatedCount = 0;
+      for (size_t b = binCount - 1; b > 0; b--) {
+        accumulated = merge(accumulated, binBoxes[b]);
+        accumulatedCount += binCounts[b];
+        rightCost[b] = surfaceArea(accumulated) * float(accumulatedCount);
+      }
+      accumulated = emptyBox;
+      accumulatedCount = 0;
+      for (size_t split = 1; split < binCount; split++) {
+        accumulated = merge(accumulated, binBoxes[split - 1]);
+        accumulatedCount += binCounts[split - 1];
+        const float cost = surfaceArea(accumulated) * float(accumulatedCount) + rightCost[split];
+        if (cost < bestCost) bestAxis = axis, bestSplit = split, bestCost = cost;
+      }
+    }
+  }
+
+  // Splitting costs a box test for each child on top of the tests below them
+  const float area = surfaceArea(box);
+  const float splitCost = 1.0f + (area > 0.0f ? bestCost / area : 0.0f);
+  if (count <= maxLeafSize && (bestAxis < 0 || splitCost >= float(count))) return makeLeaf();
+
+  uint32_t *first = m_objects.data() + begin, *last = m_objects.data() + end;
+  uint32_t mid = begin + count / 2;
+  if (bestAxis >= 0) {
+    const float scale = float(binCount) / (centroidBox.max[bestAxis] - centroidBox.min[bestAxis]);
+    const float minimum = centroidBox.min[bestAxis];
+    uint32_t *split = std::partition(first, last, [&](uint32_t o) {
+      return std::min(binCount - 1, size_t((centroids[o][bestAxis] - minimum) * scale)) < bestSplit;
+    });
+    if (split != first && split != last) mid = uint32_t(split - m_objects.data());
+  }
+  // Otherwise the centroids are all in one place, or the tree is too deep: split in half
+
+  buildNode(bounds, centroids, begin, mid, node, depth + 1);
+  m_nodes[node].offset = buildNode(bounds, centroids, mid, end, node, depth + 1);
+  m_nodes[node].count = 0;
+  return node;
+}
+
+void Tree::updateNode(uint32_t node) {
+  Node &n = m_nodes[node];
+  Aabb box = emptyBox;
+  if (n.isLeaf()) {
+    for (uint32_t i = n.offset; i < n.offset + n.count; i++) box = merge(box, m_objectBounds[i]);
+  } else {
+    box = merge(nodeBounds(m_nodes[node + 1]), nodeBounds(m_nodes[n.offset]));
+  }
+  setBounds(n, box);
+}
+
+void Tree::refit(const Aabb *bounds) {
+  for (size_t k = 0; k < m_objects.size(); k++) m_objectBounds[k] = bounds[m_objects[k]];
+
+  // Children come after their parents
+  for (size_t node = m_nodes.size(); node-- > 0;) updateNode(uint32_t(node));
+}
+
+void Tree::refit(const Aabb *bounds, const uint32_t *moved, size_t movedCount) {
+  for (size_t i = 0; i < movedCount; i++) m_objectBounds[m_slotOf[moved[i]]] = bounds[moved[i]];
+
+  /*
+   * Nodes are recomputed from their children, so once a node comes out the
+   * same the ones above it are up to date already
+   */
+  for (size_t i = 0; i < movedCount; i++) {
+    for (uint32_t node = m_leafOf[moved[i]]; node != noParent; node = m_parents[node]) {
+      const Node before = m_nodes[node];
+      updateNode(node);
+      const Node &after = m_nodes[node];
+      if (std::equal(before.min, before.min + 3, after.min) && std::equal(before.max, before.max + 3, after.max)) break;
+    }
+  }
+}
+
+float Tree::sahCost() const {
+  if (m_nodes.empty()) return 0.0f;
+
+  float cost = 0.0f;
+  for (const Node &node: m_nodes) cost += surfaceArea(nodeBounds(node)) * float(node.isLeaf() ? node.count : 1);
+  const float rootArea = surfaceArea(nodeBounds(m_nodes[0]));
+  return rootArea > 0.0f ? cost / rootArea : 0.0f;
+}
+
+std::pair<uint32_t, uint32_t> Tree::subtreeObjects(uint32_t node) const {
+  // Leaves are in depth first order too, the subtree's objects are those of its leftmost leaf to its rightmost
+  uint32_t left = node, right = node;
+  while (!m_nodes[left].isLeaf()) left++;
+  while (!m_nodes[right].isLeaf()) right = m_nodes[right].offset;
+  return {m_nodes[left].offset, m_nodes[right].offset + m_nodes[right].count};
+}
+
+size_t Tree::queryFrustum(const cull::Frustum &frustum, uint32_t *out) const {
+  if (m_nodes.empty()) return 0;
+
+  struct Entry {
+    uint32_t node;
+    uint32_t planes; // Planes the parent straddles, the others it's inside of
+  } stack[64];
+  size_t top = 0, n = 0;
+  stack[top++] = {0, allPlanes};
+
+  while (top > 0) {
+    const Entry entry = stack[--top];
+    const Node &node = m_nodes[entry.node];
+    const uint32_t planes = classify(frustum, node.min, node.max, entry.planes);
+    if (planes == outside) continue;
+
+    if (planes == 0) {
+      const auto [first, last] = subtreeObjects(entry.node);
+      n = std::copy(m_objects.begin() + first, m_objects.begin() + last, out + n) - out;
+    } else if (node.isLeaf()) {
+      for (uint32_t i = node.offset; i < node.offset + node.count; i++) {
+        const Aabb &box = m_objectBounds[i];
+        out[n] = m_objects[i];
+        n += classify(frustum, &box.min.x, &box.max.x, planes) != outside;
+      }
+    } else {
+      stack[top++] = {node.offset, planes};
+      stack[top++] = {entry.node + 1, planes};
+    }
+  }
+  return n;
+}
+
+size_t Tree::queryAabb(const Aabb &box, uint32_t *out) const {
+  if (m_nodes.empty()) return 0;
+
+  uint32_t stack[64];
+  size_t top = 0, n = 0;
+  stack[top++] = 0;
+
+  while (top > 0) {
+    const uint32_t index = stack[--top];
+    const Node &node = m_nodes[index];
+    if (!overlaps(node.min, node.max, box)) continue;
+
+    if (contains(box, node.min, node.max)) {
+      const auto [first, last] = subtreeObjects(index);
+      n = std::copy(m_objects.begin() + first, m_objects.begin() + last, out + n) - out;
+    } else if (node.isLeaf()) {
+      for (uint32_t i = node.offset; i < node.offset + node.count; i++) {
+        const Aabb &object = m_objectBounds[i];
+        out[n] = m_objects[i];
+        n += overlaps(&object.min.x, &object.max.x, box);
+      }
+    } else {
+      stack[top++] = node.offset;
+      stack[top++] = index + 1;
+    }
+  }
+  return n;
+}
+}
@@ -0,0 +1,192 @@
+#ifndef LEARN_METAL_BVH_HPP
+#define LEARN_METAL_BVH_HPP
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "culling.hpp"
+#include "simd-types.hpp"
+
+/**
+ * Bounding volume hierarchy over axis aligned boxes, for scene queries that
+ * would otherwise scan every object: frustum culling, box overlap and ray
+ * casts.
+ */
+namespace bvh {
+struct Aabb {
+  psimd::float3 min, max;
+};
+
+Aabb merge(const Aabb &a, const Aabb &b);
+
+float surfaceArea(const Aabb &box);
+
+/**
+ * Flattened node, two per cache line. Nodes are stored depth first, so an
+ * interior node's left child follows it and offset is its right child. A leaf
+ * holds count objects, from offset in the tree's object order.
+ */
+struct Node {
+  float min[3];
+  uint32_t offset;
+  float max[3];
+  uint32_t count; // 0 for interior nodes
+
+  bool isLeaf() const { return count > 0; }
+};
+
+static_assert(sizeof(Node) == 32);
+
+/**
+ * Ray for raycast, hits are only searched in [tMin, tMax]. The intersect
+ * callback of raycast shortens tMax as it finds closer hits.
+ */
+struct Ray {
+  psimd::float3 origin;
+  psimd::float3 direction;
+  float tMin = 0.0f;
+  float tMax = INFINITY;
+};
+
+class Tree {
+public:
+  static constexpr size_t maxLeafSize = 4;
+  // Deeper nodes are split in half, so no tree is deeper than 64 (raycast's stack)
+  static constexpr size_t maxDepth = 32;
+
+  /**
+   * Builds the tree over one box per object, objects are referred to by their
+   * index. Top down, splitting where the surface area heuristic (binned, over
+   * all three axes) is lowest.
+   */
+  void build(const Aabb *bounds, size_t count);
+
+  /**
+   * Updates the boxes of all objects and every node above them, keeping the
+   * tree's structure. The tree gets looser as objects move away from where it
+   * was built, rebuild when sahCost has grown a lot.
+   */
+  void refit(const Aabb *bounds);
+
+  /**
+   * Same for the listed objects only, walking up from their leaves
+   */
+  void refit(const Aabb *bounds, const uint32_t *moved, size_t movedCount);
+
+  /**
+   * Expected cost of a query relative to a single box test, lower is better
+   */
+  float sahCost() const;
+
+  size_t objectCount() const { return m_objects.size(); }
+
+  const std::vector<Node> &nodes() const { return m_nodes; }
+
+  /**
+   * Object indices in leaf order, a leaf's offset and count index into these
+   */
+  const std::vector<uint32_t> &objects() const { return m_objects; }
+
+  /**
+   * Writes the objects whose box intersects the frustum to out, which must
+   * hold objectCount() entries, and returns how many there are. Subtrees
+   * entirely inside skip the remaining tests. Order follows the tree.
+   */
+  size_t queryFrustum(const cull::Frustum &frustum, uint32_t *out) const;
+
+  /**
+   * Same for the objects whose box overlaps box
+   */
+  size_t queryAabb(const Aabb &box, uint32_t *out) const;
+
+  /**
+   * Visits the objects whose box the ray enters, nearest node first, and
+   * calls intersect(object, ray) for each. intersect returns true on a hit and
+   * shortens ray.tMax to it, which prunes what's behind. Returns true if
+   * anything was hit.
+   */
+  template<typename Intersect>
+  bool raycast(Ray &ray, Intersect &&intersect) const;
+
+private:
+  std::vector<Node> m_nodes;
+  std::vector<uint32_t> m_objects;   // Object indices in leaf order
+  std::vector<Aabb> m_objectBounds;  // In leaf order too
+  std::vector<uint32_t> m_parents;
+  std::vector<uint32_t> m_leafOf;    // Per object
+  std::vector<uint32_t> m_slotOf;    // Per object, position in leaf order
+
+  uint32_t buildNode(const Aabb *bounds, const psimd::float3 *centroids, uint32_t begin, uint32_t end,
+                     uint32_t parent, size_t depth);
+
+  std::pair<uint32_t, uint32_t> subtreeObjects(uint32_t node) const;
+
+  void updateNode(uint32_t node);
+};
+
+/**
+ * Distance along the ray to the node's box, if the ray enters it before
+ * tMax. invDirection is 1 / direction per component.
+ */
+inline bool intersectNode(const Node &node, const psimd::float3 &origin, const psimd::float3 &invDirection,
+                          float tMin, float tMax, float &tEnter) {
+  for (int k = 0; k < 3; k++) {
+    float t0 = (node.min[k] - origin[k]) * invDirection[k];
+    float t1 = (node.max[k] - origin[k]) * invDirection[k];
+    if (t0 > t1) std::swap(t0, t1);
+    tMin = t0 > tMin ? t0 : tMin; // Written this way so a NaN (0 * inf) leaves the range alone
+    tMax = t1 < tMax ? t1 : tMax;
+  }
+  tEnter = tMin;
+  return tMin <= tMax;
+}
+
+template<typename Intersect>
+bool Tree::raycast(Ray &ray, Intersect &&intersect) const {
+  if (m_nodes.empty()) return false;
+
+  const psimd::float3 invDirection = {1.0f / ray.direction.x, 1.0f / ray.direction.y, 1.0f / ray.direction.z};
+  float tEnter;
+  if (!intersectNode(m_nodes[0], ray.origin, invDirection, ray.tMin, ray.tMax, tEnter)) return false;
+
+  /*
+   * Depth first, the nearer child first. Entry distances go on the stack with
+   * the nodes, so nodes behind a hit found in the meantime are skipped.
+   */
+  struct Entry {
+    uint32_t node;
+    float tEnter;
+  } stack[64];
+  size_t top = 0;
+  stack[top++] = {0, tEnter};
+
+  bool hit = false;
+  while (top > 0) {
+    const Entry entry = stack[--top];
+    if (entry.tEnter > ray.tMax) continue;
+
+    const Node &node = m_nodes[entry.node];
+    if (node.isLeaf()) {
+      for (uint32_t i = node.offset; i < node.offset + node.count; i++) hit |= intersect(m_objects[i], ray);
+      continue;
+    }
+
+    uint32_t near = entry.node + 1, far = node.offset;
+    float tNear, tFar;
+    bool hitNear = intersectNode(m_nodes[near], ray.origin, invDirection, ray.tMin, ray.tMax, tNear);
+    bool hitFar = intersectNode(m_nodes[far], ray.origin, invDirection, ray.tMin, ray.tMax, tFar);
+    if (hitNear && hitFar && tFar < tNear) {
+      std::swap(near, far);
+      std::swap(tNear, tFar);
+    }
+    if (hitFar) stack[top++] = {far, tFar};
+    if (hitNear) stack[top++] = {near, tNear};
+  }
+  return hit;
+}
+}
+
+#endif //LEARN_METAL_BVH_HPP
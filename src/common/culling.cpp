@@ -0,0 +1,202 @@
+#include "culling.hpp"
+
+#include <cmath>
+
+using namespace psimd;
+
+namespace cull {
+namespace {
+/*
+ * Vector backends for the batched tests, one volume per lane. visibleMask has
+ * bit k set if lane k is >= 0.
+ */
+struct Wide4 {
+  using V = psimd::detail::f128;
+  static constexpr size_t width = 4;
+
+  static V load(const float *p) { return psimd::detail::loadu(p); }
+
+  static V splat(float s) { return psimd::detail::splat(s); }
+
+  static V add(V a, V b) { return psimd::detail::add(a, b); }
+
+  static V min(V a, V b) { return psimd::detail::min(a, b); }
+
+  static V madd(V a, V b, V c) { return psimd::detail::madd(a, b, c); }
+
+  static uint32_t visibleMask(V v) {
+#if defined(PSIMD_SSE)
+    return uint32_t(_mm_movemask_ps(_mm_cmpge_ps(v, _mm_setzero_ps())));
+#elif defined(PSIMD_NEON)
+    const uint32x4_t bits = {1, 2, 4, 8};
+    return vaddvq_u32(vandq_u32(vcgeq_f32(v, vdupq_n_f32(0.0f)), bits));
+#else
+    uint32_t mask = 0;
+    for (int k = 0; k < 4; k++) mask |= uint32_t(v.v[k] >= 0.0f) << k;
+    return mask;
+#endif
+  }
+};
+
+#if defined(PSIMD_AVX)
+struct Wide8 {
+  using V = __m256;
+  static constexpr size_t width = 8;
+
+  static V load(const float *p) { return _mm256_loadu_ps(p); }
+
+  static V splat(float s) { return _mm256_set1_ps(s); }
+
+  static V add(V a, V b) { return _mm256_add_ps(a, b); }
+
+  static V min(V a, V b) { return _mm256_min_ps(a, b); }
+
+  static V madd(V a, V b, V c) {
+#if defined(PSIMD_FMA)
+    return _mm256_fmadd_ps(a, b, c);
+#else
+    return _mm256_add_ps(_mm256_mul_ps(a, b), c);
+#endif
+  }
+
+  static uint32_t visibleMask(V v) {
+    return uint32_t(_mm256_movemask_ps(_mm256_cmp_ps(v, _mm256_setzero_ps(), _CMP_GE_OQ)));
+  }
+};
+#endif
+
+/**
+ * Frustum planes splatted across lanes, with the absolute normals for boxes
+ */
+template<typename W>
+struct Planes {
+  using V = typename W::V;
+  V nx[6], ny[6], nz[6], d[6];
+  V ax[6], ay[6], az[6];
+
+  explicit Planes(const Frustum &frustum) {
+    for (int p = 0; p < 6; p++) {
+      const float4 plane = frustum.planes[p];
+      nx[p] = W::splat(plane.x), ny[p] = W::splat(plane.y), nz[p] = W::splat(plane.z), d[p] = W::splat(plane.w);
+      ax[p] = W::splat(std::abs(plane.x)), ay[p] = W::splat(std::abs(plane.y)), az[p] = W::splat(std::abs(plane.z));
+    }
+  }
+};
+
+/*
+ * A volume is visible if its largest signed distance to each plane is >= 0,
+ * so the tests keep the minimum over the planes and compare once at the end
+ */
+template<typename W>
+inline uint32_t sphereMask(const Planes<W> &planes, const SphereArrays &s, size_t i) {
+  using V = typename W::V;
+  const V x = W::load(s.x + i), y = W::load(s.y + i), z = W::load(s.z + i), r = W::load(s.radius + i);
+
+  V distance = W::splat(INFINITY);
+  for (int p = 0; p < 6; p++) {
+    const V d = W::madd(planes.nx[p], x, W::madd(planes.ny[p], y, W::madd(planes.nz[p], z, W::add(planes.d[p], r))));
+    distance = W::min(distance, d);
+  }
+  return W::visibleMask(distance);
+}
+
+template<typename W>
+inline uint32_t boxMask(const Planes<W> &planes, const BoxArrays &b, size_t i) {
+  using V = typename W::V;
+  const V x = W::load(b.x + i), y = W::load(b.y + i), z = W::load(b.z + i);
+  const V ex = W::load(b.extentX + i), ey = W::load(b.extentY + i), ez = W::load(b.extentZ + i);
+
+  V distance = W::splat(INFINITY);
+  for (int p = 0; p < 6; p++) {
+    // Distance of the box corner furthest along the plane normal
+    V d = W::madd(planes.ax[p], ex, W::madd(planes.ay[p], ey, W::madd(planes.az[p], ez, planes.d[p])));
+    d = W::madd(planes.nx[p], x, W::madd(planes.ny[p], y, W::madd(planes.nz[p], z, d)));
+    distance = W::min(distance, d);
+  }
+  return W::visibleMask(distance);
+}
+
+/**
+ * Appends the lanes set in mask to the visible list. Every lane is written
+ * and the count only advances for visible ones, so there are no branches on
+ * the (unpredictable) visibility.
+ */
+inline size_t append(uint32_t mask, size_t first, size_t width, uint32_t *visible, size_t n) {
+  for (size_t k = 0; k < width; k++) {
+    visible[n] = uint32_t(first + k);
+    n += (mask >> k) & 1;
+  }
+  return n;
+}
+
+template<typename W, typename Volumes, typename Test>
+inline size_t cullBlocks(const Frustum &frustum, const Volumes &volumes, size_t &i, size_t count, uint32_t *visible,
+                         size_t n, Test test) {
+  const Planes<W> planes(frustum);
+  for (; i + W::width <= count; i += W::width) n = append(test(planes, volumes, i), i, W::width, visible, n);
+  return n;
+}
+}
+
+Frustum extractFrustum(const float4x4 &viewProjection) {
+  /*
+   * A point is inside when -w <= x, y <= w and 0 <= z <= w in clip space, each
+   * of those is a plane equation over the rows of the matrix
+   */
+  const float4x4 rows = transpose(viewProjection);
+  const float4 r0 = rows.columns[0], r1 = rows.columns[1], r2 = rows.columns[2], r3 = rows.columns[3];
+
+  Frustum frustum;
+  frustum.planes[0] = r3 + r0; // Left
+  frustum.planes[1] = r3 - r0; // Right
+  frustum.planes[2] = r3 + r1; // Bottom
+  frustum.planes[3] = r3 - r1; // Top
+  frustum.planes[4] = r2;      // Near
+  frustum.planes[5] = r3 - r2; // Far
+  for (float4 &plane: frustum.planes) plane /= length(make_float3(plane));
+  return frustum;
+}
+
+bool isSphereVisible(const Frustum &frustum, float3 center, float radius) {
+  for (const float4 &plane: frustum.planes) {
+    if (plane.x * center.x + plane.y * center.y + plane.z * center.z + plane.w < -radius) return false;
+  }
+  return true;
+}
+
+bool isBoxVisible(const Frustum &frustum, float3 center, float3 extent) {
+  for (const float4 &plane: frustum.planes) {
+    const float r = std::abs(plane.x) * extent.x + std::abs(plane.y) * extent.y + std::abs(plane.z) * extent.z;
+    if (plane.x * center.x + plane.y * center.y + plane.z * center.z + plane.w < -r) return false;
+  }
+  return true;
+}
+
+size_t cullSpheres(const Frustum &frustum, const SphereArrays &spheres, size_t count, uint32_t *visible) {
+  size_t i = 0, n = 0;
+#if defined(PSIMD_AVX)
+  n = cullBlocks<Wide8>(frustum, spheres, i, count, visible, n, sphereMask<Wide8>);
+#endif
+  n = cullBlocks<Wide4>(frustum, spheres, i, count, visible, n, sphereMask<Wide4>);
+
+  for (; i < count; i++) {
+    visible[n] = uint32_t(i);
+    n += isSphereVisible(frustum, {spheres.x[i], spheres.y[i], spheres.z[i]}, spheres.radius[i]);
+  }
+  return n;
+}
+
+size_t cullBoxes(const Frustum &frustum, const BoxArrays &boxes, size_t count, uint32_t *visible) {
+  size_t i = 0, n = 0;
+#if defined(PSIMD_AVX)
+  n = cullBlocks<Wide8>(frustum, boxes, i, count, visible, n, boxMask<Wide8>);
+#endif
+  n = cullBlocks<Wide4>(frustum, boxes, i, count, visible, n, boxMask<Wide4>);
+
+  for (; i < count; i++) {
+    visible[n] = uint32_t(i);
+    n += isBoxVisible(frustum, {boxes.x[i], boxes.y[i], boxes.z[i]}, {boxes.extentX[i], boxes.extentY[i], boxes.extentZ[i]});
+  }
+  return n;
+}
+}
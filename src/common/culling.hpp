@@ -0,0 +1,63 @@
+#ifndef LEARN_METAL_CULLING_HPP
+#define LEARN_METAL_CULLING_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+#include "simd-types.hpp"
+
+/**
+ * View frustum culling of bounding volumes. The batched tests take their
+ * volumes as structure-of-arrays and write out a compact list of the visible
+ * ones, so the caller only touches (uploads, draws) what survives.
+ */
+namespace cull {
+/**
+ * Inward facing planes, normalized so the plane equation is a signed distance
+ */
+struct Frustum {
+  psimd::float4 planes[6]; // Left, right, bottom, top, near, far
+};
+
+/**
+ * Extracts the planes of a view-projection matrix (Gribb and Hartmann), using
+ * the Metal clip space convention (0 <= z <= w). With a model-view-projection
+ * matrix the planes are in object space.
+ */
+Frustum extractFrustum(const psimd::float4x4 &viewProjection);
+
+/**
+ * Conservative tests, a volume is only rejected if it is entirely outside one
+ * of the planes
+ */
+bool isSphereVisible(const Frustum &frustum, psimd::float3 center, float radius);
+
+bool isBoxVisible(const Frustum &frustum, psimd::float3 center, psimd::float3 extent);
+
+/**
+ * Bounding spheres, each pointer refers to an array of count floats
+ */
+struct SphereArrays {
+  const float *x, *y, *z;
+  const float *radius;
+};
+
+/**
+ * Axis aligned boxes as center and half extent
+ */
+struct BoxArrays {
+  const float *x, *y, *z;
+  const float *extentX, *extentY, *extentZ;
+};
+
+/**
+ * Writes the indices of the visible volumes to visible, in order, and returns
+ * how many there are. visible must hold count entries. Tests eight volumes at
+ * a time with AVX, four with SSE/NEON.
+ */
+size_t cullSpheres(const Frustum &frustum, const SphereArrays &spheres, size_t count, uint32_t *visible);
+
+size_t cullBoxes(const Frustum &frustum, const BoxArrays &boxes, size_t count, uint32_t *visible);
+}
+
+#endif //LEARN_METAL_CULLING_HPP
@@ -0,0 +1,70 @@
+#include "frame-pacer.hpp"
+
+#include <algorithm>
+
+namespace gfx {
+namespace {
+double toMilliseconds(FramePacer::Clock::duration duration) {
+  return std::chrono::duration<double, std::milli>(duration).count();
+}
+}
+
+FramePacer::FramePacer(size_t framesInFlight, Clock::duration timeout)
+  : m_framesInFlight(std::clamp<size_t>(framesInFlight, 1, maxFramesInFlight)),
+    m_timeout(timeout),
+    m_slots(std::ptrdiff_t(m_framesInFlight)) {
+}
+
+FramePacer::~FramePacer() {
+  // Completion handlers point back at us, and only let go of us with the mutex
+  std::unique_lock lock(m_mutex);
+  m_completed.wait(lock, [this] { return m_submitted.load(std::memory_order_acquire) == 0; });
+}
+
+bool FramePacer::beginFrame() {
+  const Clock::time_point start = Clock::now();
+  const size_t ahead = m_submitted.load(std::memory_order_acquire);
+  const bool acquired = m_slots.try_acquire_for(m_timeout);
+  const Clock::time_point end = Clock::now();
+  if (acquired) m_frameStarts.push_back(end);
+
+  std::lock_guard lock(m_mutex);
+  m_stats.frames++;
+  if (!acquired) m_stats.timeouts++;
+  if (m_recordSamples) {
+    m_stats.waitMs.push_back(toMilliseconds(end - start));
+    m_stats.ahead.push_back(double(ahead));
+  }
+  return acquired;
+}
+
+void FramePacer::endFrame(CommandBuffer &commandBuffer) {
+  const Clock::time_point start = m_frameStarts.front();
+  m_frameStarts.pop_front();
+
+  m_submitted.fetch_add(1, std::memory_order_acq_rel);
+  commandBuffer.addCompletedHandler([this, start] {
+    // All under the lock: once the count reaches zero the destructor may run as soon as we unlock
+    std::lock_guard lock(m_mutex);
+    if (m_recordSamples) m_stats.latencyMs.push_back(toMilliseconds(Clock::now() - start));
+    m_slots.release();
+    m_submitted.fetch_sub(1, std::memory_order_acq_rel);
+    m_completed.notify_all();
+  });
+}
+
+FramePacer::Stats FramePacer::stats() const {
+  std::lock_guard lock(m_mutex);
+  return m_stats;
+}
+
+void FramePacer::setRecordSamples(bool record) {
+  std::lock_guard lock(m_mutex);
+  m_recordSamples = record;
+}
+
+void FramePacer::resetStats() {
+  std::lock_guard lock(m_mutex);
+  m_stats = {};
+}
+}
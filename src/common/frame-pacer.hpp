@@ -0,0 +1,99 @@
+#ifndef LEARN_METAL_FRAME_PACER_HPP
+#define LEARN_METAL_FRAME_PACER_HPP
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <semaphore>
+#include <vector>
+
+#include "render-backend.hpp"
+
+namespace gfx {
+/**
+ * Limits how far the CPU runs ahead of the GPU. A frame takes a slot when
+ * the CPU starts on it and gives it back once its command buffer completes,
+ * so per-frame resources indexed by frame (constants, instance copies) are
+ * never written while the GPU may still read them. More frames in flight
+ * buy throughput with latency, the stats measure both sides.
+ *
+ * beginFrame is called on the render thread, completion handlers may run on
+ * any thread.
+ */
+class FramePacer {
+public:
+  using Clock = std::chrono::steady_clock;
+
+  static constexpr size_t maxFramesInFlight = 16;
+
+  struct Stats {
+    uint64_t frames = 0;
+    uint64_t timeouts = 0;          // beginFrame calls that gave up waiting
+
+    // Samples, only recorded after setRecordSamples(true)
+    std::vector<double> waitMs;     // Per frame, time blocked in beginFrame
+    std::vector<double> ahead;      // Per frame, frames submitted but not completed when it began
+    std::vector<double> latencyMs;  // Per completed frame, from beginFrame to GPU completion
+  };
+
+  /**
+   * framesInFlight is clamped to [1, maxFramesInFlight]
+   */
+  explicit FramePacer(size_t framesInFlight, Clock::duration timeout = std::chrono::seconds(1));
+
+  /**
+   * Waits for the frames submitted before it
+   */
+  ~FramePacer();
+
+  FramePacer(const FramePacer &) = delete;
+
+  FramePacer &operator=(const FramePacer &) = delete;
+
+  /**
+   * Blocks until a slot is free. Returns false if none was freed within the
+   * timeout (the GPU is stuck or far behind), the frame should be skipped.
+   */
+  bool beginFrame();
+
+  /**
+   * Frees the slot of the oldest frame begun once commandBuffer completes.
+   * Must be called before the command buffer is committed, once per
+   * successful beginFrame, in the same order.
+   */
+  void endFrame(CommandBuffer &commandBuffer);
+
+  size_t framesInFlight() const { return m_framesInFlight; }
+
+  /**
+   * Frames submitted and not completed yet
+   */
+  size_t submitted() const { return m_submitted.load(std::memory_order_acquire); }
+
+  /**
+   * Records per-frame samples in the stats, off by default so a long running
+   * app doesn't accumulate them. The counters are always kept.
+   */
+  void setRecordSamples(bool record);
+
+  Stats stats() const;
+
+  void resetStats();
+
+private:
+  size_t m_framesInFlight;
+  Clock::duration m_timeout;
+  std::counting_semaphore<maxFramesInFlight> m_slots;
+  std::atomic<size_t> m_submitted = 0; // Decremented under the mutex
+  std::deque<Clock::time_point> m_frameStarts; // Of frames begun but not submitted, oldest first
+
+  mutable std::mutex m_mutex; // Guards the stats, and completion
+  std::condition_variable m_completed;
+  bool m_recordSamples = false;
+  Stats m_stats;
+};
+}
+
+#endif //LEARN_METAL_FRAME_PACER_HPP
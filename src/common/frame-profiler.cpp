@@ -0,0 +1,41 @@
+#include "frame-profiler.hpp"
+
+namespace {
+double toMilliseconds(FrameProfiler::Clock::duration duration) {
+  return std::chrono::duration<double, std::milli>(duration).count();
+}
+}
+
+void FrameProfiler::beginFrame() {
+  m_current.assign(m_stages.size(), 0.0);
+  m_frameStart = Clock::now();
+}
+
+void FrameProfiler::endFrame() {
+  m_frameTimes.push_back(toMilliseconds(Clock::now() - m_frameStart));
+
+  // Stages that did not run this frame get a zero sample, so all stages have one sample per frame
+  m_current.resize(m_stages.size(), 0.0);
+  for (size_t i = 0; i < m_stages.size(); i++) {
+    m_stages[i].samples.resize(m_frameTimes.size() - 1, 0.0);
+    m_stages[i].samples.push_back(m_current[i]);
+  }
+}
+
+void FrameProfiler::record(const char *stage, Clock::duration duration) {
+  std::lock_guard lock(m_mutex);
+
+  size_t idx = 0;
+  while (idx < m_stages.size() && m_stages[idx].name != stage) idx++;
+
+  if (idx == m_stages.size()) m_stages.push_back({stage, {}});
+  if (m_current.size() < m_stages.size()) m_current.resize(m_stages.size(), 0.0);
+
+  m_current[idx] += toMilliseconds(duration);
+}
+
+void FrameProfiler::reset() {
+  m_stages.clear();
+  m_current.clear();
+  m_frameTimes.clear();
+}
@@ -0,0 +1,69 @@
+#ifndef LEARN_METAL_FRAME_PROFILER_HPP
+#define LEARN_METAL_FRAME_PROFILER_HPP
+
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/**
+ * Collects CPU time per frame and per named stage of a frame. Renderers mark
+ * their stages with FrameProfiler::Scope, which does nothing when no profiler
+ * is attached, so the instrumentation can stay in the draw loop.
+ */
+class FrameProfiler {
+public:
+  using Clock = std::chrono::high_resolution_clock;
+
+  struct Stage {
+    std::string name;
+    std::vector<double> samples; // Milliseconds, one per frame
+  };
+
+  /**
+   * Times a stage from construction to destruction
+   */
+  class Scope {
+  public:
+    Scope(FrameProfiler *profiler, const char *stage)
+      : m_profiler(profiler), m_stage(stage), m_start(profiler ? Clock::now() : Clock::time_point()) {}
+
+    ~Scope() {
+      if (m_profiler) m_profiler->record(m_stage, Clock::now() - m_start);
+    }
+
+    Scope(const Scope &) = delete;
+
+    Scope &operator=(const Scope &) = delete;
+
+  private:
+    FrameProfiler *m_profiler;
+    const char *m_stage;
+    Clock::time_point m_start;
+  };
+
+  void beginFrame();
+
+  void endFrame();
+
+  /**
+   * Adds time to a stage of the current frame, stages are created on first use.
+   * Safe to call from any thread, stages may run on jobs.
+   */
+  void record(const char *stage, Clock::duration duration);
+
+  const std::vector<Stage> &stages() const { return m_stages; }
+
+  const std::vector<double> &frameTimes() const { return m_frameTimes; }
+
+  void reset();
+
+private:
+  std::vector<Stage> m_stages;
+  std::vector<double> m_current;
+  std::vector<double> m_frameTimes;
+  Clock::time_point m_frameStart;
+  std::mutex m_mutex;
+};
+
+#endif //LEARN_METAL_FRAME_PROFILER_HPP
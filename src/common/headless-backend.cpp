@@ -0,0 +1,620 @@
+#include "headless-backend.hpp"
+
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <variant>
+
+#include "pipeline-cache.hpp"
+
+namespace gfx {
+namespace detail {
+std::string functionKey(const std::string &library, const std::string &name) {
+  std::string key = library;
+  key += ':';
+  key += name;
+  return key;
+}
+
+/**
+ * Vertex functions registered for a vertex layout are keyed by the layout too
+ */
+std::string functionKey(const std::string &library, const std::string &name, const VertexDescriptor &layout) {
+  std::string key = functionKey(library, name);
+  auto append = [&](char separator, size_t value) {
+    key += separator;
+    key += std::to_string(value);
+  };
+  for (const VertexAttribute &attrib: layout.attributes) {
+    append(':', size_t(attrib.format));
+    append(',', attrib.offset);
+    append(',', attrib.bufferIndex);
+  }
+  for (const VertexBufferLayout &buffer: layout.layouts) {
+    append(':', buffer.bufferIndex);
+    append(',', buffer.stride);
+  }
+  return key;
+}
+
+class HeadlessBuffer : public Buffer {
+public:
+  explicit HeadlessBuffer(size_t length) : m_data(length) {}
+
+  void *contents() override { return m_data.data(); }
+
+  size_t length() const override { return m_data.size(); }
+
+  void didModifyRange(size_t, size_t) override {}
+
+  const std::byte *data() const { return m_data.data(); }
+
+private:
+  std::vector<std::byte> m_data;
+};
+
+/**
+ * Completes command buffers in commit order on a thread of its own, each
+ * taking a fixed time after the previous one
+ */
+class GpuTimeline {
+public:
+  using Clock = std::chrono::steady_clock;
+  using Handlers = std::vector<std::function<void()>>;
+
+  explicit GpuTimeline(std::chrono::nanoseconds gpuTime) : m_gpuTime(gpuTime), m_thread([this] { run(); }) {}
+
+  ~GpuTimeline() {
+    {
+      std::lock_guard lock(m_mutex);
+      m_quit = true;
+    }
+    m_wake.notify_one();
+    m_thread.join();
+  }
+
+  void submit(Handlers handlers) {
+    {
+      std::lock_guard lock(m_mutex);
+      m_lastDone = std::max(m_lastDone, Clock::now()) + m_gpuTime;
+      m_pending.push_back({m_lastDone, std::move(handlers)});
+    }
+    m_wake.notify_one();
+  }
+
+private:
+  struct Submission {
+    Clock::time_point done;
+    Handlers handlers;
+  };
+
+  std::chrono::nanoseconds m_gpuTime;
+  std::mutex m_mutex;
+  std::condition_variable m_wake;
+  std::deque<Submission> m_pending;
+  Clock::time_point m_lastDone;
+  bool m_quit = false;
+  std::thread m_thread;
+
+  void run() {
+    std::unique_lock lock(m_mutex);
+    while (true) {
+      m_wake.wait(lock, [this] { return m_quit || !m_pending.empty(); });
+      if (m_pending.empty()) return;
+
+      // Until the command buffer's GPU time is up, pending work is finished right away when quitting
+      m_wake.wait_until(lock, m_pending.front().done, [this] { return m_quit; });
+      Handlers handlers = std::move(m_pending.front().handlers);
+      m_pending.pop_front();
+
+      lock.unlock();
+      for (auto &handler: handlers) handler();
+      lock.lock();
+    }
+  }
+};
+
+class HeadlessRenderPipelineState : public RenderPipelineState {
+public:
+  RenderPipelineDescriptor desc;
+  CpuVertexFunction vertexFunction;
+  CpuFragmentFunction fragmentFunction;
+};
+
+class HeadlessDepthStencilState : public DepthStencilState {
+public:
+  DepthStencilDescriptor desc;
+};
+
+/**
+ * Stand-in for a binary archive: there's no compiled code to keep, so the
+ * file only lists the hashes of the pipeline keys (see pipeline-cache.hpp)
+ * created with it, one per line in hex. Enough to check which pipelines a
+ * run would have found in a real archive.
+ */
+class HeadlessPipelineArchive : public PipelineArchive {
+public:
+  static constexpr const char *header = "learn-metal pipeline archive 1";
+
+  explicit HeadlessPipelineArchive(std::string path) : m_path(std::move(path)) {}
+
+  bool load(std::string *error) {
+    std::ifstream in(m_path);
+    if (!in) return true; // No file yet
+
+    std::string line;
+    if (!std::getline(in, line) || line != header) {
+      if (error) *error = m_path + " is not a pipeline archive";
+      return false;
+    }
+    while (std::getline(in, line)) {
+      if (!line.empty()) m_hashes.insert(strtoull(line.c_str(), nullptr, 16));
+    }
+    return true;
+  }
+
+  /**
+   * Counts a hit if the pipeline was archived before, adds it otherwise
+   */
+  void lookup(const RenderPipelineDescriptor &desc) {
+    if (m_hashes.insert(hashKey(pipelineKey(desc))).second) {
+      m_stats.misses++;
+    } else {
+      m_stats.hits++;
+    }
+  }
+
+  bool serialize(std::string *error) override {
+    std::ofstream out(m_path, std::ios::trunc);
+    out << header << "\n";
+    char hex[17];
+    for (uint64_t hash: m_hashes) {
+      snprintf(hex, sizeof(hex), "%016llx", static_cast<unsigned long long>(hash));
+      out << hex << "\n";
+    }
+    if (!out) {
+      if (error) *error = "Failed to write " + m_path;
+      return false;
+    }
+    return true;
+  }
+
+  const Stats &stats() const override { return m_stats; }
+
+private:
+  std::string m_path;
+  std::set<uint64_t> m_hashes;
+  Stats m_stats;
+};
+
+/*
+ * Recorded commands
+ */
+namespace cmd {
+struct BeginPass {
+  HeadlessRenderTarget *target;
+};
+
+struct SetPipeline {
+  const HeadlessRenderPipelineState *pso;
+};
+
+struct SetDepthStencil {
+  const HeadlessDepthStencilState *dsso;
+};
+
+struct SetWinding {
+  Winding winding;
+};
+
+struct SetCullMode {
+  CullMode cullMode;
+};
+
+struct SetViewport {
+  Viewport viewport;
+};
+
+struct SetVertexBuffer {
+  const HeadlessBuffer *buffer;
+  size_t offset, index;
+};
+
+// Inline data lives in the command buffer's byte arena
+struct SetVertexBytes {
+  size_t arenaOffset, index;
+};
+
+struct Draw {
+  size_t vertexStart, vertexCount, instanceCount;
+};
+
+struct DrawIndexed {
+  size_t indexCount;
+  IndexType indexType;
+  const HeadlessBuffer *indexBuffer;
+  size_t indexBufferOffset, instanceCount;
+};
+
+struct Present {
+  HeadlessRenderTarget *target;
+};
+
+// Next sub-encoder of a parallel pass: state is reset, the target is kept
+struct ContinuePass {};
+}
+
+using Command = std::variant<
+  cmd::BeginPass, cmd::SetPipeline, cmd::SetDepthStencil, cmd::SetWinding, cmd::SetCullMode,
+  cmd::SetViewport, cmd::SetVertexBuffer, cmd::SetVertexBytes, cmd::Draw, cmd::DrawIndexed, cmd::Present,
+  cmd::ContinuePass
+>;
+
+/**
+ * Command list plus the arena for setVertexBytes data
+ */
+struct CommandList {
+  std::vector<Command> commands;
+  std::vector<std::byte> bytes;
+};
+
+class HeadlessRenderCommandEncoder : public RenderCommandEncoder {
+public:
+  explicit HeadlessRenderCommandEncoder(CommandList &list) : m_list(list) {}
+
+  void setRenderPipelineState(const RenderPipelineState *pso) override {
+    m_list.commands.emplace_back(cmd::SetPipeline{static_cast<const HeadlessRenderPipelineState *>(pso)});
+  }
+
+  void setDepthStencilState(const DepthStencilState *dsso) override {
+    m_list.commands.emplace_back(cmd::SetDepthStencil{static_cast<const HeadlessDepthStencilState *>(dsso)});
+  }
+
+  void setFrontFacingWinding(Winding winding) override {
+    m_list.commands.emplace_back(cmd::SetWinding{winding});
+  }
+
+  void setCullMode(CullMode cullMode) override {
+    m_list.commands.emplace_back(cmd::SetCullMode{cullMode});
+  }
+
+  void setViewport(const Viewport &viewport) override {
+    m_list.commands.emplace_back(cmd::SetViewport{viewport});
+  }
+
+  void setVertexBuffer(const Buffer *buffer, size_t offset, size_t index) override {
+    m_list.commands.emplace_back(cmd::SetVertexBuffer{static_cast<const HeadlessBuffer *>(buffer), offset, index});
+  }
+
+  void setVertexBytes(const void *bytes, size_t length, size_t index) override {
+    // Keep 16 byte alignment so the data can be read as SIMD types
+    size_t offset = (m_list.bytes.size() + 15) & ~size_t(15);
+    m_list.bytes.resize(offset + length);
+    std::memcpy(m_list.bytes.data() + offset, bytes, length);
+    m_list.commands.emplace_back(cmd::SetVertexBytes{offset, index});
+  }
+
+  void drawPrimitives(
+    PrimitiveType,
+    size_t vertexStart,
+    size_t vertexCount,
+    size_t instanceCount
+  ) override {
+    m_list.commands.emplace_back(cmd::Draw{vertexStart, vertexCount, instanceCount});
+  }
+
+  void drawIndexedPrimitives(
+    PrimitiveType,
+    size_t indexCount,
+    IndexType indexType,
+    const Buffer *indexBuffer,
+    size_t indexBufferOffset,
+    size_t instanceCount
+  ) override {
+    m_list.commands.emplace_back(cmd::DrawIndexed{
+      indexCount, indexType, static_cast<const HeadlessBuffer *>(indexBuffer), indexBufferOffset, instanceCount
+    });
+  }
+
+  void endEncoding() override {}
+
+private:
+  CommandList &m_list;
+};
+
+/**
+ * Each sub-encoder records into a list of its own, so threads don't share
+ * anything. The lists are appended to the command buffer's in creation order
+ * when the pass ends.
+ */
+class HeadlessParallelRenderCommandEncoder : public ParallelRenderCommandEncoder {
+public:
+  explicit HeadlessParallelRenderCommandEncoder(CommandList &list) : m_list(list) {}
+
+  RenderCommandEncoder *renderCommandEncoder() override {
+    m_lists.push_back(std::make_unique<CommandList>());
+    m_encoders.push_back(std::make_unique<HeadlessRenderCommandEncoder>(*m_lists.back()));
+    return m_encoders.back().get();
+  }
+
+  void endEncoding() override {
+    size_t commandCount = m_list.commands.size(), byteCount = m_list.bytes.size();
+    for (const auto &list: m_lists) commandCount += list->commands.size() + 1, byteCount += list->bytes.size() + 15;
+    m_list.commands.reserve(commandCount);
+    m_list.bytes.reserve(byteCount);
+
+    for (const auto &list: m_lists) {
+      m_list.commands.emplace_back(cmd::ContinuePass{});
+
+      // setVertexBytes offsets move with the sub-encoder's arena, which stays 16 byte aligned
+      const size_t base = (m_list.bytes.size() + 15) & ~size_t(15), first = m_list.commands.size();
+      m_list.bytes.resize(base);
+      m_list.bytes.insert(m_list.bytes.end(), list->bytes.begin(), list->bytes.end());
+      m_list.commands.insert(m_list.commands.end(), list->commands.begin(), list->commands.end());
+      if (base == 0) continue;
+      for (size_t i = first; i < m_list.commands.size(); i++) {
+        if (auto *c = std::get_if<cmd::SetVertexBytes>(&m_list.commands[i])) c->arenaOffset += base;
+      }
+    }
+    m_lists.clear();
+  }
+
+private:
+  CommandList &m_list;
+  std::vector<std::unique_ptr<CommandList>> m_lists;
+  std::vector<std::unique_ptr<HeadlessRenderCommandEncoder>> m_encoders;
+};
+
+/**
+ * Records commands, executes them on commit
+ */
+class HeadlessCommandBuffer : public CommandBuffer {
+public:
+  explicit HeadlessCommandBuffer(HeadlessDevice &device) : m_device(device) {}
+
+  RenderCommandEncoder *renderCommandEncoder(RenderTarget &target) override {
+    m_list.commands.emplace_back(cmd::BeginPass{static_cast<HeadlessRenderTarget *>(&target)});
+    m_encoders.push_back(std::make_unique<HeadlessRenderCommandEncoder>(m_list));
+    return m_encoders.back().get();
+  }
+
+  ParallelRenderCommandEncoder *parallelRenderCommandEncoder(RenderTarget &target) override {
+    m_list.commands.emplace_back(cmd::BeginPass{static_cast<HeadlessRenderTarget *>(&target)});
+    m_parallelEncoders.push_back(std::make_unique<HeadlessParallelRenderCommandEncoder>(m_list));
+    return m_parallelEncoders.back().get();
+  }
+
+  void present(RenderTarget &target) override {
+    m_list.commands.emplace_back(cmd::Present{static_cast<HeadlessRenderTarget *>(&target)});
+  }
+
+  void addCompletedHandler(std::function<void()> handler) override {
+    m_completedHandlers.push_back(std::move(handler));
+  }
+
+  void commit() override {
+    HeadlessStats &stats = m_device.m_stats;
+    stats.commandBuffers++;
+    stats.commands += m_list.commands.size();
+
+    execute();
+
+    if (m_device.m_timeline) {
+      m_device.m_timeline->submit(std::move(m_completedHandlers));
+    } else {
+      for (auto &handler: m_completedHandlers) handler();
+    }
+    m_completedHandlers.clear();
+  }
+
+private:
+  HeadlessDevice &m_device;
+  CommandList m_list;
+  std::vector<std::unique_ptr<HeadlessRenderCommandEncoder>> m_encoders;
+  std::vector<std::unique_ptr<HeadlessParallelRenderCommandEncoder>> m_parallelEncoders;
+  std::vector<std::function<void()>> m_completedHandlers;
+
+  /**
+   * Replays the command list, tracking encoder state like the GPU would
+   */
+  void execute() {
+    const bool rasterize = m_device.mode() == HeadlessDevice::Mode::Rasterize;
+
+    HeadlessRenderTarget *target = nullptr;
+    const HeadlessRenderPipelineState *pso = nullptr;
+    raster::RasterState state;
+    ShaderBindings bindings;
+    std::vector<uint32_t> indices;
+
+    // Nothing carries over from one encoder to the next, as on the GPU
+    auto resetState = [&] {
+      pso = nullptr;
+      state = {};
+      state.viewport = {0.0, 0.0, double(target->width()), double(target->height()), 0.0, 1.0};
+      bindings = {};
+    };
+
+    auto drawState = [&] {
+      return target && target->image() && pso && pso->vertexFunction && pso->fragmentFunction;
+    };
+
+    for (const Command &command: m_list.commands) {
+      if (auto *c = std::get_if<cmd::BeginPass>(&command)) {
+        // New pass, encoder state and bindings are reset and the target cleared
+        target = c->target;
+        resetState();
+        if (rasterize && target->image()) target->image()->clear(target->clearColor, target->clearDepth);
+      } else if (std::get_if<cmd::ContinuePass>(&command)) {
+        resetState();
+      } else if (auto *c = std::get_if<cmd::SetPipeline>(&command)) {
+        pso = c->pso;
+      } else if (auto *c = std::get_if<cmd::SetDepthStencil>(&command)) {
+        state.depthCompare = c->dsso->desc.depthCompareFunction;
+        state.depthWrite = c->dsso->desc.depthWriteEnabled;
+      } else if (auto *c = std::get_if<cmd::SetWinding>(&command)) {
+        state.frontFacingWinding = c->winding;
+      } else if (auto *c = std::get_if<cmd::SetCullMode>(&command)) {
+        state.cullMode = c->cullMode;
+      } else if (auto *c = std::get_if<cmd::SetViewport>(&command)) {
+        state.viewport = c->viewport;
+      } else if (auto *c = std::get_if<cmd::SetVertexBuffer>(&command)) {
+        bindings.vertexBuffers[c->index] = c->buffer ? c->buffer->data() + c->offset : nullptr;
+      } else if (auto *c = std::get_if<cmd::SetVertexBytes>(&command)) {
+        bindings.vertexBuffers[c->index] = m_list.bytes.data() + c->arenaOffset;
+      } else if (auto *c = std::get_if<cmd::Draw>(&command)) {
+        m_device.m_stats.drawCalls++;
+        if (!rasterize || !drawState()) continue;
+
+        auto vertexFn = [&](uint32_t vertexId, uint32_t instanceId) {
+          return pso->vertexFunction(bindings, vertexId, instanceId);
+        };
+        m_device.m_rasterizer.draw(
+          *target->image(), state, vertexFn, pso->fragmentFunction,
+          uint32_t(c->vertexStart), uint32_t(c->vertexCount), uint32_t(c->instanceCount)
+        );
+      } else if (auto *c = std::get_if<cmd::DrawIndexed>(&command)) {
+        m_device.m_stats.drawCalls++;
+        if (!rasterize || !drawState()) continue;
+
+        const std::byte *indexData = c->indexBuffer->data() + c->indexBufferOffset;
+        const uint32_t *indexPtr = reinterpret_cast<const uint32_t *>(indexData);
+        if (c->indexType == IndexType::UInt16) {
+          auto *indices16 = reinterpret_cast<const uint16_t *>(indexData);
+          indices.assign(indices16, indices16 + c->indexCount);
+          indexPtr = indices.data();
+        }
+
+        auto vertexFn = [&](uint32_t vertexId, uint32_t instanceId) {
+          return pso->vertexFunction(bindings, vertexId, instanceId);
+        };
+        m_device.m_rasterizer.drawIndexed(
+          *target->image(), state, vertexFn, pso->fragmentFunction,
+          indexPtr, c->indexCount, uint32_t(c->instanceCount)
+        );
+      } else if (auto *c = std::get_if<cmd::Present>(&command)) {
+        c->target->presentCount++;
+      }
+    }
+  }
+};
+
+class HeadlessCommandQueue : public CommandQueue {
+public:
+  explicit HeadlessCommandQueue(HeadlessDevice &device) : m_device(device) {}
+
+  std::unique_ptr<CommandBuffer> commandBuffer() override {
+    return std::make_unique<HeadlessCommandBuffer>(m_device);
+  }
+
+private:
+  HeadlessDevice &m_device;
+};
+}
+
+using namespace detail;
+
+/*
+ * Render target
+ */
+HeadlessRenderTarget::HeadlessRenderTarget(uint32_t width, uint32_t height, bool allocateImage)
+  : m_width(width), m_height(height) {
+  if (allocateImage) m_image.emplace(width, height);
+}
+
+void HeadlessRenderTarget::resize(uint32_t width, uint32_t height) {
+  m_width = width;
+  m_height = height;
+  if (m_image) m_image.emplace(width, height);
+}
+
+/*
+ * Device
+ */
+HeadlessDevice::HeadlessDevice(Mode mode) : m_mode(mode) {
+}
+
+HeadlessDevice::~HeadlessDevice() = default;
+
+void HeadlessDevice::setGpuTime(std::chrono::nanoseconds gpuTime) {
+  m_timeline.reset();
+  if (gpuTime.count() > 0) m_timeline = std::make_unique<GpuTimeline>(gpuTime);
+}
+
+void HeadlessDevice::registerVertexFunction(const std::string &library, const std::string &name, CpuVertexFunction fn) {
+  m_vertexFunctions[functionKey(library, name)] = std::move(fn);
+}
+
+void HeadlessDevice::registerVertexFunction(
+  const std::string &library,
+  const std::string &name,
+  const VertexDescriptor &layout,
+  CpuVertexFunction fn
+) {
+  m_vertexFunctions[functionKey(library, name, layout)] = std::move(fn);
+}
+
+void HeadlessDevice::registerFragmentFunction(
+  const std::string &library,
+  const std::string &name,
+  CpuFragmentFunction fn
+) {
+  m_fragmentFunctions[functionKey(library, name)] = std::move(fn);
+}
+
+std::unique_ptr<Buffer> HeadlessDevice::newBuffer(size_t length, StorageMode) {
+  return std::make_unique<HeadlessBuffer>(length);
+}
+
+std::unique_ptr<RenderPipelineState> HeadlessDevice::newRenderPipelineState(
+  const RenderPipelineDescriptor &desc,
+  std::string *error
+) {
+  auto pso = std::make_unique<HeadlessRenderPipelineState>();
+  pso->desc = desc;
+  pso->desc.archive = nullptr;
+
+  if (m_mode == Mode::Null) {
+    if (desc.archive) static_cast<HeadlessPipelineArchive *>(desc.archive)->lookup(desc);
+    return pso;
+  }
+
+  // The version for the pipeline's vertex layout if there's one, the layout independent one otherwise
+  auto vertexFn = m_vertexFunctions.find(functionKey(desc.library, desc.vertexFunction, desc.vertexDescriptor));
+  if (vertexFn == m_vertexFunctions.end()) vertexFn = m_vertexFunctions.find(functionKey(desc.library, desc.vertexFunction));
+  auto fragmentFn = m_fragmentFunctions.find(functionKey(desc.library, desc.fragmentFunction));
+  if (vertexFn == m_vertexFunctions.end() || fragmentFn == m_fragmentFunctions.end()) {
+    if (error) {
+      *error = "No CPU implementation registered for " + desc.library + ": " +
+               desc.vertexFunction + ", " + desc.fragmentFunction;
+    }
+    return nullptr;
+  }
+
+  pso->vertexFunction = vertexFn->second;
+  pso->fragmentFunction = fragmentFn->second;
+  if (desc.archive) static_cast<HeadlessPipelineArchive *>(desc.archive)->lookup(desc);
+  return pso;
+}
+
+std::unique_ptr<DepthStencilState> HeadlessDevice::newDepthStencilState(const DepthStencilDescriptor &desc) {
+  auto dsso = std::make_unique<HeadlessDepthStencilState>();
+  dsso->desc = desc;
+  return dsso;
+}
+
+std::unique_ptr<PipelineArchive> HeadlessDevice::newPipelineArchive(const std::string &path, std::string *error) {
+  auto archive = std::make_unique<HeadlessPipelineArchive>(path);
+  if (!archive->load(error)) return nullptr;
+  return archive;
+}
+
+std::unique_ptr<CommandQueue> HeadlessDevice::newCommandQueue() {
+  return std::make_unique<HeadlessCommandQueue>(*this);
+}
+}
@@ -0,0 +1,167 @@
+#ifndef LEARN_METAL_HEADLESS_BACKEND_HPP
+#define LEARN_METAL_HEADLESS_BACKEND_HPP
+
+#include <chrono>
+#include <map>
+#include <memory>
+#include <optional>
+
+#include "render-backend.hpp"
+#include "rasterizer.hpp"
+#include "vertex-layout.hpp"
+
+/**
+ * Backend without a GPU. Commands are recorded into plain command lists and,
+ * on commit, either executed with the software rasterizer or dropped (null
+ * mode, to measure CPU submission cost in isolation). Completion handlers run
+ * on the committing thread once the commands have been executed, or later on
+ * a simulated GPU timeline (see HeadlessDevice::setGpuTime).
+ */
+namespace gfx {
+namespace detail {
+class HeadlessCommandBuffer;
+class GpuTimeline;
+}
+
+class HeadlessRenderTarget : public RenderTarget {
+public:
+  /**
+   * Without an image (null mode targets) only the size is tracked
+   */
+  HeadlessRenderTarget(uint32_t width, uint32_t height, bool allocateImage = true);
+
+  uint32_t width() const override { return m_width; }
+
+  uint32_t height() const override { return m_height; }
+
+  PixelFormat colorPixelFormat() const override { return PixelFormat::BGRA8Unorm_sRGB; }
+
+  PixelFormat depthPixelFormat() const override { return PixelFormat::Depth32Float; }
+
+  void resize(uint32_t width, uint32_t height);
+
+  raster::RenderTarget *image() { return m_image ? &*m_image : nullptr; }
+
+  psimd::float4 clearColor = {0.0f, 0.0f, 0.0f, 1.0f};
+  float clearDepth = 1.0f;
+
+  size_t presentCount = 0;
+
+private:
+  uint32_t m_width, m_height;
+  std::optional<raster::RenderTarget> m_image;
+};
+
+/**
+ * Buffers bound to the vertex stage, as seen by a CPU shader
+ */
+struct ShaderBindings {
+  static constexpr size_t maxBuffers = 31;
+
+  const std::byte *vertexBuffers[maxBuffers] = {};
+
+  template<typename T>
+  const T *buffer(size_t index) const { return reinterpret_cast<const T *>(vertexBuffers[index]); }
+};
+
+/**
+ * CPU implementation of a vertex function
+ */
+using CpuVertexFunction = std::function<raster::Varyings(const ShaderBindings &bindings, uint32_t vertexId, uint32_t instanceId)>;
+
+/**
+ * CPU implementation of a fragment function
+ */
+using CpuFragmentFunction = raster::FragmentFunction;
+
+struct HeadlessStats {
+  uint64_t commandBuffers = 0;
+  uint64_t commands = 0;
+  uint64_t drawCalls = 0;
+};
+
+class HeadlessDevice : public Device {
+public:
+  enum class Mode {
+    Rasterize, // Execute draws with the software rasterizer
+    Null,      // Record commands only
+  };
+
+  explicit HeadlessDevice(Mode mode = Mode::Rasterize);
+
+  ~HeadlessDevice() override;
+
+  Mode mode() const { return m_mode; }
+
+  /**
+   * Shader functions are looked up by library and function name when
+   * creating pipelines, in rasterize mode all of them must be registered
+   */
+  void registerVertexFunction(const std::string &library, const std::string &name, CpuVertexFunction fn);
+
+  /**
+   * A version of a vertex function for one vertex layout, picked for
+   * pipelines whose vertex descriptor is exactly that layout. That's how
+   * [[stage_in]] is emulated: each version reads its vertices as the struct
+   * the layout was generated from (see fetchAttribute), without going through
+   * the vertex descriptor.
+   */
+  void registerVertexFunction(
+    const std::string &library,
+    const std::string &name,
+    const VertexDescriptor &layout,
+    CpuVertexFunction fn
+  );
+
+  /**
+   * Same, for vertices of type V read from buffer bufferIndex
+   */
+  template<typename V>
+  void registerVertexFunction(const std::string &library, const std::string &name, size_t bufferIndex, CpuVertexFunction fn) {
+    registerVertexFunction(library, name, vertexDescriptor<V>(bufferIndex), std::move(fn));
+  }
+
+  void registerFragmentFunction(const std::string &library, const std::string &name, CpuFragmentFunction fn);
+
+  std::unique_ptr<Buffer> newBuffer(size_t length, StorageMode storageMode) override;
+
+  std::unique_ptr<RenderPipelineState> newRenderPipelineState(
+    const RenderPipelineDescriptor &desc,
+    std::string *error
+  ) override;
+
+  std::unique_ptr<DepthStencilState> newDepthStencilState(const DepthStencilDescriptor &desc) override;
+
+  /**
+   * A hash-only stand-in, see HeadlessPipelineArchive
+   */
+  std::unique_ptr<PipelineArchive> newPipelineArchive(const std::string &path, std::string *error) override;
+
+  std::unique_ptr<CommandQueue> newCommandQueue() override;
+
+  raster::Rasterizer &rasterizer() { return m_rasterizer; }
+
+  const HeadlessStats &stats() const { return m_stats; }
+
+  /**
+   * Simulated GPU time per command buffer. Above zero, command buffers still
+   * execute on commit, but complete on a timeline thread one after the
+   * other, each gpuTime after the previous one finished (or after its
+   * commit, if the GPU was idle). Lets frame pacing be tested with a GPU
+   * that's slower than the CPU.
+   */
+  void setGpuTime(std::chrono::nanoseconds gpuTime);
+
+private:
+  friend class detail::HeadlessCommandBuffer;
+
+  Mode m_mode;
+  std::map<std::string, CpuVertexFunction> m_vertexFunctions;
+  std::map<std::string, CpuFragmentFunction> m_fragmentFunctions;
+  raster::Rasterizer m_rasterizer;
+  HeadlessStats m_stats;
+  std::unique_ptr<detail::GpuTimeline> m_timeline;
+};
+}
+
+#endif //LEARN_METAL_HEADLESS_BACKEND_HPP
@@ -0,0 +1,99 @@
+#ifndef LEARN_METAL_INSTANCE_BUFFER_HPP
+#define LEARN_METAL_INSTANCE_BUFFER_HPP
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <vector>
+
+#include "render-backend.hpp"
+
+namespace gfx {
+/**
+ * Per-instance data that persists across frames. The authoritative copy lives
+ * on the CPU, with one GPU-visible buffer per frame in flight so a buffer is
+ * never written while the GPU may still be reading it. Modified instances are
+ * tracked per buffer, and uploading a frame only copies the instances that
+ * changed since that buffer was last used.
+ */
+template<typename T>
+class InstanceBuffer {
+public:
+  static constexpr size_t maxCopies = 8;
+
+  InstanceBuffer(Device &device, size_t count, size_t copies)
+    : m_data(count), m_dirtyMask(count, allCopies(copies)) {
+    assert(copies > 0 && copies <= maxCopies);
+
+    m_copies.resize(copies);
+    for (Copy &copy: m_copies) {
+      copy.buffer = device.newBuffer(std::max<size_t>(count, 1) * sizeof(T), StorageMode::Shared);
+      copy.dirty.resize(count);
+      for (size_t i = 0; i < count; i++) copy.dirty[i] = static_cast<uint32_t>(i);
+    }
+  }
+
+  size_t size() const { return m_data.size(); }
+
+  const T &operator[](size_t index) const { return m_data[index]; }
+
+  /**
+   * Returns the instance for writing, marking it dirty in every buffer
+   */
+  T &modify(size_t index) {
+    const uint8_t all = allCopies(m_copies.size());
+    if (m_dirtyMask[index] != all) {
+      for (size_t c = 0; c < m_copies.size(); c++) {
+        if (!(m_dirtyMask[index] & (1u << c))) m_copies[c].dirty.push_back(static_cast<uint32_t>(index));
+      }
+      m_dirtyMask[index] = all;
+    }
+    return m_data[index];
+  }
+
+  void set(size_t index, const T &value) { modify(index) = value; }
+
+  /**
+   * Brings the buffer for a frame up to date and returns it
+   */
+  Buffer *upload(size_t frameIdx) {
+    const size_t c = frameIdx % m_copies.size();
+    Copy &copy = m_copies[c];
+
+    auto *dst = static_cast<T *>(copy.buffer->contents());
+    size_t first = m_data.size(), last = 0;
+    for (uint32_t index: copy.dirty) {
+      memcpy(dst + index, &m_data[index], sizeof(T));
+      m_dirtyMask[index] &= static_cast<uint8_t>(~(1u << c));
+      first = std::min<size_t>(first, index);
+      last = std::max<size_t>(last, index);
+    }
+
+    if (!copy.dirty.empty()) copy.buffer->didModifyRange(first * sizeof(T), (last - first + 1) * sizeof(T));
+
+    m_lastUploadCount = copy.dirty.size();
+    copy.dirty.clear();
+    return copy.buffer.get();
+  }
+
+  /**
+   * Number of instances copied by the last upload
+   */
+  size_t lastUploadCount() const { return m_lastUploadCount; }
+
+private:
+  struct Copy {
+    std::unique_ptr<Buffer> buffer;
+    std::vector<uint32_t> dirty;
+  };
+
+  std::vector<T> m_data;
+  std::vector<uint8_t> m_dirtyMask; // Bit c set: instance is pending upload to copy c
+  std::vector<Copy> m_copies;
+  size_t m_lastUploadCount = 0;
+
+  static uint8_t allCopies(size_t copies) { return static_cast<uint8_t>((1u << copies) - 1); }
+};
+}
+
+#endif //LEARN_METAL_INSTANCE_BUFFER_HPP
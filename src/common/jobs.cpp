@@ -0,0 +1,343 @@
+#include "jobs.hpp"
+
+#include <algorithm>
+#include <memory>
+#include <thread>
+
+namespace jobs {
+namespace detail {
+struct Job {
+  std::function<void()> fn;
+  Counter *counter;
+};
+
+namespace {
+/**
+ * Chase-Lev deque with a fixed capacity, using the C11 memory orders from
+ * "Correct and Efficient Work-Stealing for Weak Memory Models" (Lê et al.).
+ * The owner pushes and pops at the bottom, thieves take from the top, and
+ * only a thief racing the owner for the last job needs a CAS.
+ */
+class WorkQueue {
+public:
+  static constexpr int64_t capacity = 4096;
+
+  /**
+   * Owner only. Returns false if the queue is full.
+   */
+  bool push(Job *job) {
+    const int64_t bottom = m_bottom.load(std::memory_order_relaxed);
+    const int64_t top = m_top.load(std::memory_order_acquire);
+    if (bottom - top >= capacity) return false;
+
+    m_jobs[bottom & (capacity - 1)].store(job, std::memory_order_relaxed);
+    m_bottom.store(bottom + 1, std::memory_order_release);
+    return true;
+  }
+
+  /**
+   * Owner only, newest job first
+   */
+  Job *pop() {
+    const int64_t bottom = m_bottom.load(std::memory_order_relaxed) - 1;
+    m_bottom.store(bottom, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t top = m_top.load(std::memory_order_relaxed);
+
+    if (top > bottom) {
+      m_bottom.store(bottom + 1, std::memory_order_relaxed);
+      return nullptr;
+    }
+
+    Job *job = m_jobs[bottom & (capacity - 1)].load(std::memory_order_relaxed);
+    if (top == bottom) {
+      // Last one, a thief may be taking it too
+      if (!m_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) job = nullptr;
+      m_bottom.store(bottom + 1, std::memory_order_relaxed);
+    }
+    return job;
+  }
+
+  /**
+   * Any thread, oldest job first. Returns nullptr if empty or if another
+   * thread got there first.
+   */
+  Job *steal() {
+    int64_t top = m_top.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    const int64_t bottom = m_bottom.load(std::memory_order_acquire);
+    if (top >= bottom) return nullptr;
+
+    Job *job = m_jobs[top & (capacity - 1)].load(std::memory_order_relaxed);
+    if (!m_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) return nullptr;
+    return job;
+  }
+
+  // Written by the owner only
+  std::atomic<uint64_t> executed = 0, stolen = 0;
+
+private:
+  alignas(64) std::atomic<int64_t> m_top = 0;
+  alignas(64) std::atomic<int64_t> m_bottom = 0;
+  std::atomic<Job *> m_jobs[capacity];
+};
+
+constexpr size_t maxQueues = 64;
+
+thread_local WorkQueue *t_queue = nullptr;
+thread_local bool t_registered = false;
+}
+
+/**
+ * Worker threads plus a queue for every thread that has submitted jobs.
+ * Queues are never freed before the scheduler, so a thread that exits with
+ * jobs left in its queue leaves them for the others to steal.
+ */
+class Scheduler {
+public:
+  Scheduler() {
+    const size_t workers = std::max(1u, std::thread::hardware_concurrency()) - 1;
+    m_limit = workers + 1;
+    for (size_t i = 0; i < workers; i++) {
+      m_threads.emplace_back([this, i] { workerLoop(i + 1); });
+    }
+  }
+
+  ~Scheduler() {
+    m_quit = true;
+    m_limit = 0;
+    wakeAll();
+    for (auto &thread: m_threads) thread.join();
+    for (auto &queue: m_queues) delete queue.load();
+  }
+
+  size_t threadCount() const { return m_threads.size() + 1; }
+
+  void setLimit(size_t count) {
+    m_limit = std::clamp<size_t>(count, 1, threadCount());
+    wakeAll();
+  }
+
+  size_t limit() const { return m_limit; }
+
+  Stats stats() const {
+    Stats stats;
+    for (size_t i = 0; i < std::min(m_queueCount.load(), maxQueues); i++) {
+      if (const WorkQueue *queue = m_queues[i].load(std::memory_order_acquire)) {
+        stats.executed += queue->executed.load(std::memory_order_relaxed);
+        stats.stolen += queue->stolen.load(std::memory_order_relaxed);
+      }
+    }
+    return stats;
+  }
+
+  void submit(Job *job) {
+    WorkQueue *queue = localQueue();
+    if (!queue || !queue->push(job)) {
+      // Out of queues or queue space, the submitter runs it
+      execute(job, queue, false);
+      return;
+    }
+
+    // Seq_cst pairs with the sleeper count, so a worker going to sleep either sees the new epoch or gets notified
+    m_epoch.fetch_add(1);
+    if (m_sleeping.load() > 0) m_epoch.notify_one();
+  }
+
+  void submitAfter(Counter &dependency, Job *job) {
+    {
+      std::lock_guard lock(dependency.m_mutex);
+      if (dependency.m_pending.load(std::memory_order_acquire) != 0) {
+        dependency.m_continuations.push_back(job);
+        return;
+      }
+    }
+    submit(job);
+  }
+
+  static void add(Counter &counter) { counter.m_pending.fetch_add(1, std::memory_order_relaxed); }
+
+  void wait(Counter &counter) {
+    WorkQueue *queue = localQueue();
+    while (!counter.done()) {
+      bool stolen;
+      if (Job *job = find(queue, stolen)) {
+        execute(job, queue, stolen);
+      } else {
+        std::this_thread::yield();
+      }
+    }
+
+    // The last decrement happens under the lock, once we get it the counter is no longer in use
+    std::lock_guard lock(counter.m_mutex);
+  }
+
+private:
+  std::vector<std::thread> m_threads;
+  std::atomic<WorkQueue *> m_queues[maxQueues] = {};
+  std::atomic<size_t> m_queueCount = 0;
+
+  std::atomic<uint32_t> m_epoch = 0; // Bumped whenever a job is queued
+  std::atomic<uint32_t> m_sleeping = 0;
+  std::atomic<size_t> m_limit = 1;
+  std::atomic<bool> m_quit = false;
+
+  /**
+   * Parked workers wait for the limit to change, the others for the epoch
+   */
+  void wakeAll() {
+    m_epoch.fetch_add(1);
+    m_epoch.notify_all();
+    m_limit.notify_all();
+  }
+
+  WorkQueue *localQueue() {
+    if (!t_registered) {
+      t_registered = true;
+      const size_t index = m_queueCount.fetch_add(1);
+      if (index < maxQueues) {
+        t_queue = new WorkQueue();
+        m_queues[index].store(t_queue, std::memory_order_release);
+      }
+    }
+    return t_queue;
+  }
+
+  /**
+   * Own queue first, then steals, starting from a different queue on every
+   * thread so thieves don't all fight over the same one
+   */
+  Job *find(WorkQueue *queue, bool &stolen) {
+    stolen = false;
+    if (Job *job = queue ? queue->pop() : nullptr) return job;
+
+    stolen = true;
+    const size_t count = std::min(m_queueCount.load(), maxQueues);
+    const size_t start = std::hash<std::thread::id>()(std::this_thread::get_id());
+    for (size_t i = 0; i < count; i++) {
+      WorkQueue *victim = m_queues[(start + i) % count].load(std::memory_order_acquire);
+      if (!victim || victim == queue) continue;
+      if (Job *job = victim->steal()) return job;
+    }
+    return nullptr;
+  }
+
+  void execute(Job *job, WorkQueue *queue, bool stolen) {
+    job->fn();
+    Counter *counter = job->counter;
+    delete job;
+
+    if (queue) {
+      queue->executed.store(queue->executed.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+      if (stolen) queue->stolen.store(queue->stolen.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+    if (counter) complete(*counter);
+  }
+
+  void complete(Counter &counter) {
+    // Not the last job: nobody can be done waiting on the counter yet, so no lock
+    uint32_t pending = counter.m_pending.load(std::memory_order_relaxed);
+    while (pending > 1) {
+      if (counter.m_pending.compare_exchange_weak(pending, pending - 1, std::memory_order_acq_rel)) return;
+    }
+
+    std::vector<Job *> ready;
+    {
+      std::lock_guard lock(counter.m_mutex);
+      if (counter.m_pending.fetch_sub(1, std::memory_order_acq_rel) == 1) ready.swap(counter.m_continuations);
+    }
+    for (Job *job: ready) submit(job);
+  }
+
+  void workerLoop(size_t index) {
+    WorkQueue *queue = localQueue();
+    while (!m_quit) {
+      const size_t limit = m_limit;
+      if (index >= limit) {
+        // Parked, finish what's queued here first
+        while (Job *job = queue ? queue->pop() : nullptr) execute(job, queue, false);
+        m_limit.wait(limit);
+        continue;
+      }
+
+      const uint32_t epoch = m_epoch.load();
+      bool stolen;
+      if (Job *job = find(queue, stolen)) {
+        execute(job, queue, stolen);
+        continue;
+      }
+
+      // Jobs often come in bursts, look again a few times before sleeping
+      bool found = false;
+      for (int spin = 0; spin < 64 && !found; spin++) {
+        std::this_thread::yield();
+        found = m_epoch.load() != epoch;
+      }
+      if (found) continue;
+
+      m_sleeping.fetch_add(1);
+      m_epoch.wait(epoch);
+      m_sleeping.fetch_sub(1);
+    }
+  }
+};
+
+namespace {
+Scheduler &scheduler() {
+  static Scheduler scheduler;
+  return scheduler;
+}
+}
+}
+
+size_t threadCount() {
+  return detail::scheduler().threadCount();
+}
+
+void setThreadLimit(size_t count) {
+  detail::scheduler().setLimit(count);
+}
+
+size_t threadLimit() {
+  return detail::scheduler().limit();
+}
+
+Stats stats() {
+  return detail::scheduler().stats();
+}
+
+void run(std::function<void()> fn, Counter *counter) {
+  if (counter) detail::Scheduler::add(*counter);
+  detail::scheduler().submit(new detail::Job{std::move(fn), counter});
+}
+
+void runAfter(Counter &dependency, std::function<void()> fn, Counter *counter) {
+  if (counter) detail::Scheduler::add(*counter);
+  detail::scheduler().submitAfter(dependency, new detail::Job{std::move(fn), counter});
+}
+
+void wait(Counter &counter) {
+  detail::scheduler().wait(counter);
+}
+
+void parallelFor(size_t count, size_t grain, const std::function<void(size_t begin, size_t end)> &fn) {
+  if (count == 0) return;
+  grain = std::max<size_t>(grain, 1);
+  if (count <= grain || threadLimit() == 1) {
+    for (size_t begin = 0; begin < count; begin += grain) fn(begin, std::min(begin + grain, count));
+    return;
+  }
+
+  Counter counter;
+  std::function<void(size_t, size_t)> split = [&](size_t begin, size_t end) {
+    while (end - begin > grain) {
+      const size_t middle = begin + (end - begin) / 2;
+      run([&split, middle, end] { split(middle, end); }, &counter);
+      end = middle;
+    }
+    fn(begin, end);
+  };
+  split(0, count);
+  wait(counter);
+}
+}
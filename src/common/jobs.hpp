@@ -0,0 +1,96 @@
+#ifndef LEARN_METAL_JOBS_HPP
+#define LEARN_METAL_JOBS_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+/**
+ * Work-stealing job system for the per-frame CPU work. Every thread that
+ * submits jobs gets its own queue (a Chase-Lev deque): it pushes and pops at
+ * one end without contention, idle workers steal from the other end. Jobs
+ * are grouped by counters, which can be waited on and can start continuation
+ * jobs once they reach zero. There are no fibers: a thread waiting on a
+ * counter runs other jobs until it's done.
+ */
+namespace jobs {
+namespace detail {
+struct Job;
+class Scheduler;
+}
+
+/**
+ * Number of unfinished jobs in a group. Waiting on it is the only way to know
+ * the jobs are done before destroying it.
+ */
+class Counter {
+public:
+  Counter() = default;
+
+  Counter(const Counter &) = delete;
+
+  Counter &operator=(const Counter &) = delete;
+
+  bool done() const { return m_pending.load(std::memory_order_acquire) == 0; }
+
+private:
+  friend class detail::Scheduler;
+
+  std::atomic<uint32_t> m_pending = 0;
+  std::mutex m_mutex; // Guards the continuations, and the last decrement
+  std::vector<detail::Job *> m_continuations;
+};
+
+struct Stats {
+  uint64_t executed = 0; // Jobs run
+  uint64_t stolen = 0;   // Of those, taken from another thread's queue
+};
+
+/**
+ * Threads jobs run on, including the caller: one per hardware thread
+ */
+size_t threadCount();
+
+/**
+ * Lets only the first count threads (the callers, and count - 1 workers)
+ * take jobs, the others sleep. For measuring scaling, all threads by default.
+ */
+void setThreadLimit(size_t count);
+
+size_t threadLimit();
+
+/**
+ * Totals since startup
+ */
+Stats stats();
+
+/**
+ * Queues fn to run on any thread. counter, if given, is incremented now and
+ * decremented once fn has returned.
+ */
+void run(std::function<void()> fn, Counter *counter = nullptr);
+
+/**
+ * Queues fn once dependency reaches zero, right away if it already has.
+ * counter is incremented now, so waiting on it covers the continuation and
+ * whatever the continuation adds to it.
+ */
+void runAfter(Counter &dependency, std::function<void()> fn, Counter *counter = nullptr);
+
+/**
+ * Runs jobs until counter reaches zero
+ */
+void wait(Counter &counter);
+
+/**
+ * Calls fn(begin, end) over ranges covering [0, count), none longer than
+ * grain, and waits for all of them. The range is split in halves as jobs, so
+ * idle threads steal the biggest pieces left.
+ */
+void parallelFor(size_t count, size_t grain, const std::function<void(size_t begin, size_t end)> &fn);
+}
+
+#endif //LEARN_METAL_JOBS_HPP
@@ -1,6 +1,294 @@
 #include "matrices.hpp"
 
 namespace mat {
+namespace {
+/*
+ * Vector backends for the batched kernels, one object per lane
+ */
+struct Scalar {
+  using V = float;
+  static constexpr size_t width = 1;
+
+  static V splat(float s) { return s; }
+
+  static V add(V a, V b) { return a + b; }
+
+  static V sub(V a, V b) { return a - b; }
+
+  static V mul(V a, V b) { return a * b; }
+};
+
+struct Wide4 {
+  using V = psimd::detail::f128;
+  static constexpr size_t width = 4;
+
+  static V load(const float *p) { return psimd::detail::loadu(p); }
+
+  static V splat(float s) { return psimd::detail::splat(s); }
+
+  static V add(V a, V b) { return psimd::detail::add(a, b); }
+
+  static V sub(V a, V b) { return psimd::detail::sub(a, b); }
+
+  static V mul(V a, V b) { return psimd::detail::mul(a, b); }
+
+  /**
+   * Writes column j of four matrices, given its rows across objects
+   */
+  static void storeColumn(float4x4 *out, int j, V r0, V r1, V r2, V r3) {
+    psimd::detail::transpose(r0, r1, r2, r3);
+    psimd::detail::store(&out[0].columns[j].x, r0);
+    psimd::detail::store(&out[1].columns[j].x, r1);
+    psimd::detail::store(&out[2].columns[j].x, r2);
+    psimd::detail::store(&out[3].columns[j].x, r3);
+  }
+};
+
+#if defined(PSIMD_AVX)
+struct Wide8 {
+  using V = __m256;
+  static constexpr size_t width = 8;
+
+  static V load(const float *p) { return _mm256_loadu_ps(p); }
+
+  static V splat(float s) { return _mm256_set1_ps(s); }
+
+  static V add(V a, V b) { return _mm256_add_ps(a, b); }
+
+  static V sub(V a, V b) { return _mm256_sub_ps(a, b); }
+
+  static V mul(V a, V b) { return _mm256_mul_ps(a, b); }
+
+  /**
+   * Writes column j of eight matrices. The shuffles transpose each 128-bit half
+   * on its own, so the low half holds objects 0-3 and the high half 4-7.
+   */
+  static void storeColumn(float4x4 *out, int j, V r0, V r1, V r2, V r3) {
+    V t0 = _mm256_unpacklo_ps(r0, r1);
+    V t1 = _mm256_unpackhi_ps(r0, r1);
+    V t2 = _mm256_unpacklo_ps(r2, r3);
+    V t3 = _mm256_unpackhi_ps(r2, r3);
+    V c[4] = {
+      _mm256_shuffle_ps(t0, t2, 0x44),
+      _mm256_shuffle_ps(t0, t2, 0xee),
+      _mm256_shuffle_ps(t1, t3, 0x44),
+      _mm256_shuffle_ps(t1, t3, 0xee),
+    };
+    for (int k = 0; k < 4; k++) {
+      _mm_store_ps(&out[k].columns[j].x, _mm256_castps256_ps128(c[k]));
+      _mm_store_ps(&out[k + 4].columns[j].x, _mm256_extractf128_ps(c[k], 1));
+    }
+  }
+};
+#endif
+
+/*
+ * sincos constants. pi/2 is split in three parts so n * pio2a and n * pio2b are
+ * exact for |n| < 2^16, coefficients are minimax fits on [-pi/4, pi/4].
+ */
+constexpr float twoOverPi = 0.636619772367581343f;
+constexpr float pio2a = 1.5703125f;
+constexpr float pio2b = 4.837512969970703125e-4f;
+constexpr float pio2c = 7.54978995489188216e-8f;
+
+constexpr float sin1 = -1.6666654611e-1f;
+constexpr float sin2 = 8.3321608736e-3f;
+constexpr float sin3 = -1.9515295891e-4f;
+
+constexpr float cos1 = 4.166664568298827e-2f;
+constexpr float cos2 = -1.388731625493765e-3f;
+constexpr float cos3 = 2.443315711809948e-5f;
+
+/**
+ * sin and cos polynomials for r in [-pi/4, pi/4]
+ */
+template<typename W>
+inline void sincosPoly(typename W::V r, typename W::V &s, typename W::V &c) {
+  using V = typename W::V;
+  const V r2 = W::mul(r, r);
+  const V ps = W::add(W::mul(W::add(W::mul(W::splat(sin3), r2), W::splat(sin2)), r2), W::splat(sin1));
+  const V pc = W::add(W::mul(W::add(W::mul(W::splat(cos3), r2), W::splat(cos2)), r2), W::splat(cos1));
+  s = W::add(W::mul(W::mul(ps, r2), r), r);
+  c = W::add(W::mul(pc, W::mul(r2, r2)), W::sub(W::splat(1.0f), W::mul(r2, W::splat(0.5f))));
+}
+
+/**
+ * sincos for four lanes. Quadrant selection needs integer ops, which the
+ * psimd backends don't expose, so those are written out per backend.
+ */
+inline void sincos4(psimd::detail::f128 x, psimd::detail::f128 &s, psimd::detail::f128 &c) {
+  using namespace psimd::detail;
+#if defined(PSIMD_SCALAR)
+  for (int i = 0; i < 4; i++) sincos(x.v[i], s.v[i], c.v[i]);
+#else
+#if defined(PSIMD_SSE)
+  const __m128i n = _mm_cvtps_epi32(mul(x, splat(twoOverPi)));
+  const f128 nf = _mm_cvtepi32_ps(n);
+#else
+  const int32x4_t n = vcvtnq_s32_f32(mul(x, splat(twoOverPi)));
+  const f128 nf = vcvtq_f32_s32(n);
+#endif
+
+  f128 r = madd(nf, splat(-pio2a), x);
+  r = madd(nf, splat(-pio2b), r);
+  r = madd(nf, splat(-pio2c), r);
+
+  f128 ps, pc;
+  sincosPoly<Wide4>(r, ps, pc);
+
+  /*
+   * Odd quadrants swap sin and cos, sin is negated in quadrants 2 and 3 and
+   * cos in quadrants 1 and 2
+   */
+#if defined(PSIMD_SSE)
+  const __m128i one = _mm_set1_epi32(1), two = _mm_set1_epi32(2);
+  const f128 swap = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(n, one), one));
+  const f128 sinSign = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(n, two), 30));
+  const f128 cosSign = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(_mm_add_epi32(n, one), two), 30));
+
+  s = _mm_xor_ps(_mm_or_ps(_mm_and_ps(swap, pc), _mm_andnot_ps(swap, ps)), sinSign);
+  c = _mm_xor_ps(_mm_or_ps(_mm_and_ps(swap, ps), _mm_andnot_ps(swap, pc)), cosSign);
+#else
+  const int32x4_t one = vdupq_n_s32(1), two = vdupq_n_s32(2);
+  const uint32x4_t swap = vtstq_s32(n, one);
+  const uint32x4_t sinSign = vshlq_n_u32(vreinterpretq_u32_s32(vandq_s32(n, two)), 30);
+  const uint32x4_t cosSign = vshlq_n_u32(vreinterpretq_u32_s32(vandq_s32(vaddq_s32(n, one), two)), 30);
+
+  s = vreinterpretq_f32_u32(veorq_u32(vreinterpretq_u32_f32(vbslq_f32(swap, pc, ps)), sinSign));
+  c = vreinterpretq_f32_u32(veorq_u32(vreinterpretq_u32_f32(vbslq_f32(swap, ps, pc)), cosSign));
+#endif
+#endif
+}
+
+/**
+ * Composes W::width transforms starting at object i
+ */
+template<typename W>
+inline void composeTRSBlock(const TRSArrays &in, size_t i, float4x4 *out) {
+  using V = typename W::V;
+  const V one = W::splat(1.0f), zero = W::splat(0.0f);
+
+  const V qx = W::load(in.qx + i), qy = W::load(in.qy + i), qz = W::load(in.qz + i), qw = W::load(in.qw + i);
+  const V x2 = W::add(qx, qx), y2 = W::add(qy, qy), z2 = W::add(qz, qz);
+  const V xx = W::mul(qx, x2), yy = W::mul(qy, y2), zz = W::mul(qz, z2);
+  const V xy = W::mul(qx, y2), xz = W::mul(qx, z2), yz = W::mul(qy, z2);
+  const V wx = W::mul(qw, x2), wy = W::mul(qw, y2), wz = W::mul(qw, z2);
+
+  const V sx = W::load(in.sx + i), sy = W::load(in.sy + i), sz = W::load(in.sz + i);
+
+  W::storeColumn(
+    out + i, 0,
+    W::mul(W::sub(one, W::add(yy, zz)), sx),
+    W::mul(W::add(xy, wz), sx),
+    W::mul(W::sub(xz, wy), sx),
+    zero
+  );
+  W::storeColumn(
+    out + i, 1,
+    W::mul(W::sub(xy, wz), sy),
+    W::mul(W::sub(one, W::add(xx, zz)), sy),
+    W::mul(W::add(yz, wx), sy),
+    zero
+  );
+  W::storeColumn(
+    out + i, 2,
+    W::mul(W::add(xz, wy), sz),
+    W::mul(W::sub(yz, wx), sz),
+    W::mul(W::sub(one, W::add(xx, yy)), sz),
+    zero
+  );
+  W::storeColumn(out + i, 3, W::load(in.tx + i), W::load(in.ty + i), W::load(in.tz + i), one);
+}
+}
+
+void sincos(float x, float &s, float &c) {
+  // Adding and subtracting 1.5 * 2^23 rounds to the nearest integer
+  constexpr float roundMagic = 12582912.0f;
+  const float nf = (x * twoOverPi + roundMagic) - roundMagic;
+  const auto n = static_cast<int32_t>(nf);
+
+  float r = x - nf * pio2a;
+  r -= nf * pio2b;
+  r -= nf * pio2c;
+
+  float ps, pc;
+  sincosPoly<Scalar>(r, ps, pc);
+
+  // Branch free, the quadrant is unpredictable for random input
+  const float p[2] = {ps, pc};
+  s = p[n & 1] * float(1 - (n & 2));
+  c = p[~n & 1] * float(1 - ((n + 1) & 2));
+}
+
+void sincos(const float *x, float *s, float *c, size_t count) {
+  using namespace psimd::detail;
+  size_t i = 0;
+  for (; i + 4 <= count; i += 4) {
+    f128 vs, vc;
+    sincos4(loadu(x + i), vs, vc);
+    storeu(s + i, vs);
+    storeu(c + i, vc);
+  }
+  for (; i < count; i++) sincos(x[i], s[i], c[i]);
+}
+
+quat quaternion(float angle, float3 axis) {
+  float s, c;
+  sincos(angle * 0.5f, s, c);
+  return {axis.x * s, axis.y * s, axis.z * s, c};
+}
+
+quat operator*(quat a, quat b) {
+  return {
+    a.w * b.x + a.x * b.w + a.y * b.z - a.z * b.y,
+    a.w * b.y - a.x * b.z + a.y * b.w + a.z * b.x,
+    a.w * b.z + a.x * b.y - a.y * b.x + a.z * b.w,
+    a.w * b.w - a.x * b.x - a.y * b.y - a.z * b.z,
+  };
+}
+
+quat conjugate(quat q) {
+  return {-q.x, -q.y, -q.z, q.w};
+}
+
+float dot(quat a, quat b) {
+  return a.x * b.x + a.y * b.y + a.z * b.z + a.w * b.w;
+}
+
+quat normalize(quat q) {
+  const float inv = 1.0f / std::sqrt(dot(q, q));
+  return {q.x * inv, q.y * inv, q.z * inv, q.w * inv};
+}
+
+quat nlerp(quat a, quat b, float t) {
+  // q and -q are the same rotation, flip b to interpolate the short way around
+  const float sign = dot(a, b) < 0.0f ? -1.0f : 1.0f;
+  const float ta = 1.0f - t, tb = t * sign;
+  return normalize({a.x * ta + b.x * tb, a.y * ta + b.y * tb, a.z * ta + b.z * tb, a.w * ta + b.w * tb});
+}
+
+quat slerp(quat a, quat b, float t) {
+  float cosTheta = dot(a, b);
+  const float sign = cosTheta < 0.0f ? -1.0f : 1.0f;
+  cosTheta *= sign;
+
+  // Nearly parallel, sin(theta) is too small to divide by and nlerp is exact enough
+  if (cosTheta > 0.9995f) return nlerp(a, b, t);
+
+  const float theta = std::acos(cosTheta);
+  const float invSin = 1.0f / std::sin(theta);
+  const float ta = std::sin((1.0f - t) * theta) * invSin;
+  const float tb = std::sin(t * theta) * invSin * sign;
+  return {a.x * ta + b.x * tb, a.y * ta + b.y * tb, a.z * ta + b.z * tb, a.w * ta + b.w * tb};
+}
+
+float3 rotate(quat q, float3 v) {
+  // v + 2w(u x v) + 2u x (u x v), with u the vector part
+  const float3 u = {q.x, q.y, q.z};
+  const float3 t = 2.0f * cross(u, v);
+  return v + q.w * t + cross(u, t);
+}
+
 float4x4 identity() {
   return {1.0f};
 }
@@ -15,9 +303,8 @@ float4x4 translation(float3 t) {
 }
 
 float4x4 rotation(float angle, float3 rotationAxis) {
-  const float a = angle;
-  const float c = cos(a);
-  const float s = sin(a);
+  float s, c;
+  sincos(angle, s, c);
 
   const float3 axis = normalize(rotationAxis);
   const float3 temp = (1.0f - c) * axis;
@@ -30,6 +317,10 @@ float4x4 rotation(float angle, float3 rotationAxis) {
   };
 }
 
+float4x4 rotation(quat q) {
+  return composeTRS(float3{0.0f}, q, float3{1.0f});
+}
+
 float4x4 scaling(float3 s) {
   return {
     float4{s.x, 0.0f, 0.0f, 0.0f},
@@ -62,5 +353,108 @@ float4x4 projection(float fov, float aspect, float near, float far) {
     float4{0.0f, 0.0f, tz, 0.0f},
   };
 }
+
+float3x3 normalMatrix(const float4x4 &m) {
+  const float3 c0 = make_float3(m.columns[0]);
+  const float3 c1 = make_float3(m.columns[1]);
+  const float3 c2 = make_float3(m.columns[2]);
+
+  /*
+   * The columns of the inverse transpose are the cross products of pairs of
+   * columns, divided by the determinant
+   */
+  const float3 r0 = cross(c1, c2);
+  const float3 r1 = cross(c2, c0);
+  const float3 r2 = cross(c0, c1);
+  const float invDet = 1.0f / dot(c0, r0);
+
+  return {r0 * invDet, r1 * invDet, r2 * invDet};
 }
 
+void multiply(const float4x4 &a, const float4x4 *b, float4x4 *out, size_t count) {
+#if defined(PSIMD_AVX)
+  const __m256 a0 = _mm256_broadcast_ps(reinterpret_cast<const __m128 *>(&a.columns[0]));
+  const __m256 a1 = _mm256_broadcast_ps(reinterpret_cast<const __m128 *>(&a.columns[1]));
+  const __m256 a2 = _mm256_broadcast_ps(reinterpret_cast<const __m128 *>(&a.columns[2]));
+  const __m256 a3 = _mm256_broadcast_ps(reinterpret_cast<const __m128 *>(&a.columns[3]));
+
+  for (size_t i = 0; i < count; i++) {
+    const float *src = &b[i].columns[0].x;
+    float *dst = &out[i].columns[0].x;
+
+    // Both column pairs are loaded before storing, so out may alias b
+    __m256 b01 = _mm256_loadu_ps(src);
+    __m256 b23 = _mm256_loadu_ps(src + 8);
+
+    __m256 c01 = _mm256_mul_ps(a0, _mm256_permute_ps(b01, 0x00));
+    __m256 c23 = _mm256_mul_ps(a0, _mm256_permute_ps(b23, 0x00));
+#if defined(PSIMD_FMA)
+    c01 = _mm256_fmadd_ps(a1, _mm256_permute_ps(b01, 0x55), c01);
+    c23 = _mm256_fmadd_ps(a1, _mm256_permute_ps(b23, 0x55), c23);
+    c01 = _mm256_fmadd_ps(a2, _mm256_permute_ps(b01, 0xaa), c01);
+    c23 = _mm256_fmadd_ps(a2, _mm256_permute_ps(b23, 0xaa), c23);
+    c01 = _mm256_fmadd_ps(a3, _mm256_permute_ps(b01, 0xff), c01);
+    c23 = _mm256_fmadd_ps(a3, _mm256_permute_ps(b23, 0xff), c23);
+#else
+    c01 = _mm256_add_ps(c01, _mm256_mul_ps(a1, _mm256_permute_ps(b01, 0x55)));
+    c23 = _mm256_add_ps(c23, _mm256_mul_ps(a1, _mm256_permute_ps(b23, 0x55)));
+    c01 = _mm256_add_ps(c01, _mm256_mul_ps(a2, _mm256_permute_ps(b01, 0xaa)));
+    c23 = _mm256_add_ps(c23, _mm256_mul_ps(a2, _mm256_permute_ps(b23, 0xaa)));
+    c01 = _mm256_add_ps(c01, _mm256_mul_ps(a3, _mm256_permute_ps(b01, 0xff)));
+    c23 = _mm256_add_ps(c23, _mm256_mul_ps(a3, _mm256_permute_ps(b23, 0xff)));
+#endif
+    _mm256_storeu_ps(dst, c01);
+    _mm256_storeu_ps(dst + 8, c23);
+  }
+#else
+  using namespace psimd::detail;
+  const f128 a0 = load(a.columns[0]);
+  const f128 a1 = load(a.columns[1]);
+  const f128 a2 = load(a.columns[2]);
+  const f128 a3 = load(a.columns[3]);
+
+  for (size_t i = 0; i < count; i++) {
+    f128 bc[4];
+    for (int j = 0; j < 4; j++) bc[j] = load(b[i].columns[j]);
+
+    for (int j = 0; j < 4; j++) {
+      f128 c = mul(a0, lane<0>(bc[j]));
+      c = madd(a1, lane<1>(bc[j]), c);
+      c = madd(a2, lane<2>(bc[j]), c);
+      c = madd(a3, lane<3>(bc[j]), c);
+      store(&out[i].columns[j].x, c);
+    }
+  }
+#endif
+}
+
+float4x4 composeTRS(float3 t, quat q, float3 s) {
+  const float x2 = q.x + q.x, y2 = q.y + q.y, z2 = q.z + q.z;
+  const float xx = q.x * x2, yy = q.y * y2, zz = q.z * z2;
+  const float xy = q.x * y2, xz = q.x * z2, yz = q.y * z2;
+  const float wx = q.w * x2, wy = q.w * y2, wz = q.w * z2;
+
+  return {
+    float4{(1.0f - (yy + zz)) * s.x, (xy + wz) * s.x, (xz - wy) * s.x, 0.0f},
+    float4{(xy - wz) * s.y, (1.0f - (xx + zz)) * s.y, (yz + wx) * s.y, 0.0f},
+    float4{(xz + wy) * s.z, (yz - wx) * s.z, (1.0f - (xx + yy)) * s.z, 0.0f},
+    float4{t.x, t.y, t.z, 1.0f},
+  };
+}
+
+void composeTRS(const TRSArrays &in, float4x4 *out, size_t count) {
+  size_t i = 0;
+#if defined(PSIMD_AVX)
+  for (; i + Wide8::width <= count; i += Wide8::width) composeTRSBlock<Wide8>(in, i, out);
+#endif
+  for (; i + Wide4::width <= count; i += Wide4::width) composeTRSBlock<Wide4>(in, i, out);
+
+  for (; i < count; i++) {
+    out[i] = composeTRS(
+      {in.tx[i], in.ty[i], in.tz[i]},
+      {in.qx[i], in.qy[i], in.qz[i], in.qw[i]},
+      {in.sx[i], in.sy[i], in.sz[i]}
+    );
+  }
+}
+}
@@ -1,22 +1,120 @@
 #ifndef LEARN_METAL_MATRICES_HPP
 #define LEARN_METAL_MATRICES_HPP
 
-#include <simd/simd.h>
+#include "simd-types.hpp"
 
-using namespace simd;
+using namespace psimd;
 
 namespace mat {
+/**
+ * Sine and cosine of x, sharing a single range reduction. Max absolute error
+ * is 1.2e-7 for |x| <= 8192 (about 1 ulp near 1), accuracy degrades for larger
+ * inputs. Not rounded the same as libm, so don't expect identical results.
+ */
+void sincos(float x, float &s, float &c);
+
+/**
+ * Batched sincos, s[i] and c[i] are the sine and cosine of x[i]. Processes four
+ * values at a time with SSE/NEON, same error bounds as the scalar version.
+ */
+void sincos(const float *x, float *s, float *c, size_t count);
+
+/**
+ * Rotation quaternion, stored as (x, y, z, w) with w the real part. 16 bytes,
+ * same as a float4.
+ */
+struct alignas(16) quat {
+  float x, y, z, w;
+
+  quat() = default;
+
+  constexpr quat(float x, float y, float z, float w) : x(x), y(y), z(z), w(w) {}
+
+  static constexpr quat identity() { return {0.0f, 0.0f, 0.0f, 1.0f}; }
+};
+
+static_assert(sizeof(quat) == 16);
+
+/**
+ * Rotation of angle radians around a unit length axis. Unlike rotation(), the
+ * axis is not normalized here.
+ */
+quat quaternion(float angle, float3 axis);
+
+/**
+ * Hamilton product, a * b rotates by b first, then by a
+ */
+quat operator*(quat a, quat b);
+
+quat conjugate(quat q);
+
+float dot(quat a, quat b);
+
+quat normalize(quat q);
+
+/**
+ * Normalized linear interpolation, cheap and accurate enough for small angles
+ */
+quat nlerp(quat a, quat b, float t);
+
+/**
+ * Spherical linear interpolation, constant angular velocity. Both take the
+ * shortest path.
+ */
+quat slerp(quat a, quat b, float t);
+
+/**
+ * Rotates a vector without building a matrix
+ */
+float3 rotate(quat q, float3 v);
+
 float4x4 identity();
 
 float4x4 translation(float3 t);
 
 float4x4 rotation(float angle, float3 axis);
 
+float4x4 rotation(quat q);
+
 float4x4 scaling(float3 s);
 
 float4x4 scaling(float s);
 
 float4x4 projection(float fov, float aspect, float near, float far);
+
+/**
+ * Inverse transpose of the upper 3x3 part, transforms normals correctly under
+ * non-uniform scaling
+ */
+float3x3 normalMatrix(const float4x4 &m);
+
+/**
+ * out[i] = a * b[i] for count matrices, with a kept in registers. Used to
+ * compute model-view-projection matrices for many objects at once. out may
+ * alias b.
+ */
+void multiply(const float4x4 &a, const float4x4 *b, float4x4 *out, size_t count);
+
+/**
+ * translation(t) * rotation(q) * scaling(s), for a unit quaternion q
+ */
+float4x4 composeTRS(float3 t, quat q, float3 s);
+
+/**
+ * Structure-of-arrays input for batched TRS composition, each pointer refers
+ * to an array of count floats
+ */
+struct TRSArrays {
+  const float *tx, *ty, *tz;
+  const float *qx, *qy, *qz, *qw;
+  const float *sx, *sy, *sz;
+};
+
+/**
+ * Batched composeTRS, out[i] is the transform of object i. Processes eight
+ * objects at a time with AVX, four with SSE/NEON.
+ */
+void composeTRS(const TRSArrays &in, float4x4 *out, size_t count);
 }
 
 #endif //LEARN_METAL_MATRICES_HPP
@@ -0,0 +1,293 @@
+#include "mesh-optimizer.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+using namespace psimd;
+
+namespace mesh {
+namespace {
+/*
+ * Forsyth's scoring parameters, from the original article
+ */
+constexpr int scoreCacheSize = 32;
+constexpr float cacheDecayPower = 1.5f;
+constexpr float lastTriangleScore = 0.75f;
+constexpr float valenceBoostScale = 2.0f;
+constexpr float valenceBoostPower = 0.5f;
+constexpr uint32_t maxValenceScore = 64;
+
+struct ScoreTables {
+  float cache[scoreCacheSize];
+  float valence[maxValenceScore];
+
+  ScoreTables() {
+    for (int i = 0; i < scoreCacheSize; i++) {
+      // The last triangle's vertices get a fixed score, so the next one doesn't always reuse its edge
+      cache[i] = i < 3
+                 ? lastTriangleScore
+                 : std::pow(1.0f - float(i - 3) / float(scoreCacheSize - 3), cacheDecayPower);
+    }
+    valence[0] = 0.0f;
+    for (uint32_t i = 1; i < maxValenceScore; i++) {
+      valence[i] = valenceBoostScale * std::pow(float(i), -valenceBoostPower);
+    }
+  }
+
+  float score(int cachePosition, uint32_t remaining) const {
+    if (remaining == 0) return -1.0f;
+    float s = cachePosition >= 0 ? cache[cachePosition] : 0.0f;
+    return s + valence[std::min(remaining, maxValenceScore - 1)];
+  }
+};
+
+/**
+ * Triangle clusters for overdraw sorting, split where a triangle misses the
+ * cache on all three vertices
+ */
+std::vector<size_t> findClusters(const uint32_t *indices, size_t indexCount, size_t vertexCount) {
+  std::vector<size_t> clusters;
+  std::vector<size_t> stamp(vertexCount, 0);
+  size_t time = defaultCacheSize + 1;
+
+  for (size_t i = 0; i < indexCount; i += 3) {
+    int misses = 0;
+    for (int k = 0; k < 3; k++) {
+      uint32_t v = indices[i + k];
+      if (time - stamp[v] > defaultCacheSize) {
+        stamp[v] = time++;
+        misses++;
+      }
+    }
+    if (misses == 3 || i == 0) clusters.push_back(i / 3);
+  }
+  return clusters;
+}
+}
+
+CacheStats analyzeVertexCache(const uint32_t *indices, size_t indexCount, size_t cacheSize) {
+  CacheStats stats;
+  stats.triangles = indexCount / 3;
+  if (indexCount == 0) return stats;
+
+  const size_t vertexCount = *std::max_element(indices, indices + indexCount) + 1;
+
+  /*
+   * A vertex is in the FIFO if fewer than cacheSize vertices have been
+   * transformed since it was
+   */
+  std::vector<size_t> stamp(vertexCount, 0);
+  std::vector<bool> used(vertexCount, false);
+  size_t time = cacheSize + 1;
+
+  for (size_t i = 0; i < indexCount; i++) {
+    uint32_t v = indices[i];
+    if (time - stamp[v] > cacheSize) {
+      stamp[v] = time++;
+      stats.transformed++;
+    }
+    used[v] = true;
+  }
+
+  stats.vertices = size_t(std::count(used.begin(), used.end(), true));
+  stats.acmr = float(stats.transformed) / float(stats.triangles);
+  stats.atvr = float(stats.transformed) / float(stats.vertices);
+  return stats;
+}
+
+void optimizeVertexCache(uint32_t *indices, size_t indexCount, size_t vertexCount) {
+  static const ScoreTables tables;
+  const size_t triangleCount = indexCount / 3;
+  if (triangleCount == 0) return;
+
+  /*
+   * Triangles adjacent to each vertex, only the first remaining[v] entries of
+   * a vertex's range are triangles that haven't been emitted yet
+   */
+  std::vector<uint32_t> remaining(vertexCount, 0);
+  for (size_t i = 0; i < indexCount; i++) remaining[indices[i]]++;
+
+  std::vector<uint32_t> offsets(vertexCount + 1, 0);
+  std::partial_sum(remaining.begin(), remaining.end(), offsets.begin() + 1);
+
+  std::vector<uint32_t> adjacency(indexCount);
+  {
+    std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+    for (size_t i = 0; i < indexCount; i++) adjacency[fill[indices[i]]++] = uint32_t(i / 3);
+  }
+
+  std::vector<int> cachePosition(vertexCount, -1);
+  std::vector<float> vertexScore(vertexCount);
+  for (size_t v = 0; v < vertexCount; v++) vertexScore[v] = tables.score(-1, remaining[v]);
+
+  std::vector<float> triangleScore(triangleCount);
+  for (size_t t = 0; t < triangleCount; t++) {
+    const uint32_t *tri = indices + t * 3;
+    triangleScore[t] = vertexScore[tri[0]] + vertexScore[tri[1]] + vertexScore[tri[2]];
+  }
+
+  std::vector<bool> emitted(triangleCount, false);
+  std::vector<uint32_t> result;
+  result.reserve(indexCount);
+
+  uint32_t cache[scoreCacheSize + 3], nextCache[scoreCacheSize + 3];
+  size_t cacheCount = 0;
+
+  size_t best = size_t(std::max_element(triangleScore.begin(), triangleScore.end()) - triangleScore.begin());
+  size_t cursor = 0;
+
+  while (true) {
+    const uint32_t *tri = indices + best * 3;
+    result.insert(result.end(), tri, tri + 3);
+    emitted[best] = true;
+
+    /*
+     * Remove the triangle from its vertices' adjacency, and move its vertices
+     * to the front of the cache
+     */
+    size_t nextCount = 0;
+    for (int k = 0; k < 3; k++) {
+      const uint32_t v = tri[k];
+      uint32_t *adj = adjacency.data() + offsets[v];
+      for (uint32_t j = 0; j < remaining[v]; j++) {
+        if (adj[j] == best) {
+          adj[j] = adj[remaining[v] - 1];
+          break;
+        }
+      }
+      remaining[v]--;
+      if (std::find(nextCache, nextCache + nextCount, v) == nextCache + nextCount) nextCache[nextCount++] = v;
+    }
+    for (size_t i = 0; i < cacheCount; i++) {
+      const uint32_t v = cache[i];
+      if (std::find(nextCache, nextCache + nextCount, v) == nextCache + nextCount) nextCache[nextCount++] = v;
+    }
+
+    /*
+     * Rescore every vertex that was or is in the cache, and the remaining
+     * triangles around them. The best of those is the next one.
+     */
+    for (size_t i = 0; i < nextCount; i++) {
+      const uint32_t v = nextCache[i];
+      cachePosition[v] = i < scoreCacheSize ? int(i) : -1;
+      vertexScore[v] = tables.score(cachePosition[v], remaining[v]);
+    }
+
+    float bestScore = -1.0f;
+    best = triangleCount;
+    for (size_t i = 0; i < nextCount; i++) {
+      const uint32_t v = nextCache[i];
+      const uint32_t *adj = adjacency.data() + offsets[v];
+      for (uint32_t j = 0; j < remaining[v]; j++) {
+        const uint32_t t = adj[j];
+        const uint32_t *other = indices + t * 3;
+        triangleScore[t] = vertexScore[other[0]] + vertexScore[other[1]] + vertexScore[other[2]];
+        if (triangleScore[t] > bestScore) {
+          bestScore = triangleScore[t];
+          best = t;
+        }
+      }
+    }
+
+    cacheCount = std::min(nextCount, size_t(scoreCacheSize));
+    std::copy(nextCache, nextCache + cacheCount, cache);
+
+    // Nothing left around the cache, continue with the first triangle not emitted yet
+    if (best == triangleCount) {
+      while (cursor < triangleCount && emitted[cursor]) cursor++;
+      if (cursor == triangleCount) break;
+      best = cursor;
+    }
+  }
+
+  std::copy(result.begin(), result.end(), indices);
+}
+
+void optimizeOverdraw(uint32_t *indices, size_t indexCount, const Vertex *vertices, size_t vertexCount,
+                      float threshold) {
+  const size_t triangleCount = indexCount / 3;
+  if (triangleCount == 0) return;
+
+  const std::vector<size_t> clusters = findClusters(indices, indexCount, vertexCount);
+  if (clusters.size() < 2) return;
+
+  /*
+   * Area weighted centroid of the whole mesh, and of each cluster along with
+   * its average normal
+   */
+  struct Cluster {
+    size_t begin, end;
+    float3 centroid, normal;
+    float area;
+    float sortKey;
+  };
+  std::vector<Cluster> info(clusters.size());
+
+  float3 meshCentroid{0.0f};
+  float meshArea = 0.0f;
+  for (size_t c = 0; c < clusters.size(); c++) {
+    Cluster &cluster = info[c];
+    cluster = {clusters[c], c + 1 < clusters.size() ? clusters[c + 1] : triangleCount, float3{0.0f}, float3{0.0f}, 0.0f, 0.0f};
+
+    for (size_t t = cluster.begin; t < cluster.end; t++) {
+      const float3 p0 = vertices[indices[t * 3]].position;
+      const float3 p1 = vertices[indices[t * 3 + 1]].position;
+      const float3 p2 = vertices[indices[t * 3 + 2]].position;
+
+      const float3 n = cross(p1 - p0, p2 - p0);
+      const float area = length(n);
+      cluster.centroid += (p0 + p1 + p2) * (area / 3.0f);
+      cluster.normal += n;
+      cluster.area += area;
+    }
+
+    meshCentroid += cluster.centroid;
+    meshArea += cluster.area;
+    if (cluster.area > 0.0f) cluster.centroid /= cluster.area;
+  }
+  if (meshArea > 0.0f) meshCentroid /= meshArea;
+
+  /*
+   * Clusters facing away from the center are likely to occlude the rest
+   */
+  for (Cluster &cluster: info) {
+    const float len = length(cluster.normal);
+    cluster.sortKey = len > 0.0f ? dot(cluster.centroid - meshCentroid, cluster.normal / len) : 0.0f;
+  }
+  std::stable_sort(info.begin(), info.end(), [](const Cluster &a, const Cluster &b) { return a.sortKey > b.sortKey; });
+
+  std::vector<uint32_t> result;
+  result.reserve(indexCount);
+  for (const Cluster &cluster: info) {
+    result.insert(result.end(), indices + cluster.begin * 3, indices + cluster.end * 3);
+  }
+
+  const float before = analyzeVertexCache(indices, indexCount).acmr;
+  const float after = analyzeVertexCache(result.data(), indexCount).acmr;
+  if (after <= before * threshold) std::copy(result.begin(), result.end(), indices);
+}
+
+void optimizeVertexFetch(MeshData &mesh) {
+  constexpr uint32_t unused = ~0u;
+  std::vector<uint32_t> remap(mesh.vertices.size(), unused);
+  std::vector<Vertex> vertices;
+  vertices.reserve(mesh.vertices.size());
+
+  for (uint32_t &index: mesh.indices) {
+    if (remap[index] == unused) {
+      remap[index] = uint32_t(vertices.size());
+      vertices.push_back(mesh.vertices[index]);
+    }
+    index = remap[index];
+  }
+
+  mesh.vertices = std::move(vertices);
+}
+
+void optimize(MeshData &mesh) {
+  optimizeVertexCache(mesh.indices.data(), mesh.indices.size(), mesh.vertices.size());
+  optimizeOverdraw(mesh.indices.data(), mesh.indices.size(), mesh.vertices.data(), mesh.vertices.size());
+  optimizeVertexFetch(mesh);
+}
+}
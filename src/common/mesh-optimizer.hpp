@@ -0,0 +1,72 @@
+#ifndef LEARN_METAL_MESH_OPTIMIZER_HPP
+#define LEARN_METAL_MESH_OPTIMIZER_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+#include "mesh.hpp"
+
+/**
+ * Index and vertex reordering passes, for meshes that arrive in arbitrary
+ * triangle order. Run them in this order, each one keeps most of what the
+ * previous passes gained:
+ *   optimizeVertexCache   triangle order for post-transform cache reuse
+ *   optimizeOverdraw      cluster order for early depth rejection
+ *   optimizeVertexFetch   vertex order for memory locality
+ */
+namespace mesh {
+/**
+ * Post-transform vertex cache simulation results. ACMR (average cache miss
+ * ratio) is vertex shader invocations per triangle, 0.5 is the best a regular
+ * grid can do and 3 the worst. ATVR (average transformed vertex ratio) is
+ * invocations per vertex, 1 is optimal.
+ */
+struct CacheStats {
+  size_t triangles = 0;
+  size_t vertices = 0;
+  size_t transformed = 0;
+  float acmr = 0.0f;
+  float atvr = 0.0f;
+};
+
+/**
+ * FIFO cache sizes of recent GPUs are in the 16-32 entry range
+ */
+constexpr size_t defaultCacheSize = 16;
+
+/**
+ * Simulates a FIFO post-transform cache of the given size over the index
+ * buffer. Only vertices referenced by the indices count towards ATVR.
+ */
+CacheStats analyzeVertexCache(const uint32_t *indices, size_t indexCount, size_t cacheSize = defaultCacheSize);
+
+/**
+ * Reorders triangles for vertex cache reuse, using Tom Forsyth's linear-speed
+ * vertex cache optimization. Runs in linear time, independent of the actual
+ * cache size.
+ */
+void optimizeVertexCache(uint32_t *indices, size_t indexCount, size_t vertexCount);
+
+/**
+ * Reorders clusters of triangles so those facing out of the mesh come first,
+ * reducing overdraw from most viewpoints (Sander et al, "Fast Triangle
+ * Reordering for Vertex Locality and Reduced Overdraw"). Clusters are split
+ * where the cache-optimized order has a cache reset, and the new order is only
+ * kept if ACMR gets no worse than threshold times the input's.
+ */
+void optimizeOverdraw(uint32_t *indices, size_t indexCount, const Vertex *vertices, size_t vertexCount,
+                      float threshold = 1.05f);
+
+/**
+ * Reorders vertices in order of first use and remaps the indices to match.
+ * Unused vertices are dropped.
+ */
+void optimizeVertexFetch(MeshData &mesh);
+
+/**
+ * All of the above, in order
+ */
+void optimize(MeshData &mesh);
+}
+
+#endif //LEARN_METAL_MESH_OPTIMIZER_HPP
@@ -0,0 +1,276 @@
+#include "mesh-simplifier.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <numeric>
+
+#include "mesh-optimizer.hpp"
+
+using namespace psimd;
+
+namespace mesh {
+namespace {
+/**
+ * Sum of squared distances to a set of weighted planes, as a symmetric 4x4
+ * matrix. Doubles, as the terms of the error cancel out.
+ */
+struct Quadric {
+  double a00 = 0, a01 = 0, a02 = 0, a11 = 0, a12 = 0, a22 = 0; // n n^T
+  double b0 = 0, b1 = 0, b2 = 0;                               // d n
+  double c = 0;                                                // d^2
+  double weight = 0;
+
+  void addPlane(float3 n, float d, float w) {
+    a00 += w * n.x * n.x, a01 += w * n.x * n.y, a02 += w * n.x * n.z;
+    a11 += w * n.y * n.y, a12 += w * n.y * n.z, a22 += w * n.z * n.z;
+    b0 += w * d * n.x, b1 += w * d * n.y, b2 += w * d * n.z;
+    c += w * d * d;
+    weight += w;
+  }
+
+  Quadric &operator+=(const Quadric &q) {
+    a00 += q.a00, a01 += q.a01, a02 += q.a02, a11 += q.a11, a12 += q.a12, a22 += q.a22;
+    b0 += q.b0, b1 += q.b1, b2 += q.b2;
+    c += q.c;
+    weight += q.weight;
+    return *this;
+  }
+
+  /**
+   * Weighted mean squared distance of p to the planes
+   */
+  double error(float3 p) const {
+    const double x = p.x, y = p.y, z = p.z;
+    const double e = x * (a00 * x + 2 * a01 * y + 2 * a02 * z) + y * (a11 * y + 2 * a12 * z) + a22 * z * z +
+                     2 * (b0 * x + b1 * y + b2 * z) + c;
+    return weight > 0 ? std::max(e, 0.0) / weight : 0.0;
+  }
+};
+
+struct Collapse {
+  uint32_t from, to;
+  double error;
+};
+
+uint64_t edgeKey(uint32_t a, uint32_t b) {
+  return uint64_t(a) << 32 | b;
+}
+
+/**
+ * Maps every vertex to the first vertex with the same position, so seams
+ * (same position, different attributes) don't read as holes
+ */
+std::vector<uint32_t> weldPositions(const Vertex *vertices, size_t vertexCount) {
+  std::vector<uint32_t> order(vertexCount);
+  std::iota(order.begin(), order.end(), 0u);
+  auto less = [&](uint32_t a, uint32_t b) {
+    return memcmp(&vertices[a].position, &vertices[b].position, 3 * sizeof(float)) < 0;
+  };
+  std::stable_sort(order.begin(), order.end(), less);
+
+  std::vector<uint32_t> remap(vertexCount);
+  for (size_t i = 0; i < vertexCount; i++) {
+    const bool same = i > 0 && !less(order[i - 1], order[i]);
+    remap[order[i]] = same ? remap[order[i - 1]] : order[i];
+  }
+  return remap;
+}
+
+/**
+ * True if moving vertex from to the position of to flips any of from's other
+ * triangles, or makes them degenerate
+ */
+bool flips(const std::vector<uint32_t> &indices, const uint32_t *triangles, size_t triangleCount,
+           const Vertex *vertices, uint32_t from, uint32_t to) {
+  const float3 target = vertices[to].position;
+  for (size_t i = 0; i < triangleCount; i++) {
+    const uint32_t *tri = indices.data() + triangles[i] * 3;
+    if (tri[0] == to || tri[1] == to || tri[2] == to) continue; // Removed by the collapse
+
+    float3 p[3], q[3];
+    for (int k = 0; k < 3; k++) {
+      p[k] = vertices[tri[k]].position;
+      q[k] = tri[k] == from ? target : p[k];
+    }
+    const float3 before = cross(p[1] - p[0], p[2] - p[0]);
+    const float3 after = cross(q[1] - q[0], q[2] - q[0]);
+    if (dot(before, after) <= 0.0f) return true;
+  }
+  return false;
+}
+}
+
+std::vector<uint32_t> simplify(const uint32_t *indices, size_t indexCount, const Vertex *vertices, size_t vertexCount,
+                               size_t targetIndexCount, float maxError, float *resultError) {
+  double worstError = 0.0;
+  const double maxErrorSquared = double(maxError) * double(maxError);
+
+  /*
+   * Work on welded vertices, dropping triangles that are degenerate already
+   */
+  const std::vector<uint32_t> weld = weldPositions(vertices, vertexCount);
+  std::vector<uint32_t> result;
+  result.reserve(indexCount);
+  for (size_t i = 0; i + 2 < indexCount; i += 3) {
+    const uint32_t a = weld[indices[i]], b = weld[indices[i + 1]], c = weld[indices[i + 2]];
+    if (a != b && b != c && a != c) result.insert(result.end(), {a, b, c});
+  }
+
+  /*
+   * Vertex quadrics from the planes of their triangles, weighted by area.
+   * Vertices on an edge without a twin are on an open boundary and stay put.
+   */
+  std::vector<Quadric> quadrics(vertexCount);
+  std::vector<bool> boundary(vertexCount, false);
+  {
+    std::vector<uint64_t> edges;
+    edges.reserve(result.size());
+    for (size_t i = 0; i < result.size(); i += 3) {
+      const uint32_t *tri = result.data() + i;
+      const float3 p0 = vertices[tri[0]].position, p1 = vertices[tri[1]].position, p2 = vertices[tri[2]].position;
+      const float3 n = cross(p1 - p0, p2 - p0);
+      const float area = length(n);
+      if (area > 0.0f) {
+        const float3 unit = n / area;
+        for (int k = 0; k < 3; k++) quadrics[tri[k]].addPlane(unit, -dot(unit, p0), area * 0.5f);
+      }
+      for (int k = 0; k < 3; k++) edges.push_back(edgeKey(tri[k], tri[(k + 1) % 3]));
+    }
+
+    std::sort(edges.begin(), edges.end());
+    for (uint64_t e: edges) {
+      const auto a = uint32_t(e >> 32), b = uint32_t(e);
+      if (!std::binary_search(edges.begin(), edges.end(), edgeKey(b, a))) boundary[a] = boundary[b] = true;
+    }
+  }
+
+  /*
+   * Collapse in passes: find the cheapest collapse for every edge, then apply
+   * them in order of error. A vertex takes part in one collapse per pass, so
+   * the costs computed for the pass stay valid.
+   */
+  std::vector<uint32_t> collapseTo(vertexCount);
+  std::vector<bool> locked(vertexCount);
+  std::vector<uint32_t> offsets(vertexCount + 1), adjacency;
+  std::vector<uint64_t> edges;
+  std::vector<Collapse> collapses;
+
+  while (result.size() > targetIndexCount) {
+    // Triangles around each vertex
+    std::fill(offsets.begin(), offsets.end(), 0u);
+    for (uint32_t v: result) offsets[v + 1]++;
+    std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+    adjacency.resize(result.size());
+    {
+      std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+      for (size_t i = 0; i < result.size(); i++) adjacency[fill[result[i]]++] = uint32_t(i / 3);
+    }
+
+    // Unique edges, each with the cheaper of its two directions
+    edges.clear();
+    for (size_t i = 0; i < result.size(); i += 3) {
+      for (int k = 0; k < 3; k++) {
+        const uint32_t a = result[i + k], b = result[i + (k + 1) % 3];
+        edges.push_back(edgeKey(std::min(a, b), std::max(a, b)));
+      }
+    }
+    std::sort(edges.begin(), edges.end());
+    edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+
+    collapses.clear();
+    for (uint64_t e: edges) {
+      const auto a = uint32_t(e >> 32), b = uint32_t(e);
+      Quadric q = quadrics[a];
+      q += quadrics[b];
+      const double ab = boundary[a] ? INFINITY : q.error(vertices[b].position);
+      const double ba = boundary[b] ? INFINITY : q.error(vertices[a].position);
+      if (std::isinf(ab) && std::isinf(ba)) continue;
+      collapses.push_back(ab <= ba ? Collapse{a, b, ab} : Collapse{b, a, ba});
+    }
+    std::sort(collapses.begin(), collapses.end(), [](const Collapse &x, const Collapse &y) { return x.error < y.error; });
+
+    /*
+     * Each collapse removes the (usually two) triangles on its edge, stop once
+     * that reaches the target
+     */
+    std::iota(collapseTo.begin(), collapseTo.end(), 0u);
+    std::fill(locked.begin(), locked.end(), false);
+    size_t triangles = result.size() / 3, applied = 0;
+    const size_t targetTriangles = targetIndexCount / 3;
+
+    for (const Collapse &c: collapses) {
+      if (triangles <= targetTriangles || c.error > maxErrorSquared) break;
+      if (locked[c.from] || locked[c.to]) continue;
+
+      const uint32_t *around = adjacency.data() + offsets[c.from];
+      const size_t aroundCount = offsets[c.from + 1] - offsets[c.from];
+      if (flips(result, around, aroundCount, vertices, c.from, c.to)) continue;
+
+      /*
+       * Neighbours are locked too: their triangles change shape, so their
+       * flip checks and costs for this pass would be stale
+       */
+      for (size_t i = 0; i < aroundCount; i++) {
+        const uint32_t *tri = result.data() + around[i] * 3;
+        locked[tri[0]] = locked[tri[1]] = locked[tri[2]] = true;
+        if (tri[0] == c.to || tri[1] == c.to || tri[2] == c.to) triangles--;
+      }
+
+      collapseTo[c.from] = c.to;
+      quadrics[c.to] += quadrics[c.from];
+      worstError = std::max(worstError, c.error);
+      applied++;
+    }
+    if (applied == 0) break;
+
+    // Apply the collapses and drop the triangles that became degenerate
+    size_t out = 0;
+    for (size_t i = 0; i < result.size(); i += 3) {
+      const uint32_t a = collapseTo[result[i]], b = collapseTo[result[i + 1]], c = collapseTo[result[i + 2]];
+      if (a == b || b == c || a == c) continue;
+      result[out++] = a, result[out++] = b, result[out++] = c;
+    }
+    result.resize(out);
+  }
+
+  if (resultError) *resultError = float(std::sqrt(worstError));
+  return result;
+}
+
+void buildLods(MeshData &mesh, size_t maxLevels, float reduction) {
+  const auto baseCount = uint32_t(mesh.lods.empty() ? mesh.indices.size() : mesh.lods[0].indexCount);
+  mesh.indices.resize(baseCount);
+  mesh.lods.clear();
+  mesh.lods.push_back({0, baseCount, 0.0f});
+
+  /*
+   * Each level is simplified from the previous one, so the chain costs about
+   * twice the first level. The quadrics only see the previous level, so each
+   * level's error is an estimate: the summed RMS errors along the chain. It
+   * is not a bound on the distance to the full mesh.
+   */
+  for (size_t level = 1; level < maxLevels; level++) {
+    const Lod previous = mesh.lods.back();
+    const size_t targetCount = size_t(float(previous.indexCount / 3) * reduction) * 3;
+    if (targetCount == 0) break;
+
+    float error = 0.0f;
+    std::vector<uint32_t> indices = simplify(mesh.indices.data() + previous.firstIndex, previous.indexCount,
+                                             mesh.vertices.data(), mesh.vertices.size(), targetCount, INFINITY, &error);
+
+    // Stalled, no point in a level that isn't much smaller than the last
+    if (indices.empty() || float(indices.size()) > float(previous.indexCount) * 0.9f) break;
+
+    optimizeVertexCache(indices.data(), indices.size(), mesh.vertices.size());
+    mesh.lods.push_back({uint32_t(mesh.indices.size()), uint32_t(indices.size()), previous.error + error});
+    mesh.indices.insert(mesh.indices.end(), indices.begin(), indices.end());
+  }
+}
+
+size_t selectLod(const Lod *lods, size_t count, float pixelsPerUnit, float maxPixelError) {
+  size_t level = 0;
+  while (level + 1 < count && lods[level + 1].error * pixelsPerUnit <= maxPixelError) level++;
+  return level;
+}
+}
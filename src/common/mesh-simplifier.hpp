@@ -0,0 +1,52 @@
+#ifndef LEARN_METAL_MESH_SIMPLIFIER_HPP
+#define LEARN_METAL_MESH_SIMPLIFIER_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "mesh.hpp"
+
+/**
+ * Mesh simplification and level of detail selection. Simplified meshes only
+ * drop triangles and reuse the original vertices, so every level of detail
+ * draws from the same vertex buffer.
+ */
+namespace mesh {
+/**
+ * Simplifies a triangle list by edge collapses ordered by quadric error
+ * (Garland and Heckbert, "Surface Simplification Using Quadric Error
+ * Metrics"), until at most targetIndexCount indices are left or the next
+ * collapse's error would exceed maxError. Each vertex collapses
+ * onto a neighbour and collapses that would flip a triangle are skipped.
+ * Vertices sharing a position are treated as one, and vertices on open
+ * boundaries stay in place.
+ *
+ * Returns the new indices, and sets resultError to the largest error of the
+ * collapses made, in object space units. A collapse's error is the RMS
+ * distance of the new position to the planes of the triangles it replaces,
+ * area weighted, so single points may end up further away.
+ */
+std::vector<uint32_t> simplify(const uint32_t *indices, size_t indexCount, const Vertex *vertices, size_t vertexCount,
+                               size_t targetIndexCount, float maxError, float *resultError = nullptr);
+
+/**
+ * Builds a LOD chain, each level with about reduction times the triangles of
+ * the previous one, replacing mesh.lods. The levels' indices are appended to
+ * the index buffer, after level 0, and optimized for the vertex cache. Stops
+ * after maxLevels levels (including level 0), or when simplification stalls.
+ * Run after the optimizer passes, which don't know about LODs.
+ */
+void buildLods(MeshData &mesh, size_t maxLevels = 6, float reduction = 0.5f);
+
+/**
+ * Coarsest level whose error covers at most maxPixelError pixels on screen.
+ * pixelsPerUnit is the size of an object space unit at the object's distance,
+ * viewport height / 2 * projection[1][1] / distance for a perspective
+ * projection. Levels must be ordered by increasing error. The errors are
+ * estimates, so this is a heuristic rather than a guarantee.
+ */
+size_t selectLod(const Lod *lods, size_t count, float pixelsPerUnit, float maxPixelError);
+}
+
+#endif //LEARN_METAL_MESH_SIMPLIFIER_HPP
@@ -0,0 +1,429 @@
+#include "mesh.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+#include "vertex-formats.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static_assert(std::endian::native == std::endian::little, "Mesh files are little endian");
+
+using namespace psimd;
+
+namespace mesh {
+namespace {
+size_t alignUp(size_t value, size_t alignment) {
+  return (value + alignment - 1) / alignment * alignment;
+}
+
+bool fail(std::string *error, const std::string &message) {
+  if (error) *error = message;
+  return false;
+}
+
+/**
+ * Checks the header and that all sections lie within the file
+ */
+bool validate(const std::byte *data, size_t size, std::string *error) {
+  if (size < sizeof(Header)) return fail(error, "File too small for a mesh header");
+
+  const auto &header = *reinterpret_cast<const Header *>(data);
+  if (memcmp(header.magic, magic, sizeof(magic)) != 0) return fail(error, "Not a mesh file");
+  if (header.version < 1 || header.version > version) {
+    return fail(error, "Unsupported mesh version " + std::to_string(header.version));
+  }
+  if (vertexStride(header.layout) == 0 || header.vertexStride != vertexStride(header.layout)) {
+    return fail(error, "Unsupported vertex layout");
+  }
+
+  auto inBounds = [size](uint64_t offset, uint64_t count, uint64_t stride) {
+    return offset % sectionAlignment == 0 && offset <= size && count <= (size - offset) / stride;
+  };
+  if (!inBounds(header.vertexOffset, header.vertexCount, header.vertexStride)) {
+    return fail(error, "Vertex data out of bounds");
+  }
+  if (!inBounds(header.indexOffset, header.indexCount, sizeof(uint32_t))) {
+    return fail(error, "Index data out of bounds");
+  }
+  if (!inBounds(header.meshletOffset, header.meshletCount, sizeof(Meshlet))) {
+    return fail(error, "Meshlet data out of bounds");
+  }
+  if (!inBounds(header.lodOffset, header.lodCount, sizeof(Lod))) return fail(error, "LOD data out of bounds");
+  if (header.indexCount % 3 != 0) return fail(error, "Index count is not a multiple of 3");
+
+  const auto *indices = reinterpret_cast<const uint32_t *>(data + header.indexOffset);
+  uint32_t maxIndex = 0;
+  for (size_t i = 0; i < header.indexCount; i++) maxIndex = std::max(maxIndex, indices[i]);
+  if (header.indexCount > 0 && maxIndex >= header.vertexCount) return fail(error, "Index out of range");
+
+  const auto *meshlets = reinterpret_cast<const Meshlet *>(data + header.meshletOffset);
+  for (size_t i = 0; i < header.meshletCount; i++) {
+    const Meshlet &m = meshlets[i];
+    if (m.firstIndex % 3 != 0 || m.firstIndex > header.indexCount ||
+        m.triangleCount > (header.indexCount - m.firstIndex) / 3) {
+      return fail(error, "Meshlet index range out of bounds");
+    }
+  }
+
+  const auto *lods = reinterpret_cast<const Lod *>(data + header.lodOffset);
+  for (size_t i = 0; i < header.lodCount; i++) {
+    const Lod &lod = lods[i];
+    if (lod.firstIndex % 3 != 0 || lod.indexCount % 3 != 0 || lod.firstIndex > header.indexCount ||
+        lod.indexCount > header.indexCount - lod.firstIndex) {
+      return fail(error, "LOD index range out of bounds");
+    }
+  }
+
+  return true;
+}
+
+/*
+ * OBJ parsing helpers, operating on a line at a time
+ */
+const char *skipSpace(const char *p, const char *end) {
+  while (p < end && (*p == ' ' || *p == '\t')) p++;
+  return p;
+}
+
+/**
+ * Parses up to max floats, returns how many were read
+ */
+int parseFloats(const char *p, const char *end, float *out, int max) {
+  int n = 0;
+  while (n < max) {
+    p = skipSpace(p, end);
+    if (p == end) break;
+    char *next;
+    out[n] = std::strtof(p, &next);
+    if (next == p) break;
+    p = next;
+    n++;
+  }
+  return n;
+}
+}
+
+size_t vertexStride(Layout layout) {
+  switch (layout) {
+    case Layout::PositionColor:
+      return sizeof(Vertex);
+    case Layout::HalfPositionColor:
+      return sizeof(HalfVertex);
+    case Layout::Snorm16PositionColor:
+      return sizeof(Snorm16Vertex);
+  }
+  return 0;
+}
+
+bool parseLayout(const std::string &name, Layout &layout) {
+  for (Layout l: {Layout::PositionColor, Layout::HalfPositionColor, Layout::Snorm16PositionColor}) {
+    if (name == layoutName(l)) {
+      layout = l;
+      return true;
+    }
+  }
+  return false;
+}
+
+const char *layoutName(Layout layout) {
+  switch (layout) {
+    case Layout::PositionColor:
+      return "float";
+    case Layout::HalfPositionColor:
+      return "half";
+    case Layout::Snorm16PositionColor:
+      return "snorm16";
+  }
+  return "unknown";
+}
+
+gfx::VertexDescriptor vertexDescriptor(Layout layout, size_t bufferIndex) {
+  switch (layout) {
+    case Layout::PositionColor:
+      return gfx::vertexDescriptor<Vertex>(bufferIndex);
+    case Layout::HalfPositionColor:
+      return gfx::vertexDescriptor<HalfVertex>(bufferIndex);
+    case Layout::Snorm16PositionColor:
+      return gfx::vertexDescriptor<Snorm16Vertex>(bufferIndex);
+  }
+  return {};
+}
+
+void encodeVertices(Layout layout, const Vertex *vertices, size_t count, void *out) {
+  switch (layout) {
+    case Layout::PositionColor:
+      memcpy(out, vertices, count * sizeof(Vertex));
+      break;
+    case Layout::HalfPositionColor: {
+      auto *packed = static_cast<HalfVertex *>(out);
+      for (size_t i = 0; i < count; i++) {
+        for (int k = 0; k < 3; k++) packed[i].position.v[k] = gfx::toHalf(vertices[i].position[k]);
+        packed[i].position.v[3] = gfx::toHalf(1.0f);
+        for (int k = 0; k < 4; k++) packed[i].color.v[k] = gfx::toUnorm8(vertices[i].color[k]);
+      }
+      break;
+    }
+    case Layout::Snorm16PositionColor: {
+      auto *packed = static_cast<Snorm16Vertex *>(out);
+      for (size_t i = 0; i < count; i++) {
+        for (int k = 0; k < 3; k++) packed[i].position.v[k] = gfx::toSnorm16(vertices[i].position[k]);
+        packed[i].position.v[3] = gfx::toSnorm16(1.0f);
+        for (int k = 0; k < 4; k++) packed[i].color.v[k] = gfx::toUnorm8(vertices[i].color[k]);
+      }
+      break;
+    }
+  }
+}
+
+namespace {
+/**
+ * Decodes through the layout description, same as the GPU's vertex fetch
+ */
+template<typename V>
+void decodeVertices(const V *vertices, size_t count, Vertex *out) {
+  for (size_t i = 0; i < count; i++) {
+    out[i].position = make_float3(gfx::fetchAttribute<V, 0>(vertices[i]));
+    out[i].color = gfx::fetchAttribute<V, 1>(vertices[i]);
+  }
+}
+}
+
+void decodeVertices(Layout layout, const void *data, size_t count, Vertex *out) {
+  switch (layout) {
+    case Layout::PositionColor:
+      memcpy(out, data, count * sizeof(Vertex));
+      break;
+    case Layout::HalfPositionColor:
+      decodeVertices(static_cast<const HalfVertex *>(data), count, out);
+      break;
+    case Layout::Snorm16PositionColor:
+      decodeVertices(static_cast<const Snorm16Vertex *>(data), count, out);
+      break;
+  }
+}
+
+EncodingError measureError(Layout layout, const Vertex *vertices, size_t count) {
+  EncodingError error;
+  if (count == 0) return error;
+
+  std::vector<std::byte> encoded(count * vertexStride(layout));
+  std::vector<Vertex> decoded(count);
+  encodeVertices(layout, vertices, count, encoded.data());
+  decodeVertices(layout, encoded.data(), count, decoded.data());
+
+  double sumSquared = 0.0;
+  for (size_t i = 0; i < count; i++) {
+    const float3 d = decoded[i].position - vertices[i].position;
+    error.maxPosition = std::max({error.maxPosition, std::abs(d.x), std::abs(d.y), std::abs(d.z)});
+    sumSquared += double(dot(d, d));
+
+    const float4 c = decoded[i].color - vertices[i].color;
+    error.maxColor = std::max({error.maxColor, std::abs(c.x), std::abs(c.y), std::abs(c.z), std::abs(c.w)});
+  }
+  error.rmsPosition = float(std::sqrt(sumSquared / double(count)));
+  return error;
+}
+
+MeshFile::~MeshFile() {
+  if (m_data) munmap(const_cast<std::byte *>(m_data), m_size);
+}
+
+std::unique_ptr<MeshFile> MeshFile::open(const std::string &path, std::string *error) {
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    fail(error, "Failed to open " + path + ": " + strerror(errno));
+    return nullptr;
+  }
+
+  struct stat st{};
+  if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+    ::close(fd);
+    fail(error, "Failed to read " + path);
+    return nullptr;
+  }
+
+  const auto size = static_cast<size_t>(st.st_size);
+  void *data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd); // The mapping keeps the file alive
+  if (data == MAP_FAILED) {
+    fail(error, "Failed to map " + path + ": " + strerror(errno));
+    return nullptr;
+  }
+
+  std::unique_ptr<MeshFile> file(new MeshFile(static_cast<const std::byte *>(data), size));
+  if (!validate(file->m_data, size, error)) {
+    if (error) *error = path + ": " + *error;
+    return nullptr;
+  }
+  return file;
+}
+
+bool write(const std::string &path, const MeshData &mesh, std::string *error, Layout layout) {
+  std::vector<std::byte> vertexData(mesh.vertices.size() * vertexStride(layout));
+  encodeVertices(layout, mesh.vertices.data(), mesh.vertices.size(), vertexData.data());
+
+  Header header{};
+  memcpy(header.magic, magic, sizeof(magic));
+  header.version = version;
+  header.layout = layout;
+  header.vertexStride = uint32_t(vertexStride(layout));
+  header.vertexCount = mesh.vertices.size();
+  header.vertexOffset = alignUp(sizeof(Header), sectionAlignment);
+  header.indexCount = mesh.indices.size();
+  header.indexOffset = alignUp(header.vertexOffset + vertexData.size(), sectionAlignment);
+  header.meshletCount = mesh.meshlets.size();
+  header.meshletOffset = alignUp(header.indexOffset + mesh.indices.size() * sizeof(uint32_t), sectionAlignment);
+  header.lodCount = mesh.lods.size();
+  header.lodOffset = alignUp(header.meshletOffset + mesh.meshlets.size() * sizeof(Meshlet), sectionAlignment);
+
+  for (int i = 0; i < 3; i++) {
+    header.boundsMin[i] = mesh.vertices.empty() ? 0.0f : mesh.vertices[0].position[i];
+    header.boundsMax[i] = header.boundsMin[i];
+  }
+  for (const Vertex &v: mesh.vertices) {
+    for (int i = 0; i < 3; i++) {
+      header.boundsMin[i] = std::min(header.boundsMin[i], v.position[i]);
+      header.boundsMax[i] = std::max(header.boundsMax[i], v.position[i]);
+    }
+  }
+
+  std::ofstream out(path, std::ios::binary);
+  if (!out) return fail(error, "Failed to open " + path + " for writing");
+
+  static const char padding[sectionAlignment] = {};
+  auto pad = [&](size_t to) { out.write(padding, std::streamsize(to - size_t(out.tellp()))); };
+
+  out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+  pad(header.vertexOffset);
+  out.write(reinterpret_cast<const char *>(vertexData.data()), std::streamsize(vertexData.size()));
+  pad(header.indexOffset);
+  out.write(reinterpret_cast<const char *>(mesh.indices.data()), std::streamsize(mesh.indices.size() * sizeof(uint32_t)));
+  pad(header.meshletOffset);
+  out.write(reinterpret_cast<const char *>(mesh.meshlets.data()), std::streamsize(mesh.meshlets.size() * sizeof(Meshlet)));
+  pad(header.lodOffset);
+  out.write(reinterpret_cast<const char *>(mesh.lods.data()), std::streamsize(mesh.lods.size() * sizeof(Lod)));
+
+  if (!out) return fail(error, "Failed to write " + path);
+  return true;
+}
+
+bool importOBJ(const std::string &path, MeshData &mesh, std::string *error) {
+  std::ifstream in(path, std::ios::binary);
+  if (!in) return fail(error, "Failed to open " + path);
+
+  std::stringstream buffer;
+  buffer << in.rdbuf();
+  const std::string text = buffer.str();
+
+  struct Position {
+    float3 p;
+    float4 color;
+    bool hasColor;
+  };
+  std::vector<Position> positions;
+  std::vector<uint32_t> polygon;
+
+  mesh.vertices.clear();
+  mesh.indices.clear();
+  mesh.meshlets.clear();
+  mesh.lods.clear();
+
+  size_t lineNumber = 0;
+  for (size_t start = 0; start < text.size();) {
+    size_t eol = text.find('\n', start);
+    if (eol == std::string::npos) eol = text.size();
+    const char *p = text.data() + start, *end = text.data() + eol;
+    start = eol + 1;
+    lineNumber++;
+    if (end > p && end[-1] == '\r') end--;
+
+    p = skipSpace(p, end);
+    if (end - p < 2 || (p[1] != ' ' && p[1] != '\t')) continue;
+
+    if (p[0] == 'v') {
+      float values[6];
+      int n = parseFloats(p + 1, end, values, 6);
+      if (n < 3) return fail(error, path + ":" + std::to_string(lineNumber) + ": Invalid vertex");
+
+      Position pos{{values[0], values[1], values[2]}, float4{1.0f}, n == 6};
+      if (pos.hasColor) pos.color = {values[3], values[4], values[5], 1.0f};
+      positions.push_back(pos);
+    } else if (p[0] == 'f') {
+      /*
+       * Face vertices are v, v/vt, v//vn or v/vt/vn, only v is used. OBJ
+       * indices are 1-based, negative indices count back from the last vertex.
+       */
+      polygon.clear();
+      for (p++; (p = skipSpace(p, end)) < end;) {
+        char *next;
+        long index = std::strtol(p, &next, 10);
+        if (next == p) break;
+        if (index < 0) index += long(positions.size()) + 1;
+        if (index <= 0 || size_t(index) > positions.size()) {
+          return fail(error, path + ":" + std::to_string(lineNumber) + ": Invalid face index");
+        }
+        polygon.push_back(uint32_t(index - 1));
+
+        p = next;
+        while (p < end && *p != ' ' && *p != '\t') p++;
+      }
+      if (polygon.size() < 3) return fail(error, path + ":" + std::to_string(lineNumber) + ": Invalid face");
+
+      for (size_t i = 2; i < polygon.size(); i++) {
+        mesh.indices.insert(mesh.indices.end(), {polygon[0], polygon[i - 1], polygon[i]});
+      }
+    }
+  }
+
+  /*
+   * Only positions are indexed, so OBJ vertices map 1:1 to mesh vertices
+   */
+  float3 lo{0.0f}, hi{0.0f};
+  if (!positions.empty()) lo = hi = positions[0].p;
+  for (const Position &pos: positions) {
+    lo = min(lo, pos.p);
+    hi = max(hi, pos.p);
+  }
+  const float3 extent = max(hi - lo, float3{1e-6f});
+
+  mesh.vertices.resize(positions.size());
+  for (size_t i = 0; i < positions.size(); i++) {
+    const Position &pos = positions[i];
+    const float3 c = (pos.p - lo) / extent;
+    mesh.vertices[i] = {pos.p, pos.hasColor ? pos.color : make_float4(c, 1.0f)};
+  }
+  return true;
+}
+
+void normalize(MeshData &mesh) {
+  if (mesh.vertices.empty()) return;
+
+  float3 lo = mesh.vertices[0].position, hi = lo;
+  for (const Vertex &v: mesh.vertices) {
+    lo = min(lo, v.position);
+    hi = max(hi, v.position);
+  }
+
+  const float3 center = (lo + hi) * 0.5f;
+  const float3 half = (hi - lo) * 0.5f;
+  const float extent = std::max({half.x, half.y, half.z});
+  const float scale = extent > 0.0f ? 1.0f / extent : 1.0f;
+  for (Vertex &v: mesh.vertices) v.position = (v.position - center) * scale;
+
+  // Uniform scale, normal cones stay the same
+  for (Meshlet &m: mesh.meshlets) {
+    for (int i = 0; i < 3; i++) m.center[i] = (m.center[i] - center[i]) * scale;
+    m.radius *= scale;
+  }
+  for (Lod &lod: mesh.lods) lod.error *= scale;
+}
+}
@@ -0,0 +1,275 @@
+#ifndef LEARN_METAL_MESH_HPP
+#define LEARN_METAL_MESH_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "render-backend.hpp"
+#include "simd-types.hpp"
+#include "vertex-layout.hpp"
+
+/**
+ * Binary mesh format and loaders. Vertex data is stored exactly as the GPU
+ * reads it, in one of the vertex layouts below, so a mesh file is mapped into
+ * memory and copied into buffers without any parsing.
+ *
+ * File layout, little endian:
+ *   Header
+ *   vertices     vertexCount * vertexStride bytes, at vertexOffset
+ *   indices      indexCount uint32 indices, at indexOffset
+ *   meshlets     meshletCount Meshlet structs, at meshletOffset (version 2)
+ *   lods         lodCount Lod structs, at lodOffset (version 3)
+ * All sections are aligned to sectionAlignment. Files from older versions
+ * lack the later sections, their header fields read as zero from the padding.
+ */
+namespace mesh {
+constexpr char magic[4] = {'L', 'M', 'S', 'H'};
+constexpr uint32_t version = 3;
+constexpr size_t sectionAlignment = 256;
+
+/**
+ * Vertex layouts, for mesh files and vertex buffers. The packed layouts trade
+ * precision for bandwidth, see measureError().
+ */
+enum class Layout : uint32_t {
+  PositionColor = 1,        // Vertex, 32 bytes
+  HalfPositionColor = 2,    // HalfVertex, 12 bytes
+  Snorm16PositionColor = 3, // Snorm16Vertex, 12 bytes, positions must be in [-1, 1]
+};
+
+/**
+ * Same layout as the Vertex struct in the samples' shader-defs.hpp
+ */
+struct Vertex {
+  psimd::float3 position;
+  psimd::float4 color;
+};
+
+/**
+ * Half4 position (w = 1) and UChar4Normalized RGBA color
+ */
+struct HalfVertex {
+  gfx::half4 position;
+  gfx::unorm8x4 color;
+};
+
+/**
+ * Short4Normalized position (w = 1) and UChar4Normalized RGBA color
+ */
+struct Snorm16Vertex {
+  gfx::snorm16x4 position;
+  gfx::unorm8x4 color;
+};
+
+static_assert(sizeof(Vertex) == 32);
+static_assert(sizeof(HalfVertex) == 12);
+static_assert(sizeof(Snorm16Vertex) == 12);
+}
+
+/*
+ * All layouts have the position as attribute 0 and the color as attribute 1
+ */
+template<>
+struct gfx::VertexLayout<mesh::Vertex> {
+  static constexpr AttributeInfo attributes[] = {
+    GFX_VERTEX_ATTRIBUTE(mesh::Vertex, position),
+    GFX_VERTEX_ATTRIBUTE(mesh::Vertex, color),
+  };
+};
+
+template<>
+struct gfx::VertexLayout<mesh::HalfVertex> {
+  static constexpr AttributeInfo attributes[] = {
+    GFX_VERTEX_ATTRIBUTE(mesh::HalfVertex, position),
+    GFX_VERTEX_ATTRIBUTE(mesh::HalfVertex, color),
+  };
+};
+
+template<>
+struct gfx::VertexLayout<mesh::Snorm16Vertex> {
+  static constexpr AttributeInfo attributes[] = {
+    GFX_VERTEX_ATTRIBUTE(mesh::Snorm16Vertex, position),
+    GFX_VERTEX_ATTRIBUTE(mesh::Snorm16Vertex, color),
+  };
+};
+
+namespace mesh {
+size_t vertexStride(Layout layout);
+
+/**
+ * Layout names for command line options: "float", "half" and "snorm16".
+ * Returns false for unknown names.
+ */
+bool parseLayout(const std::string &name, Layout &layout);
+
+const char *layoutName(Layout layout);
+
+/**
+ * Vertex descriptor of a layout, read from a single buffer
+ */
+gfx::VertexDescriptor vertexDescriptor(Layout layout, size_t bufferIndex = 0);
+
+/**
+ * Converts count vertices to the given layout, out holds count * vertexStride
+ * bytes
+ */
+void encodeVertices(Layout layout, const Vertex *vertices, size_t count, void *out);
+
+void decodeVertices(Layout layout, const void *data, size_t count, Vertex *out);
+
+/**
+ * Errors introduced by encoding to a layout and decoding back, positions in
+ * object space units
+ */
+struct EncodingError {
+  float maxPosition = 0.0f;
+  float rmsPosition = 0.0f;
+  float maxColor = 0.0f;
+};
+
+EncodingError measureError(Layout layout, const Vertex *vertices, size_t count);
+
+/**
+ * Cluster of consecutive triangles, drawn as the index range
+ * [firstIndex, firstIndex + triangleCount * 3), see meshlets.hpp. The bounding
+ * sphere and normal cone are in object space; the cone covers the normals of
+ * all triangles, a coneCutoff of 1 means it can't be used for culling.
+ */
+struct Meshlet {
+  uint32_t firstIndex;
+  uint32_t triangleCount;
+  uint32_t vertexCount; // Unique vertices
+  float center[3];
+  float radius;
+  float coneAxis[3];
+  float coneCutoff; // sin of the cone's half angle
+};
+
+static_assert(sizeof(Meshlet) == 44);
+
+/**
+ * Level of detail, drawn as the index range [firstIndex, firstIndex +
+ * indexCount). All levels share the vertex buffer. Level 0 is the full mesh,
+ * error estimates how far the level's surface deviates from it (summed RMS
+ * errors of the simplification chain, see buildLods), in object space units.
+ * Meshlets cover level 0 only.
+ */
+struct Lod {
+  uint32_t firstIndex;
+  uint32_t indexCount;
+  float error;
+};
+
+static_assert(sizeof(Lod) == 12);
+
+struct Header {
+  char magic[4];
+  uint32_t version;
+  Layout layout;
+  uint32_t vertexStride;
+  uint64_t vertexCount;
+  uint64_t vertexOffset;
+  uint64_t indexCount;
+  uint64_t indexOffset;
+  float boundsMin[3];
+  float boundsMax[3];
+  uint64_t meshletCount;
+  uint64_t meshletOffset;
+  uint64_t lodCount;
+  uint64_t lodOffset;
+};
+
+static_assert(sizeof(Header) == 104);
+
+/**
+ * Mesh in memory, as produced by the importers
+ */
+struct MeshData {
+  std::vector<Vertex> vertices;
+  std::vector<uint32_t> indices;
+  std::vector<Meshlet> meshlets; // Optional, see buildMeshlets()
+  std::vector<Lod> lods;         // Optional, see buildLods(). Without any, indices are level 0.
+};
+
+/**
+ * Read-only memory mapped mesh file. The header and section bounds are checked
+ * on open, as are indices, so a mesh that opens can be drawn safely.
+ */
+class MeshFile {
+public:
+  /**
+   * Returns nullptr and sets the error message on failure
+   */
+  static std::unique_ptr<MeshFile> open(const std::string &path, std::string *error);
+
+  ~MeshFile();
+
+  MeshFile(const MeshFile &) = delete;
+
+  MeshFile &operator=(const MeshFile &) = delete;
+
+  const Header &header() const { return *reinterpret_cast<const Header *>(m_data); }
+
+  Layout layout() const { return header().layout; }
+
+  const void *vertexData() const { return m_data + header().vertexOffset; }
+
+  size_t vertexDataSize() const { return header().vertexCount * header().vertexStride; }
+
+  /**
+   * Typed view of the vertices, nullptr if T doesn't match the stored stride
+   */
+  template<typename T>
+  const T *vertices() const {
+    return header().vertexStride == sizeof(T) ? reinterpret_cast<const T *>(vertexData()) : nullptr;
+  }
+
+  size_t vertexCount() const { return header().vertexCount; }
+
+  const uint32_t *indices() const { return reinterpret_cast<const uint32_t *>(m_data + header().indexOffset); }
+
+  size_t indexDataSize() const { return header().indexCount * sizeof(uint32_t); }
+
+  size_t indexCount() const { return header().indexCount; }
+
+  const Meshlet *meshlets() const {
+    return reinterpret_cast<const Meshlet *>(m_data + header().meshletOffset);
+  }
+
+  size_t meshletCount() const { return header().meshletCount; }
+
+  const Lod *lods() const { return reinterpret_cast<const Lod *>(m_data + header().lodOffset); }
+
+  size_t lodCount() const { return header().lodCount; }
+
+private:
+  const std::byte *m_data = nullptr;
+  size_t m_size = 0;
+
+  MeshFile(const std::byte *data, size_t size) : m_data(data), m_size(size) {}
+};
+
+/**
+ * Writes a mesh file with vertices in the given layout, returns false and sets
+ * the error message on failure
+ */
+bool write(const std::string &path, const MeshData &mesh, std::string *error, Layout layout = Layout::PositionColor);
+
+/**
+ * Imports triangles and polygons (fan triangulated) from a Wavefront OBJ file.
+ * Vertex colors (v x y z r g b) are kept, vertices without one are colored by
+ * their position within the bounds, like the cube sample. Normals and texture
+ * coordinates are ignored.
+ */
+bool importOBJ(const std::string &path, MeshData &mesh, std::string *error);
+
+/**
+ * Centers the mesh on the origin and scales it to fit in [-1, 1]^3
+ */
+void normalize(MeshData &mesh);
+}
+
+#endif //LEARN_METAL_MESH_HPP
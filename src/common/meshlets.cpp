@@ -0,0 +1,153 @@
+#include "meshlets.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace psimd;
+
+namespace mesh {
+namespace {
+/**
+ * Bounding sphere around the AABB center of the meshlet's vertices, and the
+ * normal cone of its triangles
+ */
+void computeBounds(Meshlet &meshlet, const MeshData &mesh, const uint32_t *vertices, size_t vertexCount) {
+  float3 lo = mesh.vertices[vertices[0]].position, hi = lo;
+  for (size_t i = 1; i < vertexCount; i++) {
+    lo = min(lo, mesh.vertices[vertices[i]].position);
+    hi = max(hi, mesh.vertices[vertices[i]].position);
+  }
+  const float3 center = (lo + hi) * 0.5f;
+
+  float radiusSquared = 0.0f;
+  for (size_t i = 0; i < vertexCount; i++) {
+    radiusSquared = std::max(radiusSquared, length_squared(mesh.vertices[vertices[i]].position - center));
+  }
+
+  /*
+   * The cone axis is the average of the triangle normals, and its half angle
+   * the largest angle between the axis and any of them. Degenerate triangles
+   * face nowhere and are skipped.
+   */
+  const uint32_t *indices = mesh.indices.data() + meshlet.firstIndex;
+  float3 normals[maxMeshletTriangles];
+  size_t normalCount = 0;
+  float3 axis{0.0f};
+  for (size_t t = 0; t < meshlet.triangleCount; t++) {
+    const float3 p0 = mesh.vertices[indices[t * 3]].position;
+    const float3 p1 = mesh.vertices[indices[t * 3 + 1]].position;
+    const float3 p2 = mesh.vertices[indices[t * 3 + 2]].position;
+
+    const float3 n = cross(p1 - p0, p2 - p0);
+    const float area = length(n);
+    if (area == 0.0f) continue;
+    normals[normalCount++] = n / area;
+    axis += n / area;
+  }
+
+  float minDot = 1.0f;
+  const float axisLength = length(axis);
+  if (axisLength > 0.0f) {
+    axis /= axisLength;
+    for (size_t i = 0; i < normalCount; i++) minDot = std::min(minDot, dot(axis, normals[i]));
+  }
+
+  for (int k = 0; k < 3; k++) {
+    meshlet.center[k] = center[k];
+    meshlet.coneAxis[k] = axis[k];
+  }
+  meshlet.radius = std::sqrt(radiusSquared);
+
+  // A cone of 90 degrees or more always has a triangle facing the camera
+  meshlet.coneCutoff = normalCount > 0 && minDot > 0.0f ? std::sqrt(1.0f - minDot * minDot) : 1.0f;
+}
+}
+
+void buildMeshlets(MeshData &mesh) {
+  mesh.meshlets.clear();
+
+  /*
+   * Greedy split in triangle order: a meshlet ends when the next triangle
+   * would take it past either limit. mark holds the meshlet number (plus one)
+   * that last used each vertex, so counting new vertices is a lookup.
+   */
+  std::vector<uint32_t> mark(mesh.vertices.size(), 0);
+  uint32_t vertices[maxMeshletVertices];
+  Meshlet meshlet{};
+
+  auto finish = [&] {
+    if (meshlet.triangleCount == 0) return;
+    computeBounds(meshlet, mesh, vertices, meshlet.vertexCount);
+    mesh.meshlets.push_back(meshlet);
+  };
+
+  const size_t indexCount = mesh.lods.empty() ? mesh.indices.size() : mesh.lods[0].indexCount;
+  for (size_t i = 0; i + 2 < indexCount; i += 3) {
+    const uint32_t *tri = mesh.indices.data() + i;
+    auto id = uint32_t(mesh.meshlets.size() + 1);
+
+    size_t added = 0;
+    for (int k = 0; k < 3; k++) {
+      if (mark[tri[k]] != id && (k < 1 || tri[k] != tri[0]) && (k < 2 || tri[k] != tri[1])) added++;
+    }
+
+    if (meshlet.vertexCount + added > maxMeshletVertices || meshlet.triangleCount == maxMeshletTriangles) {
+      finish();
+      meshlet = {};
+      meshlet.firstIndex = uint32_t(i);
+      id = uint32_t(mesh.meshlets.size() + 1);
+    }
+
+    for (int k = 0; k < 3; k++) {
+      if (mark[tri[k]] != id) {
+        mark[tri[k]] = id;
+        vertices[meshlet.vertexCount++] = tri[k];
+      }
+    }
+    meshlet.triangleCount++;
+  }
+  finish();
+}
+
+CullView makeCullView(const float4x4 &mvp, float3 cameraPosition) {
+  return {cull::extractFrustum(mvp), cameraPosition};
+}
+
+bool isVisible(const Meshlet &meshlet, const CullView &view) {
+  /*
+   * Plain scalar math on the packed fields, loading them into vectors costs
+   * more than the tests themselves
+   */
+  const float cx = meshlet.center[0], cy = meshlet.center[1], cz = meshlet.center[2];
+  for (const float4 &plane: view.frustum.planes) {
+    if (plane.x * cx + plane.y * cy + plane.z * cz + plane.w < -meshlet.radius) return false;
+  }
+
+  /*
+   * Backfacing if the view direction to every point of the sphere is within
+   * 90 degrees of all normals in the cone
+   */
+  const float dx = cx - view.cameraPosition.x;
+  const float dy = cy - view.cameraPosition.y;
+  const float dz = cz - view.cameraPosition.z;
+  const float distance = std::sqrt(dx * dx + dy * dy + dz * dz);
+  const float projected = dx * meshlet.coneAxis[0] + dy * meshlet.coneAxis[1] + dz * meshlet.coneAxis[2];
+  return projected <= meshlet.coneCutoff * distance + meshlet.radius;
+}
+
+size_t cullMeshlets(const Meshlet *meshlets, size_t count, const CullView &view, std::vector<DrawRange> &ranges) {
+  size_t visible = 0;
+  for (size_t i = 0; i < count; i++) {
+    const Meshlet &m = meshlets[i];
+    if (!isVisible(m, view)) continue;
+    visible++;
+
+    if (!ranges.empty() && ranges.back().firstIndex + ranges.back().indexCount == m.firstIndex) {
+      ranges.back().indexCount += m.triangleCount * 3;
+    } else {
+      ranges.push_back({m.firstIndex, m.triangleCount * 3});
+    }
+  }
+  return visible;
+}
+}
@@ -0,0 +1,64 @@
+#ifndef LEARN_METAL_MESHLETS_HPP
+#define LEARN_METAL_MESHLETS_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "culling.hpp"
+#include "mesh.hpp"
+#include "simd-types.hpp"
+
+/**
+ * Meshlets: small clusters of triangles with their own bounds, so invisible
+ * parts of a mesh can be culled on the CPU before submission.
+ *
+ * Without mesh shaders each meshlet is drawn as a range of the regular index
+ * buffer, so meshlets are built from consecutive triangles. Run the vertex
+ * cache optimizer first, it keeps neighbouring triangles together.
+ */
+namespace mesh {
+constexpr size_t maxMeshletVertices = 64;
+constexpr size_t maxMeshletTriangles = 124;
+
+/**
+ * Builds meshlets over the indices of LOD 0, replacing mesh.meshlets
+ */
+void buildMeshlets(MeshData &mesh);
+
+/**
+ * Culling view in the mesh's object space: frustum and camera position
+ */
+struct CullView {
+  cull::Frustum frustum;
+  psimd::float3 cameraPosition;
+};
+
+/**
+ * View for a model-view-projection matrix, and the camera position in object
+ * space
+ */
+CullView makeCullView(const psimd::float4x4 &mvp, psimd::float3 cameraPosition);
+
+/**
+ * False if the meshlet's bounding sphere is outside the frustum, or its normal
+ * cone faces away from the camera
+ */
+bool isVisible(const Meshlet &meshlet, const CullView &view);
+
+/**
+ * Index buffer range, in indices
+ */
+struct DrawRange {
+  uint32_t firstIndex;
+  uint32_t indexCount;
+};
+
+/**
+ * Culls meshlets and appends the visible ones to ranges, merging neighbours
+ * into a single range. Returns the number of visible meshlets.
+ */
+size_t cullMeshlets(const Meshlet *meshlets, size_t count, const CullView &view, std::vector<DrawRange> &ranges);
+}
+
+#endif //LEARN_METAL_MESHLETS_HPP
@@ -0,0 +1,447 @@
+#include "metal-backend.hpp"
+
+#include <filesystem>
+
+#include "utils.hpp"
+
+namespace gfx {
+namespace {
+/*
+ * Enum conversions
+ * CompareFunction, CullMode and Winding use the same values as their Metal
+ * counterparts, so those are plain casts
+ */
+MTL::PixelFormat toMTL(PixelFormat format) {
+  switch (format) {
+    case PixelFormat::BGRA8Unorm:
+      return MTL::PixelFormatBGRA8Unorm;
+    case PixelFormat::BGRA8Unorm_sRGB:
+      return MTL::PixelFormatBGRA8Unorm_sRGB;
+    case PixelFormat::Depth32Float:
+      return MTL::PixelFormatDepth32Float;
+    default:
+      return MTL::PixelFormatInvalid;
+  }
+}
+
+PixelFormat fromMTL(MTL::PixelFormat format) {
+  switch (format) {
+    case MTL::PixelFormatBGRA8Unorm:
+      return PixelFormat::BGRA8Unorm;
+    case MTL::PixelFormatBGRA8Unorm_sRGB:
+      return PixelFormat::BGRA8Unorm_sRGB;
+    case MTL::PixelFormatDepth32Float:
+      return PixelFormat::Depth32Float;
+    default:
+      return PixelFormat::Invalid;
+  }
+}
+
+MTL::VertexFormat toMTL(VertexFormat format) {
+  switch (format) {
+    case VertexFormat::Float2:
+      return MTL::VertexFormatFloat2;
+    case VertexFormat::Float3:
+      return MTL::VertexFormatFloat3;
+    case VertexFormat::Float4:
+      return MTL::VertexFormatFloat4;
+    case VertexFormat::Half2:
+      return MTL::VertexFormatHalf2;
+    case VertexFormat::Half4:
+      return MTL::VertexFormatHalf4;
+    case VertexFormat::Short2Normalized:
+      return MTL::VertexFormatShort2Normalized;
+    case VertexFormat::Short4Normalized:
+      return MTL::VertexFormatShort4Normalized;
+    case VertexFormat::UChar4Normalized:
+      return MTL::VertexFormatUChar4Normalized;
+  }
+  return MTL::VertexFormatInvalid;
+}
+
+MTL::ResourceOptions toMTL(StorageMode mode) {
+  switch (mode) {
+    case StorageMode::Shared:
+      return MTL::ResourceStorageModeShared;
+    case StorageMode::Managed:
+      return MTL::ResourceStorageModeManaged;
+    case StorageMode::Private:
+      return MTL::ResourceStorageModePrivate;
+  }
+  return MTL::ResourceStorageModeShared;
+}
+
+MTL::IndexType toMTL(IndexType type) {
+  return type == IndexType::UInt16 ? MTL::IndexTypeUInt16 : MTL::IndexTypeUInt32;
+}
+
+/*
+ * Resources
+ */
+class MetalBuffer : public Buffer {
+public:
+  MetalBuffer(MTL::Buffer *buffer, StorageMode storageMode) : m_buffer(buffer), m_storageMode(storageMode) {}
+
+  ~MetalBuffer() override { m_buffer->release(); }
+
+  void *contents() override { return m_buffer->contents(); }
+
+  size_t length() const override { return m_buffer->length(); }
+
+  void didModifyRange(size_t offset, size_t length) override {
+    if (m_storageMode == StorageMode::Managed) m_buffer->didModifyRange(NS::Range::Make(offset, length));
+  }
+
+  MTL::Buffer *buffer() const { return m_buffer; }
+
+private:
+  MTL::Buffer *m_buffer;
+  StorageMode m_storageMode;
+};
+
+class MetalRenderPipelineState : public RenderPipelineState {
+public:
+  explicit MetalRenderPipelineState(MTL::RenderPipelineState *pso) : pso(pso) {}
+
+  ~MetalRenderPipelineState() override { pso->release(); }
+
+  MTL::RenderPipelineState *pso;
+};
+
+class MetalDepthStencilState : public DepthStencilState {
+public:
+  explicit MetalDepthStencilState(MTL::DepthStencilState *dsso) : dsso(dsso) {}
+
+  ~MetalDepthStencilState() override { dsso->release(); }
+
+  MTL::DepthStencilState *dsso;
+};
+
+class MetalPipelineArchive : public PipelineArchive {
+public:
+  MetalPipelineArchive(MTL::BinaryArchive *archive, std::string path) : archive(archive), m_path(std::move(path)) {}
+
+  ~MetalPipelineArchive() override { archive->release(); }
+
+  bool serialize(std::string *error) override {
+    NS::Error *nsError = nullptr;
+    if (archive->serializeToURL(NS::URL::fileURLWithPath(nsStr(m_path.c_str())), &nsError)) return true;
+    if (error) *error = nsError ? nsError->localizedDescription()->utf8String() : "Failed to write " + m_path;
+    return false;
+  }
+
+  const Stats &stats() const override { return m_stats; }
+
+  void countLookup(bool hit) { hit ? m_stats.hits++ : m_stats.misses++; }
+
+  MTL::BinaryArchive *archive;
+
+private:
+  std::string m_path;
+  Stats m_stats;
+};
+
+const MTL::Buffer *unwrap(const Buffer *buffer) {
+  return buffer ? static_cast<const MetalBuffer *>(buffer)->buffer() : nullptr;
+}
+
+/*
+ * Commands
+ */
+class MetalRenderCommandEncoder : public RenderCommandEncoder {
+public:
+  explicit MetalRenderCommandEncoder(MTL::RenderCommandEncoder *enc) : m_enc(enc) {}
+
+  void setRenderPipelineState(const RenderPipelineState *pso) override {
+    m_enc->setRenderPipelineState(static_cast<const MetalRenderPipelineState *>(pso)->pso);
+  }
+
+  void setDepthStencilState(const DepthStencilState *dsso) override {
+    m_enc->setDepthStencilState(static_cast<const MetalDepthStencilState *>(dsso)->dsso);
+  }
+
+  void setFrontFacingWinding(Winding winding) override {
+    m_enc->setFrontFacingWinding(static_cast<MTL::Winding>(winding));
+  }
+
+  void setCullMode(CullMode cullMode) override {
+    m_enc->setCullMode(static_cast<MTL::CullMode>(cullMode));
+  }
+
+  void setViewport(const Viewport &v) override {
+    m_enc->setViewport({v.originX, v.originY, v.width, v.height, v.znear, v.zfar});
+  }
+
+  void setVertexBuffer(const Buffer *buffer, size_t offset, size_t index) override {
+    m_enc->setVertexBuffer(unwrap(buffer), offset, index);
+  }
+
+  void setVertexBytes(const void *bytes, size_t length, size_t index) override {
+    m_enc->setVertexBytes(bytes, length, index);
+  }
+
+  void drawPrimitives(
+    PrimitiveType,
+    size_t vertexStart,
+    size_t vertexCount,
+    size_t instanceCount
+  ) override {
+    m_enc->drawPrimitives(MTL::PrimitiveTypeTriangle, vertexStart, vertexCount, instanceCount);
+  }
+
+  void drawIndexedPrimitives(
+    PrimitiveType,
+    size_t indexCount,
+    IndexType indexType,
+    const Buffer *indexBuffer,
+    size_t indexBufferOffset,
+    size_t instanceCount
+  ) override {
+    m_enc->drawIndexedPrimitives(
+      MTL::PrimitiveTypeTriangle,
+      indexCount,
+      toMTL(indexType),
+      unwrap(indexBuffer),
+      indexBufferOffset,
+      instanceCount
+    );
+  }
+
+  void endEncoding() override {
+    m_enc->endEncoding();
+  }
+
+private:
+  MTL::RenderCommandEncoder *m_enc;
+};
+
+class MetalParallelRenderCommandEncoder : public ParallelRenderCommandEncoder {
+public:
+  explicit MetalParallelRenderCommandEncoder(MTL::ParallelRenderCommandEncoder *enc) : m_enc(enc) {}
+
+  RenderCommandEncoder *renderCommandEncoder() override {
+    m_encoders.push_back(std::make_unique<MetalRenderCommandEncoder>(m_enc->renderCommandEncoder()));
+    return m_encoders.back().get();
+  }
+
+  void endEncoding() override {
+    m_enc->endEncoding();
+  }
+
+private:
+  MTL::ParallelRenderCommandEncoder *m_enc;
+  std::vector<std::unique_ptr<MetalRenderCommandEncoder>> m_encoders;
+};
+
+class MetalCommandBuffer : public CommandBuffer {
+public:
+  explicit MetalCommandBuffer(MTL::CommandBuffer *cmd) : m_cmd(cmd->retain()) {}
+
+  ~MetalCommandBuffer() override { m_cmd->release(); }
+
+  RenderCommandEncoder *renderCommandEncoder(RenderTarget &target) override {
+    MTK::View *view = static_cast<MetalViewTarget &>(target).view();
+    MTL::RenderPassDescriptor *rpd = view->currentRenderPassDescriptor();
+
+    m_encoders.push_back(std::make_unique<MetalRenderCommandEncoder>(m_cmd->renderCommandEncoder(rpd)));
+    return m_encoders.back().get();
+  }
+
+  ParallelRenderCommandEncoder *parallelRenderCommandEncoder(RenderTarget &target) override {
+    MTK::View *view = static_cast<MetalViewTarget &>(target).view();
+    MTL::RenderPassDescriptor *rpd = view->currentRenderPassDescriptor();
+
+    m_parallelEncoders.push_back(
+      std::make_unique<MetalParallelRenderCommandEncoder>(m_cmd->parallelRenderCommandEncoder(rpd))
+    );
+    return m_parallelEncoders.back().get();
+  }
+
+  void present(RenderTarget &target) override {
+    m_cmd->presentDrawable(static_cast<MetalViewTarget &>(target).view()->currentDrawable());
+  }
+
+  void addCompletedHandler(std::function<void()> handler) override {
+    m_cmd->addCompletedHandler([handler = std::move(handler)](MTL::CommandBuffer *) { handler(); });
+  }
+
+  void commit() override {
+    m_cmd->commit();
+  }
+
+private:
+  MTL::CommandBuffer *m_cmd;
+  std::vector<std::unique_ptr<MetalRenderCommandEncoder>> m_encoders;
+  std::vector<std::unique_ptr<MetalParallelRenderCommandEncoder>> m_parallelEncoders;
+};
+
+class MetalCommandQueue : public CommandQueue {
+public:
+  explicit MetalCommandQueue(MTL::CommandQueue *queue) : m_queue(queue) {}
+
+  ~MetalCommandQueue() override { m_queue->release(); }
+
+  std::unique_ptr<CommandBuffer> commandBuffer() override {
+    return std::make_unique<MetalCommandBuffer>(m_queue->commandBuffer());
+  }
+
+private:
+  MTL::CommandQueue *m_queue;
+};
+}
+
+/*
+ * View render target
+ */
+MetalViewTarget::MetalViewTarget(MTK::View *view) : m_view(view) {
+}
+
+uint32_t MetalViewTarget::width() const {
+  return static_cast<uint32_t>(m_view->drawableSize().width);
+}
+
+uint32_t MetalViewTarget::height() const {
+  return static_cast<uint32_t>(m_view->drawableSize().height);
+}
+
+PixelFormat MetalViewTarget::colorPixelFormat() const {
+  return fromMTL(m_view->colorPixelFormat());
+}
+
+PixelFormat MetalViewTarget::depthPixelFormat() const {
+  return fromMTL(m_view->depthStencilPixelFormat());
+}
+
+/*
+ * Device
+ */
+MetalDevice::MetalDevice(MTL::Device *device) : m_device(device->retain()) {
+}
+
+MetalDevice::~MetalDevice() {
+  for (auto &[name, lib]: m_libraries) lib->release();
+  m_device->release();
+}
+
+MTL::Library *MetalDevice::library(const std::string &name, NS::Error **error) {
+  auto it = m_libraries.find(name);
+  if (it != m_libraries.end()) return it->second;
+
+  MTL::Library *lib = m_device->newLibrary(nsStr(name.c_str()), error);
+  if (lib) m_libraries.emplace(name, lib);
+  return lib;
+}
+
+std::unique_ptr<Buffer> MetalDevice::newBuffer(size_t length, StorageMode storageMode) {
+  return std::make_unique<MetalBuffer>(m_device->newBuffer(length, toMTL(storageMode)), storageMode);
+}
+
+std::unique_ptr<RenderPipelineState> MetalDevice::newRenderPipelineState(
+  const RenderPipelineDescriptor &desc,
+  std::string *error
+) {
+  auto setError = [&](NS::Error *nsError, const std::string &fallback) {
+    if (error) *error = nsError ? nsError->localizedDescription()->utf8String() : fallback;
+  };
+
+  /*
+   * Get the shader library, loaded once per device, then load the shader
+   * functions
+   */
+  NS::Error *nsError = nullptr;
+  MTL::Library *lib = library(desc.library, &nsError);
+  if (!lib) {
+    setError(nsError, "Failed to load " + desc.library);
+    return nullptr;
+  }
+
+  MTL::Function *vertexFunction = lib->newFunction(nsStr(desc.vertexFunction.c_str()));
+  MTL::Function *fragmentFunction = lib->newFunction(nsStr(desc.fragmentFunction.c_str()));
+
+  /*
+   * Set up the Metal pipeline descriptor, including the vertex layout
+   */
+  auto mtlDesc = MTL::RenderPipelineDescriptor::alloc()->init();
+  mtlDesc->setVertexFunction(vertexFunction);
+  mtlDesc->setFragmentFunction(fragmentFunction);
+  mtlDesc->colorAttachments()->object(0)->setPixelFormat(toMTL(desc.colorPixelFormat));
+  mtlDesc->setDepthAttachmentPixelFormat(toMTL(desc.depthPixelFormat));
+
+  if (!desc.vertexDescriptor.attributes.empty()) {
+    auto vertexDesc = MTL::VertexDescriptor::alloc()->init();
+    for (size_t i = 0; i < desc.vertexDescriptor.attributes.size(); i++) {
+      const VertexAttribute &attrib = desc.vertexDescriptor.attributes[i];
+      auto attribDesc = vertexDesc->attributes()->object(i);
+      attribDesc->setFormat(toMTL(attrib.format));
+      attribDesc->setOffset(attrib.offset);
+      attribDesc->setBufferIndex(attrib.bufferIndex);
+    }
+    for (const VertexBufferLayout &layout: desc.vertexDescriptor.layouts) {
+      vertexDesc->layouts()->object(layout.bufferIndex)->setStride(layout.stride);
+    }
+
+    mtlDesc->setVertexDescriptor(vertexDesc);
+    vertexDesc->release();
+  }
+
+  /*
+   * With an archive, try to get the compiled pipeline from it without
+   * compiling anything. On a miss, add the pipeline to the archive (which
+   * compiles it), the pipeline state is then created from the archive.
+   */
+  MTL::RenderPipelineState *pso = nullptr;
+  if (vertexFunction && fragmentFunction) {
+    if (desc.archive) {
+      auto *archive = static_cast<MetalPipelineArchive *>(desc.archive);
+      mtlDesc->setBinaryArchives(NS::Array::array(archive->archive));
+      pso = m_device->newRenderPipelineState(mtlDesc, MTL::PipelineOptionFailOnBinaryArchiveMiss, nullptr, &nsError);
+      archive->countLookup(pso != nullptr);
+      if (!pso) {
+        // Not being able to archive it doesn't stop us from compiling it
+        archive->archive->addRenderPipelineFunctions(mtlDesc, nullptr);
+        nsError = nullptr;
+      }
+    }
+    if (!pso) pso = m_device->newRenderPipelineState(mtlDesc, &nsError);
+    if (!pso) setError(nsError, "Failed to create pipeline state");
+  } else {
+    setError(nullptr, "Missing shader function in " + desc.library);
+  }
+
+  if (vertexFunction) vertexFunction->release();
+  if (fragmentFunction) fragmentFunction->release();
+  mtlDesc->release();
+
+  return pso ? std::make_unique<MetalRenderPipelineState>(pso) : nullptr;
+}
+
+std::unique_ptr<DepthStencilState> MetalDevice::newDepthStencilState(const DepthStencilDescriptor &desc) {
+  auto depthStencilDesc = MTL::DepthStencilDescriptor::alloc()->init();
+  depthStencilDesc->setDepthWriteEnabled(desc.depthWriteEnabled);
+  depthStencilDesc->setDepthCompareFunction(static_cast<MTL::CompareFunction>(desc.depthCompareFunction));
+
+  MTL::DepthStencilState *dsso = m_device->newDepthStencilState(depthStencilDesc);
+  depthStencilDesc->release();
+
+  return std::make_unique<MetalDepthStencilState>(dsso);
+}
+
+std::unique_ptr<PipelineArchive> MetalDevice::newPipelineArchive(const std::string &path, std::string *error) {
+  // Without a URL the archive starts empty
+  auto archiveDesc = MTL::BinaryArchiveDescriptor::alloc()->init();
+  if (std::filesystem::exists(path)) archiveDesc->setUrl(NS::URL::fileURLWithPath(nsStr(path.c_str())));
+
+  NS::Error *nsError = nullptr;
+  MTL::BinaryArchive *archive = m_device->newBinaryArchive(archiveDesc, &nsError);
+  archiveDesc->release();
+  if (!archive) {
+    if (error) *error = nsError ? nsError->localizedDescription()->utf8String() : "Failed to open " + path;
+    return nullptr;
+  }
+  return std::make_unique<MetalPipelineArchive>(archive, path);
+}
+
+std::unique_ptr<CommandQueue> MetalDevice::newCommandQueue() {
+  return std::make_unique<MetalCommandQueue>(m_device->newCommandQueue());
+}
+}
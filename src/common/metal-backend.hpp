@@ -0,0 +1,74 @@
+#ifndef LEARN_METAL_METAL_BACKEND_HPP
+#define LEARN_METAL_METAL_BACKEND_HPP
+
+#include <map>
+#include <string>
+
+#include "Metal/Metal.hpp"
+#include "MetalKit/MetalKit.hpp"
+
+#include "render-backend.hpp"
+
+/**
+ * Metal implementation of the gfx backend interface
+ */
+namespace gfx {
+/**
+ * Render target backed by an MTK view: renders into the view's current
+ * drawable, using the view's pixel formats and clear values
+ */
+class MetalViewTarget : public RenderTarget {
+public:
+  explicit MetalViewTarget(MTK::View *view);
+
+  uint32_t width() const override;
+
+  uint32_t height() const override;
+
+  PixelFormat colorPixelFormat() const override;
+
+  PixelFormat depthPixelFormat() const override;
+
+  MTK::View *view() const { return m_view; }
+
+private:
+  MTK::View *m_view;
+};
+
+class MetalDevice : public Device {
+public:
+  explicit MetalDevice(MTL::Device *device);
+
+  ~MetalDevice() override;
+
+  std::unique_ptr<Buffer> newBuffer(size_t length, StorageMode storageMode) override;
+
+  std::unique_ptr<RenderPipelineState> newRenderPipelineState(
+    const RenderPipelineDescriptor &desc,
+    std::string *error
+  ) override;
+
+  std::unique_ptr<DepthStencilState> newDepthStencilState(const DepthStencilDescriptor &desc) override;
+
+  /**
+   * Wraps an MTL::BinaryArchive. An archive written by another GPU or OS
+   * version fails to open, delete the file to start over.
+   */
+  std::unique_ptr<PipelineArchive> newPipelineArchive(const std::string &path, std::string *error) override;
+
+  std::unique_ptr<CommandQueue> newCommandQueue() override;
+
+  MTL::Device *device() const { return m_device; }
+
+private:
+  MTL::Device *m_device;
+  std::map<std::string, MTL::Library *> m_libraries; // Shader libraries loaded so far, by file name
+
+  /**
+   * Loads a shader library the first time it's used, owned by the device
+   */
+  MTL::Library *library(const std::string &name, NS::Error **error);
+};
+}
+
+#endif //LEARN_METAL_METAL_BACKEND_HPP
@@ -0,0 +1,289 @@
+#include "occlusion.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#include "parallel.hpp"
+
+using namespace psimd;
+
+namespace cull {
+namespace {
+/**
+ * Per lane: min(stored, depth) where coverage >= 0, stored elsewhere
+ */
+inline detail::f128 depthWhereCovered(detail::f128 stored, detail::f128 depth, detail::f128 coverage) {
+#if defined(PSIMD_SSE)
+  const __m128 mask = _mm_cmpge_ps(coverage, _mm_setzero_ps());
+  return _mm_or_ps(_mm_and_ps(mask, _mm_min_ps(stored, depth)), _mm_andnot_ps(mask, stored));
+#elif defined(PSIMD_NEON)
+  return vbslq_f32(vcgeq_f32(coverage, vdupq_n_f32(0.0f)), vminq_f32(stored, depth), stored);
+#else
+  for (int k = 0; k < 4; k++) {
+    if (coverage.v[k] >= 0.0f) stored.v[k] = std::min(stored.v[k], depth.v[k]);
+  }
+  return stored;
+#endif
+}
+
+inline float lanesMin(detail::f128 v) {
+  alignas(16) float lanes[4];
+  detail::store(lanes, v);
+  return std::min(std::min(lanes[0], lanes[1]), std::min(lanes[2], lanes[3]));
+}
+
+inline float lanesMax(detail::f128 v) {
+  alignas(16) float lanes[4];
+  detail::store(lanes, v);
+  return std::max(std::max(lanes[0], lanes[1]), std::max(lanes[2], lanes[3]));
+}
+}
+
+/**
+ * Triangle set up for rasterization at integer pixel coordinates. The edge
+ * functions are positive inside, the depth plane is offset to the farthest
+ * depth over a pixel.
+ */
+struct OcclusionBuffer::Triangle {
+  float edgeA[3], edgeB[3], edgeC[3];
+  float depthA, depthB, depthC;
+  int32_t minX, minY, maxX, maxY;
+};
+
+OcclusionBuffer::OcclusionBuffer(uint32_t width, uint32_t height) {
+  resize(width, height);
+}
+
+OcclusionBuffer::~OcclusionBuffer() = default;
+
+void OcclusionBuffer::resize(uint32_t width, uint32_t height) {
+  m_width = (std::max(width, 1u) + tileWidth - 1) / tileWidth * tileWidth;
+  m_height = (std::max(height, 1u) + tileHeight - 1) / tileHeight * tileHeight;
+  m_tilesX = m_width / tileWidth;
+  m_tilesY = m_height / tileHeight;
+
+  // Down to a single texel, odd sizes round up and the last row/column only has one child
+  m_triangles.clear();
+  m_levels.clear();
+  uint32_t w = m_width, h = m_height;
+  while (true) {
+    m_levels.push_back({w, h, std::vector<float>(size_t(w) * h, INFINITY)});
+    if (w == 1 && h == 1) break;
+    w = (w + 1) / 2, h = (h + 1) / 2;
+  }
+  m_tileStart.resize(size_t(m_tilesX) * m_tilesY + 1);
+}
+
+void OcclusionBuffer::clear() {
+  m_triangles.clear();
+}
+
+void OcclusionBuffer::addOccluder(const float4x4 &mvp, const float3 *positions, size_t vertexCount,
+                                  const uint32_t *indices, size_t indexCount) {
+  m_clip.resize(vertexCount);
+  for (size_t i = 0; i < vertexCount; i++) m_clip[i] = mvp * make_float4(positions[i], 1.0f);
+
+  const float halfWidth = float(m_width) * 0.5f, halfHeight = float(m_height) * 0.5f;
+
+  for (size_t i = 0; i + 2 < indexCount; i += 3) {
+    float x[3], y[3], z[3];
+    bool clipped = false;
+    for (int k = 0; k < 3; k++) {
+      const float4 &p = m_clip[indices[i + k]];
+      clipped |= !(p.w > 0.0f && p.z >= 0.0f);
+      const float invW = 1.0f / p.w;
+      x[k] = (p.x * invW + 1.0f) * halfWidth;
+      y[k] = (1.0f - p.y * invW) * halfHeight;
+      z[k] = p.z * invW;
+    }
+    if (clipped) continue;
+
+    // Window y points down, counter-clockwise (front facing) in NDC is a negative area here
+    float area = (x[1] - x[0]) * (y[2] - y[0]) - (y[1] - y[0]) * (x[2] - x[0]);
+    if (!(area < 0.0f)) continue;
+    std::swap(x[1], x[2]), std::swap(y[1], y[2]), std::swap(z[1], z[2]);
+    area = -area;
+
+    // Pixel bounds, clamped before the conversion as vertices near w = 0 are far off screen
+    const float width = float(m_width), height = float(m_height);
+    Triangle tri;
+    tri.minX = int32_t(std::floor(std::clamp(std::min({x[0], x[1], x[2]}), 0.0f, width)));
+    tri.minY = int32_t(std::floor(std::clamp(std::min({y[0], y[1], y[2]}), 0.0f, height)));
+    tri.maxX = int32_t(std::ceil(std::clamp(std::max({x[0], x[1], x[2]}), 0.0f, width))) - 1;
+    tri.maxY = int32_t(std::ceil(std::clamp(std::max({y[0], y[1], y[2]}), 0.0f, height))) - 1;
+    if (tri.minX > tri.maxX || tri.minY > tri.maxY) continue;
+
+    // Edge a -> b is a x + b y + c, evaluated at the pixel center
+    for (int k = 0; k < 3; k++) {
+      const int a = k, b = (k + 1) % 3;
+      const float ea = y[a] - y[b], eb = x[b] - x[a];
+      tri.edgeA[k] = ea;
+      tri.edgeB[k] = eb;
+      tri.edgeC[k] = -ea * x[a] - eb * y[a] + 0.5f * (ea + eb);
+    }
+
+    const float dzdx = ((z[1] - z[0]) * (y[2] - y[0]) - (z[2] - z[0]) * (y[1] - y[0])) / area;
+    const float dzdy = ((z[2] - z[0]) * (x[1] - x[0]) - (z[1] - z[0]) * (x[2] - x[0])) / area;
+    tri.depthA = dzdx;
+    tri.depthB = dzdy;
+    tri.depthC = z[0] - dzdx * x[0] - dzdy * y[0] + 0.5f * (dzdx + dzdy) + 0.5f * (std::abs(dzdx) + std::abs(dzdy));
+
+    m_triangles.push_back(tri);
+  }
+}
+
+void OcclusionBuffer::render() {
+  /*
+   * Bin the triangles into the tiles their bounds overlap
+   */
+  std::fill(m_tileStart.begin(), m_tileStart.end(), 0u);
+  auto forTiles = [&](const Triangle &tri, auto &&fn) {
+    for (int32_t ty = tri.minY / int32_t(tileHeight); ty <= tri.maxY / int32_t(tileHeight); ty++) {
+      for (int32_t tx = tri.minX / int32_t(tileWidth); tx <= tri.maxX / int32_t(tileWidth); tx++) {
+        fn(size_t(ty) * m_tilesX + size_t(tx));
+      }
+    }
+  };
+  for (const Triangle &tri: m_triangles) forTiles(tri, [&](size_t tile) { m_tileStart[tile + 1]++; });
+  for (size_t i = 1; i < m_tileStart.size(); i++) m_tileStart[i] += m_tileStart[i - 1];
+
+  m_tileTriangles.resize(m_tileStart.back());
+  std::vector<uint32_t> fill(m_tileStart.begin(), m_tileStart.end() - 1);
+  for (size_t t = 0; t < m_triangles.size(); t++) {
+    forTiles(m_triangles[t], [&](size_t tile) { m_tileTriangles[fill[tile]++] = uint32_t(t); });
+  }
+
+  par::parallelFor(size_t(m_tilesX) * m_tilesY, [&](size_t tile) { rasterizeTile(uint32_t(tile)); });
+  buildPyramid();
+}
+
+void OcclusionBuffer::rasterizeTile(uint32_t tile) {
+  const int32_t tileX = int32_t(tile % m_tilesX * tileWidth), tileY = int32_t(tile / m_tilesX * tileHeight);
+  float *depth = m_levels[0].depth.data();
+
+  for (int32_t y = tileY; y < tileY + int32_t(tileHeight); y++) {
+    std::fill_n(depth + size_t(y) * m_width + tileX, tileWidth, INFINITY);
+  }
+
+  /*
+   * Four pixels of a row at a time. Spans start on a multiple of four, tiles
+   * are a multiple of four wide, so they never leave the tile.
+   */
+  constexpr float lanes[4] = {0.0f, 1.0f, 2.0f, 3.0f};
+  const detail::f128 laneOffsets = detail::loadu(lanes);
+  const detail::f128 four = detail::splat(4.0f);
+
+  for (uint32_t i = m_tileStart[tile]; i < m_tileStart[tile + 1]; i++) {
+    const Triangle &tri = m_triangles[m_tileTriangles[i]];
+    const int32_t minX = std::max(tri.minX, tileX) & ~3, maxX = std::min(tri.maxX, tileX + int32_t(tileWidth) - 1);
+    const int32_t minY = std::max(tri.minY, tileY), maxY = std::min(tri.maxY, tileY + int32_t(tileHeight) - 1);
+
+    const detail::f128 a0 = detail::splat(tri.edgeA[0]), a1 = detail::splat(tri.edgeA[1]), a2 = detail::splat(tri.edgeA[2]);
+    const detail::f128 depthA = detail::splat(tri.depthA);
+
+    for (int32_t y = minY; y <= maxY; y++) {
+      const float fy = float(y);
+      const detail::f128 c0 = detail::splat(tri.edgeB[0] * fy + tri.edgeC[0]);
+      const detail::f128 c1 = detail::splat(tri.edgeB[1] * fy + tri.edgeC[1]);
+      const detail::f128 c2 = detail::splat(tri.edgeB[2] * fy + tri.edgeC[2]);
+      const detail::f128 depthRow = detail::splat(tri.depthB * fy + tri.depthC);
+
+      float *row = depth + size_t(y) * m_width;
+      detail::f128 xs = detail::add(detail::splat(float(minX)), laneOffsets);
+      for (int32_t x = minX; x <= maxX; x += 4, xs = detail::add(xs, four)) {
+        const detail::f128 coverage = detail::min(detail::min(detail::madd(a0, xs, c0), detail::madd(a1, xs, c1)),
+                                                  detail::madd(a2, xs, c2));
+        const detail::f128 z = detail::madd(depthA, xs, depthRow);
+        detail::storeu(row + x, depthWhereCovered(detail::loadu(row + x), z, coverage));
+      }
+    }
+  }
+}
+
+void OcclusionBuffer::buildPyramid() {
+  for (size_t l = 1; l < m_levels.size(); l++) {
+    const Level &src = m_levels[l - 1];
+    Level &dst = m_levels[l];
+    for (uint32_t y = 0; y < dst.height; y++) {
+      const float *row0 = src.depth.data() + size_t(2 * y) * src.width;
+      const float *row1 = 2 * y + 1 < src.height ? row0 + src.width : row0;
+      float *out = dst.depth.data() + size_t(y) * dst.width;
+      for (uint32_t x = 0; x < dst.width; x++) {
+        const uint32_t x0 = 2 * x, x1 = std::min(2 * x + 1, src.width - 1);
+        out[x] = std::max(std::max(row0[x0], row0[x1]), std::max(row1[x0], row1[x1]));
+      }
+    }
+  }
+}
+
+size_t OcclusionBuffer::triangleCount() const {
+  return m_triangles.size();
+}
+
+bool OcclusionBuffer::isSphereVisible(const float4x4 &viewProjection, float3 center, float radius) const {
+  /*
+   * Screen rectangle and nearest depth of the sphere's bounding box, from its
+   * corners in clip space. Corners are center +-ex +-ey +-ez, with the matrix
+   * columns scaled by the radius, four corners per vector and one vector per
+   * clip space component.
+   */
+  constexpr float signsX[4] = {-1.0f, 1.0f, -1.0f, 1.0f}, signsY[4] = {-1.0f, -1.0f, 1.0f, 1.0f};
+  const detail::f128 sx = detail::loadu(signsX), sy = detail::loadu(signsY);
+  const float4 *m = viewProjection.columns;
+
+  detail::f128 lo[4], hi[4];
+  for (int j = 0; j < 4; j++) {
+    const float c = m[0][j] * center.x + m[1][j] * center.y + m[2][j] * center.z + m[3][j];
+    const detail::f128 xy = detail::madd(sx, detail::splat(m[0][j] * radius), detail::madd(sy, detail::splat(m[1][j] * radius), detail::splat(c)));
+    const detail::f128 ez = detail::splat(m[2][j] * radius);
+    lo[j] = detail::sub(xy, ez), hi[j] = detail::add(xy, ez);
+  }
+
+  if (!(lanesMin(detail::min(lo[3], hi[3])) > 0.0f && lanesMin(detail::min(lo[2], hi[2])) >= 0.0f)) {
+    return true; // Crosses the near plane
+  }
+  const detail::f128 invLo = detail::div(detail::splat(1.0f), lo[3]), invHi = detail::div(detail::splat(1.0f), hi[3]);
+  const detail::f128 xLo = detail::mul(lo[0], invLo), xHi = detail::mul(hi[0], invHi);
+  const detail::f128 yLo = detail::mul(lo[1], invLo), yHi = detail::mul(hi[1], invHi);
+  const float minX = lanesMin(detail::min(xLo, xHi)), maxX = lanesMax(detail::max(xLo, xHi));
+  const float minY = lanesMin(detail::min(yLo, yHi)), maxY = lanesMax(detail::max(yLo, yHi));
+  const float minZ = lanesMin(detail::min(detail::mul(lo[2], invLo), detail::mul(hi[2], invHi)));
+  if (maxX < -1.0f || minX > 1.0f || maxY < -1.0f || minY > 1.0f) return true; // Left to frustum culling
+
+  const float halfWidth = float(m_width) * 0.5f, halfHeight = float(m_height) * 0.5f;
+  const auto pixel = [](float v, uint32_t size) { return uint32_t(std::clamp(v, 0.0f, float(size - 1))); };
+  uint32_t x0 = pixel((minX + 1.0f) * halfWidth, m_width), x1 = pixel((maxX + 1.0f) * halfWidth, m_width);
+  uint32_t y0 = pixel((1.0f - maxY) * halfHeight, m_height), y1 = pixel((1.0f - minY) * halfHeight, m_height);
+
+  /*
+   * Finest level the rectangle covers at most 4x4 texels of. A single 2x2
+   * lookup is cheaper, but coarse texels reach past the occluders' edges and
+   * end up with no depth. Visible as soon as one texel is behind the sphere.
+   */
+  size_t level = 0;
+  while ((x1 - x0 > 3 || y1 - y0 > 3) && level + 1 < m_levels.size()) {
+    x0 >>= 1, x1 >>= 1, y0 >>= 1, y1 >>= 1;
+    level++;
+  }
+
+  const Level &l = m_levels[level];
+  for (uint32_t y = y0; y <= y1; y++) {
+    const float *row = l.depth.data() + size_t(y) * l.width;
+    for (uint32_t x = x0; x <= x1; x++) {
+      if (row[x] >= minZ) return true;
+    }
+  }
+  return false;
+}
+
+size_t OcclusionBuffer::cullSpheres(const float4x4 &viewProjection, const SphereArrays &spheres, uint32_t *indices,
+                                    size_t count) const {
+  size_t n = 0;
+  for (size_t k = 0; k < count; k++) {
+    const uint32_t i = indices[k];
+    indices[n] = i;
+    n += isSphereVisible(viewProjection, {spheres.x[i], spheres.y[i], spheres.z[i]}, spheres.radius[i]);
+  }
+  return n;
+}
+}
@@ -0,0 +1,113 @@
+#ifndef LEARN_METAL_OCCLUSION_HPP
+#define LEARN_METAL_OCCLUSION_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "culling.hpp"
+#include "simd-types.hpp"
+
+namespace cull {
+/**
+ * Occlusion culling against a low resolution depth buffer rasterized on the
+ * CPU. A few large occluders are drawn each frame, a hierarchical Z pyramid
+ * (farthest depth of 2x2 texels per level) is built on top, and bounds are
+ * rejected if they're behind everything drawn over the screen area they cover.
+ *
+ * Pixels take the farthest depth an occluder has over them, so depth is
+ * conservative. Coverage is sampled at pixel centers (a pixel only partly
+ * covered along a triangle's edge would open cracks between triangles), so
+ * occluder silhouettes are accurate to half a pixel. Like the render pipeline,
+ * it keeps counter-clockwise (front facing) triangles only and drops those
+ * crossing the near plane (z < 0). Depth is z / w.
+ */
+class OcclusionBuffer {
+public:
+  static constexpr uint32_t tileWidth = 32;
+  static constexpr uint32_t tileHeight = 16;
+
+  /**
+   * Size in pixels, rounded up to whole tiles. The buffer covers the whole
+   * viewport, tests are most precise if it has the same aspect ratio.
+   */
+  explicit OcclusionBuffer(uint32_t width = 256, uint32_t height = 128);
+
+  ~OcclusionBuffer();
+
+  /**
+   * Changes the size, forgets the occluders and depth
+   */
+  void resize(uint32_t width, uint32_t height);
+
+  uint32_t width() const { return m_width; }
+
+  uint32_t height() const { return m_height; }
+
+  /**
+   * Forgets the occluders, for a new frame
+   */
+  void clear();
+
+  /**
+   * Adds a triangle list, positions in object space transformed by mvp.
+   * Occluders must not cover more than what they stand for, use the mesh
+   * itself or a simplified version of it.
+   */
+  void addOccluder(const psimd::float4x4 &mvp, const psimd::float3 *positions, size_t vertexCount,
+                   const uint32_t *indices, size_t indexCount);
+
+  /**
+   * Rasterizes the occluders, tiles in parallel, and builds the pyramid
+   */
+  void render();
+
+  /**
+   * False if the sphere (in the space viewProjection transforms from) is
+   * entirely behind the occluders
+   */
+  bool isSphereVisible(const psimd::float4x4 &viewProjection, psimd::float3 center, float radius) const;
+
+  /**
+   * Removes the occluded spheres from a list of sphere indices, keeping the
+   * order, and returns the new count
+   */
+  size_t cullSpheres(const psimd::float4x4 &viewProjection, const SphereArrays &spheres, uint32_t *indices,
+                     size_t count) const;
+
+  /**
+   * Triangles kept from the occluders by the last render
+   */
+  size_t triangleCount() const;
+
+  /**
+   * Depth of each pixel, row by row from the top, infinity where nothing was drawn
+   */
+  const float *depth() const { return m_levels[0].depth.data(); }
+
+private:
+  struct Triangle;
+
+  struct Level {
+    uint32_t width, height;
+    std::vector<float> depth;
+  };
+
+  uint32_t m_width, m_height;
+  uint32_t m_tilesX, m_tilesY;
+  std::vector<Level> m_levels;
+
+  std::vector<Triangle> m_triangles;
+  std::vector<psimd::float4> m_clip;
+
+  // Triangles per tile, a counting sort like the rasterizer's bins
+  std::vector<uint32_t> m_tileStart;
+  std::vector<uint32_t> m_tileTriangles;
+
+  void rasterizeTile(uint32_t tile);
+
+  void buildPyramid();
+};
+}
+
+#endif //LEARN_METAL_OCCLUSION_HPP
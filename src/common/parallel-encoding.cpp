@@ -0,0 +1,31 @@
+#include "parallel-encoding.hpp"
+
+#include <algorithm>
+#include <vector>
+
+#include "jobs.hpp"
+
+namespace gfx {
+void encodeParallel(ParallelRenderCommandEncoder &pass, size_t count, size_t chunkCount, const RecordFunction &record) {
+  chunkCount = std::clamp<size_t>(chunkCount, 1, std::max<size_t>(count, 1));
+
+  // Creation order is execution order, so the sub-encoders are made here, in order
+  std::vector<RenderCommandEncoder *> encoders(chunkCount);
+  for (RenderCommandEncoder *&encoder: encoders) encoder = pass.renderCommandEncoder();
+
+  // One job per chunk, the caller records the first one
+  jobs::Counter recorded;
+  auto recordChunk = [&](size_t chunk) {
+    record(*encoders[chunk], count * chunk / chunkCount, count * (chunk + 1) / chunkCount);
+    encoders[chunk]->endEncoding();
+  };
+  for (size_t chunk = 1; chunk < chunkCount; chunk++) jobs::run([&recordChunk, chunk] { recordChunk(chunk); }, &recorded);
+  recordChunk(0);
+  jobs::wait(recorded);
+  pass.endEncoding();
+}
+
+size_t encodingChunks(size_t count, size_t minDrawsPerChunk) {
+  return std::clamp<size_t>(count / std::max<size_t>(minDrawsPerChunk, 1), 1, jobs::threadLimit());
+}
+}
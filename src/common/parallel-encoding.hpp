@@ -0,0 +1,30 @@
+#ifndef LEARN_METAL_PARALLEL_ENCODING_HPP
+#define LEARN_METAL_PARALLEL_ENCODING_HPP
+
+#include <cstddef>
+#include <functional>
+
+#include "render-backend.hpp"
+
+namespace gfx {
+using RecordFunction = std::function<void(RenderCommandEncoder &encoder, size_t begin, size_t end)>;
+
+/**
+ * Records count draws from several threads. The draws are split into
+ * chunkCount contiguous chunks, each recorded by a job (see jobs.hpp) into
+ * its own sub-encoder of pass, so the commands end up in draw order whichever
+ * thread finishes first. record(encoder, begin, end) sets the state it needs,
+ * sub-encoders start from defaults, and encodes draws [begin, end). Ends the
+ * pass.
+ */
+void encodeParallel(ParallelRenderCommandEncoder &pass, size_t count, size_t chunkCount, const RecordFunction &record);
+
+/**
+ * Chunks worth splitting count draws into: one per thread, but none smaller
+ * than minDrawsPerChunk, below which setting up a sub-encoder costs more
+ * than it saves
+ */
+size_t encodingChunks(size_t count, size_t minDrawsPerChunk);
+}
+
+#endif //LEARN_METAL_PARALLEL_ENCODING_HPP
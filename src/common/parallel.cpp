@@ -0,0 +1,19 @@
+#include "parallel.hpp"
+
+#include <algorithm>
+
+#include "jobs.hpp"
+
+namespace par {
+size_t threadCount() {
+  return jobs::threadCount();
+}
+
+void parallelFor(size_t count, const std::function<void(size_t)> &fn) {
+  // A few ranges per thread, so stealing can even out uneven indices
+  const size_t grain = std::max<size_t>(1, count / (jobs::threadLimit() * 8));
+  jobs::parallelFor(count, grain, [&](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; i++) fn(i);
+  });
+}
+}
@@ -0,0 +1,22 @@
+#ifndef LEARN_METAL_PARALLEL_HPP
+#define LEARN_METAL_PARALLEL_HPP
+
+#include <cstddef>
+#include <functional>
+
+namespace par {
+/**
+ * Number of threads parallelFor spreads work over, including the caller
+ */
+size_t threadCount();
+
+/**
+ * Calls fn(i) for every i in [0, count) on the job system's threads (see
+ * jobs.hpp) and blocks until all calls have returned. The calling thread takes
+ * part in the work, and nested calls (from inside fn) are split over idle
+ * threads too.
+ */
+void parallelFor(size_t count, const std::function<void(size_t)> &fn);
+}
+
+#endif //LEARN_METAL_PARALLEL_HPP
@@ -0,0 +1,108 @@
+#include "pipeline-cache.hpp"
+
+namespace gfx {
+std::string pipelineKey(const RenderPipelineDescriptor &desc) {
+  std::string key = desc.library + ":" + desc.vertexFunction + ":" + desc.fragmentFunction;
+  key += ":color=" + std::to_string(int(desc.colorPixelFormat));
+  key += ":depth=" + std::to_string(int(desc.depthPixelFormat));
+  for (const VertexAttribute &attrib: desc.vertexDescriptor.attributes) {
+    key += ":attrib=" + std::to_string(int(attrib.format)) + "," + std::to_string(attrib.offset) + "," +
+           std::to_string(attrib.bufferIndex);
+  }
+  for (const VertexBufferLayout &layout: desc.vertexDescriptor.layouts) {
+    key += ":layout=" + std::to_string(layout.bufferIndex) + "," + std::to_string(layout.stride);
+  }
+  return key;
+}
+
+std::string pipelineKey(const DepthStencilDescriptor &desc) {
+  return "depth=" + std::to_string(int(desc.depthCompareFunction)) + "," + std::to_string(int(desc.depthWriteEnabled));
+}
+
+uint64_t hashKey(std::string_view key) {
+  uint64_t hash = 0xcbf29ce484222325ull;
+  for (char c: key) {
+    hash ^= uint8_t(c);
+    hash *= 0x100000001b3ull;
+  }
+  return hash;
+}
+
+PipelineCache::PipelineCache(Device &device) : m_device(device) {
+}
+
+bool PipelineCache::openArchive(const std::string &path, std::string *error) {
+  std::unique_ptr<PipelineArchive> archive = m_device.newPipelineArchive(path, error);
+  if (!archive) return false;
+
+  std::lock_guard lock(m_mutex);
+  m_archive = std::move(archive);
+  m_savedMisses = m_archive->stats().misses;
+  return true;
+}
+
+bool PipelineCache::save(std::string *error) {
+  std::lock_guard lock(m_mutex);
+  if (!m_archive || m_archive->stats().misses == m_savedMisses) return true;
+  if (!m_archive->serialize(error)) return false;
+  m_savedMisses = m_archive->stats().misses;
+  return true;
+}
+
+template<typename State>
+const State *PipelineCache::find(const Map<State> &map, uint64_t hash, const std::string &key) {
+  auto it = map.find(hash);
+  if (it == map.end()) return nullptr;
+  for (const Entry<State> &entry: it->second) {
+    if (entry.key == key) return entry.state.get();
+  }
+  return nullptr;
+}
+
+const RenderPipelineState *PipelineCache::renderPipelineState(const RenderPipelineDescriptor &desc, std::string *error) {
+  std::string key = pipelineKey(desc);
+  const uint64_t hash = hashKey(key);
+
+  std::lock_guard lock(m_mutex);
+  m_stats.lookups++;
+  if (const RenderPipelineState *pso = find(m_pipelines, hash, key)) {
+    m_stats.memoryHits++;
+    return pso;
+  }
+
+  RenderPipelineDescriptor archived = desc;
+  archived.archive = m_archive.get();
+  std::unique_ptr<RenderPipelineState> pso = m_device.newRenderPipelineState(archived, error);
+  if (!pso) return nullptr;
+
+  m_stats.created++;
+  return m_pipelines[hash].emplace_back(Entry<RenderPipelineState>{std::move(key), std::move(pso)}).state.get();
+}
+
+const DepthStencilState *PipelineCache::depthStencilState(const DepthStencilDescriptor &desc) {
+  std::string key = pipelineKey(desc);
+  const uint64_t hash = hashKey(key);
+
+  std::lock_guard lock(m_mutex);
+  m_stats.lookups++;
+  if (const DepthStencilState *dsso = find(m_depthStencils, hash, key)) {
+    m_stats.memoryHits++;
+    return dsso;
+  }
+
+  m_stats.created++;
+  return m_depthStencils[hash].emplace_back(
+    Entry<DepthStencilState>{std::move(key), m_device.newDepthStencilState(desc)}
+  ).state.get();
+}
+
+PipelineCache::Stats PipelineCache::stats() const {
+  std::lock_guard lock(m_mutex);
+  Stats stats = m_stats;
+  if (m_archive) {
+    stats.archiveHits = m_archive->stats().hits;
+    stats.archiveMisses = m_archive->stats().misses;
+  }
+  return stats;
+}
+}
@@ -0,0 +1,100 @@
+#ifndef LEARN_METAL_PIPELINE_CACHE_HPP
+#define LEARN_METAL_PIPELINE_CACHE_HPP
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "render-backend.hpp"
+
+namespace gfx {
+/**
+ * Canonical text form of everything that makes a pipeline different from
+ * another: shader library and functions, vertex layout and attachment
+ * formats. Equal descriptors give equal keys.
+ */
+std::string pipelineKey(const RenderPipelineDescriptor &desc);
+
+std::string pipelineKey(const DepthStencilDescriptor &desc);
+
+/**
+ * 64-bit FNV-1a
+ */
+uint64_t hashKey(std::string_view key);
+
+/**
+ * Pipeline and depth/stencil states keyed by descriptor hash. Asking twice
+ * for the same descriptor returns the same state, so each variant is created
+ * once however many renderers or passes use it. With an archive open,
+ * compiled pipelines are also kept on disk across runs, which takes shader
+ * compilation off startup and off the first frame that uses a variant.
+ *
+ * States are owned by the cache and live as long as it does. Thread safe.
+ */
+class PipelineCache {
+public:
+  struct Stats {
+    uint64_t lookups = 0;
+    uint64_t memoryHits = 0;   // Lookups answered by a state created earlier
+    uint64_t created = 0;      // States created by the device
+    uint64_t archiveHits = 0;  // Of the pipelines created, compiled code found in the archive
+    uint64_t archiveMisses = 0;
+  };
+
+  explicit PipelineCache(Device &device);
+
+  PipelineCache(const PipelineCache &) = delete;
+
+  PipelineCache &operator=(const PipelineCache &) = delete;
+
+  /**
+   * Persists compiled pipelines in the archive at path (see
+   * Device::newPipelineArchive). Returns false and sets the error message if
+   * it can't be opened, the cache keeps working without it.
+   */
+  bool openArchive(const std::string &path, std::string *error);
+
+  /**
+   * Writes the archive if pipelines were added to it since it was opened or
+   * last saved. Returns false and sets the error message on failure.
+   */
+  bool save(std::string *error);
+
+  /**
+   * Returns nullptr and sets the error message on failure. Failures aren't
+   * cached, the next lookup tries again.
+   */
+  const RenderPipelineState *renderPipelineState(const RenderPipelineDescriptor &desc, std::string *error);
+
+  const DepthStencilState *depthStencilState(const DepthStencilDescriptor &desc);
+
+  Stats stats() const;
+
+private:
+  template<typename State>
+  struct Entry {
+    std::string key; // Compared on hash matches, so a collision can't return the wrong state
+    std::unique_ptr<State> state;
+  };
+
+  template<typename State>
+  using Map = std::unordered_map<uint64_t, std::vector<Entry<State>>>;
+
+  Device &m_device;
+  std::unique_ptr<PipelineArchive> m_archive;
+  uint64_t m_savedMisses = 0; // Archive misses when it was last opened or saved
+
+  mutable std::mutex m_mutex;
+  Map<RenderPipelineState> m_pipelines;
+  Map<DepthStencilState> m_depthStencils;
+  Stats m_stats;
+
+  template<typename State>
+  static const State *find(const Map<State> &map, uint64_t hash, const std::string &key);
+};
+}
+
+#endif //LEARN_METAL_PIPELINE_CACHE_HPP
@@ -0,0 +1,503 @@
+#include "rasterizer.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+
+#include "parallel.hpp"
+
+namespace raster {
+namespace {
+/*
+ * Color encoding
+ */
+struct SRGBTable {
+  static constexpr size_t size = 4096;
+  uint8_t encode[size + 1];
+
+  SRGBTable() : encode() {
+    for (size_t i = 0; i <= size; i++) {
+      float l = float(i) / float(size);
+      float s = l <= 0.0031308f ? l * 12.92f : 1.055f * std::pow(l, 1.0f / 2.4f) - 0.055f;
+      encode[i] = static_cast<uint8_t>(std::clamp(s * 255.0f + 0.5f, 0.0f, 255.0f));
+    }
+  }
+};
+
+const SRGBTable &srgbTable() {
+  static SRGBTable table;
+  return table;
+}
+
+inline uint8_t toUnorm(float v) {
+  return static_cast<uint8_t>(std::clamp(v, 0.0f, 1.0f) * 255.0f + 0.5f);
+}
+
+inline uint8_t toSRGB(const SRGBTable &table, float v) {
+  return table.encode[static_cast<size_t>(std::clamp(v, 0.0f, 1.0f) * float(SRGBTable::size) + 0.5f)];
+}
+
+inline uint32_t packBGRA8(const SRGBTable &table, float4 c) {
+  return uint32_t(toSRGB(table, c.z)) |
+         uint32_t(toSRGB(table, c.y)) << 8 |
+         uint32_t(toSRGB(table, c.x)) << 16 |
+         uint32_t(toUnorm(c.w)) << 24;
+}
+
+inline bool depthTest(CompareFunction fn, float fragment, float stored) {
+  switch (fn) {
+    case CompareFunction::Never:
+      return false;
+    case CompareFunction::Less:
+      return fragment < stored;
+    case CompareFunction::Equal:
+      return fragment == stored;
+    case CompareFunction::LessEqual:
+      return fragment <= stored;
+    case CompareFunction::Greater:
+      return fragment > stored;
+    case CompareFunction::NotEqual:
+      return fragment != stored;
+    case CompareFunction::GreaterEqual:
+      return fragment >= stored;
+    case CompareFunction::Always:
+      return true;
+  }
+  return false;
+}
+
+/*
+ * Clipping
+ * Triangles are clipped against the near and far planes (0 <= z <= w) and a
+ * guard band in x/y, so the fixed point setup below never overflows.
+ */
+constexpr float guardBand = 2.0f;
+constexpr size_t maxClipVertices = 9; // 3 + one per clip plane
+
+inline float clipDistance(const float4 &p, int plane) {
+  switch (plane) {
+    case 0:
+      return p.z;
+    case 1:
+      return p.w - p.z;
+    case 2:
+      return guardBand * p.w + p.x;
+    case 3:
+      return guardBand * p.w - p.x;
+    case 4:
+      return guardBand * p.w + p.y;
+    default:
+      return guardBand * p.w - p.y;
+  }
+}
+
+inline uint32_t outcode(const float4 &p) {
+  uint32_t code = 0;
+  for (int plane = 0; plane < 6; plane++) {
+    if (clipDistance(p, plane) < 0.0f) code |= 1u << plane;
+  }
+  return code;
+}
+
+inline Varyings lerp(const Varyings &a, const Varyings &b, float t) {
+  return {mix(a.position, b.position, t), mix(a.color, b.color, t)};
+}
+
+/**
+ * Sutherland-Hodgman against the planes in `planes`, returns the vertex count
+ */
+size_t clipPolygon(Varyings *poly, size_t count, uint32_t planes) {
+  Varyings scratch[maxClipVertices];
+  Varyings *in = poly, *out = scratch;
+
+  for (int plane = 0; plane < 6 && count >= 3; plane++) {
+    if (!(planes & (1u << plane))) continue;
+
+    size_t outCount = 0;
+    for (size_t i = 0; i < count; i++) {
+      const Varyings &a = in[i], &b = in[(i + 1) % count];
+      float da = clipDistance(a.position, plane), db = clipDistance(b.position, plane);
+
+      if (da >= 0.0f) out[outCount++] = a;
+      if ((da >= 0.0f) != (db >= 0.0f)) out[outCount++] = lerp(a, b, da / (da - db));
+    }
+
+    std::swap(in, out);
+    count = outCount;
+  }
+
+  if (in != poly) std::copy(in, in + count, poly);
+  return count;
+}
+}
+
+/**
+ * Triangle ready for rasterization: window space, fixed point (8 sub-pixel
+ * bits) vertex positions, ordered so the signed area is positive and all
+ * three edge functions are positive inside
+ */
+struct Rasterizer::SetupTriangle {
+  static constexpr int subPixelBits = 8;
+  static constexpr int64_t subPixelOne = 1 << subPixelBits;
+
+  int32_t x[3], y[3];
+  int64_t area;
+  int32_t bias[3];
+  int32_t minX, minY, maxX, maxY;
+
+  float z[3];
+  float invW[3];
+  float4 colorOverW[3];
+};
+
+/**
+ * Output of the setup stage for a contiguous range of triangles, triangles
+ * are binned per tile with a counting sort (tileStart is a prefix sum)
+ */
+struct Rasterizer::Chunk {
+  std::vector<SetupTriangle> triangles;
+  std::vector<uint32_t> tileStart;
+  std::vector<uint32_t> tileTriangles;
+  uint64_t culled = 0, clipped = 0;
+};
+
+/*
+ * Render target
+ */
+RenderTarget::RenderTarget(uint32_t width, uint32_t height)
+  : m_width(width), m_height(height), m_color(size_t(width) * height), m_depth(size_t(width) * height) {
+}
+
+void RenderTarget::clear(float4 color, float depth) {
+  std::fill(m_color.begin(), m_color.end(), packBGRA8(srgbTable(), color));
+  std::fill(m_depth.begin(), m_depth.end(), depth);
+}
+
+uint32_t RenderTarget::packColor(float4 color) {
+  return packBGRA8(srgbTable(), color);
+}
+
+bool RenderTarget::writeTGA(const char *path) const {
+  FILE *file = std::fopen(path, "wb");
+  if (!file) return false;
+
+  // Uncompressed true color, 32 bpp, origin at the top left
+  uint8_t header[18] = {};
+  header[2] = 2;
+  header[12] = m_width & 0xff;
+  header[13] = (m_width >> 8) & 0xff;
+  header[14] = m_height & 0xff;
+  header[15] = (m_height >> 8) & 0xff;
+  header[16] = 32;
+  header[17] = 0x28;
+
+  // TGA stores BGRA, same as our color buffer on little endian machines
+  bool ok = std::fwrite(header, sizeof(header), 1, file) == 1 &&
+            std::fwrite(m_color.data(), sizeof(uint32_t), m_color.size(), file) == m_color.size();
+
+  std::fclose(file);
+  return ok;
+}
+
+/*
+ * Rasterizer
+ */
+Rasterizer::Rasterizer() = default;
+
+Rasterizer::~Rasterizer() = default;
+
+void Rasterizer::drawIndexed(
+  RenderTarget &target,
+  const RasterState &state,
+  const VertexFunction &vertexFn,
+  const FragmentFunction &fragmentFn,
+  const uint32_t *indices,
+  size_t indexCount,
+  uint32_t instanceCount
+) {
+  if (indexCount < 3 || instanceCount == 0) return;
+
+  // Only the referenced range of vertices is shaded
+  auto [minIt, maxIt] = std::minmax_element(indices, indices + indexCount);
+  drawTriangles(
+    target, state, vertexFn, fragmentFn, indices, indexCount,
+    *minIt, *maxIt - *minIt + 1, instanceCount
+  );
+}
+
+void Rasterizer::draw(
+  RenderTarget &target,
+  const RasterState &state,
+  const VertexFunction &vertexFn,
+  const FragmentFunction &fragmentFn,
+  uint32_t vertexStart,
+  uint32_t vertexCount,
+  uint32_t instanceCount
+) {
+  if (vertexCount < 3 || instanceCount == 0) return;
+
+  drawTriangles(
+    target, state, vertexFn, fragmentFn, nullptr, vertexCount,
+    vertexStart, vertexCount, instanceCount
+  );
+}
+
+void Rasterizer::drawTriangles(
+  RenderTarget &target,
+  const RasterState &state,
+  const VertexFunction &vertexFn,
+  const FragmentFunction &fragmentFn,
+  const uint32_t *indices,
+  size_t indexCount,
+  uint32_t firstVertex,
+  uint32_t vertexCount,
+  uint32_t instanceCount
+) {
+  /*
+   * Vertex stage, every instance gets its own copy of the vertex range
+   */
+  const size_t totalVertices = size_t(vertexCount) * instanceCount;
+  m_vertices.resize(totalVertices);
+
+  constexpr size_t vertexBlock = 1024;
+  par::parallelFor((totalVertices + vertexBlock - 1) / vertexBlock, [&](size_t block) {
+    size_t end = std::min(totalVertices, (block + 1) * vertexBlock);
+    for (size_t i = block * vertexBlock; i < end; i++) {
+      auto instance = static_cast<uint32_t>(i / vertexCount);
+      auto vertex = static_cast<uint32_t>(i % vertexCount);
+      m_vertices[i] = vertexFn(firstVertex + vertex, instance);
+    }
+  });
+  m_stats.verticesShaded += totalVertices;
+
+  /*
+   * Scissor rect: viewport clamped to the render target
+   */
+  const Viewport &vp = state.viewport;
+  const int32_t scissorMinX = std::max(0, static_cast<int32_t>(vp.originX));
+  const int32_t scissorMinY = std::max(0, static_cast<int32_t>(vp.originY));
+  const int32_t scissorMaxX = std::min(static_cast<int32_t>(target.width()), static_cast<int32_t>(vp.originX + vp.width)) - 1;
+  const int32_t scissorMaxY = std::min(static_cast<int32_t>(target.height()), static_cast<int32_t>(vp.originY + vp.height)) - 1;
+  if (scissorMaxX < scissorMinX || scissorMaxY < scissorMinY) return;
+
+  const uint32_t tilesX = (target.width() + tileSize - 1) / tileSize;
+  const uint32_t tilesY = (target.height() + tileSize - 1) / tileSize;
+  const uint32_t tileCount = tilesX * tilesY;
+
+  /*
+   * Setup stage: clip, cull, project and bin, in chunks of triangles
+   */
+  const size_t trianglesPerInstance = indexCount / 3;
+  const size_t triangleCount = trianglesPerInstance * instanceCount;
+  const size_t chunkSize = std::max<size_t>(256, triangleCount / (par::threadCount() * 4) + 1);
+  const size_t chunkCount = (triangleCount + chunkSize - 1) / chunkSize;
+  m_chunks.resize(chunkCount);
+  m_stats.trianglesSubmitted += triangleCount;
+
+  const float halfWidth = float(vp.width) * 0.5f, halfHeight = float(vp.height) * 0.5f;
+  const float depthScale = float(vp.zfar - vp.znear);
+
+  par::parallelFor(chunkCount, [&](size_t chunkIdx) {
+    Chunk &chunk = m_chunks[chunkIdx];
+    chunk.triangles.clear();
+    chunk.culled = chunk.clipped = 0;
+
+    std::vector<uint32_t> tileOf;
+    const size_t begin = chunkIdx * chunkSize, end = std::min(triangleCount, begin + chunkSize);
+
+    for (size_t t = begin; t < end; t++) {
+      const size_t instance = t / trianglesPerInstance;
+      const size_t first = (t % trianglesPerInstance) * 3;
+      const Varyings *instanceVertices = m_vertices.data() + instance * vertexCount;
+
+      Varyings poly[maxClipVertices];
+      for (int k = 0; k < 3; k++) {
+        uint32_t index = indices ? indices[first + k] : firstVertex + static_cast<uint32_t>(first) + k;
+        poly[k] = instanceVertices[index - firstVertex];
+      }
+
+      uint32_t codes[3] = {outcode(poly[0].position), outcode(poly[1].position), outcode(poly[2].position)};
+      if (codes[0] & codes[1] & codes[2]) {
+        chunk.culled++;
+        continue;
+      }
+
+      size_t polyCount = 3;
+      if (uint32_t straddled = codes[0] | codes[1] | codes[2]) {
+        polyCount = clipPolygon(poly, polyCount, straddled);
+        chunk.clipped++;
+      }
+
+      // Project to window space
+      struct WindowVertex {
+        float x, y, z, invW;
+      } win[maxClipVertices];
+      for (size_t i = 0; i < polyCount; i++) {
+        const float4 &p = poly[i].position;
+        float invW = 1.0f / p.w;
+        win[i] = {
+          float(vp.originX) + (p.x * invW + 1.0f) * halfWidth,
+          float(vp.originY) + (1.0f - p.y * invW) * halfHeight,
+          float(vp.znear) + p.z * invW * depthScale,
+          invW,
+        };
+      }
+
+      // Triangulate the clipped polygon as a fan
+      for (size_t i = 1; i + 1 < polyCount; i++) {
+        size_t v[3] = {0, i, i + 1};
+
+        SetupTriangle tri;
+        for (int k = 0; k < 3; k++) {
+          tri.x[k] = static_cast<int32_t>(std::lround(win[v[k]].x * SetupTriangle::subPixelOne));
+          tri.y[k] = static_cast<int32_t>(std::lround(win[v[k]].y * SetupTriangle::subPixelOne));
+        }
+
+        // Window space y points down, so a positive area here is clockwise in NDC
+        int64_t area = int64_t(tri.x[1] - tri.x[0]) * (tri.y[2] - tri.y[0]) -
+                       int64_t(tri.y[1] - tri.y[0]) * (tri.x[2] - tri.x[0]);
+        if (area == 0) {
+          chunk.culled++;
+          continue;
+        }
+
+        bool ccw = area < 0;
+        bool front = (state.frontFacingWinding == Winding::CounterClockwise) == ccw;
+        if ((state.cullMode == CullMode::Back && !front) || (state.cullMode == CullMode::Front && front)) {
+          chunk.culled++;
+          continue;
+        }
+
+        // Make the orientation positive so edge functions are positive inside
+        if (area < 0) {
+          std::swap(v[1], v[2]);
+          std::swap(tri.x[1], tri.x[2]);
+          std::swap(tri.y[1], tri.y[2]);
+          area = -area;
+        }
+        tri.area = area;
+
+        for (int k = 0; k < 3; k++) {
+          tri.z[k] = win[v[k]].z;
+          tri.invW[k] = win[v[k]].invW;
+          tri.colorOverW[k] = poly[v[k]].color * win[v[k]].invW;
+        }
+
+        // Top-left fill rule: pixels exactly on an edge belong to top and left edges only
+        for (int k = 0; k < 3; k++) {
+          int a = (k + 1) % 3, b = (k + 2) % 3;
+          int32_t dx = tri.x[b] - tri.x[a], dy = tri.y[b] - tri.y[a];
+          bool topLeft = (dy == 0 && dx > 0) || dy < 0;
+          tri.bias[k] = topLeft ? 0 : -1;
+        }
+
+        // Pixel bounding box, clamped to the scissor rect
+        constexpr int32_t round = SetupTriangle::subPixelOne - 1;
+        tri.minX = std::max(scissorMinX, std::min({tri.x[0], tri.x[1], tri.x[2]}) >> SetupTriangle::subPixelBits);
+        tri.minY = std::max(scissorMinY, std::min({tri.y[0], tri.y[1], tri.y[2]}) >> SetupTriangle::subPixelBits);
+        tri.maxX = std::min(scissorMaxX, (std::max({tri.x[0], tri.x[1], tri.x[2]}) + round) >> SetupTriangle::subPixelBits);
+        tri.maxY = std::min(scissorMaxY, (std::max({tri.y[0], tri.y[1], tri.y[2]}) + round) >> SetupTriangle::subPixelBits);
+        if (tri.minX > tri.maxX || tri.minY > tri.maxY) {
+          chunk.culled++;
+          continue;
+        }
+
+        auto triIdx = static_cast<uint32_t>(chunk.triangles.size());
+        chunk.triangles.push_back(tri);
+        for (int32_t ty = tri.minY / int32_t(tileSize); ty <= tri.maxY / int32_t(tileSize); ty++) {
+          for (int32_t tx = tri.minX / int32_t(tileSize); tx <= tri.maxX / int32_t(tileSize); tx++) {
+            tileOf.push_back(ty * tilesX + tx);
+            tileOf.push_back(triIdx);
+          }
+        }
+      }
+    }
+
+    // Counting sort of (tile, triangle) pairs by tile, keeping triangle order
+    chunk.tileStart.assign(tileCount + 1, 0);
+    for (size_t i = 0; i < tileOf.size(); i += 2) chunk.tileStart[tileOf[i] + 1]++;
+    for (uint32_t tile = 0; tile < tileCount; tile++) chunk.tileStart[tile + 1] += chunk.tileStart[tile];
+
+    chunk.tileTriangles.resize(tileOf.size() / 2);
+    std::vector<uint32_t> cursor(chunk.tileStart.begin(), chunk.tileStart.end() - 1);
+    for (size_t i = 0; i < tileOf.size(); i += 2) chunk.tileTriangles[cursor[tileOf[i]]++] = tileOf[i + 1];
+  });
+
+  for (const Chunk &chunk: m_chunks) {
+    m_stats.trianglesCulled += chunk.culled;
+    m_stats.trianglesClipped += chunk.clipped;
+    m_stats.trianglesRasterized += chunk.triangles.size();
+  }
+
+  /*
+   * Raster stage, one task per tile
+   */
+  const SRGBTable &srgb = srgbTable();
+  std::atomic<uint64_t> fragmentsShaded = 0;
+
+  par::parallelFor(tileCount, [&](size_t tile) {
+    const int32_t tileMinX = int32_t(tile % tilesX) * int32_t(tileSize);
+    const int32_t tileMinY = int32_t(tile / tilesX) * int32_t(tileSize);
+    const int32_t tileMaxX = std::min(tileMinX + int32_t(tileSize), int32_t(target.width())) - 1;
+    const int32_t tileMaxY = std::min(tileMinY + int32_t(tileSize), int32_t(target.height())) - 1;
+
+    uint64_t fragments = 0;
+    for (const Chunk &chunk: m_chunks) {
+      for (uint32_t i = chunk.tileStart[tile]; i < chunk.tileStart[tile + 1]; i++) {
+        const SetupTriangle &tri = chunk.triangles[chunk.tileTriangles[i]];
+
+        const int32_t minX = std::max(tri.minX, tileMinX), maxX = std::min(tri.maxX, tileMaxX);
+        const int32_t minY = std::max(tri.minY, tileMinY), maxY = std::min(tri.maxY, tileMaxY);
+
+        // Edge function k is opposite vertex k: e_k(p) = (b - a) x (p - a)
+        int64_t stepX[3], stepY[3], rowStart[3];
+        const int64_t px = int64_t(minX) * SetupTriangle::subPixelOne + SetupTriangle::subPixelOne / 2;
+        const int64_t py = int64_t(minY) * SetupTriangle::subPixelOne + SetupTriangle::subPixelOne / 2;
+        for (int k = 0; k < 3; k++) {
+          int a = (k + 1) % 3, b = (k + 2) % 3;
+          int64_t dx = tri.x[b] - tri.x[a], dy = tri.y[b] - tri.y[a];
+          stepX[k] = -dy * SetupTriangle::subPixelOne;
+          stepY[k] = dx * SetupTriangle::subPixelOne;
+          rowStart[k] = dx * (py - tri.y[a]) - dy * (px - tri.x[a]) + tri.bias[k];
+        }
+
+        const float invArea = 1.0f / float(tri.area);
+        for (int32_t y = minY; y <= maxY; y++) {
+          int64_t e[3] = {rowStart[0], rowStart[1], rowStart[2]};
+          uint32_t *colorRow = target.color() + size_t(y) * target.width();
+          float *depthRow = target.depth() + size_t(y) * target.width();
+
+          for (int32_t x = minX; x <= maxX; x++) {
+            if ((e[0] | e[1] | e[2]) >= 0) {
+              // Undo the fill rule bias for interpolation
+              float b0 = float(e[0] - tri.bias[0]) * invArea;
+              float b1 = float(e[1] - tri.bias[1]) * invArea;
+              float b2 = float(e[2] - tri.bias[2]) * invArea;
+
+              float z = b0 * tri.z[0] + b1 * tri.z[1] + b2 * tri.z[2];
+              if (depthTest(state.depthCompare, z, depthRow[x])) {
+                float oneOverW = b0 * tri.invW[0] + b1 * tri.invW[1] + b2 * tri.invW[2];
+                float4 color = (tri.colorOverW[0] * b0 + tri.colorOverW[1] * b1 + tri.colorOverW[2] * b2)
+                               * (1.0f / oneOverW);
+
+                Varyings in = {float4{float(x) + 0.5f, float(y) + 0.5f, z, oneOverW}, color};
+                colorRow[x] = packBGRA8(srgb, fragmentFn(in));
+                if (state.depthWrite) depthRow[x] = z;
+                fragments++;
+              }
+            }
+
+            for (int k = 0; k < 3; k++) e[k] += stepX[k];
+          }
+
+          for (int k = 0; k < 3; k++) rowStart[k] += stepY[k];
+        }
+      }
+    }
+
+    fragmentsShaded += fragments;
+  });
+
+  m_stats.fragmentsShaded += fragmentsShaded;
+}
+}
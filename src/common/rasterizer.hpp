@@ -0,0 +1,175 @@
+#ifndef LEARN_METAL_RASTERIZER_HPP
+#define LEARN_METAL_RASTERIZER_HPP
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include "simd-types.hpp"
+
+/**
+ * Software rasterizer, a CPU reference for the fixed function parts of the
+ * Metal render pipeline used by the samples. Follows Metal conventions:
+ * clip space is -w <= x, y <= w and 0 <= z <= w, NDC y points up, window
+ * y points down, and pixel centers are at +0.5.
+ */
+namespace raster {
+using namespace psimd;
+
+enum class CompareFunction {
+  Never, Less, Equal, LessEqual, Greater, NotEqual, GreaterEqual, Always
+};
+
+enum class CullMode {
+  None, Front, Back
+};
+
+enum class Winding {
+  Clockwise, CounterClockwise
+};
+
+struct Viewport {
+  double originX, originY, width, height, znear, zfar;
+};
+
+/**
+ * Fixed function state, equivalent to what the samples set on the render
+ * command encoder and depth/stencil state
+ */
+struct RasterState {
+  Viewport viewport = {0.0, 0.0, 0.0, 0.0, 0.0, 1.0};
+  CullMode cullMode = CullMode::None;
+  Winding frontFacingWinding = Winding::Clockwise;
+  CompareFunction depthCompare = CompareFunction::Always;
+  bool depthWrite = false;
+};
+
+/**
+ * In-memory render target: BGRA8Unorm_sRGB color and Depth32Float depth
+ */
+class RenderTarget {
+public:
+  RenderTarget(uint32_t width, uint32_t height);
+
+  uint32_t width() const { return m_width; }
+
+  uint32_t height() const { return m_height; }
+
+  uint32_t *color() { return m_color.data(); }
+
+  const uint32_t *color() const { return m_color.data(); }
+
+  float *depth() { return m_depth.data(); }
+
+  const float *depth() const { return m_depth.data(); }
+
+  /**
+   * Clears to a linear color (encoded to sRGB) and a depth value
+   */
+  void clear(float4 color, float depth = 1.0f);
+
+  /**
+   * Encodes a linear color the way the color buffer stores it
+   */
+  static uint32_t packColor(float4 color);
+
+  /**
+   * Writes the color buffer as an uncompressed 32-bit TGA image
+   */
+  bool writeTGA(const char *path) const;
+
+private:
+  uint32_t m_width, m_height;
+  std::vector<uint32_t> m_color;
+  std::vector<float> m_depth;
+};
+
+/**
+ * Vertex shader output, same as the RasterVertex struct in the shaders
+ */
+struct Varyings {
+  float4 position;
+  float4 color;
+};
+
+using VertexFunction = std::function<Varyings(uint32_t vertexId, uint32_t instanceId)>;
+using FragmentFunction = std::function<float4(const Varyings &in)>;
+
+struct Stats {
+  uint64_t verticesShaded = 0;
+  uint64_t trianglesSubmitted = 0;
+  uint64_t trianglesCulled = 0;
+  uint64_t trianglesClipped = 0;
+  uint64_t trianglesRasterized = 0;
+  uint64_t fragmentsShaded = 0;
+};
+
+/**
+ * Executes draw calls against a render target. The vertex stage runs once per
+ * unique vertex, then triangles are set up, binned into screen tiles and the
+ * tiles are rasterized in parallel. Triangles within a tile are processed in
+ * submission order, so results are deterministic.
+ */
+class Rasterizer {
+public:
+  static constexpr uint32_t tileSize = 64;
+
+  Rasterizer();
+
+  ~Rasterizer();
+
+  /**
+   * Equivalent to drawIndexedPrimitives(PrimitiveTypeTriangle, ...)
+   */
+  void drawIndexed(
+    RenderTarget &target,
+    const RasterState &state,
+    const VertexFunction &vertexFn,
+    const FragmentFunction &fragmentFn,
+    const uint32_t *indices,
+    size_t indexCount,
+    uint32_t instanceCount = 1
+  );
+
+  /**
+   * Equivalent to drawPrimitives(PrimitiveTypeTriangle, ...)
+   */
+  void draw(
+    RenderTarget &target,
+    const RasterState &state,
+    const VertexFunction &vertexFn,
+    const FragmentFunction &fragmentFn,
+    uint32_t vertexStart,
+    uint32_t vertexCount,
+    uint32_t instanceCount = 1
+  );
+
+  const Stats &stats() const { return m_stats; }
+
+  void resetStats() { m_stats = {}; }
+
+private:
+  struct SetupTriangle;
+  struct Chunk;
+
+  Stats m_stats;
+
+  // Scratch memory, kept between draws to avoid reallocation
+  std::vector<Varyings> m_vertices;
+  std::vector<Chunk> m_chunks;
+
+  void drawTriangles(
+    RenderTarget &target,
+    const RasterState &state,
+    const VertexFunction &vertexFn,
+    const FragmentFunction &fragmentFn,
+    const uint32_t *indices,
+    size_t indexCount,
+    uint32_t firstVertex,
+    uint32_t vertexCount,
+    uint32_t instanceCount
+  );
+};
+}
+
+#endif //LEARN_METAL_RASTERIZER_HPP
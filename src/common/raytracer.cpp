@@ -0,0 +1,399 @@
+#include "raytracer.hpp"
+
+#include <algorithm>
+
+#include "matrices.hpp"
+#include "parallel.hpp"
+
+using namespace psimd;
+using namespace psimd::detail;
+
+namespace rt {
+namespace {
+/*
+ * Lane masks for the packet tests. bits has bit k set if lane k is.
+ */
+#if defined(PSIMD_SSE)
+using Mask = __m128;
+
+inline Mask lessThan(f128 a, f128 b) { return _mm_cmplt_ps(a, b); }
+
+inline Mask lessEqual(f128 a, f128 b) { return _mm_cmple_ps(a, b); }
+
+inline Mask both(Mask a, Mask b) { return _mm_and_ps(a, b); }
+
+inline uint32_t bits(Mask m) { return uint32_t(_mm_movemask_ps(m)); }
+#elif defined(PSIMD_NEON)
+using Mask = uint32x4_t;
+
+inline Mask lessThan(f128 a, f128 b) { return vcltq_f32(a, b); }
+
+inline Mask lessEqual(f128 a, f128 b) { return vcleq_f32(a, b); }
+
+inline Mask both(Mask a, Mask b) { return vandq_u32(a, b); }
+
+inline uint32_t bits(Mask m) {
+  const uint32x4_t lanes = {1, 2, 4, 8};
+  return vaddvq_u32(vandq_u32(m, lanes));
+}
+#else
+using Mask = uint32_t;
+
+inline Mask lessThan(f128 a, f128 b) {
+  Mask m = 0;
+  for (int k = 0; k < 4; k++) m |= uint32_t(a.v[k] < b.v[k]) << k;
+  return m;
+}
+
+inline Mask lessEqual(f128 a, f128 b) {
+  Mask m = 0;
+  for (int k = 0; k < 4; k++) m |= uint32_t(a.v[k] <= b.v[k]) << k;
+  return m;
+}
+
+inline Mask both(Mask a, Mask b) { return a & b; }
+
+inline uint32_t bits(Mask m) { return m; }
+#endif
+
+/**
+ * Smallest lane of v among those in mask
+ */
+inline float lanesMin(f128 v, uint32_t mask) {
+  alignas(16) float lanes[4];
+  store(lanes, v);
+  float result = INFINITY;
+  for (; mask; mask &= mask - 1) result = std::min(result, lanes[__builtin_ctz(mask)]);
+  return result;
+}
+
+/**
+ * Affine inverse: normalMatrix is the inverse transpose of the upper 3x3
+ */
+float4x4 inverseAffine(const float4x4 &m) {
+  const float3x3 n = mat::normalMatrix(m);
+  float4x4 inverse{1.0f};
+  for (int i = 0; i < 3; i++) {
+    for (int j = 0; j < 3; j++) inverse.columns[j][i] = n.columns[i][j];
+  }
+  const float4 t = inverse * make_float4(make_float3(m.columns[3]), 0.0f);
+  inverse.columns[3] = {-t.x, -t.y, -t.z, 1.0f};
+  return inverse;
+}
+
+bvh::Aabb transformBounds(const float4x4 &m, const bvh::Aabb &box) {
+  const float3 center = make_float3(m * make_float4((box.min + box.max) * 0.5f, 1.0f));
+  const float3 extent = (box.max - box.min) * 0.5f;
+  float3 e = {0.0f, 0.0f, 0.0f};
+  for (int c = 0; c < 3; c++) {
+    for (int r = 0; r < 3; r++) e[r] += std::abs(m.columns[c][r]) * extent[c];
+  }
+  return {center - e, center + e};
+}
+}
+
+/*
+ * Packet in SIMD registers. Node slabs are tested as t = bound * inverse +
+ * offset, offset being -origin * inverse.
+ */
+struct Scene::Packet {
+  f128 originX, originY, originZ;
+  f128 directionX, directionY, directionZ;
+  f128 inverseX, inverseY, inverseZ;
+  f128 offsetX, offsetY, offsetZ;
+  f128 tMin, tMax;
+
+  void prepare() {
+    const f128 one = splat(1.0f);
+    inverseX = div(one, directionX), inverseY = div(one, directionY), inverseZ = div(one, directionZ);
+    const f128 zero = splat(0.0f);
+    offsetX = sub(zero, mul(originX, inverseX));
+    offsetY = sub(zero, mul(originY, inverseY));
+    offsetZ = sub(zero, mul(originZ, inverseZ));
+  }
+
+  /**
+   * The same rays in the space of an affine transform
+   */
+  Packet transformed(const float4x4 &m) const {
+    auto point = [&](int r, f128 x, f128 y, f128 z, f128 w) {
+      return madd(splat(m.columns[0][r]), x, madd(splat(m.columns[1][r]), y, madd(splat(m.columns[2][r]), z, w)));
+    };
+    const f128 zero = splat(0.0f);
+    Packet p;
+    p.originX = point(0, originX, originY, originZ, splat(m.columns[3][0]));
+    p.originY = point(1, originX, originY, originZ, splat(m.columns[3][1]));
+    p.originZ = point(2, originX, originY, originZ, splat(m.columns[3][2]));
+    p.directionX = point(0, directionX, directionY, directionZ, zero);
+    p.directionY = point(1, directionX, directionY, directionZ, zero);
+    p.directionZ = point(2, directionX, directionY, directionZ, zero);
+    p.tMin = tMin, p.tMax = tMax;
+    p.prepare();
+    return p;
+  }
+
+  /**
+   * Lanes that enter the node's box before their tMax, and where
+   */
+  uint32_t enters(const bvh::Node &node, f128 &tEnter) const {
+    const f128 x0 = madd(splat(node.min[0]), inverseX, offsetX), x1 = madd(splat(node.max[0]), inverseX, offsetX);
+    const f128 y0 = madd(splat(node.min[1]), inverseY, offsetY), y1 = madd(splat(node.max[1]), inverseY, offsetY);
+    const f128 z0 = madd(splat(node.min[2]), inverseZ, offsetZ), z1 = madd(splat(node.max[2]), inverseZ, offsetZ);
+    const f128 near = max(max(min(x0, x1), min(y0, y1)), max(min(z0, z1), tMin));
+    const f128 far = min(min(max(x0, x1), max(y0, y1)), min(max(z0, z1), tMax));
+    tEnter = near;
+    return bits(lessEqual(near, far));
+  }
+};
+
+namespace {
+/**
+ * Depth first traversal for a packet, descending wherever any active lane
+ * enters, nearer child first. leaf(object, lanes) is called for the objects
+ * of the leaves reached, and may shorten packet.tMax.
+ */
+template<typename P, typename Leaf>
+void traverse(const bvh::Tree &tree, const P &packet, uint32_t active, Leaf &&leaf) {
+  const std::vector<bvh::Node> &nodes = tree.nodes();
+  if (nodes.empty() || !active) return;
+
+  struct Entry {
+    f128 tEnter;
+    uint32_t node;
+    uint32_t lanes;
+  } stack[64];
+  size_t top = 0;
+
+  f128 tEnter;
+  const uint32_t rootLanes = packet.enters(nodes[0], tEnter) & active;
+  if (rootLanes) stack[top++] = {tEnter, 0, rootLanes};
+
+  while (top > 0) {
+    const Entry entry = stack[--top];
+    // Lanes that found hits in front of the node in the meantime drop out
+    const uint32_t lanes = entry.lanes & bits(lessEqual(entry.tEnter, packet.tMax));
+    if (!lanes) continue;
+
+    const bvh::Node &node = nodes[entry.node];
+    if (node.isLeaf()) {
+      for (uint32_t i = node.offset; i < node.offset + node.count; i++) leaf(tree.objects()[i], lanes);
+      continue;
+    }
+
+    uint32_t near = entry.node + 1, far = node.offset;
+    f128 tNear, tFar;
+    uint32_t nearLanes = packet.enters(nodes[near], tNear) & lanes;
+    uint32_t farLanes = packet.enters(nodes[far], tFar) & lanes;
+    if (nearLanes && farLanes && lanesMin(tFar, farLanes) < lanesMin(tNear, nearLanes)) {
+      std::swap(near, far);
+      std::swap(tNear, tFar);
+      std::swap(nearLanes, farLanes);
+    }
+    if (farLanes) stack[top++] = {tFar, far, farLanes};
+    if (nearLanes) stack[top++] = {tNear, near, nearLanes};
+  }
+}
+}
+
+Camera makeCamera(const float4x4 &view, const float4x4 &projection) {
+  // The rows of a rigid view matrix are the camera's axes in world space
+  const float3 right = {view.columns[0].x, view.columns[1].x, view.columns[2].x};
+  const float3 up = {view.columns[0].y, view.columns[1].y, view.columns[2].y};
+  const float3 back = {view.columns[0].z, view.columns[1].z, view.columns[2].z};
+  const float3 t = make_float3(view.columns[3]);
+
+  /*
+   * View depth d = -z projects to clip z = offset - scale * d and w = d, so
+   * depth = offset / d - scale
+   */
+  Camera camera;
+  camera.position = -(right * t.x + up * t.y + back * t.z);
+  camera.right = right / projection.columns[0].x;
+  camera.up = up / projection.columns[1].y;
+  camera.forward = -back;
+  camera.depthScale = projection.columns[2].z;
+  camera.depthOffset = projection.columns[3].z;
+  camera.near = camera.depthOffset / camera.depthScale;
+  camera.far = camera.depthOffset / (1.0f + camera.depthScale);
+  return camera;
+}
+
+uint32_t Scene::addMesh(const float3 *positions, const uint32_t *indices, size_t triangleCount) {
+  Mesh &mesh = m_meshes.emplace_back();
+  mesh.triangles.resize(triangleCount);
+  mesh.bounds = {float3{INFINITY}, float3{-INFINITY}};
+
+  std::vector<bvh::Aabb> boxes(triangleCount);
+  for (size_t i = 0; i < triangleCount; i++) {
+    const float3 a = positions[indices[3 * i]], b = positions[indices[3 * i + 1]], c = positions[indices[3 * i + 2]];
+    mesh.triangles[i] = {a, b - a, c - a};
+    boxes[i] = {min(min(a, b), c), max(max(a, b), c)};
+    mesh.bounds = bvh::merge(mesh.bounds, boxes[i]);
+  }
+  mesh.tree.build(boxes.data(), triangleCount);
+  return uint32_t(m_meshes.size() - 1);
+}
+
+void Scene::setInstances(const Instance *instances, size_t count) {
+  const bool same = count == m_instances.size() &&
+                    std::equal(instances, instances + count, m_instances.begin(),
+                               [](const Instance &a, const Instance &b) { return a.mesh == b.mesh; });
+
+  m_instances.assign(instances, instances + count);
+  m_worldToObject.resize(count);
+  m_instanceBounds.resize(count);
+  for (size_t i = 0; i < count; i++) {
+    m_worldToObject[i] = inverseAffine(instances[i].transform);
+    m_instanceBounds[i] = transformBounds(instances[i].transform, m_meshes[instances[i].mesh].bounds);
+  }
+
+  if (same) {
+    m_tree.refit(m_instanceBounds.data());
+  } else {
+    m_tree.build(m_instanceBounds.data(), count);
+  }
+}
+
+bool Scene::intersectMesh(const Mesh &mesh, bvh::Ray &ray, Hit &hit) const {
+  // Möller-Trumbore, det is positive for counter-clockwise triangles seen from the ray
+  return mesh.tree.raycast(ray, [&](uint32_t primitive, bvh::Ray &r) {
+    const Triangle &tri = mesh.triangles[primitive];
+    const float3 p = cross(r.direction, tri.edge2);
+    const float det = dot(tri.edge1, p);
+    if (m_cullBackFaces ? !(det > 0.0f) : det == 0.0f) return false;
+
+    const float inverse = 1.0f / det;
+    const float3 s = r.origin - tri.v0;
+    const float u = dot(s, p) * inverse;
+    const float3 q = cross(s, tri.edge1);
+    const float v = dot(r.direction, q) * inverse;
+    const float t = dot(tri.edge2, q) * inverse;
+    if (!(u >= 0.0f && v >= 0.0f && u + v <= 1.0f && t >= r.tMin && t < r.tMax)) return false;
+
+    r.tMax = t;
+    hit.t = t, hit.primitive = primitive, hit.u = u, hit.v = v;
+    return true;
+  });
+}
+
+bool Scene::intersect(bvh::Ray &ray, Hit &hit) const {
+  // Directions aren't normalized in object space, so t means the same in both spaces
+  return m_tree.raycast(ray, [&](uint32_t instance, bvh::Ray &r) {
+    const float4x4 &m = m_worldToObject[instance];
+    bvh::Ray local = {make_float3(m * make_float4(r.origin, 1.0f)), make_float3(m * make_float4(r.direction, 0.0f)),
+                      r.tMin, r.tMax};
+    if (!intersectMesh(m_meshes[m_instances[instance].mesh], local, hit)) return false;
+
+    r.tMax = local.tMax;
+    hit.instance = instance;
+    return true;
+  });
+}
+
+uint32_t Scene::intersectMesh(const Mesh &mesh, Packet &packet, uint32_t active, Hit *hits) const {
+  uint32_t hitLanes = 0;
+  const f128 zero = splat(0.0f), one = splat(1.0f);
+  const Packet &p = packet;
+
+  traverse(mesh.tree, packet, active, [&](uint32_t primitive, uint32_t lanes) {
+    const Triangle &tri = mesh.triangles[primitive];
+    const f128 e1x = splat(tri.edge1.x), e1y = splat(tri.edge1.y), e1z = splat(tri.edge1.z);
+    const f128 e2x = splat(tri.edge2.x), e2y = splat(tri.edge2.y), e2z = splat(tri.edge2.z);
+
+    // p = direction x edge2
+    const f128 px = sub(mul(p.directionY, e2z), mul(p.directionZ, e2y));
+    const f128 py = sub(mul(p.directionZ, e2x), mul(p.directionX, e2z));
+    const f128 pz = sub(mul(p.directionX, e2y), mul(p.directionY, e2x));
+    const f128 det = madd(e1x, px, madd(e1y, py, mul(e1z, pz)));
+    const f128 inverse = div(one, det);
+
+    // s = origin - v0, q = s x edge1
+    const f128 sx = sub(p.originX, splat(tri.v0.x)), sy = sub(p.originY, splat(tri.v0.y)), sz = sub(p.originZ, splat(tri.v0.z));
+    const f128 u = mul(madd(sx, px, madd(sy, py, mul(sz, pz))), inverse);
+    const f128 qx = sub(mul(sy, e1z), mul(sz, e1y));
+    const f128 qy = sub(mul(sz, e1x), mul(sx, e1z));
+    const f128 qz = sub(mul(sx, e1y), mul(sy, e1x));
+    const f128 v = mul(madd(p.directionX, qx, madd(p.directionY, qy, mul(p.directionZ, qz))), inverse);
+    const f128 t = mul(madd(e2x, qx, madd(e2y, qy, mul(e2z, qz))), inverse);
+
+    const Mask facing = m_cullBackFaces ? lessThan(zero, det) : lessThan(zero, mul(det, det));
+    const Mask inside = both(both(lessEqual(zero, u), lessEqual(zero, v)), lessEqual(add(u, v), one));
+    const Mask inRange = both(lessEqual(p.tMin, t), lessThan(t, p.tMax));
+    const uint32_t hit = bits(both(both(facing, inside), inRange)) & lanes;
+    if (!hit) return;
+
+    alignas(16) float ts[4], us[4], vs[4], tMax[4];
+    store(ts, t), store(us, u), store(vs, v), store(tMax, packet.tMax);
+    for (uint32_t m = hit; m; m &= m - 1) {
+      const int k = __builtin_ctz(m);
+      hits[k].t = tMax[k] = ts[k], hits[k].primitive = primitive, hits[k].u = us[k], hits[k].v = vs[k];
+    }
+    packet.tMax = load(tMax);
+    hitLanes |= hit;
+  });
+  return hitLanes;
+}
+
+void Scene::intersect(RayPacket &packet, Hit *hits) const {
+  Packet p;
+  p.originX = load(packet.originX), p.originY = load(packet.originY), p.originZ = load(packet.originZ);
+  p.directionX = load(packet.directionX), p.directionY = load(packet.directionY), p.directionZ = load(packet.directionZ);
+  p.tMin = load(packet.tMin), p.tMax = load(packet.tMax);
+  p.prepare();
+  const uint32_t active = bits(lessEqual(p.tMin, p.tMax));
+
+  traverse(m_tree, p, active, [&](uint32_t instance, uint32_t lanes) {
+    Packet local = p.transformed(m_worldToObject[instance]);
+    uint32_t hit = intersectMesh(m_meshes[m_instances[instance].mesh], local, lanes, hits);
+    p.tMax = local.tMax;
+    for (; hit; hit &= hit - 1) hits[__builtin_ctz(hit)].instance = instance;
+  });
+  store(packet.tMax, p.tMax);
+}
+
+void traceImage(const Scene &scene, const Camera &camera, uint32_t width, uint32_t height, Hit *hits, bool packets) {
+  constexpr uint32_t tileSize = 16;
+  const uint32_t tilesX = (width + tileSize - 1) / tileSize, tilesY = (height + tileSize - 1) / tileSize;
+  const float scaleX = 2.0f / float(width), scaleY = 2.0f / float(height);
+
+  par::parallelFor(size_t(tilesX) * tilesY, [&](size_t tile) {
+    const uint32_t minX = uint32_t(tile % tilesX) * tileSize, minY = uint32_t(tile / tilesX) * tileSize;
+    const uint32_t maxX = std::min(minX + tileSize, width), maxY = std::min(minY + tileSize, height);
+
+    if (!packets) {
+      for (uint32_t y = minY; y < maxY; y++) {
+        for (uint32_t x = minX; x < maxX; x++) {
+          Hit hit;
+          bvh::Ray ray = camera.ray((float(x) + 0.5f) * scaleX - 1.0f, 1.0f - (float(y) + 0.5f) * scaleY);
+          scene.intersect(ray, hit);
+          hits[size_t(y) * width + x] = hit;
+        }
+      }
+      return;
+    }
+
+    // 2x2 quads, lanes past the edges of the image are inactive
+    for (uint32_t y = minY; y < maxY; y += 2) {
+      for (uint32_t x = minX; x < maxX; x += 2) {
+        RayPacket packet;
+        Hit quad[4];
+        for (uint32_t k = 0; k < 4; k++) {
+          const uint32_t px = x + (k & 1), py = y + (k >> 1);
+          const bvh::Ray ray = camera.ray((float(px) + 0.5f) * scaleX - 1.0f, 1.0f - (float(py) + 0.5f) * scaleY);
+          packet.originX[k] = ray.origin.x, packet.originY[k] = ray.origin.y, packet.originZ[k] = ray.origin.z;
+          packet.directionX[k] = ray.direction.x, packet.directionY[k] = ray.direction.y, packet.directionZ[k] = ray.direction.z;
+          const bool inside = px < maxX && py < maxY;
+          packet.tMin[k] = inside ? ray.tMin : INFINITY;
+          packet.tMax[k] = inside ? ray.tMax : 0.0f;
+        }
+        scene.intersect(packet, quad);
+
+        for (uint32_t k = 0; k < 4; k++) {
+          const uint32_t px = x + (k & 1), py = y + (k >> 1);
+          if (px < maxX && py < maxY) hits[size_t(py) * width + px] = quad[k];
+        }
+      }
+    }
+  });
+}
+}
@@ -0,0 +1,140 @@
+#ifndef LEARN_METAL_RAYTRACER_HPP
+#define LEARN_METAL_RAYTRACER_HPP
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "bvh.hpp"
+#include "simd-types.hpp"
+
+/**
+ * CPU ray tracer over triangle meshes, a ground truth for the rasterized
+ * images and the CPU counterpart of Metal's acceleration structures: each
+ * mesh has its own tree in object space (a primitive acceleration structure)
+ * and instances of the meshes are placed in a top level tree (an instance
+ * acceleration structure).
+ */
+namespace rt {
+constexpr uint32_t noHit = UINT32_MAX;
+
+struct Hit {
+  float t = INFINITY;
+  uint32_t instance = noHit;
+  uint32_t primitive = 0;
+  float u = 0.0f, v = 0.0f; // Barycentrics of the triangle's second and third vertex
+};
+
+struct Instance {
+  uint32_t mesh;
+  psimd::float4x4 transform; // Object to world, affine
+};
+
+/**
+ * Four rays traced together, one per lane. Rays through neighbouring pixels
+ * mostly visit the same nodes, so node tests are shared. Lanes with tMin >
+ * tMax are inactive.
+ */
+struct alignas(16) RayPacket {
+  float originX[4], originY[4], originZ[4];
+  float directionX[4], directionY[4], directionZ[4];
+  float tMin[4], tMax[4];
+};
+
+/**
+ * Pinhole camera matching a rigid view matrix and a perspective projection
+ * (mat::projection). Directions are scaled so t is the view space depth, and
+ * [near, far] is where the projected depth is in [0, 1], where Metal clips.
+ */
+struct Camera {
+  psimd::float3 position;
+  psimd::float3 right, up, forward; // Per unit of NDC x and y, and per unit of depth
+  float near, far;
+  float depthScale, depthOffset;
+
+  /**
+   * Ray through NDC (x, y), y up
+   */
+  bvh::Ray ray(float x, float y) const {
+    return {position, forward + right * x + up * y, near, far};
+  }
+
+  /**
+   * Depth buffer value at distance t
+   */
+  float depth(float t) const { return depthOffset / t - depthScale; }
+};
+
+Camera makeCamera(const psimd::float4x4 &view, const psimd::float4x4 &projection);
+
+class Scene {
+public:
+  /**
+   * Adds a mesh and builds its tree, returns its index for Instance::mesh.
+   * Triangles are triples of indices into positions.
+   */
+  uint32_t addMesh(const psimd::float3 *positions, const uint32_t *indices, size_t triangleCount);
+
+  /**
+   * Places the instances and builds the top level tree. If the instances are
+   * the same ones as before, moved, the tree is only refit.
+   */
+  void setInstances(const Instance *instances, size_t count);
+
+  /**
+   * Ignore triangles that are clockwise seen from the ray, as with
+   * counter-clockwise front faces and back face culling. On by default.
+   */
+  void setBackFaceCulling(bool enabled) { m_cullBackFaces = enabled; }
+
+  size_t meshCount() const { return m_meshes.size(); }
+
+  size_t instanceCount() const { return m_instances.size(); }
+
+  /**
+   * Finds the nearest hit in [ray.tMin, ray.tMax], shortening ray.tMax to it.
+   * Returns false if nothing was hit, leaving hit alone.
+   */
+  bool intersect(bvh::Ray &ray, Hit &hit) const;
+
+  /**
+   * Same for four rays at once, with SIMD node and triangle tests
+   */
+  void intersect(RayPacket &packet, Hit *hits) const;
+
+private:
+  struct Triangle {
+    psimd::float3 v0, edge1, edge2;
+  };
+
+  struct Mesh {
+    std::vector<Triangle> triangles;
+    bvh::Tree tree;
+    bvh::Aabb bounds;
+  };
+
+  struct Packet;
+
+  std::vector<Mesh> m_meshes;
+  std::vector<Instance> m_instances;
+  std::vector<psimd::float4x4> m_worldToObject;
+  std::vector<bvh::Aabb> m_instanceBounds;
+  bvh::Tree m_tree;
+  bool m_cullBackFaces = true;
+
+  bool intersectMesh(const Mesh &mesh, bvh::Ray &ray, Hit &hit) const;
+
+  uint32_t intersectMesh(const Mesh &mesh, Packet &packet, uint32_t active, Hit *hits) const;
+};
+
+/**
+ * Traces one ray per pixel center, y down, and writes the hits to hits
+ * (width * height, row major). Tiles of pixels are spread over threads, and
+ * traced as packets of 2x2 pixels or one ray at a time.
+ */
+void traceImage(const Scene &scene, const Camera &camera, uint32_t width, uint32_t height, Hit *hits,
+                bool packets = true);
+}
+
+#endif //LEARN_METAL_RAYTRACER_HPP
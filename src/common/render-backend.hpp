@@ -0,0 +1,286 @@
+#ifndef LEARN_METAL_RENDER_BACKEND_HPP
+#define LEARN_METAL_RENDER_BACKEND_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "rasterizer.hpp"
+
+/**
+ * Thin rendering backend interface, modelled after the subset of Metal the
+ * samples use. Implementations:
+ *   - gfx::MetalDevice (metal-backend.hpp), macOS only
+ *   - gfx::HeadlessDevice (headless-backend.hpp), CPU rasterizer or null
+ *
+ * Objects created by a device are owned by the caller (unique_ptr), command
+ * encoders are owned by their command buffer.
+ */
+namespace gfx {
+// Fixed function enums are shared with the software rasterizer
+using raster::CompareFunction;
+using raster::CullMode;
+using raster::Winding;
+using raster::Viewport;
+
+enum class PixelFormat {
+  Invalid, BGRA8Unorm, BGRA8Unorm_sRGB, Depth32Float
+};
+
+enum class StorageMode {
+  Shared, Managed, Private
+};
+
+/**
+ * Packed formats are converted to float on fetch, see vertex-formats.hpp
+ */
+enum class VertexFormat {
+  Float2, Float3, Float4,
+  Half2, Half4,
+  Short2Normalized, Short4Normalized,
+  UChar4Normalized
+};
+
+enum class PrimitiveType {
+  Triangle
+};
+
+enum class IndexType {
+  UInt16, UInt32
+};
+
+/*
+ * Descriptors
+ */
+struct VertexAttribute {
+  VertexFormat format;
+  size_t offset;
+  size_t bufferIndex;
+};
+
+struct VertexBufferLayout {
+  size_t bufferIndex;
+  size_t stride;
+};
+
+/**
+ * Equivalent to MTL::VertexDescriptor, attribute i is [[attribute(i)]]
+ */
+struct VertexDescriptor {
+  std::vector<VertexAttribute> attributes;
+  std::vector<VertexBufferLayout> layouts;
+};
+
+class PipelineArchive;
+
+struct RenderPipelineDescriptor {
+  std::string library;
+  std::string vertexFunction;
+  std::string fragmentFunction;
+  VertexDescriptor vertexDescriptor;
+  PixelFormat colorPixelFormat = PixelFormat::Invalid;
+  PixelFormat depthPixelFormat = PixelFormat::Invalid;
+
+  /**
+   * Compiled pipelines are looked up in the archive first, and added to it
+   * when missing. Not part of the pipeline's identity.
+   */
+  PipelineArchive *archive = nullptr;
+};
+
+struct DepthStencilDescriptor {
+  CompareFunction depthCompareFunction = CompareFunction::Always;
+  bool depthWriteEnabled = false;
+};
+
+/*
+ * Resources
+ */
+class Buffer {
+public:
+  virtual ~Buffer() = default;
+
+  virtual void *contents() = 0;
+
+  virtual size_t length() const = 0;
+
+  /**
+   * Flushes CPU writes to a managed buffer, no-op for shared buffers
+   */
+  virtual void didModifyRange(size_t offset, size_t length) = 0;
+};
+
+class RenderPipelineState {
+public:
+  virtual ~RenderPipelineState() = default;
+};
+
+class DepthStencilState {
+public:
+  virtual ~DepthStencilState() = default;
+};
+
+/**
+ * Compiled pipelines kept across runs, equivalent to MTL::BinaryArchive.
+ * Pipelines created with an archive count as hits if their compiled code
+ * was found in it, misses are compiled and added.
+ */
+class PipelineArchive {
+public:
+  struct Stats {
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+  };
+
+  virtual ~PipelineArchive() = default;
+
+  /**
+   * Writes the archive back to the file it was opened from. Returns false and
+   * sets the error message on failure.
+   */
+  virtual bool serialize(std::string *error) = 0;
+
+  virtual const Stats &stats() const = 0;
+};
+
+/**
+ * Something we can render into: a view's drawable or an offscreen image
+ */
+class RenderTarget {
+public:
+  virtual ~RenderTarget() = default;
+
+  virtual uint32_t width() const = 0;
+
+  virtual uint32_t height() const = 0;
+
+  virtual PixelFormat colorPixelFormat() const = 0;
+
+  virtual PixelFormat depthPixelFormat() const = 0;
+};
+
+/*
+ * Commands
+ */
+class RenderCommandEncoder {
+public:
+  virtual ~RenderCommandEncoder() = default;
+
+  virtual void setRenderPipelineState(const RenderPipelineState *pso) = 0;
+
+  virtual void setDepthStencilState(const DepthStencilState *dsso) = 0;
+
+  virtual void setFrontFacingWinding(Winding winding) = 0;
+
+  virtual void setCullMode(CullMode cullMode) = 0;
+
+  virtual void setViewport(const Viewport &viewport) = 0;
+
+  virtual void setVertexBuffer(const Buffer *buffer, size_t offset, size_t index) = 0;
+
+  virtual void setVertexBytes(const void *bytes, size_t length, size_t index) = 0;
+
+  virtual void drawPrimitives(
+    PrimitiveType primitiveType,
+    size_t vertexStart,
+    size_t vertexCount,
+    size_t instanceCount = 1
+  ) = 0;
+
+  virtual void drawIndexedPrimitives(
+    PrimitiveType primitiveType,
+    size_t indexCount,
+    IndexType indexType,
+    const Buffer *indexBuffer,
+    size_t indexBufferOffset,
+    size_t instanceCount = 1
+  ) = 0;
+
+  virtual void endEncoding() = 0;
+};
+
+/**
+ * Render pass recorded by several threads, equivalent to
+ * MTL::ParallelRenderCommandEncoder. Each sub-encoder is used by one thread at
+ * a time and starts with default state. Their commands execute in the order
+ * the sub-encoders were created, whatever order they're recorded in.
+ */
+class ParallelRenderCommandEncoder {
+public:
+  virtual ~ParallelRenderCommandEncoder() = default;
+
+  /**
+   * Owned by the parallel encoder. Not thread safe, create the sub-encoders
+   * before handing them out.
+   */
+  virtual RenderCommandEncoder *renderCommandEncoder() = 0;
+
+  /**
+   * Ends the pass, after every sub-encoder has ended encoding
+   */
+  virtual void endEncoding() = 0;
+};
+
+class CommandBuffer {
+public:
+  virtual ~CommandBuffer() = default;
+
+  /**
+   * Starts a render pass that clears the target, the encoder is owned by the
+   * command buffer
+   */
+  virtual RenderCommandEncoder *renderCommandEncoder(RenderTarget &target) = 0;
+
+  /**
+   * Same, for a pass recorded from several threads
+   */
+  virtual ParallelRenderCommandEncoder *parallelRenderCommandEncoder(RenderTarget &target) = 0;
+
+  virtual void present(RenderTarget &target) = 0;
+
+  /**
+   * Called once the commands have finished executing, possibly on another thread
+   */
+  virtual void addCompletedHandler(std::function<void()> handler) = 0;
+
+  virtual void commit() = 0;
+};
+
+class CommandQueue {
+public:
+  virtual ~CommandQueue() = default;
+
+  virtual std::unique_ptr<CommandBuffer> commandBuffer() = 0;
+};
+
+class Device {
+public:
+  virtual ~Device() = default;
+
+  virtual std::unique_ptr<Buffer> newBuffer(size_t length, StorageMode storageMode) = 0;
+
+  /**
+   * Returns nullptr and sets the error message on failure
+   */
+  virtual std::unique_ptr<RenderPipelineState> newRenderPipelineState(
+    const RenderPipelineDescriptor &desc,
+    std::string *error
+  ) = 0;
+
+  virtual std::unique_ptr<DepthStencilState> newDepthStencilState(const DepthStencilDescriptor &desc) = 0;
+
+  /**
+   * Opens the archive stored at path, or starts an empty one if there's no
+   * file yet. Returns nullptr and sets the error message if the file can't
+   * be used.
+   */
+  virtual std::unique_ptr<PipelineArchive> newPipelineArchive(const std::string &path, std::string *error) = 0;
+
+  virtual std::unique_ptr<CommandQueue> newCommandQueue() = 0;
+};
+}
+
+#endif //LEARN_METAL_RENDER_BACKEND_HPP
@@ -0,0 +1,42 @@
+#ifndef LEARN_METAL_RENDERER_HPP
+#define LEARN_METAL_RENDERER_HPP
+
+#include <functional>
+#include <memory>
+
+#include "frame-profiler.hpp"
+#include "render-backend.hpp"
+
+/**
+ * Per-frame code of a sample, written against the gfx backend interface so
+ * the same code runs in an MTK view and in headless tools
+ */
+class Renderer {
+public:
+  virtual ~Renderer() = default;
+
+  /**
+   * Renders and submits one frame, time is in seconds since startup
+   */
+  virtual void draw(gfx::RenderTarget &target, float time) = 0;
+
+  /**
+   * Submits frames the renderer is still holding on to, for renderers that
+   * pipeline their frames. Call before reading the target back.
+   */
+  virtual void flush(gfx::RenderTarget &target) {}
+
+  virtual void resize(uint32_t width, uint32_t height) {}
+
+  /**
+   * Attaches a profiler that receives per-stage CPU timings, nullptr detaches
+   */
+  void setProfiler(FrameProfiler *profiler) { m_profiler = profiler; }
+
+protected:
+  FrameProfiler *m_profiler = nullptr;
+};
+
+using RendererFactory = std::function<std::unique_ptr<Renderer>(gfx::Device &device, gfx::RenderTarget &target)>;
+
+#endif //LEARN_METAL_RENDERER_HPP
@@ -0,0 +1,455 @@
+#ifndef LEARN_METAL_SIMD_TYPES_HPP
+#define LEARN_METAL_SIMD_TYPES_HPP
+
+/**
+ * Portable replacement for Apple's <simd/simd.h> vector and matrix types.
+ *
+ * Layout (size and alignment) matches the Metal shading language types, so
+ * structs shared with shaders (see shader-defs.hpp) stay byte-compatible:
+ *   float2 8/8, float3 16/16, float4 16/16, float3x3 48/16, float4x4 64/16,
+ *   uint2 8/8
+ *
+ * Arithmetic is backed by NEON (arm64), SSE (x86-64, AVX/FMA when enabled)
+ * or a plain scalar fallback. Define PSIMD_FORCE_SCALAR to force the latter.
+ */
+
+#include <cmath>
+#include <cstdint>
+#include <cstddef>
+
+#if defined(PSIMD_FORCE_SCALAR)
+#define PSIMD_SCALAR 1
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define PSIMD_NEON 1
+#include <arm_neon.h>
+#elif defined(__SSE2__) || defined(_M_X64)
+#define PSIMD_SSE 1
+#include <immintrin.h>
+#if defined(__AVX__)
+#define PSIMD_AVX 1
+#endif
+#if defined(__FMA__)
+#define PSIMD_FMA 1
+#endif
+#else
+#define PSIMD_SCALAR 1
+#endif
+
+namespace psimd {
+
+/*
+ * Vector types
+ * Plain structs with public members, so they can be used in constexpr data
+ * (vertex arrays) and read field by field. SIMD registers are only used
+ * inside the operators below.
+ */
+struct alignas(8) float2 {
+  float x, y;
+
+  float2() = default;
+
+  constexpr float2(float x, float y) : x(x), y(y) {}
+
+  constexpr explicit float2(float s) : x(s), y(s) {}
+
+  constexpr float &operator[](size_t i) { return (&x)[i]; }
+
+  constexpr float operator[](size_t i) const { return (&x)[i]; }
+};
+
+struct alignas(16) float3 {
+  float x, y, z;
+
+  float3() = default;
+
+  constexpr float3(float x, float y, float z) : x(x), y(y), z(z) {}
+
+  constexpr explicit float3(float s) : x(s), y(s), z(s) {}
+
+  constexpr float &operator[](size_t i) { return (&x)[i]; }
+
+  constexpr float operator[](size_t i) const { return (&x)[i]; }
+};
+
+struct alignas(16) float4 {
+  float x, y, z, w;
+
+  float4() = default;
+
+  constexpr float4(float x, float y, float z, float w) : x(x), y(y), z(z), w(w) {}
+
+  constexpr explicit float4(float s) : x(s), y(s), z(s), w(s) {}
+
+  constexpr float &operator[](size_t i) { return (&x)[i]; }
+
+  constexpr float operator[](size_t i) const { return (&x)[i]; }
+};
+
+struct alignas(8) uint2 {
+  uint32_t x, y;
+
+  uint2() = default;
+
+  constexpr uint2(uint32_t x, uint32_t y) : x(x), y(y) {}
+};
+
+/**
+ * Column-major 3x3 matrix, same as simd::float3x3 / metal::float3x3 (each
+ * column padded to 16 bytes)
+ */
+struct alignas(16) float3x3 {
+  float3 columns[3];
+
+  float3x3() = default;
+
+  constexpr float3x3(float diagonal)
+    : columns{
+    float3{diagonal, 0.0f, 0.0f},
+    float3{0.0f, diagonal, 0.0f},
+    float3{0.0f, 0.0f, diagonal},
+  } {}
+
+  constexpr float3x3(float3 c0, float3 c1, float3 c2) : columns{c0, c1, c2} {}
+
+  constexpr float3 &operator[](size_t i) { return columns[i]; }
+
+  constexpr const float3 &operator[](size_t i) const { return columns[i]; }
+};
+
+/**
+ * Column-major 4x4 matrix, same as simd::float4x4 / metal::float4x4
+ */
+struct alignas(16) float4x4 {
+  float4 columns[4];
+
+  float4x4() = default;
+
+  // Diagonal matrix, float4x4{1.0f} is the identity
+  constexpr float4x4(float diagonal)
+    : columns{
+    float4{diagonal, 0.0f, 0.0f, 0.0f},
+    float4{0.0f, diagonal, 0.0f, 0.0f},
+    float4{0.0f, 0.0f, diagonal, 0.0f},
+    float4{0.0f, 0.0f, 0.0f, diagonal},
+  } {}
+
+  constexpr float4x4(float4 c0, float4 c1, float4 c2, float4 c3) : columns{c0, c1, c2, c3} {}
+
+  constexpr float4 &operator[](size_t i) { return columns[i]; }
+
+  constexpr const float4 &operator[](size_t i) const { return columns[i]; }
+};
+
+static_assert(sizeof(float2) == 8 && alignof(float2) == 8);
+static_assert(sizeof(float3) == 16 && alignof(float3) == 16);
+static_assert(sizeof(float4) == 16 && alignof(float4) == 16);
+static_assert(sizeof(uint2) == 8 && alignof(uint2) == 8);
+static_assert(sizeof(float3x3) == 48 && alignof(float3x3) == 16);
+static_assert(sizeof(float4x4) == 64 && alignof(float4x4) == 16);
+
+/*
+ * Backend primitives, all operating on four lanes
+ */
+namespace detail {
+#if defined(PSIMD_SSE)
+using f128 = __m128;
+
+inline f128 load(const float *p) { return _mm_load_ps(p); }
+
+inline f128 loadu(const float *p) { return _mm_loadu_ps(p); }
+
+inline void store(float *p, f128 v) { _mm_store_ps(p, v); }
+
+inline void storeu(float *p, f128 v) { _mm_storeu_ps(p, v); }
+
+inline f128 splat(float s) { return _mm_set1_ps(s); }
+
+inline f128 add(f128 a, f128 b) { return _mm_add_ps(a, b); }
+
+inline f128 sub(f128 a, f128 b) { return _mm_sub_ps(a, b); }
+
+inline f128 mul(f128 a, f128 b) { return _mm_mul_ps(a, b); }
+
+inline f128 div(f128 a, f128 b) { return _mm_div_ps(a, b); }
+
+inline f128 min(f128 a, f128 b) { return _mm_min_ps(a, b); }
+
+inline f128 max(f128 a, f128 b) { return _mm_max_ps(a, b); }
+
+inline f128 madd(f128 a, f128 b, f128 c) {
+#if defined(PSIMD_FMA)
+  return _mm_fmadd_ps(a, b, c);
+#else
+  return _mm_add_ps(_mm_mul_ps(a, b), c);
+#endif
+}
+
+template<int I>
+inline f128 lane(f128 v) { return _mm_shuffle_ps(v, v, _MM_SHUFFLE(I, I, I, I)); }
+
+inline float hsum(f128 v) {
+  f128 shuf = _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1));
+  f128 sums = _mm_add_ps(v, shuf);
+  shuf = _mm_movehl_ps(shuf, sums);
+  return _mm_cvtss_f32(_mm_add_ss(sums, shuf));
+}
+
+inline f128 maskXYZ(f128 v) {
+  return _mm_and_ps(v, _mm_castsi128_ps(_mm_set_epi32(0, -1, -1, -1)));
+}
+
+inline void transpose(f128 &r0, f128 &r1, f128 &r2, f128 &r3) { _MM_TRANSPOSE4_PS(r0, r1, r2, r3); }
+#elif defined(PSIMD_NEON)
+using f128 = float32x4_t;
+
+inline f128 load(const float *p) { return vld1q_f32(p); }
+
+inline f128 loadu(const float *p) { return vld1q_f32(p); }
+
+inline void store(float *p, f128 v) { vst1q_f32(p, v); }
+
+inline void storeu(float *p, f128 v) { vst1q_f32(p, v); }
+
+inline f128 splat(float s) { return vdupq_n_f32(s); }
+
+inline f128 add(f128 a, f128 b) { return vaddq_f32(a, b); }
+
+inline f128 sub(f128 a, f128 b) { return vsubq_f32(a, b); }
+
+inline f128 mul(f128 a, f128 b) { return vmulq_f32(a, b); }
+
+inline f128 div(f128 a, f128 b) { return vdivq_f32(a, b); }
+
+inline f128 min(f128 a, f128 b) { return vminq_f32(a, b); }
+
+inline f128 max(f128 a, f128 b) { return vmaxq_f32(a, b); }
+
+inline f128 madd(f128 a, f128 b, f128 c) { return vfmaq_f32(c, a, b); }
+
+template<int I>
+inline f128 lane(f128 v) { return vdupq_laneq_f32(v, I); }
+
+inline float hsum(f128 v) { return vaddvq_f32(v); }
+
+inline f128 maskXYZ(f128 v) { return vsetq_lane_f32(0.0f, v, 3); }
+
+inline void transpose(f128 &r0, f128 &r1, f128 &r2, f128 &r3) {
+  float32x4x2_t t01 = vtrnq_f32(r0, r1);
+  float32x4x2_t t23 = vtrnq_f32(r2, r3);
+  r0 = vcombine_f32(vget_low_f32(t01.val[0]), vget_low_f32(t23.val[0]));
+  r1 = vcombine_f32(vget_low_f32(t01.val[1]), vget_low_f32(t23.val[1]));
+  r2 = vcombine_f32(vget_high_f32(t01.val[0]), vget_high_f32(t23.val[0]));
+  r3 = vcombine_f32(vget_high_f32(t01.val[1]), vget_high_f32(t23.val[1]));
+}
+#else
+struct f128 {
+  float v[4];
+};
+
+inline f128 load(const float *p) { return {p[0], p[1], p[2], p[3]}; }
+
+inline f128 loadu(const float *p) { return load(p); }
+
+inline void store(float *p, f128 v) { for (int i = 0; i < 4; i++) p[i] = v.v[i]; }
+
+inline void storeu(float *p, f128 v) { store(p, v); }
+
+inline f128 splat(float s) { return {s, s, s, s}; }
+
+#define PSIMD_SCALAR_OP(name, expr)                      \
+  inline f128 name(f128 a, f128 b) {                     \
+    f128 r;                                              \
+    for (int i = 0; i < 4; i++) r.v[i] = (expr);         \
+    return r;                                            \
+  }
+
+PSIMD_SCALAR_OP(add, a.v[i] + b.v[i])
+
+PSIMD_SCALAR_OP(sub, a.v[i] - b.v[i])
+
+PSIMD_SCALAR_OP(mul, a.v[i] * b.v[i])
+
+PSIMD_SCALAR_OP(div, a.v[i] / b.v[i])
+
+PSIMD_SCALAR_OP(min, a.v[i] < b.v[i] ? a.v[i] : b.v[i])
+
+PSIMD_SCALAR_OP(max, a.v[i] > b.v[i] ? a.v[i] : b.v[i])
+
+#undef PSIMD_SCALAR_OP
+
+inline f128 madd(f128 a, f128 b, f128 c) { return add(mul(a, b), c); }
+
+template<int I>
+inline f128 lane(f128 v) { return splat(v.v[I]); }
+
+inline float hsum(f128 v) { return (v.v[0] + v.v[1]) + (v.v[2] + v.v[3]); }
+
+inline f128 maskXYZ(f128 v) {
+  v.v[3] = 0.0f;
+  return v;
+}
+
+inline void transpose(f128 &r0, f128 &r1, f128 &r2, f128 &r3) {
+  f128 t[4] = {r0, r1, r2, r3};
+  for (int i = 0; i < 4; i++) {
+    r0.v[i] = t[i].v[0];
+    r1.v[i] = t[i].v[1];
+    r2.v[i] = t[i].v[2];
+    r3.v[i] = t[i].v[3];
+  }
+}
+#endif
+
+// float3 has a padding lane, it is loaded but never used for reductions
+inline f128 load(const float3 &v) { return load(&v.x); }
+
+inline f128 load(const float4 &v) { return load(&v.x); }
+
+template<typename T>
+inline T as(f128 v) {
+  T r;
+  store(&r.x, v);
+  return r;
+}
+}
+
+/*
+ * Component-wise arithmetic for the 3/4 wide types
+ */
+#define PSIMD_VECTOR_OPS(T)                                                                      \
+  inline T operator+(T a, T b) { return detail::as<T>(detail::add(detail::load(a), detail::load(b))); } \
+  inline T operator-(T a, T b) { return detail::as<T>(detail::sub(detail::load(a), detail::load(b))); } \
+  inline T operator*(T a, T b) { return detail::as<T>(detail::mul(detail::load(a), detail::load(b))); } \
+  inline T operator/(T a, T b) { return detail::as<T>(detail::div(detail::load(a), detail::load(b))); } \
+  inline T operator*(T a, float s) { return detail::as<T>(detail::mul(detail::load(a), detail::splat(s))); } \
+  inline T operator*(float s, T a) { return a * s; }                                             \
+  inline T operator/(T a, float s) { return a * (1.0f / s); }                                    \
+  inline T operator-(T a) { return detail::as<T>(detail::sub(detail::splat(0.0f), detail::load(a))); } \
+  inline T &operator+=(T &a, T b) { return a = a + b; }                                          \
+  inline T &operator-=(T &a, T b) { return a = a - b; }                                          \
+  inline T &operator*=(T &a, T b) { return a = a * b; }                                          \
+  inline T &operator*=(T &a, float s) { return a = a * s; }                                      \
+  inline T &operator/=(T &a, float s) { return a = a / s; }                                      \
+  inline T min(T a, T b) { return detail::as<T>(detail::min(detail::load(a), detail::load(b))); } \
+  inline T max(T a, T b) { return detail::as<T>(detail::max(detail::load(a), detail::load(b))); } \
+  inline T clamp(T v, T lo, T hi) { return min(max(v, lo), hi); }                                \
+  inline T mix(T a, T b, float t) { return a + (b - a) * t; }
+
+PSIMD_VECTOR_OPS(float3)
+
+PSIMD_VECTOR_OPS(float4)
+
+#undef PSIMD_VECTOR_OPS
+
+inline float dot(float4 a, float4 b) {
+  return detail::hsum(detail::mul(detail::load(a), detail::load(b)));
+}
+
+inline float dot(float3 a, float3 b) {
+  return detail::hsum(detail::maskXYZ(detail::mul(detail::load(a), detail::load(b))));
+}
+
+inline float3 cross(float3 a, float3 b) {
+  return {a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x};
+}
+
+template<typename T>
+inline float length_squared(T v) { return dot(v, v); }
+
+template<typename T>
+inline float length(T v) { return std::sqrt(dot(v, v)); }
+
+template<typename T>
+inline T normalize(T v) { return v * (1.0f / length(v)); }
+
+/*
+ * float2 is too narrow to benefit from SIMD, plain scalar ops
+ */
+inline float2 operator+(float2 a, float2 b) { return {a.x + b.x, a.y + b.y}; }
+
+inline float2 operator-(float2 a, float2 b) { return {a.x - b.x, a.y - b.y}; }
+
+inline float2 operator*(float2 a, float2 b) { return {a.x * b.x, a.y * b.y}; }
+
+inline float2 operator/(float2 a, float2 b) { return {a.x / b.x, a.y / b.y}; }
+
+inline float2 operator*(float2 a, float s) { return {a.x * s, a.y * s}; }
+
+inline float2 operator*(float s, float2 a) { return a * s; }
+
+inline float2 operator/(float2 a, float s) { return {a.x / s, a.y / s}; }
+
+inline float2 operator-(float2 a) { return {-a.x, -a.y}; }
+
+inline float dot(float2 a, float2 b) { return a.x * b.x + a.y * b.y; }
+
+/*
+ * Conversions (same names as the simd::make_* functions)
+ */
+inline constexpr float4 make_float4(float3 v, float w) { return {v.x, v.y, v.z, w}; }
+
+inline constexpr float3 make_float3(float4 v) { return {v.x, v.y, v.z}; }
+
+inline constexpr float2 make_float2(float4 v) { return {v.x, v.y}; }
+
+/*
+ * Matrix operations
+ */
+inline float4 operator*(const float4x4 &m, float4 v) {
+  using namespace detail;
+  f128 vv = load(v);
+  f128 r = mul(load(m.columns[0]), lane<0>(vv));
+  r = madd(load(m.columns[1]), lane<1>(vv), r);
+  r = madd(load(m.columns[2]), lane<2>(vv), r);
+  r = madd(load(m.columns[3]), lane<3>(vv), r);
+  return as<float4>(r);
+}
+
+inline float3 operator*(const float3x3 &m, float3 v) {
+  using namespace detail;
+  f128 vv = load(v);
+  f128 r = mul(load(m.columns[0]), lane<0>(vv));
+  r = madd(load(m.columns[1]), lane<1>(vv), r);
+  r = madd(load(m.columns[2]), lane<2>(vv), r);
+  return as<float3>(r);
+}
+
+inline float4x4 operator*(const float4x4 &a, const float4x4 &b) {
+  float4x4 r;
+#if defined(PSIMD_AVX)
+  // Two result columns per iteration: each 128-bit half broadcasts its own column's lanes
+  const __m256 a0 = _mm256_broadcast_ps(reinterpret_cast<const __m128 *>(&a.columns[0]));
+  const __m256 a1 = _mm256_broadcast_ps(reinterpret_cast<const __m128 *>(&a.columns[1]));
+  const __m256 a2 = _mm256_broadcast_ps(reinterpret_cast<const __m128 *>(&a.columns[2]));
+  const __m256 a3 = _mm256_broadcast_ps(reinterpret_cast<const __m128 *>(&a.columns[3]));
+
+  for (int j = 0; j < 4; j += 2) {
+    __m256 bc = _mm256_loadu_ps(&b.columns[j].x);
+    __m256 c = _mm256_mul_ps(a0, _mm256_permute_ps(bc, 0x00));
+#if defined(PSIMD_FMA)
+    c = _mm256_fmadd_ps(a1, _mm256_permute_ps(bc, 0x55), c);
+    c = _mm256_fmadd_ps(a2, _mm256_permute_ps(bc, 0xaa), c);
+    c = _mm256_fmadd_ps(a3, _mm256_permute_ps(bc, 0xff), c);
+#else
+    c = _mm256_add_ps(c, _mm256_mul_ps(a1, _mm256_permute_ps(bc, 0x55)));
+    c = _mm256_add_ps(c, _mm256_mul_ps(a2, _mm256_permute_ps(bc, 0xaa)));
+    c = _mm256_add_ps(c, _mm256_mul_ps(a3, _mm256_permute_ps(bc, 0xff)));
+#endif
+    _mm256_storeu_ps(&r.columns[j].x, c);
+  }
+#else
+  for (int j = 0; j < 4; j++) r.columns[j] = a * b.columns[j];
+#endif
+  return r;
+}
+
+inline float4x4 transpose(const float4x4 &m) {
+  float4x4 r;
+  for (int i = 0; i < 4; i++) {
+    r.columns[i] = {m.columns[0][i], m.columns[1][i], m.columns[2][i], m.columns[3][i]};
+  }
+  return r;
+}
+}
+
+#endif //LEARN_METAL_SIMD_TYPES_HPP
@@ -0,0 +1,123 @@
+#include "upload-ring.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <iostream>
+
+namespace gfx {
+namespace {
+size_t alignUp(size_t value, size_t alignment) {
+  return (value + alignment - 1) / alignment * alignment;
+}
+}
+
+UploadRing::UploadRing(Device &device, size_t capacity, StorageMode storageMode, size_t alignment)
+  : m_capacity(alignUp(capacity, alignment)), m_alignment(alignment) {
+  assert(alignment > 0 && (alignment & (alignment - 1)) == 0);
+  assert(storageMode != StorageMode::Private);
+
+  m_buffer = device.newBuffer(m_capacity, storageMode);
+  m_stats.capacity = m_capacity;
+}
+
+void UploadRing::reclaim() {
+  /*
+   * Command buffers on a queue complete in submission order, so frames retire
+   * in order too
+   */
+  uint64_t completed = m_completedFrames.load(std::memory_order_acquire);
+  while (!m_inFlight.empty() && m_inFlight.front().id < completed) {
+    m_tail = m_inFlight.front().end;
+    m_inFlight.pop_front();
+  }
+  if (m_inFlight.empty()) m_tail = m_frameStart;
+}
+
+void UploadRing::beginFrame() {
+  reclaim();
+
+  m_frameStart = m_head;
+  m_stats.frameBytes = 0;
+  m_stats.frameAllocations = 0;
+}
+
+UploadRing::Allocation UploadRing::allocate(size_t size, size_t alignment) {
+  alignment = std::max(alignment, m_alignment);
+  if (size == 0) size = 1;
+
+  if (size > m_capacity) {
+    std::cerr << "Upload ring allocation of " << size << " bytes exceeds capacity of " << m_capacity << "\n";
+    m_stats.failures++;
+    return {};
+  }
+
+  /*
+   * Align the offset, then skip the rest of the buffer if the slice would
+   * straddle the end
+   */
+  size_t offset = m_head % m_capacity;
+  uint64_t pos = m_head + (alignUp(offset, alignment) - offset);
+  offset = pos % m_capacity;
+  if (offset + size > m_capacity) {
+    pos += m_capacity - offset;
+    offset = 0;
+  }
+
+  /*
+   * Wait for older frames to retire until there's room. Memory used by the
+   * current frame can't be recycled, if it's in the way the allocation fails.
+   */
+  bool stalled = false;
+  while (pos + size - m_tail > m_capacity) {
+    reclaim();
+    if (pos + size - m_tail <= m_capacity) break;
+
+    if (m_inFlight.empty()) {
+      std::cerr << "Upload ring out of memory, frame uses " << (m_head - m_frameStart) << " of "
+                << m_capacity << " bytes\n";
+      m_stats.failures++;
+      return {};
+    }
+
+    if (!stalled) m_stats.stalls++;
+    stalled = true;
+
+    uint64_t completed = m_completedFrames.load(std::memory_order_acquire);
+    if (m_inFlight.front().id >= completed) m_completedFrames.wait(completed, std::memory_order_acquire);
+  }
+
+  m_head = pos + size;
+
+  m_stats.frameAllocations++;
+  m_stats.frameBytes = m_head - m_frameStart;
+  m_stats.peakFrameBytes = std::max(m_stats.peakFrameBytes, m_stats.frameBytes);
+  m_stats.highWaterMark = std::max<size_t>(m_stats.highWaterMark, m_head - m_tail);
+
+  return {m_buffer.get(), offset, size, static_cast<std::byte *>(m_buffer->contents()) + offset};
+}
+
+void UploadRing::endFrame(CommandBuffer &commandBuffer) {
+  /*
+   * Flush the frame's range, which is split in two if the frame wrapped around
+   */
+  if (m_head > m_frameStart) {
+    size_t start = m_frameStart % m_capacity;
+    size_t length = m_head - m_frameStart;
+    if (start + length <= m_capacity) {
+      m_buffer->didModifyRange(start, length);
+    } else {
+      m_buffer->didModifyRange(start, m_capacity - start);
+      m_buffer->didModifyRange(0, start + length - m_capacity);
+    }
+  }
+
+  uint64_t id = m_frameId++;
+  m_inFlight.push_back({id, m_head});
+  m_frameStart = m_head;
+
+  commandBuffer.addCompletedHandler([this, id] {
+    m_completedFrames.store(id + 1, std::memory_order_release);
+    m_completedFrames.notify_all();
+  });
+}
+}
@@ -0,0 +1,109 @@
+#ifndef LEARN_METAL_UPLOAD_RING_HPP
+#define LEARN_METAL_UPLOAD_RING_HPP
+
+#include <atomic>
+#include <cstring>
+#include <deque>
+
+#include "render-backend.hpp"
+
+namespace gfx {
+/**
+ * Sub-allocator for per-frame upload data (constants, instance data, etc).
+ * Hands out aligned slices of a single CPU-visible buffer, linearly within a
+ * frame and wrapping around as a ring across frames. Memory is recycled a whole
+ * frame at a time, once the command buffer the frame was submitted with has
+ * completed.
+ *
+ * beginFrame, allocations and endFrame must come from one thread at a time
+ * (not necessarily the same one every frame), completion handlers may run on
+ * any thread.
+ */
+class UploadRing {
+public:
+  /**
+   * Metal requires 256 byte aligned offsets for constant buffers on macOS
+   */
+  static constexpr size_t defaultAlignment = 256;
+
+  struct Allocation {
+    Buffer *buffer = nullptr;
+    size_t offset = 0;
+    size_t size = 0;
+    void *data = nullptr;
+
+    explicit operator bool() const { return buffer != nullptr; }
+  };
+
+  struct Stats {
+    size_t capacity = 0;
+    size_t frameBytes = 0;      // Bytes used by the current frame, including padding
+    size_t frameAllocations = 0;
+    size_t peakFrameBytes = 0;  // Largest frame so far
+    size_t highWaterMark = 0;   // Most bytes in use at once, across all frames in flight
+    uint64_t stalls = 0;        // Allocations that had to wait for a frame to retire
+    uint64_t failures = 0;      // Allocations that could not fit at all
+  };
+
+  UploadRing(
+    Device &device,
+    size_t capacity,
+    StorageMode storageMode = StorageMode::Shared,
+    size_t alignment = defaultAlignment
+  );
+
+  /**
+   * Reclaims the memory of retired frames and starts a new frame
+   */
+  void beginFrame();
+
+  /**
+   * Returns a slice of at least the given alignment (and never less than the
+   * ring's alignment). Waits for in-flight frames to retire if the ring is full;
+   * if the request doesn't fit even then, an empty allocation is returned.
+   */
+  Allocation allocate(size_t size, size_t alignment = 0);
+
+  template<typename T>
+  Allocation push(const T &value) {
+    Allocation allocation = allocate(sizeof(T), alignof(T));
+    if (allocation) memcpy(allocation.data, &value, sizeof(T));
+    return allocation;
+  }
+
+  /**
+   * Ends the current frame, its memory is recycled once the command buffer
+   * completes. Must be called before the command buffer is committed.
+   */
+  void endFrame(CommandBuffer &commandBuffer);
+
+  const Stats &stats() const { return m_stats; }
+
+  Buffer *buffer() const { return m_buffer.get(); }
+
+private:
+  struct Frame {
+    uint64_t id;
+    uint64_t end; // Ring position one past the frame's last allocation
+  };
+
+  std::unique_ptr<Buffer> m_buffer;
+  size_t m_capacity, m_alignment;
+
+  /*
+   * Positions grow monotonically, offsets into the buffer are taken modulo the
+   * capacity. [m_tail, m_head) is the memory in use.
+   */
+  uint64_t m_head = 0, m_tail = 0, m_frameStart = 0;
+
+  uint64_t m_frameId = 0;
+  std::deque<Frame> m_inFlight;
+  std::atomic<uint64_t> m_completedFrames{0};
+
+  Stats m_stats;
+
+  void reclaim();
+};
+}
+
+#endif //LEARN_METAL_UPLOAD_RING_HPP
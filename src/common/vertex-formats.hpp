@@ -0,0 +1,138 @@
+#ifndef LEARN_METAL_VERTEX_FORMATS_HPP
+#define LEARN_METAL_VERTEX_FORMATS_HPP
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include "render-backend.hpp"
+
+/**
+ * Conversions for packed vertex attribute formats. Decoding follows the Metal
+ * vertex fetch rules, so CPU code reads attributes exactly as shaders do.
+ */
+namespace gfx {
+/**
+ * IEEE 754 half precision, rounding to nearest even
+ */
+inline uint16_t toHalf(float f) {
+  uint32_t x = std::bit_cast<uint32_t>(f);
+  const auto sign = uint16_t((x >> 16) & 0x8000);
+  x &= 0x7fffffff;
+
+  if (x >= 0x7f800000) return sign | (x > 0x7f800000 ? 0x7e00 : 0x7c00); // NaN, inf
+  if (x >= 0x477ff000) return sign | 0x7c00;                             // Rounds past the largest half
+  if (x < 0x38800000) {
+    // Below the smallest normal half, subnormal steps are 2^-24
+    return sign | uint16_t(std::nearbyint(std::bit_cast<float>(x) * 16777216.0f));
+  }
+
+  // Rebias the exponent from 127 to 15 and round off 13 mantissa bits
+  return sign | uint16_t((x + 0xc8000fff + ((x >> 13) & 1)) >> 13);
+}
+
+inline float fromHalf(uint16_t h) {
+  const uint32_t sign = uint32_t(h & 0x8000) << 16;
+  const uint32_t exponent = (h >> 10) & 0x1f, mantissa = h & 0x3ff;
+
+  if (exponent == 0) {
+    const float v = float(mantissa) * 5.9604644775390625e-8f;
+    return sign ? -v : v;
+  }
+  if (exponent == 31) return std::bit_cast<float>(sign | 0x7f800000 | (mantissa << 13));
+  return std::bit_cast<float>(sign | ((exponent + 112) << 23) | (mantissa << 13));
+}
+
+inline int16_t toSnorm16(float f) {
+  return int16_t(std::lround(std::clamp(f, -1.0f, 1.0f) * 32767.0f));
+}
+
+inline float fromSnorm16(int16_t v) {
+  // -32768 and -32767 both map to -1
+  return std::max(float(v) / 32767.0f, -1.0f);
+}
+
+inline uint8_t toUnorm8(float f) {
+  return uint8_t(std::lround(std::clamp(f, 0.0f, 1.0f) * 255.0f));
+}
+
+inline float fromUnorm8(uint8_t v) {
+  return float(v) / 255.0f;
+}
+
+/**
+ * Octahedral encoding of a unit vector into [-1, 1]^2, the upper hemisphere
+ * maps to the inner diamond and the lower one is folded over the corners.
+ * Quantized to snorm16 the max error is under 0.05 degrees.
+ */
+inline psimd::float2 encodeOctahedral(psimd::float3 n) {
+  const float invL1 = 1.0f / (std::abs(n.x) + std::abs(n.y) + std::abs(n.z));
+  psimd::float2 p = {n.x * invL1, n.y * invL1};
+  if (n.z < 0.0f) {
+    p = {
+      (1.0f - std::abs(p.y)) * (p.x >= 0.0f ? 1.0f : -1.0f),
+      (1.0f - std::abs(p.x)) * (p.y >= 0.0f ? 1.0f : -1.0f),
+    };
+  }
+  return p;
+}
+
+inline psimd::float3 decodeOctahedral(psimd::float2 e) {
+  psimd::float3 n = {e.x, e.y, 1.0f - std::abs(e.x) - std::abs(e.y)};
+  const float t = std::max(-n.z, 0.0f);
+  n.x += n.x >= 0.0f ? -t : t;
+  n.y += n.y >= 0.0f ? -t : t;
+  return psimd::normalize(n);
+}
+
+constexpr size_t formatSize(VertexFormat format) {
+  switch (format) {
+    case VertexFormat::Float2:
+      return 8;
+    case VertexFormat::Float3:
+      return 12;
+    case VertexFormat::Float4:
+      return 16;
+    case VertexFormat::Half2:
+      return 4;
+    case VertexFormat::Half4:
+      return 8;
+    case VertexFormat::Short2Normalized:
+      return 4;
+    case VertexFormat::Short4Normalized:
+      return 8;
+    case VertexFormat::UChar4Normalized:
+      return 4;
+  }
+  return 0;
+}
+
+/**
+ * Reads one attribute, missing components are filled in with (0, 0, 0, 1)
+ */
+template<VertexFormat Format>
+inline psimd::float4 decodeAttribute(const std::byte *p) {
+  psimd::float4 v = {0.0f, 0.0f, 0.0f, 1.0f};
+  if constexpr (Format == VertexFormat::Float2 || Format == VertexFormat::Float3 || Format == VertexFormat::Float4) {
+    memcpy(&v.x, p, formatSize(Format));
+  } else if constexpr (Format == VertexFormat::Half2 || Format == VertexFormat::Half4) {
+    constexpr int n = Format == VertexFormat::Half2 ? 2 : 4;
+    uint16_t h[n];
+    memcpy(h, p, sizeof(h));
+    for (int i = 0; i < n; i++) v[i] = fromHalf(h[i]);
+  } else if constexpr (Format == VertexFormat::Short2Normalized || Format == VertexFormat::Short4Normalized) {
+    constexpr int n = Format == VertexFormat::Short2Normalized ? 2 : 4;
+    int16_t s[n];
+    memcpy(s, p, sizeof(s));
+    for (int i = 0; i < n; i++) v[i] = fromSnorm16(s[i]);
+  } else if constexpr (Format == VertexFormat::UChar4Normalized) {
+    for (int i = 0; i < 4; i++) v[i] = fromUnorm8(uint8_t(p[i]));
+  }
+  return v;
+}
+}
+
+#endif //LEARN_METAL_VERTEX_FORMATS_HPP
@@ -0,0 +1,155 @@
+#ifndef LEARN_METAL_VERTEX_LAYOUT_HPP
+#define LEARN_METAL_VERTEX_LAYOUT_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+#include "render-backend.hpp"
+#include "vertex-formats.hpp"
+
+/**
+ * Compile time vertex layout descriptions. A vertex struct is described once,
+ * as a list of its members, and the vertex descriptor and CPU attribute fetch
+ * are derived from that, so they can't drift out of sync with the struct:
+ *
+ *   template<>
+ *   struct gfx::VertexLayout<MyVertex> {
+ *     static constexpr gfx::AttributeInfo attributes[] = {
+ *       GFX_VERTEX_ATTRIBUTE(MyVertex, position), // [[attribute(0)]]
+ *       GFX_VERTEX_ATTRIBUTE(MyVertex, color),    // [[attribute(1)]]
+ *     };
+ *   };
+ *
+ * Attribute formats follow from the member types, see AttributeFormat.
+ */
+namespace gfx {
+/*
+ * Packed attribute types, so every vertex format has its own C++ type
+ */
+struct half2 {
+  uint16_t v[2];
+};
+
+struct half4 {
+  uint16_t v[4];
+};
+
+struct snorm16x2 {
+  int16_t v[2];
+};
+
+struct snorm16x4 {
+  int16_t v[4];
+};
+
+struct unorm8x4 {
+  uint8_t v[4];
+};
+
+/**
+ * Vertex format of a member type, undefined for types without one
+ */
+template<typename T>
+struct AttributeFormat;
+
+#define GFX_ATTRIBUTE_FORMAT(Type, Format)                          \
+  template<>                                                        \
+  struct AttributeFormat<Type> {                                    \
+    static constexpr VertexFormat value = VertexFormat::Format;     \
+  };
+
+GFX_ATTRIBUTE_FORMAT(psimd::float2, Float2)
+
+GFX_ATTRIBUTE_FORMAT(psimd::float3, Float3)
+
+GFX_ATTRIBUTE_FORMAT(psimd::float4, Float4)
+
+GFX_ATTRIBUTE_FORMAT(half2, Half2)
+
+GFX_ATTRIBUTE_FORMAT(half4, Half4)
+
+GFX_ATTRIBUTE_FORMAT(snorm16x2, Short2Normalized)
+
+GFX_ATTRIBUTE_FORMAT(snorm16x4, Short4Normalized)
+
+GFX_ATTRIBUTE_FORMAT(unorm8x4, UChar4Normalized)
+
+#undef GFX_ATTRIBUTE_FORMAT
+
+struct AttributeInfo {
+  VertexFormat format;
+  size_t offset;
+  size_t size; // Size of the member, can be more than the format reads (float3 padding)
+};
+
+template<typename M>
+constexpr AttributeInfo attributeInfo(size_t offset) {
+  return {AttributeFormat<M>::value, offset, sizeof(M)};
+}
+
+#define GFX_VERTEX_ATTRIBUTE(Struct, member) \
+  ::gfx::attributeInfo<decltype(Struct::member)>(offsetof(Struct, member))
+
+template<typename V>
+struct VertexLayout;
+
+/**
+ * Attributes must lie within the struct and be 4 byte aligned, and the stride
+ * a multiple of 4, as Metal requires
+ */
+template<typename V>
+constexpr bool isValidLayout() {
+  for (const AttributeInfo &a: VertexLayout<V>::attributes) {
+    if (a.offset % 4 != 0 || a.offset + a.size > sizeof(V) || formatSize(a.format) > a.size) return false;
+  }
+  return sizeof(V) % 4 == 0;
+}
+
+template<typename V>
+constexpr size_t attributeCount() {
+  return sizeof(VertexLayout<V>::attributes) / sizeof(AttributeInfo);
+}
+
+/**
+ * Whether A and B are read the same way, so a buffer of one can be bound
+ * as the other
+ */
+template<typename A, typename B>
+constexpr bool isSameLayout() {
+  if (sizeof(A) != sizeof(B) || attributeCount<A>() != attributeCount<B>()) return false;
+  for (size_t i = 0; i < attributeCount<A>(); i++) {
+    const AttributeInfo &a = VertexLayout<A>::attributes[i], &b = VertexLayout<B>::attributes[i];
+    if (a.format != b.format || a.offset != b.offset) return false;
+  }
+  return true;
+}
+
+/**
+ * Vertex descriptor for a buffer of V, bound at bufferIndex
+ */
+template<typename V>
+VertexDescriptor vertexDescriptor(size_t bufferIndex = 0) {
+  static_assert(isValidLayout<V>(), "Invalid vertex layout");
+
+  VertexDescriptor desc;
+  for (const AttributeInfo &a: VertexLayout<V>::attributes) desc.attributes.push_back({a.format, a.offset, bufferIndex});
+  desc.layouts = {{bufferIndex, sizeof(V)}};
+  return desc;
+}
+
+/**
+ * Reads [[attribute(I)]] of a vertex, converted like the GPU's vertex fetch.
+ * The format is a template argument, so there's no format switch, only the
+ * one conversion.
+ */
+template<typename V, size_t I>
+inline psimd::float4 fetchAttribute(const V &vertex) {
+  static_assert(isValidLayout<V>(), "Invalid vertex layout");
+  static_assert(I < attributeCount<V>(), "Attribute index out of range");
+
+  constexpr AttributeInfo a = VertexLayout<V>::attributes[I];
+  return decodeAttribute<a.format>(reinterpret_cast<const std::byte *>(&vertex) + a.offset);
+}
+}
+
+#endif //LEARN_METAL_VERTEX_LAYOUT_HPP
@@ -1,16 +1,32 @@
 #include "view-delegate.hpp"
 
-MyMTKViewDelegate::MyMTKViewDelegate()
-  : MTK::ViewDelegate() {
+MyMTKViewDelegate::MyMTKViewDelegate(RendererFactory rendererFactory)
+  : MTK::ViewDelegate(), m_rendererFactory(std::move(rendererFactory)) {
 }
 
 MyMTKViewDelegate::~MyMTKViewDelegate() {
-  m_commandQueue->release();
-  m_device->release();
+  // The renderer holds resources created by the device, destroy it first
+  m_renderer.reset();
 }
 
 void MyMTKViewDelegate::init(MTL::Device *device, MTK::View *view) {
-  m_device = device->retain();
-  m_commandQueue = m_device->newCommandQueue();
-  m_view = view;
+  m_device = std::make_unique<gfx::MetalDevice>(device);
+  m_renderTarget = std::make_unique<gfx::MetalViewTarget>(view);
+  m_renderer = m_rendererFactory(*m_device, *m_renderTarget);
+
+  m_startTime = std::chrono::steady_clock::now();
+}
+
+void MyMTKViewDelegate::drawInMTKView(MTK::View *view) {
+  NS::AutoreleasePool *pool = NS::AutoreleasePool::alloc()->init();
+
+  auto now = std::chrono::steady_clock::now();
+  float time = std::chrono::duration_cast<std::chrono::duration<float>>(now - m_startTime).count();
+  m_renderer->draw(*m_renderTarget, time);
+
+  pool->release();
+}
+
+void MyMTKViewDelegate::drawableSizeWillChange(MTK::View *view, CGSize size) {
+  m_renderer->resize(static_cast<uint32_t>(size.width), static_cast<uint32_t>(size.height));
 }
@@ -1,22 +1,41 @@
 #ifndef _00_window_view_delegate_h
 #define _00_window_view_delegate_h
 
+#include <chrono>
+#include <memory>
+
 #include "Metal/Metal.hpp"
 #include "AppKit/AppKit.hpp"
 #include "MetalKit/MetalKit.hpp"
 
+#include "metal-backend.hpp"
+#include "renderer.hpp"
+
+/**
+ * Connects a Renderer to an MTK view. Owns the Metal backend objects and
+ * forwards draw and resize events from the view to the renderer, which is
+ * created through the factory once the device is available.
+ */
 class MyMTKViewDelegate : public MTK::ViewDelegate {
 public:
-  MyMTKViewDelegate();
+  explicit MyMTKViewDelegate(RendererFactory rendererFactory);
 
   ~MyMTKViewDelegate() override;
 
   virtual void init(MTL::Device *device, MTK::View *view);
 
+  void drawInMTKView(MTK::View *view) override;
+
+  void drawableSizeWillChange(MTK::View *view, CGSize size) override;
+
 protected:
-  MTL::Device *m_device = nullptr;
-  MTL::CommandQueue *m_commandQueue = nullptr;
-  MTK::View *m_view = nullptr;
+  RendererFactory m_rendererFactory;
+
+  std::unique_ptr<gfx::MetalDevice> m_device;
+  std::unique_ptr<gfx::MetalViewTarget> m_renderTarget;
+  std::unique_ptr<Renderer> m_renderer;
+
+  std::chrono::time_point<std::chrono::steady_clock> m_startTime;
 };
 
 #endif
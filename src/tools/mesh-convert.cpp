@@ -0,0 +1,111 @@
+#include <chrono>
+#include <iostream>
+#include <string>
+
+#include <mesh.hpp>
+#include <mesh-optimizer.hpp>
+#include <mesh-simplifier.hpp>
+#include <meshlets.hpp>
+
+/**
+ * Converts a Wavefront OBJ file to the binary mesh format loaded by the
+ * samples (see mesh.hpp).
+ *
+ * Usage: mesh-convert input.obj output.mesh [--keep-units] [--no-optimize] [--no-lods] [--no-meshlets] [--layout L]
+ *
+ * Meshes are centered and scaled to fit in [-1, 1]^3, same as the cube, unless
+ * --keep-units is given. Triangles and vertices are reordered for the vertex
+ * cache, overdraw and vertex fetch (see mesh-optimizer.hpp) unless
+ * --no-optimize is given, and simulated cache statistics are reported.
+ * --layout picks the stored vertex layout: float (default), half or snorm16,
+ * the packed ones report their quantization error. A LOD chain (see
+ * mesh-simplifier.hpp) and meshlets for cluster culling (see meshlets.hpp) are
+ * built after optimizing, unless --no-lods or --no-meshlets is given.
+ */
+namespace {
+void printCacheStats(const char *label, const mesh::MeshData &data) {
+  std::cout << "  " << label << ":";
+  for (size_t cacheSize: {16, 32}) {
+    mesh::CacheStats stats = mesh::analyzeVertexCache(data.indices.data(), data.indices.size(), cacheSize);
+    std::cout << " ACMR " << stats.acmr << ", ATVR " << stats.atvr << " (" << cacheSize << " entries)";
+    if (cacheSize == 16) std::cout << ";";
+  }
+  std::cout << "\n";
+}
+}
+
+int main(int argc, char **argv) {
+  if (argc < 3) {
+    std::cerr << "Usage: mesh-convert input.obj output.mesh [--keep-units] [--no-optimize] [--no-lods] [--no-meshlets] [--layout L]\n";
+    return 1;
+  }
+  const std::string inPath = argv[1], outPath = argv[2];
+  bool keepUnits = false, optimize = true, lods = true, meshlets = true;
+  mesh::Layout layout = mesh::Layout::PositionColor;
+  for (int i = 3; i < argc; i++) {
+    const std::string arg = argv[i];
+    if (arg == "--keep-units") keepUnits = true;
+    else if (arg == "--no-optimize") optimize = false;
+    else if (arg == "--no-lods") lods = false;
+    else if (arg == "--no-meshlets") meshlets = false;
+    else if (arg == "--layout" && i + 1 < argc) {
+      if (!mesh::parseLayout(argv[++i], layout)) {
+        std::cerr << "Unknown vertex layout " << argv[i] << ", expected float, half or snorm16\n";
+        return 1;
+      }
+    } else {
+      std::cerr << "Unknown option " << arg << "\n";
+      return 1;
+    }
+  }
+
+  auto start = std::chrono::high_resolution_clock::now();
+
+  std::string error;
+  mesh::MeshData data;
+  if (!mesh::importOBJ(inPath, data, &error)) {
+    std::cerr << error << "\n";
+    return 1;
+  }
+  if (!keepUnits) mesh::normalize(data);
+
+  if (optimize) {
+    printCacheStats("before", data);
+    mesh::optimize(data);
+    printCacheStats("after", data);
+  }
+
+  if (lods) {
+    mesh::buildLods(data);
+    for (size_t i = 0; i < data.lods.size(); i++) {
+      std::cout << "  LOD " << i << ": " << data.lods[i].indexCount / 3 << " triangles, error " << data.lods[i].error
+                << "\n";
+    }
+  }
+
+  if (meshlets) {
+    mesh::buildMeshlets(data);
+    size_t withCone = 0;
+    for (const mesh::Meshlet &m: data.meshlets) withCone += m.coneCutoff < 1.0f;
+    std::cout << "  " << data.meshlets.size() << " meshlets, " << withCone << " with a usable normal cone\n";
+  }
+
+  if (layout != mesh::Layout::PositionColor) {
+    mesh::EncodingError e = mesh::measureError(layout, data.vertices.data(), data.vertices.size());
+    std::cout << "  " << mesh::layoutName(layout) << " layout: position error max " << e.maxPosition
+              << ", rms " << e.rmsPosition << "; color error max " << e.maxColor << "\n";
+  }
+
+  if (!mesh::write(outPath, data, &error, layout)) {
+    std::cerr << error << "\n";
+    return 1;
+  }
+
+  auto end = std::chrono::high_resolution_clock::now();
+  std::cout << "Wrote " << outPath << ": " << data.vertices.size() << " vertices ("
+            << data.vertices.size() * mesh::vertexStride(layout) << " bytes), "
+            << (data.lods.empty() ? data.indices.size() : data.lods[0].indexCount) / 3 << " triangles, "
+            << data.lods.size() << " LODs, " << data.meshlets.size() << " meshlets in "
+            << std::chrono::duration<double, std::milli>(end - start).count() << " ms\n";
+  return 0;
+}